@@ -32,43 +32,320 @@
 // Spec says a data packet is max 1024 bytes, but add some headroom...
 #define DATA_BUF_LEN 2048
 
+//
+// Received data are written to the file in background (on core 1),
+// while this program keeps reading the line. Data are collected
+// in a ring of chunks, each written by one job. When a background
+// program occupies core 1, jobs run synchronously, and ^C still works.
+//
+#define CHUNK_SIZE 4096 // Multiple of cluster size
+#define NUM_CHUNKS 4
+
+typedef struct {
+    fpm_job_t job;              // Write job, result is fs_result_t or -1 when disk is full
+    file_t *file;               // File to write
+    unsigned len;               // Bytes in chunk
+    bool busy;                  // Job submitted
+    uint8_t data[CHUNK_SIZE];
+} chunk_t;
+
+//
+// State of the receiver. Programs have no writable static data,
+// so it is allocated on the heap.
+//
+typedef struct {
+    zmodem_t z;                 // Protocol state and console buffers
+    chunk_t chunks[NUM_CHUNKS];
+    unsigned chunk_index;       // Chunk being filled
+} receiver_t;
+
+//
+// Console input and output are buffered in zmodem_t, to move data in bulk
+// instead of one call per byte. Input buffer matches the console
+// receive ring, so data blocks are decoded in long runs.
+//
+
+//
+// Write pending output to console.
+//
+static void zm_flush(zmodem_t *z)
+{
+    if (z->out_len > 0) {
+        fpm_write(z->out_buf, z->out_len);
+        z->out_len = 0;
+    }
+}
+
 //
 // Implementation-defined receive character function.
+// Unlike fpm_getchar(), fpm_read() passes ^C as data.
 //
-ZRESULT zm_recv()
+ZRESULT zm_recv(zmodem_t *z)
 {
-    // TODO: ignore ^C in FP/M somehow.
-    return fpm_getchar();
+    if (z->in_pos >= z->in_len) {
+        // Remote side waits for our reply before sending more.
+        zm_flush(z);
+
+        int nbytes = fpm_read(z->in_buf, sizeof(z->in_buf), -1);
+        if (nbytes <= 0) {
+            return CLOSED;
+        }
+        z->in_len = nbytes;
+        z->in_pos = 0;
+    }
+    return (uint8_t) z->in_buf[z->in_pos++];
+}
+
+//
+// Received bytes not consumed yet, for bulk decoding.
+//
+const uint8_t *zm_recv_peek(zmodem_t *z, unsigned *len)
+{
+    *len = z->in_len - z->in_pos;
+    return (const uint8_t *)&z->in_buf[z->in_pos];
+}
+
+void zm_recv_skip(zmodem_t *z, unsigned len)
+{
+    z->in_pos += len;
 }
 
 //
 // Implementation-defined send character function.
 //
-ZRESULT zm_send(uint8_t chr)
+ZRESULT zm_send(zmodem_t *z, uint8_t chr)
 {
-    fpm_putchar(chr);
+    if (z->out_len >= sizeof(z->out_buf)) {
+        zm_flush(z);
+    }
+    z->out_buf[z->out_len++] = chr;
     return OK;
 }
 
 //
-// Receive file.
+// Write chunk to the file.
+// Executed in background.
+//
+static void write_chunk(fpm_job_t *job)
+{
+    chunk_t *c = job->arg;
+    unsigned nbytes_written = 0;
+
+    job->result = f_write(c->file, c->data, c->len, &nbytes_written);
+    if (job->result == FR_OK && nbytes_written != c->len) {
+        // Out of disk space.
+        job->result = -1;
+    }
+}
+
+//
+// Wait until the chunk is written, and make it available.
+// Return false on write error.
+//
+static bool chunk_release(chunk_t *c)
+{
+    if (!c->busy) {
+        return true;
+    }
+    int result = fpm_job_wait(&c->job);
+    c->busy = false;
+    c->len = 0;
+    if (result == FR_OK) {
+        return true;
+    }
+
+    fpm_delay_msec(500);
+    if (result < 0) {
+        fpm_printf("\nNot enough space on device\r\n");
+    } else {
+        fpm_printf("\nWrite error: %s\r\n", f_strerror(result));
+    }
+    return false;
+}
+
+//
+// Start writing the current chunk, and switch to the next one.
+// Wait only when all chunks are busy.
+// Return false on write error.
+//
+static bool chunk_submit(receiver_t *r, file_t *file)
+{
+    chunk_t *c = &r->chunks[r->chunk_index];
+    if (c->len > 0) {
+        c->file = file;
+        c->busy = true;
+        c->job.func = write_chunk;
+        c->job.arg = c;
+        fpm_job_submit(&c->job);
+
+        r->chunk_index = (r->chunk_index + 1) % NUM_CHUNKS;
+    }
+    return chunk_release(&r->chunks[r->chunk_index]);
+}
+
+//
+// Put received data into the ring.
+// Return false on write error.
+//
+static bool store_data(receiver_t *r, file_t *file, const uint8_t *data, unsigned len)
+{
+    while (len > 0) {
+        chunk_t *c = &r->chunks[r->chunk_index];
+        unsigned n = CHUNK_SIZE - c->len;
+        if (n > len) {
+            n = len;
+        }
+        memmove(&c->data[c->len], data, n);
+        c->len += n;
+        data += n;
+        len -= n;
+
+        if (c->len == CHUNK_SIZE && !chunk_submit(r, file)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//
+// Write the rest of data and close the file.
+// Return false on write error.
+//
+static bool finish_file(receiver_t *r, file_t *file)
+{
+    bool ok = chunk_submit(r, file);
+    for (unsigned i = 0; i < NUM_CHUNKS; i++) {
+        if (!chunk_release(&r->chunks[i])) {
+            ok = false;
+        }
+    }
+    // Release space allocated in advance but not received.
+    f_truncate(file);
+    f_close(file);
+    return ok;
+}
+
+//
+// Allocate space for the file as one contiguous block, when the sender tells the size.
+// File info follows the name: size in decimal, then optional fields.
+// Return false when it is an executable which will not be contiguous.
+//
+static bool preallocate(file_t *fp, const uint8_t *data, unsigned len)
+{
+    const char *name = (const char *)data;
+    unsigned name_len = strlen(name);
+    bool is_exe = name_len >= 4 && strcasecmp(name + name_len - 4, ".exe") == 0;
+    unsigned long size = 0;
+
+    if (name_len + 1 < len && !fpm_strtoul(&size, name + name_len + 1, NULL, 10) && size > 0 &&
+        f_expand(fp, size, 1) == FR_OK) {
+        return true;
+    }
+    return !is_exe;
+}
+
+//
+// Create missing parent directories of the file.
+// Sender passes names relative to its directory tree, like "dir/sub/file".
+//
+static void make_parents(char *path)
+{
+    for (char *p = strchr(path, '/'); p; p = strchr(p + 1, '/')) {
+        if (p == path || p[-1] == ':') {
+            // Root directory.
+            continue;
+        }
+        *p = 0;
+        f_mkdir(path);
+        *p = '/';
+    }
+}
+
+//
+// Open destination file in given directory.
+// Create subdirectories as needed.
+// For resume, keep existing contents and seek to the end.
+// Return status of operation.
 //
-void rz()
+static fs_result_t open_file(file_t *fp, const char *dir, const char *name, bool resume)
+{
+    char *path = alloca(strlen(dir) + strlen(name) + 2);
+    if (dir[0] != 0) {
+        // Put file into target directory.
+        strcpy(path, dir);
+        if (path[strlen(path) - 1] != '/' && path[strlen(path) - 1] != ':') {
+            strcat(path, "/");
+        }
+        strcat(path, name);
+    } else {
+        strcpy(path, name);
+    }
+
+    uint8_t mode = FA_WRITE | (resume ? FA_OPEN_ALWAYS : FA_CREATE_ALWAYS);
+    fs_result_t status = f_open(fp, path, mode);
+    if (status == FR_NO_PATH) {
+        make_parents(path);
+        status = f_open(fp, path, mode);
+    }
+    if (status != FR_OK) {
+        fpm_delay_msec(500);
+        fpm_printf("\nFile %s: %s\r\n", path, f_strerror(status));
+        return status;
+    }
+    if (resume) {
+        status = f_lseek(fp, f_size(fp));
+        if (status != FR_OK) {
+            fpm_delay_msec(500);
+            fpm_printf("\nFile %s: %s\r\n", path, f_strerror(status));
+            f_close(fp);
+        }
+    }
+    return status;
+}
+
+//
+// Print statistics of the transfer.
+//
+static void show_statistics(unsigned num_files, uint32_t nbytes, uint64_t elapsed_usec)
+{
+    unsigned msec = elapsed_usec / 1000;
+
+    fpm_printf("\r\nReceived %u file(s), %u byte(s) in %u.%03u seconds",
+               num_files, nbytes, msec / 1000, msec % 1000);
+    if (msec > 0) {
+        fpm_printf(", %u bytes/sec", (unsigned)(nbytes * 1000ULL / msec));
+    }
+    fpm_puts("\r\n");
+}
+
+//
+// Receive files into given directory.
+//
+void rz(const char *dir)
 {
     uint8_t data_buf[DATA_BUF_LEN];
     uint16_t count;
-    uint32_t received_data_size = 0;
+    uint32_t file_pos = 0;      // Position in current file
+    uint32_t total_bytes = 0;   // Bytes received in this session
+    unsigned num_files = 0;
+    unsigned num_fragmented = 0; // Programs without contiguous space
+    uint64_t start_time = 0;
     ZHDR hdr;
     file_t *fdest = alloca(f_sizeof_file_t());
     fs_result_t fs_status = FR_NO_FILE;
-    zmodem_t z = {};
+    receiver_t *r = fpm_alloc(sizeof(receiver_t));
+    if (!r) {
+        fpm_puts("Out of memory\r\n");
+        return;
+    }
+    zmodem_t *z = &r->z;
 
     fpm_puts("rz waiting for receive.");
     fpm_delay_msec(100);
 
 startframe:
     while (true) {
-        uint16_t result = zm_await_header(&z, &hdr);
+        uint16_t result = zm_await_header(z, &hdr);
 
         switch (result) {
         case CANCELLED:
@@ -83,7 +360,15 @@ startframe:
             case ZEOF:
                 // Got ZRQINIT or ZEOF.
 
-                result = zm_send_flags_hdr(ZRINIT, CANOVIO | CANFC32, 0, 0, 0);
+                if (hdr.type == ZEOF && fs_status == FR_OK) {
+                    // End of file: wait for pending writes.
+                    fs_status = FR_NO_FILE;
+                    if (!finish_file(r, fdest)) {
+                        goto cleanup;
+                    }
+                }
+
+                result = zm_send_flags_hdr(z, ZRINIT, CANOVIO | CANFC32, 0, 0, 0);
 
                 if (result == CANCELLED) {
                     fpm_delay_msec(500);
@@ -101,7 +386,7 @@ startframe:
             case ZFIN:
                 // Got ZFIN.
 
-                result = zm_send_pos_hdr(ZFIN, 0);
+                result = zm_send_pos_hdr(z, ZFIN, 0);
 
                 if (result == CANCELLED) {
                     fpm_delay_msec(500);
@@ -115,13 +400,25 @@ startframe:
                     goto cleanup;
                 }
 
-                fpm_delay_msec(500);
-                fpm_printf("\nTransfer complete; Received %u byte(s)\n", received_data_size);
+                if (num_files > 0) {
+                    uint64_t elapsed_usec = fpm_time_usec() - start_time;
+                    fpm_delay_msec(500);
+                    show_statistics(num_files, total_bytes, elapsed_usec);
+                }
                 goto cleanup;
 
             case ZFILE:
                 // Got ZFILE.
 
+                if (fs_status == FR_OK) {
+                    // Previous file was not finished by ZEOF.
+                    fs_status = FR_NO_FILE;
+                    if (!finish_file(r, fdest)) {
+                        goto cleanup;
+                    }
+                }
+
+                bool resume = false;
                 switch (hdr.flags.f0) {
                 case 0: // no special treatment - default to ZCBIN
                 case ZCBIN:
@@ -131,7 +428,8 @@ startframe:
                     // --> ASCII Receive: ignored, not supported.
                     break;
                 case ZCRESUM:
-                    // --> Resume interrupted transfer: ignored, not supported.
+                    // --> Resume interrupted transfer: append to existing file.
+                    resume = true;
                     break;
                 default:
                     // WARN: Invalid conversion flag hdr.flags.f0.
@@ -139,7 +437,7 @@ startframe:
                 }
 
                 count = DATA_BUF_LEN;
-                result = zm_read_data_block(&z, data_buf, &count);
+                result = zm_read_data_block(z, data_buf, &count);
                 // Result of data block read is [0x%04x] (got %d character(s))", result, count
 
                 if (result == CANCELLED) {
@@ -149,14 +447,21 @@ startframe:
                 } else if (!IS_ERROR(result)) {
                     // Receiving file: name in data_buf
 
-                    fs_status = f_open(fdest, (char*)data_buf, FA_WRITE | FA_CREATE_ALWAYS);
+                    fs_status = open_file(fdest, dir, (char*)data_buf, resume);
                     if (fs_status != FR_OK) {
-                        fpm_delay_msec(500);
-                        fpm_printf("\nFile %s: %s\r\n", data_buf, f_strerror(fs_status));
                         goto cleanup;
                     }
+                    if (!resume && !preallocate(fdest, data_buf, count)) {
+                        num_fragmented++;
+                    }
+                    if (num_files == 0) {
+                        start_time = fpm_time_usec();
+                    }
+                    num_files++;
 
-                    result = zm_send_pos_hdr(ZRPOS, received_data_size);
+                    // Ask sender to continue from end of existing data.
+                    file_pos = resume ? f_size(fdest) : 0;
+                    result = zm_send_pos_hdr(z, ZRPOS, file_pos);
 
                     if (result == CANCELLED) {
                         fpm_delay_msec(500);
@@ -177,9 +482,25 @@ startframe:
             case ZDATA:
                 // Got ZDATA.
 
+                if (fs_status == FR_OK && zm_get_hdr_position(&hdr) != file_pos) {
+                    // Data for wrong position: ask again.
+                    result = zm_send_pos_hdr(z, ZRPOS, file_pos);
+
+                    if (result == CANCELLED) {
+                        fpm_delay_msec(500);
+                        fpm_printf("\nTransfer cancelled by remote; Bailing...\n");
+                        goto cleanup;
+                    } else if (result == CLOSED) {
+                        fpm_delay_msec(500);
+                        fpm_printf("\nConnection closed prematurely; Bailing...\n");
+                        goto cleanup;
+                    }
+                    continue;
+                }
+
                 while (true) {
                     count = DATA_BUF_LEN;
-                    result = zm_read_data_block(&z, data_buf, &count);
+                    result = zm_read_data_block(z, data_buf, &count);
                     // Result of data block read is [0x%04x] (got %d character(s)), result, count
 
                     if (fs_status != FR_OK) {
@@ -194,36 +515,28 @@ startframe:
                         goto cleanup;
                     } else if (!IS_ERROR(result)) {
                         // Received %d byte(s) of data, count
+                        // Writing blocks only when all chunks are busy.
 
-                        unsigned nbytes_written = 0;
-                        fs_status = f_write(fdest, data_buf, count - 1, &nbytes_written);
-                        if (fs_status != FR_OK) {
-                            fpm_delay_msec(500);
-                            fpm_printf("\nWrite error: %s\r\n", f_strerror(fs_status));
-                            goto cleanup;
-                        }
-                        if (nbytes_written != count - 1) {
-                            // Out of disk space.
-                            fpm_delay_msec(500);
-                            fpm_printf("\nNot enough space on device\r\n");
+                        if (!store_data(r, fdest, data_buf, count - 1)) {
                             goto cleanup;
                         }
 
-                        received_data_size += (count - 1);
+                        file_pos += (count - 1);
+                        total_bytes += (count - 1);
 
                         if (result == GOT_CRCE) {
                             // End of frame, header follows, no ZACK expected.
-                            // Got CRCE; Frame done [NOACK] [Pos: 0x%08x], received_data_size
+                            // Got CRCE; Frame done [NOACK] [Pos: 0x%08x], file_pos
                             break;
                         } else if (result == GOT_CRCG) {
                             // Frame continues, non-stop (another data packet follows)
-                            // Got CRCG; Frame continues [NOACK] [Pos: 0x%08x], received_data_size
+                            // Got CRCG; Frame continues [NOACK] [Pos: 0x%08x], file_pos
                             continue;
                         } else if (result == GOT_CRCQ) {
                             // Frame continues, ZACK required
-                            // Got CRCQ; Frame continues [ACK] [Pos: 0x%08x], received_data_size
+                            // Got CRCQ; Frame continues [ACK] [Pos: 0x%08x], file_pos
 
-                            result = zm_send_pos_hdr(ZACK, received_data_size);
+                            result = zm_send_pos_hdr(z, ZACK, file_pos);
 
                             if (result == CANCELLED) {
                                 fpm_delay_msec(500);
@@ -240,9 +553,9 @@ startframe:
                             continue;
                         } else if (result == GOT_CRCW) {
                             // End of frame, header follows, ZACK expected.
-                            // Got CRCW; Frame done [ACK] [Pos: 0x%08x], received_data_size);
+                            // Got CRCW; Frame done [ACK] [Pos: 0x%08x], file_pos);
 
-                            result = zm_send_pos_hdr(ZACK, received_data_size);
+                            result = zm_send_pos_hdr(z, ZACK, file_pos);
 
                             if (result == CANCELLED) {
                                 fpm_delay_msec(500);
@@ -262,7 +575,7 @@ startframe:
                     } else {
                         // Error while receiving block: 0x%04x, result
 
-                        result = zm_send_pos_hdr(ZRPOS, received_data_size);
+                        result = zm_send_pos_hdr(z, ZRPOS, file_pos);
 
                         if (result == CANCELLED) {
                             fpm_delay_msec(500);
@@ -290,7 +603,7 @@ startframe:
         case BAD_CRC:
             // Didn't get valid header - CRC Check failed.
 
-            result = zm_send_pos_hdr(ZNAK, received_data_size);
+            result = zm_send_pos_hdr(z, ZNAK, file_pos);
 
             if (result == CANCELLED) {
                 fpm_delay_msec(500);
@@ -308,7 +621,7 @@ startframe:
         default:
             // Didn't get valid header - result is 0x%04x, result
 
-            result = zm_send_pos_hdr(ZNAK, received_data_size);
+            result = zm_send_pos_hdr(z, ZNAK, file_pos);
 
             if (result == CANCELLED) {
                 fpm_delay_msec(500);
@@ -326,9 +639,15 @@ startframe:
     }
 
 cleanup:
+    zm_flush(z);
     if (fs_status == FR_OK) {
-        f_close(fdest);
+        finish_file(r, fdest);
+    }
+    if (num_fragmented > 0) {
+        fpm_printf("\r\n%u program(s) received fragmented, run defrag to make them executable\r\n",
+                   num_fragmented);
     }
+    fpm_free(r);
 }
 
 int main(int argc, char **argv)
@@ -339,11 +658,46 @@ int main(int argc, char **argv)
     };
     struct fpm_opt opt = {};
 
+    const char *dir = "";
+
     while (fpm_getopt(argc, argv, "h", long_opts, &opt) >= 0) {
-        fpm_puts("Usage: rz\r\n");
-        return 0;
+        switch (opt.ret) {
+        case 1:
+            if (dir[0] != 0) {
+                // Only one directory allowed.
+                goto usage;
+            }
+            dir = opt.arg;
+            break;
+
+        case '?':
+            // Unknown option: message already printed.
+            fpm_puts("\r\n");
+            return 0;
+
+        case 'h':
+usage:      fpm_puts("Usage:\r\n"
+                     "    rz [directory]\r\n"
+                     "Receive files with ZMODEM protocol. Interrupted transfer\r\n"
+                     "is resumed when sender requests it, like 'sz --resume'.\r\n"
+                     "\n");
+            return 0;
+        }
+    }
+
+    if (dir[0] != 0) {
+        // Check target directory.
+        directory_t *dp = alloca(f_sizeof_directory_t());
+        fs_result_t status = f_opendir(dp, dir);
+        if (status == FR_OK) {
+            f_closedir(dp);
+        } else {
+            fpm_printf("%s: %s\r\n", dir, f_strerror(status));
+            return 0;
+        }
     }
 
-    // Invoked without arguments: receive file.
-    rz();
+    // Receive files.
+    rz(dir);
+    return 0;
 }
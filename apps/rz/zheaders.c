@@ -21,7 +21,7 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 //
-#include <string.h>
+#include <fpm/api.h>
 #include "crc.h"
 #include "ztypes.h"
 #include "znumbers.h"
@@ -39,14 +39,13 @@ void zm_calc_hdr_crc(ZHDR *hdr)
     hdr->crc2 = CRC_LSB(crc);
 }
 
+//
+// Data blocks are checksummed by the kernel, a word at a time
+// or in hardware.
+//
 uint16_t zm_calc_data_crc(uint8_t *buf, uint16_t len)
 {
-    uint16_t crc = CRC_START_XMODEM;
-
-    for (int i = 0; i < len; i++) {
-        crc = update_crc16_ccitt(buf[i], crc);
-    }
-    return crc;
+    return fpm_crc16(CRC_START_XMODEM, buf, len);
 }
 
 //
@@ -56,17 +55,13 @@ uint16_t zm_calc_data_crc(uint8_t *buf, uint16_t len)
 //
 uint32_t zm_calc_data_crc32(uint8_t *buf, uint16_t len)
 {
-    uint32_t crc = CRC_START_32;
-
-    if (buf != 0) {
-        if (len == 0) {
-            len = strlen((const char *)buf);
-        }
-        for (unsigned l = 0; l < len; l++) {
-            crc = update_crc32(buf[l], crc);
-        }
+    if (buf == 0) {
+        return 0;
+    }
+    if (len == 0) {
+        len = strlen((const char *)buf);
     }
-    return ~crc;
+    return fpm_crc32(0, buf, len);
 }
 
 ZRESULT zm_to_hex_header(ZHDR *hdr, uint8_t *buf, int max_len)
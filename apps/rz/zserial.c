@@ -22,12 +22,13 @@
 // SOFTWARE.
 //
 #include <string.h>
+#include <fpm/api.h>
 #include "crc.h"
 #include "zmodem.h"
 
-ZRESULT zm_read_crlf()
+ZRESULT zm_read_crlf(zmodem_t *z)
 {
-    uint16_t c = zm_read_escaped(); // zm_recv();
+    uint16_t c = zm_read_escaped(z); // zm_recv();
 
     if (IS_ERROR(c)) {
         DEBUGF("CRLF: Got error on first character: 0x%04x\n", c);
@@ -37,7 +38,7 @@ ZRESULT zm_read_crlf()
         return OK;
     } else if (c == CR || c == (CR | 0x80)) {
         TRACEF("CRLF: Got CR on first character, await LF\n");
-        c = zm_read_escaped(); // zm_recv();
+        c = zm_read_escaped(z); // zm_recv();
 
         if (IS_ERROR(c)) {
             return c;
@@ -55,14 +56,14 @@ ZRESULT zm_read_crlf()
     }
 }
 
-ZRESULT zm_read_hex_byte()
+ZRESULT zm_read_hex_byte(zmodem_t *z)
 {
-    int c1 = zm_recv(), c2;
+    int c1 = zm_recv(z), c2;
 
     if (IS_ERROR(c1)) {
         return c1;
     } else {
-        c2 = zm_recv();
+        c2 = zm_recv(z);
         if (IS_ERROR(c2)) {
             return c2;
         } else {
@@ -71,15 +72,16 @@ ZRESULT zm_read_hex_byte()
     }
 }
 
-ZRESULT zm_read_escaped()
+ZRESULT zm_read_escaped(zmodem_t *z)
 {
     ZRESULT c;
 
     while (true) {
-        c = zm_recv();
+        c = zm_recv(z);
 
-        // Return immediately if non-control character or error
-        if (NONCONTROL(c) || IS_ERROR(c)) {
+        // Return immediately if error, or not a control character,
+        // with or without parity bit
+        if ((c & 0x60) || IS_ERROR(c)) {
             if (IS_ERROR(c)) {
                 TRACEF("  >> READ_ESCAPED: IS ERROR: [0x%04x]\n", c);
             } else {
@@ -153,13 +155,13 @@ gotzdle:
     //        * c is definitely **not** CAN, but WAS preceeded by exactly one ZDLE,
     //          so is either protocol control, or an escaped character.
     //
-    if (IS_ERROR(c = zm_recv()))
+    if (IS_ERROR(c = zm_recv(z)))
         return c;
-    if (c == CAN && IS_ERROR(c = zm_recv()))
+    if (c == CAN && IS_ERROR(c = zm_recv(z)))
         return c;
-    if (c == CAN && IS_ERROR(c = zm_recv()))
+    if (c == CAN && IS_ERROR(c = zm_recv(z)))
         return c;
-    if (c == CAN && IS_ERROR(c = zm_recv()))
+    if (c == CAN && IS_ERROR(c = zm_recv(z)))
         return c;
 
     switch (c) {
@@ -195,25 +197,85 @@ gotzdle:
     return BAD_ESCAPE;
 }
 
-// Just read a data block - no CRC checking is done; see read_data_block
-static ZRESULT recv_data_block(uint8_t *buf, uint16_t *len)
+//
+// Count leading bytes which need no decoding: anything but ZDLE, XON and XOFF,
+// with or without parity bit, as zm_read_escaped() drops them.
+// Aligned words without control characters are skipped four bytes at a time.
+//
+static unsigned plain_run(const uint8_t *ptr, unsigned len)
+{
+    unsigned n = 0;
+
+    while (n < len) {
+        if (len - n >= 4 && ((uintptr_t)&ptr[n] & 3) == 0) {
+            uint32_t word;
+            memcpy(&word, __builtin_assume_aligned(&ptr[n], 4), 4);
+            word &= 0x7f7f7f7f;
+            if (((word - 0x20202020) & ~word & 0x80808080) == 0) {
+                // No byte below 0x20, ignoring parity bit.
+                n += 4;
+                continue;
+            }
+        }
+        uint8_t c = ptr[n];
+        if (c == ZDLE || c == XON || c == XOFF || c == (XON | 0x80) || c == (XOFF | 0x80)) {
+            break;
+        }
+        n++;
+    }
+    return n;
+}
+
+//
+// Update running CRC of the data block.
+//
+static void update_data_crc(zmodem_t *z, uint32_t *crc, const uint8_t *buf, unsigned len)
+{
+    if (z->in_32bit_block) {
+        *crc = fpm_crc32(*crc, buf, len);
+    } else {
+        *crc = fpm_crc16(*crc, buf, len);
+    }
+}
+
+//
+// Read a data block up to the frame end, and compute its CRC on the way.
+// The frame end is stored too, as CRC takes it into account.
+// Runs of plain bytes are copied straight from the input buffer;
+// escapes and flow control go through zm_read_escaped().
+// No CRC checking is done; see zm_read_data_block().
+//
+static ZRESULT recv_data_block(zmodem_t *z, uint8_t *buf, uint16_t *len, uint32_t *crc)
 {
     uint16_t max = *len;
     *len = 0;
 
     while (*len < max) {
-        ZRESULT c = zm_read_escaped();
+        unsigned avail;
+        const uint8_t *input = zm_recv_peek(z, &avail);
+        if (avail > max - *len) {
+            avail = max - *len;
+        }
+        unsigned run = plain_run(input, avail);
+        if (run > 0) {
+            memcpy(&buf[*len], input, run);
+            zm_recv_skip(z, run);
+            update_data_crc(z, crc, &buf[*len], run);
+            *len += run;
+            continue;
+        }
 
+        ZRESULT c = zm_read_escaped(z);
         if (IS_ERROR(c)) {
             DEBUGF("  >> RECV_BLOCK: GOT ERROR: 0x%04x\n", c);
             return c;
-        } else {
-            // Always add, even if frameend, as CRC takes that into account...
-            buf[(*len)++] = ZVALUE(c);
+        }
+        buf[*len] = ZVALUE(c);
+        update_data_crc(z, crc, &buf[*len], 1);
+        (*len)++;
 
-            if (IS_FIN(c)) {
-                return c;
-            }
+        if (IS_FIN(c)) {
+            return c;
         }
     }
 
@@ -223,7 +285,8 @@ static ZRESULT recv_data_block(uint8_t *buf, uint16_t *len)
 ZRESULT zm_read_data_block(zmodem_t *z, uint8_t *buf, uint16_t *len)
 {
     DEBUGF("  >> READ_BLOCK: Reading %d-bit block\n", z->in_32bit_block ? 32 : 16);
-    ZRESULT result = recv_data_block(buf, len);
+    uint32_t calc_crc = z->in_32bit_block ? 0 : CRC_START_XMODEM;
+    ZRESULT result = recv_data_block(z, buf, len, &calc_crc);
     DEBUGF("  >> READ_BLOCK: Result of data block recv is [0x%04x] (got %d character(s))\n", result,
            *len);
 
@@ -231,34 +294,33 @@ ZRESULT zm_read_data_block(zmodem_t *z, uint8_t *buf, uint16_t *len)
         return result;
     } else {
         // CRC bytes are ZDLE escaped!
-        ZRESULT crc1 = zm_read_escaped();
+        ZRESULT crc1 = zm_read_escaped(z);
         if (IS_ERROR(crc1)) {
             DEBUGF("  >> READ_BLOCK: Error while reading crc1: 0x%04x\n", crc1);
             return crc1;
         }
 
-        ZRESULT crc2 = zm_read_escaped();
+        ZRESULT crc2 = zm_read_escaped(z);
         if (IS_ERROR(crc2)) {
             return crc2;
             DEBUGF("  >> READ_BLOCK: Error while reading crc2: 0x%04x\n", crc2);
         }
 
         if (z->in_32bit_block) {
-            ZRESULT crc3 = zm_read_escaped();
+            ZRESULT crc3 = zm_read_escaped(z);
             if (IS_ERROR(crc3)) {
                 return crc3;
                 DEBUGF("  >> READ_BLOCK: Error while reading crc3: 0x%04x\n", crc3);
             }
 
-            ZRESULT crc4 = zm_read_escaped();
+            ZRESULT crc4 = zm_read_escaped(z);
             if (IS_ERROR(crc4)) {
                 return crc4;
                 DEBUGF("  >> READ_BLOCK: Error while reading crc4: 0x%04x\n", crc4);
             }
 
-            DEBUGF("  >> READ_BLOCK: Calculate CRC32 for block len: %d\n", *len);
+            DEBUGF("  >> READ_BLOCK: Check CRC32 for block len: %d\n", *len);
             uint32_t recv_crc = CRC32(ZVALUE(crc1), ZVALUE(crc2), ZVALUE(crc3), ZVALUE(crc4));
-            uint32_t calc_crc = zm_calc_data_crc32(buf, *len);
 
             if (recv_crc == calc_crc) {
                 DEBUGF("  >> READ_BLOCK: CRC32 is good (recv: 0x%08x; calc: 0x%08x)\n", recv_crc,
@@ -270,9 +332,8 @@ ZRESULT zm_read_data_block(zmodem_t *z, uint8_t *buf, uint16_t *len)
                 return BAD_CRC;
             }
         } else {
-            DEBUGF("  >> READ_BLOCK: Calculate CRC16 for block len: %d\n", *len);
+            DEBUGF("  >> READ_BLOCK: Check CRC16 for block len: %d\n", *len);
             uint16_t recv_crc = CRC(ZVALUE(crc1), ZVALUE(crc2));
-            uint16_t calc_crc = zm_calc_data_crc(buf, *len);
 
             if (recv_crc == calc_crc) {
                 DEBUGF("  >> READ_BLOCK: CRC is good (recv: 0x%04x; calc: 0x%04x)\n", recv_crc,
@@ -287,10 +348,10 @@ ZRESULT zm_read_data_block(zmodem_t *z, uint8_t *buf, uint16_t *len)
     }
 }
 
-ZRESULT zm_await_zdle()
+ZRESULT zm_await_zdle(zmodem_t *z)
 {
     while (true) {
-        int c = zm_recv();
+        int c = zm_recv(z);
 
         if (IS_ERROR(c)) {
             DEBUGF("Got error :(\n");
@@ -336,7 +397,7 @@ ZRESULT zm_read_hex_header(zmodem_t *z, ZHDR *hdr)
     //      the need to have the all-byte layout in ZHDR struct...
     for (int i = 0; i < ZHDR_SIZE - 2; i++) {
         // TODO use read_hex_byte here...
-        uint16_t c1 = zm_recv();
+        uint16_t c1 = zm_recv(z);
 
         if (IS_ERROR(c1)) {
             DEBUGF("READ_HEX: Character %d/1 is error: 0x%04x\n", i, c1);
@@ -346,7 +407,7 @@ ZRESULT zm_read_hex_header(zmodem_t *z, ZHDR *hdr)
             return CLOSED;
         } else {
             TRACEF("READ_HEX: Character %d/1 is good: 0x%04x\n", i, c1);
-            uint16_t c2 = zm_recv();
+            uint16_t c2 = zm_recv(z);
 
             if (IS_ERROR(c2)) {
                 DEBUGF("READ_HEX: Character %d/2 is error: 0x%04x\n", i, c2);
@@ -397,7 +458,7 @@ ZRESULT zm_read_binary16_header(zmodem_t *z, ZHDR *hdr)
     z->in_32bit_block = 0;
 
     for (int i = 0; i < ZHDR_SIZE - 2; i++) {
-        uint16_t b = zm_read_escaped();
+        uint16_t b = zm_read_escaped(z);
 
         if (IS_ERROR(b)) {
             DEBUGF("READ_BIN16: Character %d/1 is error: 0x%04x\n", i, b);
@@ -435,7 +496,7 @@ ZRESULT zm_read_binary32_header(zmodem_t *z, ZHDR *hdr)
     z->in_32bit_block = 1;
 
     for (int i = 0; i < ZHDR_SIZE; i++) {
-        uint16_t b = zm_read_escaped();
+        uint16_t b = zm_read_escaped(z);
 
         if (IS_ERROR(b)) {
             DEBUGF("READ_BIN32: Character %d/1 is error: 0x%04x\n", i, b);
@@ -472,9 +533,9 @@ ZRESULT zm_await_header(zmodem_t *z, ZHDR *hdr)
     uint16_t result;
 
     while (true) {
-        if (zm_await_zdle() == OK) {
+        if (zm_await_zdle(z) == OK) {
             DEBUGF("Got ZDLE, awaiting type...\n");
-            ZRESULT frame_type = zm_read_escaped();
+            ZRESULT frame_type = zm_read_escaped(z);
 
             if (frame_type == CANCELLED) {
                 return CANCELLED;
@@ -491,7 +552,7 @@ ZRESULT zm_await_header(zmodem_t *z, ZHDR *hdr)
 
                 if (result == OK) {
                     DEBUGF("Got valid header\n");
-                    return zm_read_crlf();
+                    return zm_read_crlf(z);
                 } else {
                     DEBUGF("Didn't get valid header [0x%02x]\n", result);
                     return result;
@@ -528,12 +589,12 @@ ZRESULT zm_await_header(zmodem_t *z, ZHDR *hdr)
     }
 }
 
-ZRESULT zm_send_sz(uint8_t *data)
+ZRESULT zm_send_sz(zmodem_t *z, uint8_t *data)
 {
     register uint16_t result;
 
     while (*data) {
-        result = zm_send(*data++);
+        result = zm_send(z, *data++);
 
         if (IS_ERROR(result)) {
             return result;
@@ -543,23 +604,23 @@ ZRESULT zm_send_sz(uint8_t *data)
     return OK;
 }
 
-static ZRESULT just_send_hex_hdr(uint8_t *buf)
+static ZRESULT just_send_hex_hdr(zmodem_t *z, uint8_t *buf)
 {
-    zm_send(ZPAD);
-    zm_send(ZPAD);
-    zm_send(ZDLE);
+    zm_send(z, ZPAD);
+    zm_send(z, ZPAD);
+    zm_send(z, ZDLE);
 
     DEBUGF("  >> SEND (raw): [%s]\n", buf);
 
-    ZRESULT result = zm_send_sz(buf);
+    ZRESULT result = zm_send_sz(z, buf);
     if (IS_ERROR(result)) {
         return result;
     } else {
-        return zm_send(XON);
+        return zm_send(z, XON);
     }
 }
 
-ZRESULT zm_send_hex_hdr(ZHDR *hdr)
+ZRESULT zm_send_hex_hdr(zmodem_t *z, ZHDR *hdr)
 {
     uint8_t buf[HEX_HDR_STR_LEN];
 
@@ -569,11 +630,37 @@ ZRESULT zm_send_hex_hdr(ZHDR *hdr)
     if (IS_ERROR(result)) {
         return result;
     } else {
-        return just_send_hex_hdr(buf);
+        return just_send_hex_hdr(z, buf);
     }
 }
 
-ZRESULT zm_send_pos_hdr(uint8_t type, uint32_t pos)
+void zm_set_hdr_position(ZHDR *hdr, uint32_t pos)
+{
+#ifdef ZM_BIG_ENDIAN
+    hdr->position.p3 = (uint8_t)(pos & 0xff);
+    hdr->position.p2 = (uint8_t)(pos >> 8) & 0xff;
+    hdr->position.p1 = (uint8_t)(pos >> 16) & 0xff;
+    hdr->position.p0 = (uint8_t)(pos >> 24) & 0xff;
+#else
+    hdr->position.p0 = (uint8_t)(pos & 0xff);
+    hdr->position.p1 = (uint8_t)(pos >> 8) & 0xff;
+    hdr->position.p2 = (uint8_t)(pos >> 16) & 0xff;
+    hdr->position.p3 = (uint8_t)(pos >> 24) & 0xff;
+#endif
+}
+
+uint32_t zm_get_hdr_position(const ZHDR *hdr)
+{
+#ifdef ZM_BIG_ENDIAN
+    return hdr->position.p3 | hdr->position.p2 << 8 |
+           hdr->position.p1 << 16 | (uint32_t)hdr->position.p0 << 24;
+#else
+    return hdr->position.p0 | hdr->position.p1 << 8 |
+           hdr->position.p2 << 16 | (uint32_t)hdr->position.p3 << 24;
+#endif
+}
+
+ZRESULT zm_send_pos_hdr(zmodem_t *z, uint8_t type, uint32_t pos)
 {
     ZHDR hdr;
 
@@ -582,25 +669,15 @@ ZRESULT zm_send_pos_hdr(uint8_t type, uint32_t pos)
 #endif
 
     hdr.type = type;
-#ifdef ZM_BIG_ENDIAN
-    hdr.position.p3 = (uint8_t)(pos & 0xff);
-    hdr.position.p2 = (uint8_t)(pos >> 8) & 0xff;
-    hdr.position.p1 = (uint8_t)(pos >> 16) & 0xff;
-    hdr.position.p0 = (uint8_t)(pos >> 24) & 0xff;
-#else
-    hdr.position.p0 = (uint8_t)(pos & 0xff);
-    hdr.position.p1 = (uint8_t)(pos >> 8) & 0xff;
-    hdr.position.p2 = (uint8_t)(pos >> 16) & 0xff;
-    hdr.position.p3 = (uint8_t)(pos >> 24) & 0xff;
-#endif
+    zm_set_hdr_position(&hdr, pos);
 
     DEBUGF("Sending position header as hex; Dump is:\n");
     DEBUG_DUMPHDR_P(hdrptr);
 
-    return zm_send_hex_hdr(&hdr);
+    return zm_send_hex_hdr(z, &hdr);
 }
 
-ZRESULT zm_send_flags_hdr(uint8_t type, uint8_t f0, uint8_t f1, uint8_t f2, uint8_t f3)
+ZRESULT zm_send_flags_hdr(zmodem_t *z, uint8_t type, uint8_t f0, uint8_t f1, uint8_t f2, uint8_t f3)
 {
     ZHDR hdr;
 
@@ -617,5 +694,97 @@ ZRESULT zm_send_flags_hdr(uint8_t type, uint8_t f0, uint8_t f1, uint8_t f2, uint
     DEBUGF("Sending flags header as hex; Dump is:\n");
     DEBUG_DUMPHDR_F(hdrptr);
 
-    return zm_send_hex_hdr(&hdr);
+    return zm_send_hex_hdr(z, &hdr);
+}
+
+ZRESULT zm_send_escaped(zmodem_t *z, uint8_t c)
+{
+    switch (c) {
+    case ZDLE:
+    case 0x10:
+    case 0x10 | 0x80:
+    case XON:
+    case XON | 0x80:
+    case XOFF:
+    case XOFF | 0x80:
+        // Data link escape, and characters which can be eaten by the line.
+        zm_send(z, ZDLE);
+        return zm_send(z, c ^ 0x40);
+    default:
+        return zm_send(z, c);
+    }
+}
+
+//
+// Send CRC of header or data block: 16-bit CRC as MSB first,
+// 32-bit CRC as LSB first.
+//
+static ZRESULT send_crc(zmodem_t *z, uint32_t crc)
+{
+    if (z->out_32bit_block) {
+        zm_send_escaped(z, CRC32_B1(crc));
+        zm_send_escaped(z, CRC32_B2(crc));
+        zm_send_escaped(z, CRC32_B3(crc));
+        return zm_send_escaped(z, CRC32_B4(crc));
+    } else {
+        zm_send_escaped(z, CRC_MSB(crc));
+        return zm_send_escaped(z, CRC_LSB(crc));
+    }
+}
+
+ZRESULT zm_send_bin_hdr(zmodem_t *z, ZHDR *hdr)
+{
+    const uint8_t *ptr = (const uint8_t *)hdr;
+    uint32_t crc32 = CRC_START_32;
+    uint16_t crc16 = CRC_START_XMODEM;
+
+    DEBUGF("Sending binary header; Dump is:\n");
+    DEBUG_DUMPHDR(hdr);
+
+    zm_send(z, ZPAD);
+    zm_send(z, ZDLE);
+    zm_send(z, z->out_32bit_block ? ZBIN32 : ZBIN16);
+
+    // Type and four bytes of flags or position.
+    for (int i = 0; i < 5; i++) {
+        zm_send_escaped(z, ptr[i]);
+        crc32 = update_crc32(ptr[i], crc32);
+        crc16 = update_crc16_ccitt(ptr[i], crc16);
+    }
+    return send_crc(z, z->out_32bit_block ? ~crc32 : crc16);
+}
+
+ZRESULT zm_send_bin_pos_hdr(zmodem_t *z, uint8_t type, uint32_t pos)
+{
+    ZHDR hdr;
+
+    hdr.type = type;
+    zm_set_hdr_position(&hdr, pos);
+    return zm_send_bin_hdr(z, &hdr);
+}
+
+ZRESULT zm_send_data_block(zmodem_t *z, const uint8_t *buf, uint16_t len, uint8_t frameend)
+{
+    DEBUGF("  >> SEND_BLOCK: %d byte(s), frame end '%c'\n", len, frameend);
+
+    for (int i = 0; i < len; i++) {
+        zm_send_escaped(z, buf[i]);
+    }
+
+    // Frame end is covered by CRC.
+    zm_send(z, ZDLE);
+    zm_send(z, frameend);
+    uint32_t crc;
+    if (z->out_32bit_block) {
+        crc = fpm_crc32(fpm_crc32(0, buf, len), &frameend, 1);
+    } else {
+        crc = fpm_crc16(fpm_crc16(CRC_START_XMODEM, buf, len), &frameend, 1);
+    }
+
+    ZRESULT result = send_crc(z, crc);
+    if (frameend == ZCRCW && !IS_ERROR(result)) {
+        // Receiver expects flow control to be enabled.
+        result = zm_send(z, XON);
+    }
+    return result;
 }
@@ -28,8 +28,20 @@
 extern "C" {
 #endif
 
+//
+// State of the session. Programs are mapped read-only, without writable
+// static data, so the caller keeps it on stack and passes it down.
+//
 typedef struct {
     uint8_t in_32bit_block;
+    uint8_t out_32bit_block;    // Send binary headers and data with CRC32
+
+    // Console input and output, buffered by zm_recv() and zm_send().
+    unsigned in_len;            // Bytes in input buffer
+    unsigned in_pos;            // Next byte to return
+    unsigned out_len;           // Bytes pending in output buffer
+    char in_buf[1024];
+    char out_buf[256];
 } zmodem_t;
 
 #define NONCONTROL(c) ((bool)((uint8_t)(c & 0xe0)))
@@ -37,26 +49,35 @@ typedef struct {
 //
 // The lib doesn't implement these - they need to be provided.
 //
-ZRESULT zm_recv();
-ZRESULT zm_send(uint8_t chr);
+ZRESULT zm_recv(zmodem_t *z);
+ZRESULT zm_send(zmodem_t *z, uint8_t chr);
+
+//
+// Access to input buffer, for bulk decoding of data blocks.
+// zm_recv_peek() returns received bytes not consumed yet, without waiting;
+// the count is zero when the buffer is empty.
+// zm_recv_skip() consumes the given number of bytes.
+//
+const uint8_t *zm_recv_peek(zmodem_t *z, unsigned *len);
+void zm_recv_skip(zmodem_t *z, unsigned len);
 
 //
 // Receive CR/LF (with CR being optional).
 //
-ZRESULT zm_read_crlf();
+ZRESULT zm_read_crlf(zmodem_t *z);
 
 //
 // Read two ASCII characters and convert them from hex.
 //
-ZRESULT zm_read_hex_byte();
+ZRESULT zm_read_hex_byte(zmodem_t *z);
 
 //
 // Read character, taking care of ZMODEM Data Link Escapes (ZDLE)
 // and swallowing XON/XOFF.
 //
-ZRESULT zm_read_escaped();
+ZRESULT zm_read_escaped(zmodem_t *z);
 
-ZRESULT zm_await_zdle();
+ZRESULT zm_await_zdle(zmodem_t *z);
 ZRESULT zm_await_header(zmodem_t *z, ZHDR *hdr);
 
 ZRESULT zm_read_hex_header(zmodem_t *z, ZHDR *hdr);
@@ -72,22 +93,50 @@ ZRESULT zm_read_data_block(zmodem_t *z, uint8_t *buf, uint16_t *len);
 //
 // Send a null-terminated string.
 //
-ZRESULT zm_send_sz(uint8_t *data);
+ZRESULT zm_send_sz(zmodem_t *z, uint8_t *data);
 
 //
 // Send the given header as hex, with ZPAD/ZDLE preamble.
 //
-ZRESULT zm_send_hex_hdr(ZHDR *hdr);
+ZRESULT zm_send_hex_hdr(zmodem_t *z, ZHDR *hdr);
 
 //
 // Convenience function to build and send a position header as hex.
 //
-ZRESULT zm_send_pos_hdr(uint8_t type, uint32_t pos);
+ZRESULT zm_send_pos_hdr(zmodem_t *z, uint8_t type, uint32_t pos);
 
 //
 // Convenience function to build and send a flags header as hex.
 //
-ZRESULT zm_send_flags_hdr(uint8_t type, uint8_t f0, uint8_t f1, uint8_t f2, uint8_t f3);
+ZRESULT zm_send_flags_hdr(zmodem_t *z, uint8_t type, uint8_t f0, uint8_t f1, uint8_t f2, uint8_t f3);
+
+//
+// Set or get position field of the header.
+//
+void zm_set_hdr_position(ZHDR *hdr, uint32_t pos);
+uint32_t zm_get_hdr_position(const ZHDR *hdr);
+
+//
+// Send character, with ZDLE escape when needed.
+//
+ZRESULT zm_send_escaped(zmodem_t *z, uint8_t c);
+
+//
+// Send the given header as binary, with ZPAD/ZDLE preamble.
+// CRC32 is used when z->out_32bit_block is set, otherwise CRC16.
+//
+ZRESULT zm_send_bin_hdr(zmodem_t *z, ZHDR *hdr);
+
+//
+// Convenience function to build and send a position header as binary.
+//
+ZRESULT zm_send_bin_pos_hdr(zmodem_t *z, uint8_t type, uint32_t pos);
+
+//
+// Send data subpacket, terminated by given frame end:
+// ZCRCE, ZCRCG, ZCRCQ or ZCRCW.
+//
+ZRESULT zm_send_data_block(zmodem_t *z, const uint8_t *buf, uint16_t len, uint8_t frameend);
 
 #ifdef __cplusplus
 }
@@ -110,6 +110,7 @@ extern "C" {
 #define OUT_OF_SPACE 0x8000    // Supplied buffer is not big enough
 #define CANCELLED 0x9000       // 5x CAN received
 #define BAD_ESCAPE 0xa000      // Bad escape sequence
+#define TIMEOUT 0xb000         // No data received in time
 #define UNSUPPORTED 0xf000     // Attempted to use an unsupported protocol feature
 
 #define ERROR_CODE(x) (x & ERROR_MASK)
@@ -0,0 +1,570 @@
+//
+// Send files with ZMODEM protocol.
+//
+// Files are read in large chunks and sent as data subpackets with CRC32,
+// or CRC16 when receiver can't do CRC32. Subpackets are streamed with ZCRCG.
+// With a window, ZCRCQ asks receiver for ZACK every quarter of the window,
+// and the frame is closed with ZCRCW when a whole window is unacknowledged.
+// Receiver can interrupt the stream with ZRPOS at any time.
+//
+// Copyright (c) 2025 Serge Vakulenko
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+#include <fpm/api.h>
+#include <fpm/getopt.h>
+#include <fpm/fs.h>
+#include <alloca.h>
+
+#include "zmodem.h"
+
+#define SUBPACKET_LEN   1024    // Max length of data subpacket by spec
+#define READ_BUF_LEN    8192    // File is read in chunks of this size
+#define PATH_LEN        256     // Max length of file path
+#define TIMEOUT_MSEC    10000   // How long to wait for receiver
+#define MAX_RETRIES     10      // How many times to repeat a header
+
+//
+// State of the sender. Programs have no writable static data,
+// so it is allocated on the heap.
+//
+typedef struct {
+    zmodem_t z;                 // Protocol state and console buffers
+    unsigned window;            // Window size in bytes, 0 for unlimited streaming
+
+    uint8_t read_buf[READ_BUF_LEN];
+    uint32_t read_pos;          // File offset of data in read buffer
+    unsigned read_len;          // Bytes in read buffer
+
+    unsigned num_files;         // Files sent
+    unsigned num_skipped;       // Files skipped
+    uint32_t total_bytes;       // Bytes sent
+} sender_t;
+
+//
+// Console input and output are buffered in zmodem_t, to move data in bulk
+// instead of one call per byte.
+//
+
+//
+// Write pending output to console.
+//
+static void zm_flush(zmodem_t *z)
+{
+    if (z->out_len > 0) {
+        fpm_write(z->out_buf, z->out_len);
+        z->out_len = 0;
+    }
+}
+
+//
+// Implementation-defined receive character function.
+// Return TIMEOUT when receiver is silent.
+//
+ZRESULT zm_recv(zmodem_t *z)
+{
+    if (z->in_pos >= z->in_len) {
+        // Receiver waits for our data before replying.
+        zm_flush(z);
+
+        int nbytes = fpm_read(z->in_buf, sizeof(z->in_buf), TIMEOUT_MSEC);
+        if (nbytes <= 0) {
+            return TIMEOUT;
+        }
+        z->in_len = nbytes;
+        z->in_pos = 0;
+    }
+    return (uint8_t) z->in_buf[z->in_pos++];
+}
+
+//
+// Received bytes not consumed yet, for bulk decoding.
+//
+const uint8_t *zm_recv_peek(zmodem_t *z, unsigned *len)
+{
+    *len = z->in_len - z->in_pos;
+    return (const uint8_t *)&z->in_buf[z->in_pos];
+}
+
+void zm_recv_skip(zmodem_t *z, unsigned len)
+{
+    z->in_pos += len;
+}
+
+//
+// Implementation-defined send character function.
+//
+ZRESULT zm_send(zmodem_t *z, uint8_t chr)
+{
+    if (z->out_len >= sizeof(z->out_buf)) {
+        zm_flush(z);
+    }
+    z->out_buf[z->out_len++] = chr;
+    return OK;
+}
+
+//
+// Check whether receiver has started a header, without waiting.
+// Skip anything else, like XON after hex header.
+//
+static bool zm_input_pending(zmodem_t *z)
+{
+    for (;;) {
+        while (z->in_pos < z->in_len) {
+            uint8_t c = z->in_buf[z->in_pos];
+            if (c == ZPAD || c == (ZPAD | 0x80) || c == ZDLE) {
+                return true;
+            }
+            z->in_pos++;
+        }
+        zm_flush(z);
+
+        int nbytes = fpm_read(z->in_buf, sizeof(z->in_buf), 0);
+        if (nbytes <= 0) {
+            return false;
+        }
+        z->in_len = nbytes;
+        z->in_pos = 0;
+    }
+}
+
+//
+// Abort the session: send eight CANs, then erase them on terminal.
+//
+static void cancel(sender_t *s)
+{
+    for (int i = 0; i < 8; i++) {
+        zm_send(&s->z, CAN);
+    }
+    for (int i = 0; i < 8; i++) {
+        zm_send(&s->z, '\b');
+    }
+    zm_flush(&s->z);
+}
+
+//
+// Get pointer to file data at given position, reading next chunk when needed.
+// Return NULL on read error.
+//
+static const uint8_t *get_data(sender_t *s, file_t *fp, uint32_t pos, unsigned *len)
+{
+    if (pos < s->read_pos || pos >= s->read_pos + s->read_len) {
+        // Read next chunk.
+        s->read_len = 0;
+        if (f_lseek(fp, pos) != FR_OK ||
+            f_read(fp, s->read_buf, READ_BUF_LEN, &s->read_len) != FR_OK) {
+            return NULL;
+        }
+        s->read_pos = pos;
+    }
+
+    unsigned avail = s->read_pos + s->read_len - pos;
+    if (*len > avail) {
+        *len = avail;
+    }
+    return &s->read_buf[pos - s->read_pos];
+}
+
+//
+// Send contents of the file, starting from given position.
+// Return OK when receiver has confirmed end of file with ZRINIT,
+// ZSKIP when receiver wants to skip the file, or error code.
+//
+static ZRESULT send_data(sender_t *s, file_t *fp, uint32_t pos, uint32_t size)
+{
+    uint32_t acked = pos;       // Position acknowledged by receiver
+    uint32_t last_query = pos;  // Position of last ZCRCQ
+    bool need_header = true;    // Start new frame
+    unsigned retries = 0;
+    ZHDR hdr;
+
+    s->read_len = 0;
+    while (retries < MAX_RETRIES) {
+        if (need_header) {
+            zm_send_bin_pos_hdr(&s->z, ZDATA, pos);
+            need_header = false;
+        }
+
+        // Choose frame end for next subpacket.
+        unsigned len = SUBPACKET_LEN;
+        const uint8_t *data = (pos < size) ? get_data(s, fp, pos, &len) : s->read_buf;
+        if (!data) {
+            return ZABORT;
+        }
+        if (pos + len > size) {
+            len = size - pos;
+        }
+        uint32_t end = pos + len;
+        uint8_t frameend;
+        if (end >= size) {
+            frameend = ZCRCE;
+        } else if (s->window > 0 && end - acked >= s->window) {
+            frameend = ZCRCW;
+        } else if (s->window > 0 && end - last_query >= s->window / 4) {
+            frameend = ZCRCQ;
+            last_query = end;
+        } else {
+            frameend = ZCRCG;
+        }
+        zm_send_data_block(&s->z, data, len, frameend);
+        pos = end;
+
+        if (frameend == ZCRCE) {
+            // End of file: tell receiver the size.
+            zm_send_bin_pos_hdr(&s->z, ZEOF, pos);
+        }
+
+        // Wait for reply at the end of frame, otherwise just check for it.
+        bool wait = (frameend == ZCRCE || frameend == ZCRCW);
+        while (wait || zm_input_pending(&s->z)) {
+            ZRESULT result = zm_await_header(&s->z, &hdr);
+            if (result == CANCELLED) {
+                return CANCELLED;
+            }
+            if (result != OK) {
+                if (!wait) {
+                    // Line noise while streaming.
+                    break;
+                }
+                if (++retries >= MAX_RETRIES) {
+                    return TIMEOUT;
+                }
+                if (frameend == ZCRCE) {
+                    // Repeat end of file.
+                    zm_send_bin_pos_hdr(&s->z, ZEOF, pos);
+                    continue;
+                }
+                // No reply: repeat from last confirmed position.
+                pos = acked;
+                need_header = true;
+                break;
+            }
+
+            switch (hdr.type) {
+            case ZACK:
+                acked = zm_get_hdr_position(&hdr);
+                if (frameend == ZCRCW && acked == pos) {
+                    // Window is confirmed: continue with new frame.
+                    need_header = true;
+                    wait = false;
+                }
+                continue;
+
+            case ZRPOS:
+                // Receiver lost data: send again from given position.
+                pos = acked = last_query = zm_get_hdr_position(&hdr);
+                need_header = true;
+                retries++;
+                break;
+
+            case ZRINIT:
+                if (frameend == ZCRCE) {
+                    // End of file confirmed.
+                    return OK;
+                }
+                continue;
+
+            case ZSKIP:
+                return ZSKIP;
+
+            case ZABORT:
+            case ZERR:
+            case ZCAN:
+                return CANCELLED;
+
+            default:
+                // Ignore unexpected header.
+                continue;
+            }
+            break;
+        }
+    }
+    return TIMEOUT;
+}
+
+//
+// Send one file.
+// Return false when the session must be aborted.
+//
+static bool send_file(sender_t *s, const char *path, const char *name)
+{
+    file_t *fp = alloca(f_sizeof_file_t());
+    if (f_open(fp, path, FA_READ) != FR_OK) {
+        s->num_skipped++;
+        return true;
+    }
+    uint32_t size = f_size(fp);
+
+    // File information: name and size.
+    uint8_t info[PATH_LEN + 16];
+    unsigned name_len = strlen(name) + 1;
+    memcpy(info, name, name_len);
+    unsigned info_len = name_len + fpm_snprintf((char *)&info[name_len], 16, "%u", size) + 1;
+
+    ZRESULT result = TIMEOUT;
+    for (unsigned retry = 0; retry < MAX_RETRIES; retry++) {
+        ZHDR hdr = { .type = ZFILE, .flags = { .f0 = ZCBIN } };
+        zm_send_bin_hdr(&s->z, &hdr);
+        zm_send_data_block(&s->z, info, info_len, ZCRCW);
+
+        result = zm_await_header(&s->z, &hdr);
+        if (result == CANCELLED) {
+            break;
+        }
+        if (result != OK) {
+            // Timeout or line noise: repeat.
+            result = TIMEOUT;
+            continue;
+        }
+        if (hdr.type == ZRPOS) {
+            // Receiver tells where to start: non-zero for resumed transfer.
+            uint32_t pos = zm_get_hdr_position(&hdr);
+            result = send_data(s, fp, (pos < size) ? pos : size, size);
+            if (result == OK) {
+                s->num_files++;
+                s->total_bytes += size - pos;
+            }
+            break;
+        }
+        if (hdr.type == ZSKIP) {
+            result = ZSKIP;
+            break;
+        }
+        // Otherwise, repeat ZFILE.
+    }
+    f_close(fp);
+
+    if (result == ZSKIP) {
+        s->num_skipped++;
+        return true;
+    }
+    return result == OK;
+}
+
+//
+// Send file, or all files in directory tree.
+// Receiver gets names relative to the given offset in path.
+// Return false when the session must be aborted.
+//
+static bool send_tree(sender_t *s, char *path, unsigned name_offset)
+{
+    directory_t *dir = alloca(f_sizeof_directory_t());
+    if (f_opendir(dir, path) != FR_OK) {
+        // Not a directory.
+        return send_file(s, path, path + name_offset);
+    }
+
+    bool ok = true;
+    unsigned path_len = strlen(path);
+    file_info_t *info = alloca(sizeof(file_info_t));
+    while (ok && f_readdir(dir, info) == FR_OK && info->fname[0] != 0) {
+        if (strcmp(info->fname, ".") == 0 || strcmp(info->fname, "..") == 0) {
+            continue;
+        }
+        if (path_len + 1 + strlen(info->fname) >= PATH_LEN) {
+            // Path is too long.
+            s->num_skipped++;
+            continue;
+        }
+
+        // Append name to the path.
+        char *name = path + path_len;
+        if (name[-1] != '/' && name[-1] != ':') {
+            *name++ = '/';
+        }
+        strcpy(name, info->fname);
+
+        ok = send_tree(s, path, name_offset);
+        path[path_len] = 0;
+    }
+    f_closedir(dir);
+    return ok;
+}
+
+//
+// Wait for ZRINIT from receiver.
+// Return false when receiver doesn't respond.
+//
+static bool start_session(sender_t *s)
+{
+    ZHDR hdr;
+
+    // Start receiver on remote terminal, when it supports this.
+    zm_send_sz(&s->z, (uint8_t *)"rz\r");
+
+    for (unsigned retry = 0; retry < MAX_RETRIES; retry++) {
+        zm_send_pos_hdr(&s->z, ZRQINIT, 0);
+
+        ZRESULT result = zm_await_header(&s->z, &hdr);
+        if (result == CANCELLED) {
+            return false;
+        }
+        if (result != OK || hdr.type != ZRINIT) {
+            continue;
+        }
+
+        // Receiver capabilities.
+        s->z.out_32bit_block = (hdr.flags.f0 & CANFC32) != 0;
+
+        // Receiver can't overlap disk I/O: limit the window by its buffer size.
+        unsigned rxbuflen = hdr.position.p0 | hdr.position.p1 << 8;
+        if (rxbuflen > 0 && (s->window == 0 || s->window > rxbuflen)) {
+            s->window = rxbuflen;
+        }
+        return true;
+    }
+    return false;
+}
+
+//
+// Close the session.
+//
+static void finish_session(sender_t *s)
+{
+    ZHDR hdr;
+
+    for (unsigned retry = 0; retry < MAX_RETRIES; retry++) {
+        zm_send_pos_hdr(&s->z, ZFIN, 0);
+
+        ZRESULT result = zm_await_header(&s->z, &hdr);
+        if (result == OK && hdr.type == ZFIN) {
+            // Over and out.
+            zm_send_sz(&s->z, (uint8_t *)"OO");
+            break;
+        }
+    }
+    zm_flush(&s->z);
+}
+
+//
+// Send files and directories.
+//
+static void sz(sender_t *s, int argc, char *argv[])
+{
+    char *path = alloca(PATH_LEN);
+    uint64_t start_time = fpm_time_usec();
+    bool ok = start_session(s);
+
+    for (int i = 0; ok && i < argc; i++) {
+        if (strlen(argv[i]) >= PATH_LEN) {
+            s->num_skipped++;
+            continue;
+        }
+        strcpy(path, argv[i]);
+
+        // Remove trailing slash.
+        unsigned len = strlen(path);
+        while (len > 1 && path[len - 1] == '/' && path[len - 2] != ':') {
+            path[--len] = 0;
+        }
+
+        // Receiver gets names relative to parent directory.
+        char *base = strrchr(path, '/');
+        if (!base) {
+            base = strchr(path, ':');
+        }
+        unsigned name_offset = base ? (base - path + 1) : 0;
+        if (path[name_offset] == 0) {
+            // Root directory: send contents only.
+            name_offset = len;
+        }
+
+        ok = send_tree(s, path, name_offset);
+    }
+
+    if (ok) {
+        finish_session(s);
+    } else {
+        cancel(s);
+    }
+    unsigned msec = (fpm_time_usec() - start_time) / 1000;
+
+    fpm_delay_msec(500);
+    if (!ok) {
+        fpm_puts("\r\nTransfer cancelled\r\n");
+    }
+    fpm_printf("\r\nSent %u file(s), %u byte(s) in %u.%03u seconds",
+               s->num_files, s->total_bytes, msec / 1000, msec % 1000);
+    if (msec > 0) {
+        fpm_printf(", %u bytes/sec", (unsigned)(s->total_bytes * 1000ULL / msec));
+    }
+    fpm_puts("\r\n");
+    if (s->num_skipped > 0) {
+        fpm_printf("%u file(s) skipped\r\n", s->num_skipped);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    static const struct fpm_option long_opts[] = {
+        { "help", FPM_NO_ARG, NULL, 'h' },
+        { "window", FPM_REQUIRED_ARG, NULL, 'w' },
+        {},
+    };
+    struct fpm_opt opt = {};
+    char **files = alloca(argc * sizeof(char *));
+    int num_args = 0;
+    long value;
+    char *end;
+    unsigned window = 16 * 1024;
+    while (fpm_getopt(argc, argv, "hw:", long_opts, &opt) >= 0) {
+        switch (opt.ret) {
+        case 1:
+            files[num_args++] = (char *)opt.arg;
+            break;
+
+        case 'w':
+            if (fpm_strtol(&value, opt.arg, &end, 10) || *end != 0 || value < 0) {
+                fpm_printf("%s: Bad window size\r\n", opt.arg);
+                return 0;
+            }
+            window = value;
+            break;
+
+        case '?':
+            // Unknown option: message already printed.
+            fpm_puts("\r\n");
+            return 0;
+
+        case 'h':
+usage:      fpm_puts("Usage:\r\n"
+                     "    sz [options] file-or-directory ...\r\n"
+                     "Options:\r\n"
+                     "    -w NUM, --window=NUM  Wait for receiver after NUM bytes,\r\n"
+                     "                          0 for no limit (default 16384)\r\n"
+                     "\n");
+            return 0;
+        }
+    }
+
+    if (num_args == 0) {
+        // Nothing to send.
+        goto usage;
+    }
+
+    sender_t *s = fpm_alloc(sizeof(sender_t));
+    if (!s) {
+        fpm_puts("Out of memory\r\n");
+        return 0;
+    }
+    s->window = window;
+    sz(s, num_args, files);
+    fpm_free(s);
+    return 0;
+}
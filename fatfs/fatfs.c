@@ -322,6 +322,25 @@ typedef struct {
 #endif
 static filesystem_t FatFs[DISK_VOLUMES]; // Filesystem objects (logical drives)
 static uint16_t Fsid;                    // Filesystem mount ID
+static uint32_t Dirchanges;              // Counter of directory changes and mounts
+
+//
+// Log of recent directory changes, indexed by the counter.
+// Cluster DIRLOG_ANY marks a change of the directory tree, or a mount.
+//
+#define DIRLOG_SIZE 8
+#define DIRLOG_ANY  0xFFFFFFFF
+static fs_dirid_t Dirlog[DIRLOG_SIZE];
+
+//
+// Count a change of the directory, or of the tree with DIRLOG_ANY.
+//
+static void dir_changed(const filesystem_t *fs, uint32_t sclust)
+{
+    fs_dirid_t *entry = &Dirlog[++Dirchanges % DIRLOG_SIZE];
+    entry->fsid = fs->id;
+    entry->sclust = sclust;
+}
 
 #if FF_FS_RPATH != 0
 static uint8_t CurrVol; /* Current drive set by f_chdrive() */
@@ -2198,6 +2217,8 @@ static fs_result_t dir_register(directory_t *dp) /* Target directory with object
 {
     fs_result_t res;
     filesystem_t *fs = dp->obj.fs;
+
+    dir_changed(fs, dp->obj.sclust);
     unsigned n, len, n_ent;
     uint8_t sn[12], sum;
 
@@ -2310,6 +2331,8 @@ static fs_result_t dir_remove(directory_t *dp) /* Directory object pointing
     filesystem_t *fs = dp->obj.fs;
     uint32_t last = dp->dptr;
 
+    dir_changed(fs, dp->obj.sclust);
+
     res =
         (dp->blk_ofs == 0xFFFFFFFF) ? FR_OK : dir_sdi(dp, dp->blk_ofs); /* Goto top of the entry
                                                                            block if LFN is exist */
@@ -3265,6 +3288,7 @@ static fs_result_t mount_volume(const char **path,  /* Pointer to pointer to the
 
     fs->fs_type = (uint8_t)fmt; /* FAT sub-type (the filesystem object gets valid) */
     fs->id = ++Fsid;            /* Volume mount ID */
+    dir_changed(fs, DIRLOG_ANY);
 #if FF_USE_LFN == 1
     fs->lfnbuf = LfnBuf; /* Static LFN working buffer */
     fs->dirbuf = DirBuf; /* Static directory block scratchpad buuffer */
@@ -3385,10 +3409,49 @@ fs_result_t f_unmount(const char *path) // Logical drive number to be unmounted
 #endif
         // Invalidate the filesystem object.
         fs->fs_type = 0;
+        dir_changed(fs, DIRLOG_ANY);
     }
     return FR_OK;
 }
 
+//
+// Get counter of changes in directories of all volumes.
+// It increments when entries are created or removed, and on mount or unmount.
+//
+uint32_t f_dirchanges(void)
+{
+    return Dirchanges;
+}
+
+//
+// Get identity of the open directory, to check it with f_dirchanged().
+//
+void f_dirid(const directory_t *dp, fs_dirid_t *id)
+{
+    id->fsid = dp->obj.id;
+    id->sclust = dp->obj.sclust;
+}
+
+//
+// Has the directory changed since given value of the counter?
+// When the log does not reach that far, assume it has.
+//
+int f_dirchanged(const fs_dirid_t *id, uint32_t since)
+{
+    uint32_t count = Dirchanges - since;
+    if (count > DIRLOG_SIZE) {
+        return 1;
+    }
+    for (; count > 0; count--) {
+        const fs_dirid_t *entry = &Dirlog[(since + count) % DIRLOG_SIZE];
+        if (entry->sclust == DIRLOG_ANY ||
+            (id && entry->fsid == id->fsid && entry->sclust == id->sclust)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
 #if !FF_FS_READONLY && !FF_FS_NORTC
 //
 // Get timestamp in FatFS format.
@@ -4432,6 +4495,7 @@ fs_result_t f_opendir(directory_t *dp,  /* Pointer to directory object to create
             }
             if (res == FR_OK) {
                 dp->obj.id = fs->id;
+                dp->rd_ofs = 0xFFFFFFFF;
                 res = dir_sdi(dp, 0); /* Rewind directory */
 #if FF_FS_LOCK
                 if (res == FR_OK) {
@@ -4456,6 +4520,69 @@ fs_result_t f_opendir(directory_t *dp,  /* Pointer to directory object to create
     LEAVE_FF(fs, res);
 }
 
+/*-----------------------------------------------------------------------*/
+/* Open a Sub-directory Last Read from the Open Directory                */
+/*-----------------------------------------------------------------------*/
+/* Unlike f_opendir(), no path is followed from the root, so a directory
+   tree can be walked in time linear in the number of entries. */
+
+fs_result_t f_opendirat(directory_t *dp,     /* Pointer to directory object to create */
+                        directory_t *parent) /* Open directory, positioned by f_readdir() */
+{
+    fs_result_t res;
+    filesystem_t *fs;
+    directory_t dj;
+    DEF_NAMBUF
+
+    if (!dp)
+        return FR_INVALID_OBJECT;
+
+    res = validate(&parent->obj, &fs); /* Check validity of the parent directory */
+    if (res == FR_OK && parent->rd_ofs == 0xFFFFFFFF)
+        res = FR_NO_FILE; /* Nothing has been read */
+    if (res == FR_OK) {
+        INIT_NAMBUF(fs);
+        dj = *parent; /* Keep position of the parent */
+        res = dir_sdi(&dj, dj.rd_ofs);
+        if (res == FR_OK)
+            res = DIR_READ_FILE(&dj); /* Load the entry again */
+        if (res == FR_OK && !(dj.obj.attr & AM_DIR))
+            res = FR_NO_PATH; /* It is a file */
+        if (res == FR_OK) {
+            dp->obj.fs = fs;
+            if (fs->fs_type == FS_EXFAT) {
+                dp->obj.c_scl = dj.obj.sclust; /* Get containing directory inforamation */
+                dp->obj.c_size = ((uint32_t)dj.obj.objsize & 0xFFFFFF00) | dj.obj.stat;
+                dp->obj.c_ofs = dj.blk_ofs;
+                init_alloc_info(fs, &dp->obj); /* Get object allocation info */
+            } else {
+                dp->obj.sclust = ld_clust(fs, dj.dir); /* Get object allocation info */
+            }
+            dp->obj.id = fs->id;
+            dp->rd_ofs = 0xFFFFFFFF;
+            res = dir_sdi(dp, 0); /* Rewind directory */
+#if FF_FS_LOCK
+            if (res == FR_OK) {
+                if (dp->obj.sclust != 0) {
+                    dp->obj.lockid = inc_share(dp, 0); /* Lock the sub directory */
+                    if (!dp->obj.lockid)
+                        res = FR_TOO_MANY_OPEN_FILES;
+                } else {
+                    dp->obj.lockid = 0;
+                }
+            }
+#endif
+        }
+        FREE_NAMBUF();
+        if (res == FR_NO_FILE)
+            res = FR_NO_PATH;
+    }
+    if (res != FR_OK)
+        dp->obj.fs = 0; /* Invalidate the directory object if function failed */
+
+    LEAVE_FF(fs, res);
+}
+
 /*-----------------------------------------------------------------------*/
 /* Close Directory                                                       */
 /*-----------------------------------------------------------------------*/
@@ -4495,6 +4622,7 @@ fs_result_t f_readdir(directory_t *dp,  /* Pointer to the open directory object
 
     res = validate(&dp->obj, &fs); /* Check validity of the directory object */
     if (res == FR_OK) {
+        dp->rd_ofs = 0xFFFFFFFF;
         if (!fno) {
             res = dir_sdi(dp, 0); /* Rewind the directory object */
         } else {
@@ -4503,6 +4631,9 @@ fs_result_t f_readdir(directory_t *dp,  /* Pointer to the open directory object
             if (res == FR_NO_FILE)
                 res = FR_OK;           /* Ignore end of directory */
             if (res == FR_OK) {        /* A valid entry is found */
+                if (dp->sect) {        /* Remember where it starts */
+                    dp->rd_ofs = (dp->blk_ofs != 0xFFFFFFFF) ? dp->blk_ofs : dp->dptr;
+                }
                 get_fileinfo(dp, fno); /* Get the object information */
                 res = dir_next(dp, 0); /* Increment index for next */
                 if (res == FR_NO_FILE)
@@ -4519,23 +4650,90 @@ fs_result_t f_readdir(directory_t *dp,  /* Pointer to the open directory object
 /* Find Next File                                                        */
 /*-----------------------------------------------------------------------*/
 
+/* Quick test of the literal head of the pattern against the raw entry,
+   before the name is converted for file information.
+   0: cannot match, 1: may match */
+static int match_head(directory_t *dp)
+{
+    filesystem_t *fs = dp->obj.fs;
+    const char *pat = dp->pat;
+    unsigned i;
+    uint16_t wc;
+    char c;
+
+#if FF_USE_FIND == 2
+    return 1; /* Short name can match when long name doesn't */
+#endif
+    if (fs->fs_type == FS_EXFAT)
+        return 1; /* Name is assembled from the entry block anyway */
+
+    for (i = 0;; i++) {
+        c = pat[i];
+        if (c == 0 || c == '*' || c == '?' || (uint8_t)c >= 0x80)
+            return 1; /* End of literal head */
+        if (IsLower(c))
+            c -= 0x20;
+        if (dp->blk_ofs != 0xFFFFFFFF) { /* Long name is in the LFN buffer */
+            if (i >= FF_MAX_LFN)
+                return 1;
+            wc = fs->lfnbuf[i];
+            if (wc < 0x80 && IsLower(wc))
+                wc -= 0x20;
+            if (wc != (uint16_t)c)
+                return 0;
+        } else { /* Short name only: compare with the name body */
+            if (c == '.' || i >= 8)
+                return 1; /* Extension is not compared */
+            if (dp->dir[i] != (uint8_t)c)
+                return 0;
+        }
+    }
+}
+
 fs_result_t f_findnext(directory_t *dp,  /* Pointer to the open directory object */
                        file_info_t *fno) /* Pointer to the file information structure */
 {
     fs_result_t res;
+    filesystem_t *fs;
+    DEF_NAMBUF
 
-    for (;;) {
-        res = f_readdir(dp, fno); /* Get a directory item */
-        if (res != FR_OK || !fno || !fno->fname[0])
-            break; /* Terminate if any error or end of directory */
-        if (pattern_match(dp->pat, fno->fname, 0, FIND_RECURS))
-            break; /* Test for the file name */
+    if (!fno)
+        return f_readdir(dp, 0); /* Rewind */
+
+    res = validate(&dp->obj, &fs); /* Check validity of the directory object */
+    if (res == FR_OK) {
+        INIT_NAMBUF(fs);
+        for (;;) {
+            dp->rd_ofs = 0xFFFFFFFF;
+            res = DIR_READ_FILE(dp); /* Read an item */
+            if (res == FR_NO_FILE) { /* End of directory */
+                fno->fname[0] = 0;
+                res = FR_OK;
+                break;
+            }
+            if (res != FR_OK)
+                break;
+            if (match_head(dp)) {
+                dp->rd_ofs = (dp->blk_ofs != 0xFFFFFFFF) ? dp->blk_ofs : dp->dptr;
+                get_fileinfo(dp, fno); /* Get the object information */
+            } else {
+                fno->fname[0] = 0; /* Rejected without conversion */
+            }
+            res = dir_next(dp, 0); /* Increment index for next */
+            if (res == FR_NO_FILE)
+                res = FR_OK; /* Ignore end of directory now */
+            if (res != FR_OK)
+                break;
+            if (fno->fname[0] && pattern_match(dp->pat, fno->fname, 0, FIND_RECURS))
+                break; /* Test for the file name */
 #if FF_USE_FIND == 2
-        if (pattern_match(dp->pat, fno->altname, 0, FIND_RECURS))
-            break; /* Test for alternative name if exist */
+            if (fno->fname[0] && pattern_match(dp->pat, fno->altname, 0, FIND_RECURS))
+                break; /* Test for alternative name if exist */
 #endif
+        }
+        FREE_NAMBUF();
     }
-    return res;
+    LEAVE_FF(fs, res);
 }
 
 /*-----------------------------------------------------------------------*/
@@ -4831,6 +5029,9 @@ fs_result_t f_unlink(const char *path) /* Pointer to the file or directory path
             }
             if (res == FR_OK) {
                 res = dir_remove(&dj);            /* Remove the directory entry */
+                if (res == FR_OK && (dj.obj.attr & AM_DIR)) {
+                    dir_changed(fs, DIRLOG_ANY); /* Directory removed */
+                }
                 if (res == FR_OK && dclst != 0) { /* Remove the cluster chain if exist */
                     res = remove_chain(&obj, dclst, 0);
                 }
@@ -4844,6 +5045,144 @@ fs_result_t f_unlink(const char *path) /* Pointer to the file or directory path
     LEAVE_FF(fs, res);
 }
 
+/*-----------------------------------------------------------------------*/
+/* Release Pending Cluster Chains                                        */
+/*-----------------------------------------------------------------------*/
+/* Chains are freed in order of their first cluster, so the FAT window
+   sweeps the table once instead of jumping back and forth. Directory
+   entries are written first: a power loss may leave lost clusters,
+   but never an entry pointing to free ones. */
+
+static fs_result_t free_chains(filesystem_t *fs, fs_chains_t *chains)
+{
+    fs_result_t res;
+    obj_id_t obj;
+    uint32_t clst;
+    unsigned i, j;
+
+    res = sync_window(fs); /* Flush deleted entries */
+    if (res != FR_OK)
+        return res;
+
+    for (i = 1; i < chains->count; i++) { /* Sort by first cluster */
+        clst = chains->start[i];
+        for (j = i; j > 0 && chains->start[j - 1] > clst; j--)
+            chains->start[j] = chains->start[j - 1];
+        chains->start[j] = clst;
+    }
+    obj.fs = fs;
+    for (i = 0; i < chains->count; i++) {
+        res = remove_chain(&obj, chains->start[i], 0);
+        if (res != FR_OK)
+            break;
+    }
+    chains->count = 0;
+    if (res == FR_OK)
+        res = sync_fs(fs);
+    return res;
+}
+
+fs_result_t f_freechains(directory_t *dp,      /* Open directory on the volume */
+                         fs_chains_t *chains) /* Pending chains */
+{
+    fs_result_t res;
+    filesystem_t *fs;
+
+    res = validate(&dp->obj, &fs); /* Check validity of the directory object */
+    if (res == FR_OK)
+        res = free_chains(fs, chains);
+    LEAVE_FF(fs, res);
+}
+
+/*-----------------------------------------------------------------------*/
+/* Delete the Entry Last Read from the Open Directory                    */
+/*-----------------------------------------------------------------------*/
+
+fs_result_t f_unlinkat(directory_t *dp,      /* Open directory, positioned by f_readdir() */
+                       fs_chains_t *chains) /* Pending chains, or 0 to free at once */
+{
+    fs_result_t res;
+    filesystem_t *fs;
+    directory_t dj, sdj;
+    uint32_t dclst = 0;
+    obj_id_t obj;
+    DEF_NAMBUF
+
+    res = validate(&dp->obj, &fs); /* Check validity of the directory object */
+    if (res == FR_OK && dp->rd_ofs == 0xFFFFFFFF)
+        res = FR_NO_FILE; /* Nothing has been read, or already deleted */
+    if (res == FR_OK) {
+        INIT_NAMBUF(fs);
+        dj = *dp; /* Keep position of the directory */
+        res = dir_sdi(&dj, dj.rd_ofs);
+        if (res == FR_OK)
+            res = DIR_READ_FILE(&dj); /* Load the entry again */
+#if FF_FS_LOCK
+        if (res == FR_OK)
+            res = chk_share(&dj, 2); /* Check if it is an open object */
+#endif
+        if (res == FR_OK && (dj.obj.attr & AM_RDO))
+            res = FR_DENIED; /* Cannot remove R/O object */
+        if (res == FR_OK) {
+            obj.fs = fs;
+            if (fs->fs_type == FS_EXFAT) {
+                init_alloc_info(fs, &obj);
+                dclst = obj.sclust;
+            } else {
+                dclst = ld_clust(fs, dj.dir);
+            }
+            if (dj.obj.attr & AM_DIR) { /* Is it a sub-directory? */
+#if FF_FS_RPATH != 0
+                if (dclst == fs->cdir) { /* Is it the current directory? */
+                    res = FR_DENIED;
+                } else
+#endif
+                {
+                    sdj.obj.fs = fs; /* Open the sub-directory */
+                    sdj.obj.sclust = dclst;
+                    if (fs->fs_type == FS_EXFAT) {
+                        sdj.obj.objsize = obj.objsize;
+                        sdj.obj.stat = obj.stat;
+                    }
+                    res = dir_sdi(&sdj, 0);
+                    if (res == FR_OK) {
+                        res = DIR_READ_FILE(&sdj); /* Test if the directory is empty */
+                        if (res == FR_OK)
+                            res = FR_DENIED; /* Not empty? */
+                        if (res == FR_NO_FILE)
+                            res = FR_OK; /* Empty? */
+                    }
+                }
+            }
+        }
+        if (res == FR_OK) {
+            res = dir_remove(&dj); /* Remove the directory entry */
+            dp->rd_ofs = 0xFFFFFFFF;
+            if (res == FR_OK && (dj.obj.attr & AM_DIR)) {
+                dir_changed(fs, DIRLOG_ANY); /* Directory removed */
+            }
+        }
+        if (res == FR_OK && dclst != 0) {
+            if (chains && fs->fs_type != FS_EXFAT) {
+                /* FAT: defer, as the chain is fully described by its first cluster */
+                if (chains->count == FS_CHAINS_MAX)
+                    res = free_chains(fs, chains);
+                if (res == FR_OK)
+                    chains->start[chains->count++] = dclst;
+            } else {
+                res = remove_chain(&obj, dclst, 0);
+                if (res == FR_OK)
+                    res = sync_fs(fs);
+            }
+        } else if (res == FR_OK && !chains) {
+            res = sync_fs(fs);
+        }
+        FREE_NAMBUF();
+    }
+
+    LEAVE_FF(fs, res);
+}
+
 /*-----------------------------------------------------------------------*/
 /* Create a Directory                                                    */
 /*-----------------------------------------------------------------------*/
@@ -4898,6 +5237,7 @@ fs_result_t f_mkdir(const char *path) /* Pointer to the directory path */
                 }
             }
             if (res == FR_OK) {
+                dir_changed(fs, DIRLOG_ANY); /* New directory */
                 if (fs->fs_type == FS_EXFAT) {                /* Initialize directory entry block */
                     st_dword(fs->dirbuf + XDIR_ModTime, tm);  /* Created time */
                     st_dword(fs->dirbuf + XDIR_FstClus, dcl); /* Table start cluster */
@@ -5032,6 +5372,9 @@ fs_result_t f_rename(const char *path_old, /* Pointer to the object name to be r
             }
             if (res == FR_OK) {
                 res = dir_remove(&djo); /* Remove old entry */
+                if (res == FR_OK && (djo.obj.attr & AM_DIR)) {
+                    dir_changed(fs, DIRLOG_ANY); /* Directory moved */
+                }
                 if (res == FR_OK) {
                     res = sync_fs(fs);
                 }
@@ -5450,6 +5793,239 @@ fs_result_t f_expand(file_t *fp,    /* Pointer to the file object */
 
 #endif /* FF_USE_EXPAND && !FF_FS_READONLY */
 
+/*-----------------------------------------------------------------------*/
+/* Count Contiguous Fragments of the File                                */
+/*-----------------------------------------------------------------------*/
+
+fs_result_t f_fragments(file_t *fp,       /* Pointer to the open file object */
+                        unsigned *nfrag) /* Result: number of fragments */
+{
+    fs_result_t res;
+    filesystem_t *fs;
+    uint32_t clst, ncl, n, csz;
+
+    *nfrag = 0;
+    res = validate(&fp->obj, &fs); /* Check validity of the file object */
+    if (res != FR_OK)
+        LEAVE_FF(fs, res);
+
+    if (fp->obj.sclust == 0) /* No clusters allocated */
+        LEAVE_FF(fs, FR_OK);
+    *nfrag = 1;
+    if (fs->fs_type == FS_EXFAT && fp->obj.stat == 2) /* Known to be a contiguous chain */
+        LEAVE_FF(fs, FR_OK);
+
+    csz = (uint32_t)fs->csize * SS(fs); /* Cluster size */
+    ncl = (uint32_t)(fp->obj.objsize / csz) +
+          ((fp->obj.objsize & (csz - 1)) ? 1 : 0); /* Number of clusters */
+    clst = fp->obj.sclust;
+    for (; ncl > 1; ncl--) { /* Follow the chain */
+        n = get_fat(&fp->obj, clst);
+        if (n == 0xFFFFFFFF)
+            LEAVE_FF(fs, FR_DISK_ERR);
+        if (n < 2)
+            LEAVE_FF(fs, FR_INT_ERR);
+        if (n != clst + 1)
+            (*nfrag)++; /* Next fragment */
+        clst = n;
+    }
+    LEAVE_FF(fs, FR_OK);
+}
+
+/*-----------------------------------------------------------------------*/
+/* Check whether the File Occupies Contiguous Clusters                   */
+/*-----------------------------------------------------------------------*/
+
+fs_result_t f_contiguous(file_t *fp,      /* Pointer to the open file object */
+                         int *contiguous) /* Result: 1 when contiguous */
+{
+    unsigned nfrag;
+    fs_result_t res = f_fragments(fp, &nfrag);
+
+    *contiguous = (res == FR_OK && nfrag <= 1);
+    return res;
+}
+
+/*-----------------------------------------------------------------------*/
+/* Get Fragmentation of Free Space                                       */
+/*-----------------------------------------------------------------------*/
+
+fs_result_t f_freeruns(const char *path,   /* Logical drive number */
+                       uint32_t *nruns,    /* Result: number of free cluster runs */
+                       uint32_t *largest)  /* Result: size of the largest run in clusters */
+{
+    fs_result_t res;
+    filesystem_t *fs;
+    obj_id_t obj;
+    uint32_t clst, n, run;
+
+    *nruns = 0;
+    *largest = 0;
+    res = mount_volume(&path, &fs, 0); /* Get logical drive */
+    if (res != FR_OK)
+        LEAVE_FF(fs, res);
+    if (fs->fs_type == FS_EXFAT)
+        LEAVE_FF(fs, FR_DENIED); /* Free space is kept in the bitmap */
+
+    obj.fs = fs;
+    run = 0;
+    for (clst = 2; clst < fs->n_fatent; clst++) { /* Scan the FAT */
+        n = get_fat(&obj, clst);
+        if (n == 0xFFFFFFFF)
+            LEAVE_FF(fs, FR_DISK_ERR);
+        if (n == 1)
+            LEAVE_FF(fs, FR_INT_ERR);
+        if (n == 0) { /* Free cluster */
+            if (run++ == 0)
+                (*nruns)++;
+            if (run > *largest)
+                *largest = run;
+        } else {
+            run = 0;
+        }
+    }
+    LEAVE_FF(fs, FR_OK);
+}
+
+#if !FF_FS_READONLY
+/*-----------------------------------------------------------------------*/
+/* Move the File into a Contiguous Block Nearer the Volume Start         */
+/*-----------------------------------------------------------------------*/
+/* The lowest free block which can hold the whole chain is chosen. The
+   file is moved only when it gets contiguous, or lands below its current
+   place. The steps are ordered to survive a power loss at any point:
+   data are copied into free clusters, the new chain is written to the FAT,
+   then a single write of the directory entry switches the file over, and
+   only then the old chain is released. An interruption leaves at most
+   a chain of lost clusters, never a damaged file. */
+
+fs_result_t f_relocate(file_t *fp,       /* Pointer to the file opened for writing */
+                       void *buf,        /* Buffer for data transfer */
+                       unsigned bufsize, /* Size of buffer, at least one sector */
+                       int *moved)       /* Result: 1 when the file has been moved */
+{
+    fs_result_t res;
+    filesystem_t *fs;
+    uint32_t clst, n, ncl, tcl, nfrag, scl, run, ocl;
+    fs_lba_t src, dst;
+    unsigned cnt, nsect, bsect;
+
+    *moved = 0;
+    res = validate(&fp->obj, &fs); /* Check validity of the file object */
+    if (res != FR_OK || (res = (fs_result_t)fp->err) != FR_OK)
+        LEAVE_FF(fs, res);
+    if (!(fp->flag & FA_WRITE) || (fp->flag & FA_MODIFIED) || fs->fs_type == FS_EXFAT)
+        LEAVE_FF(fs, FR_DENIED); /* Needs exclusive access and no pending changes */
+    bsect = bufsize / SS(fs);
+    if (bsect == 0)
+        LEAVE_FF(fs, FR_INVALID_PARAMETER);
+    ocl = fp->obj.sclust;
+    if (ocl == 0)
+        LEAVE_FF(fs, FR_OK); /* Nothing to move */
+
+    /* Measure the chain */
+    tcl = 1;
+    nfrag = 1;
+    for (clst = ocl;; clst = n, tcl++) {
+        n = get_fat(&fp->obj, clst);
+        if (n == 0xFFFFFFFF)
+            LEAVE_FF(fs, FR_DISK_ERR);
+        if (n < 2 || tcl >= fs->n_fatent)
+            LEAVE_FF(fs, FR_INT_ERR); /* Broken or looped chain */
+        if (n >= fs->n_fatent)
+            break; /* End of chain */
+        if (n != clst + 1)
+            nfrag++;
+    }
+
+    /* Find the lowest free block of tcl clusters. A contiguous file
+       is only worth moving into a block located before it. */
+    scl = 0;
+    run = 0;
+    for (clst = 2; clst < fs->n_fatent; clst++) {
+        if (nfrag == 1 && clst >= ocl)
+            break;
+        n = get_fat(&fp->obj, clst);
+        if (n == 0xFFFFFFFF)
+            LEAVE_FF(fs, FR_DISK_ERR);
+        if (n == 1)
+            LEAVE_FF(fs, FR_INT_ERR);
+        if (n != 0) {
+            run = 0;
+            continue;
+        }
+        if (++run == tcl) {
+            scl = clst - tcl + 1;
+            break;
+        }
+    }
+    if (scl == 0)
+        LEAVE_FF(fs, FR_OK); /* No better place */
+
+    /* Copy data, one source fragment at a time, so that every
+       transfer is a single multi-sector write to the device */
+    dst = clst2sect(fs, scl);
+    clst = ocl;
+    while (clst < fs->n_fatent) {
+        src = clst2sect(fs, clst);
+        for (ncl = 1;; ncl++) { /* Length of the fragment */
+            n = get_fat(&fp->obj, clst);
+            if (n == 0xFFFFFFFF)
+                LEAVE_FF(fs, FR_DISK_ERR);
+            if (n != clst + 1)
+                break;
+            clst = n;
+        }
+        for (nsect = ncl * fs->csize; nsect > 0; nsect -= cnt) {
+            cnt = (nsect < bsect) ? nsect : bsect;
+            if (disk_read(fs->pdrv, buf, src, cnt) != DISK_OK ||
+                disk_write(fs->pdrv, buf, dst, cnt) != DISK_OK)
+                LEAVE_FF(fs, FR_DISK_ERR);
+            src += cnt;
+            dst += cnt;
+        }
+        clst = n; /* Next fragment */
+    }
+
+    /* Create the new chain on the FAT */
+    for (clst = scl, n = tcl; n; clst++, n--) {
+        res = put_fat(fs, clst, (n == 1) ? 0xFFFFFFFF : clst + 1);
+        if (res != FR_OK)
+            LEAVE_FF(fs, res);
+    }
+    res = sync_fs(fs);
+    if (res != FR_OK)
+        LEAVE_FF(fs, res);
+
+    /* Switch the directory entry to the new chain */
+    res = move_window(fs, fp->dir_sect);
+    if (res != FR_OK)
+        LEAVE_FF(fs, res);
+    st_clust(fs, fp->dir_ptr, scl);
+    fs->wflag = 1;
+    res = sync_fs(fs);
+    if (res != FR_OK)
+        LEAVE_FF(fs, res);
+    fp->obj.sclust = scl;
+    fp->obj.stat = 2;
+    fp->fptr = 0; /* Rewind, as cached positions refer to the old chain */
+    fp->clust = 0;
+    fp->sect = 0;
+#if FF_USE_FASTSEEK
+    fp->cltbl = 0;
+#endif
+    *moved = 1;
+
+    /* Release the old chain: free count is unchanged in total */
+    if (fs->free_clst <= fs->n_fatent - 2)
+        fs->free_clst -= tcl;
+    res = remove_chain(&fp->obj, ocl, 0);
+    if (res == FR_OK)
+        res = sync_fs(fs);
+    LEAVE_FF(fs, res);
+}
+#endif /* !FF_FS_READONLY */
+
 #if FF_USE_FORWARD
 /*-----------------------------------------------------------------------*/
 /* Forward Data to the Stream Directly                                   */
@@ -6779,3 +7355,11 @@ int f_error(file_t *fp)
 {
     return fp->err;
 }
+
+//
+// Get size of the cluster of the volume where the file resides, in bytes.
+//
+unsigned f_cluster_size(file_t *fp)
+{
+    return (unsigned)fp->obj.fs->csize * SS(fp->obj.fs);
+}
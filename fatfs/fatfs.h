@@ -131,6 +131,7 @@ struct _directory_t {
     uint8_t *dir;   /* Pointer to the directory item in the win[] */
     uint8_t fn[12]; /* SFN (in/out) {body[8],ext[3],status[1]} */
     uint32_t blk_ofs; /* Offset of current entry block being processed (0xFFFFFFFF:Invalid) */
+    uint32_t rd_ofs;  /* Offset of the entry last read by f_readdir() (0xFFFFFFFF:None) */
 #if FF_USE_FIND
     const char *pat; /* Pointer to the name matching pattern */
 #endif
@@ -167,7 +167,7 @@
 /      can be opened simultaneously under file lock control. Note that the file
 /      lock control is independent of re-entrancy. */
 
-#define FF_FS_REENTRANT 0
+#define FF_FS_REENTRANT 1
 #define FF_FS_TIMEOUT 1000
 /* The option FF_FS_REENTRANT switches the re-entrancy (thread safe) of the FatFs
 /  module itself. Note that regardless of this option, file access to different
@@ -180,7 +180,11 @@
 /      ff_mutex_create(), ff_mutex_delete(), ff_mutex_take() and ff_mutex_give()
 /      function, must be added to the project. Samples are available in ffsystem.c.
 /
-/  The FF_FS_TIMEOUT defines timeout period in unit of O/S time tick.
+/  The FF_FS_TIMEOUT defines timeout period in milliseconds.
+/  In FP/M the synchronization functions are implemented in ffsystem.c:
+/  Pico SDK mutex_t on RP2040 (safe for both cores), pthreads on Unix.
+/  Note that FF_USE_LFN must not be 1: LFN working buffers are allocated
+/  per call, on the stack of the calling thread.
 */
 
 /*--- End of configuration options ---*/
@@ -0,0 +1,101 @@
+//
+// OS dependent functions for FatFs: synchronization objects.
+//
+// Every logical drive has its own mutex, so an operation on flash:
+// does not block an operation on sd:. One extra mutex with index
+// DISK_VOLUMES protects the table of open objects (FF_FS_LOCK).
+//
+// On RP2040 the mutexes are implemented with Pico SDK mutex_t,
+// which is safe to use from both cores. On Unix - with pthreads.
+//
+#include "fatfs.h"
+#include <fpm/diskio.h>
+
+#if FF_FS_REENTRANT
+
+#if LIB_PICO_SYNC
+#include "pico/mutex.h"
+
+static mutex_t volume_mutex[DISK_VOLUMES + 1];
+
+//
+// Create a sync object for the volume.
+// Return 1 on success, 0 on failure.
+//
+// All mutexes are initialized at once on first mount, as volumes
+// which have not been mounted yet share the lock of volume 0.
+// Mutexes initialized by previous mount are kept as is.
+//
+int ff_mutex_create(int vol)
+{
+    for (int i = 0; i <= DISK_VOLUMES; i++) {
+        if (!mutex_is_initialized(&volume_mutex[i])) {
+            mutex_init(&volume_mutex[i]);
+        }
+    }
+    return 1;
+}
+
+//
+// Lock the volume.
+// Return 1 on success, 0 on timeout.
+//
+int ff_mutex_take(int vol)
+{
+    return mutex_enter_timeout_ms(&volume_mutex[vol], FF_FS_TIMEOUT);
+}
+
+//
+// Unlock the volume.
+//
+void ff_mutex_give(int vol)
+{
+    mutex_exit(&volume_mutex[vol]);
+}
+
+#else // Unix
+#include <pthread.h>
+
+static pthread_mutex_t volume_mutex[DISK_VOLUMES + 1] = {
+    [0 ... DISK_VOLUMES] = PTHREAD_MUTEX_INITIALIZER,
+};
+
+//
+// Create a sync object for the volume.
+// Mutexes are initialized statically.
+//
+int ff_mutex_create(int vol)
+{
+    return 1;
+}
+
+//
+// Lock the volume.
+// Note: pthread_mutex_timedlock() is not available on MacOS,
+// so wait without timeout.
+//
+int ff_mutex_take(int vol)
+{
+    return pthread_mutex_lock(&volume_mutex[vol]) == 0;
+}
+
+//
+// Unlock the volume.
+//
+void ff_mutex_give(int vol)
+{
+    pthread_mutex_unlock(&volume_mutex[vol]);
+}
+
+#endif // LIB_PICO_SYNC
+
+//
+// Delete a sync object.
+// The mutex is kept alive: another core or thread may still wait on it,
+// and it will be reused on next mount of the volume.
+//
+void ff_mutex_delete(int vol)
+{
+}
+
+#endif // FF_FS_REENTRANT
@@ -31,9 +31,34 @@ extern "C" {
 #define FPM_DELETE_KEY          0x2421  // ␡
 
 //
-// Last command line.
+// Command history: a ring of recent lines, stored as UTF-8.
+// Size of the ring in bytes must be a power of two.
 //
-extern uint16_t fpm_history[FPM_CMDLINE_SIZE];
+#define FPM_HISTORY_SIZE        2048
+
+typedef struct {
+    char data[FPM_HISTORY_SIZE];    // Lines terminated by NUL, oldest first
+    unsigned start;                 // Offset of the oldest line
+    unsigned end;                   // Offset past the newest line
+} fpm_history_t;
+
+extern fpm_history_t fpm_history;   // History of the shell
+
+void fpm_history_clear(fpm_history_t *history);
+void fpm_history_add(fpm_history_t *history, const uint16_t *line);
+void fpm_history_add_utf8(fpm_history_t *history, const char *line);
+
+//
+// Get line from history by index, 0 for the newest.
+// Return false when there is no such line.
+//
+bool fpm_history_get(fpm_history_t *history, unsigned index, uint16_t *line, unsigned line_size);
+
+//
+// Find the newest line containing the pattern, starting from given index.
+// Return index of the line, or -1 when not found.
+//
+int fpm_history_search(fpm_history_t *history, unsigned index, const uint16_t *pattern);
 
 //
 // Output to the console (USB or Uart).
@@ -42,6 +67,17 @@ void fpm_putwch(uint16_t);
 void fpm_putchar(char);
 void fpm_puts(const char *);
 
+//
+// Write a block of bytes to the console, without conversion.
+//
+void fpm_write(const char *, unsigned);
+
+//
+// Console output is buffered: send pending data to the console now.
+// Called implicitly before waiting for input.
+//
+void fpm_flush(void);
+
 int fpm_printf(const char *, ...);
 int fpm_snprintf(char *, size_t, const char *, ...);
 int fpm_vprintf(const char *, va_list);
@@ -70,6 +106,23 @@ uint16_t fpm_getwch(void);
 //
 char fpm_getchar(void);
 
+//
+// Wait for a keycode character, up to given number of milliseconds;
+// negative timeout means wait forever.
+// Returns:
+// - ASCII keycode, or -1 on timeout
+//
+int fpm_getchar_timeout(int);
+
+//
+// Read up to len bytes from the console, without decoding.
+// Wait for the first byte up to given number of milliseconds;
+// negative timeout means wait forever.
+// Returns:
+// - number of bytes received, or 0 on timeout
+//
+int fpm_read(char *, unsigned, int);
+
 //
 // Write the Unicode string to the console.
 //
@@ -81,11 +134,13 @@ void fpm_wputs(const uint16_t *);
 // - buffer: Pointer to the line edit buffer
 // - buffer_length: Size of the buffer in bytes
 // - clear: Set to false to not clear, true to clear on entry
+// - prompt: Print before input
+// - history: Lines for arrows up/down and ^R search, or NULL
 // Returns:
 // - The exit key pressed (ESC or CR)
 //
 int fpm_editline(uint16_t *buffer, unsigned buffer_length, bool clear,
-                 const char *prompt, uint16_t *history);
+                 const char *prompt, fpm_history_t *history);
 
 //
 // Parse a command line and split it into tokens (in place).
@@ -123,6 +178,15 @@ bool fpm_strtol(long *output, const char *str, char **endptr, int base);
 bool fpm_strtoul(unsigned long *output, const char *str, char **endptr, int base);
 bool fpm_strtod(double *output, const char *str, char **endptr);
 
+//
+// Compute checksum of a block of data.
+// To continue over several blocks, pass previous result; start with 0.
+// - fpm_crc32: CRC-32 as in ZMODEM and zlib (reflected polynomial 0xedb88320)
+// - fpm_crc16: CRC-16-CCITT as in XMODEM and SD cards (polynomial 0x1021)
+//
+uint32_t fpm_crc32(uint32_t crc, const void *buf, unsigned len);
+uint16_t fpm_crc16(uint16_t crc, const void *buf, unsigned len);
+
 //
 // Print FP/M version.
 //
@@ -176,6 +240,28 @@ size_t fpm_sizeof(void *ptr);
 size_t fpm_heap_available(void);
 size_t fpm_stack_available(void);
 
+//
+// Background jobs.
+// Jobs are executed by the second core on RP2040, or by a worker thread on Unix.
+// Submit jobs only from the foreground program, and poll for completion.
+// The job routine must not use the console or allocate memory.
+//
+enum {
+    FPM_JOB_IDLE = 0,   // Not submitted yet
+    FPM_JOB_QUEUED = 1, // Waiting in queue or running
+    FPM_JOB_DONE = 2,   // Completed
+};
+typedef struct _fpm_job_t {
+    void (*func)(struct _fpm_job_t *job); // Routine to execute in background
+    void *arg;                            // Argument for the routine
+    int result;                           // Result, set by the routine
+    unsigned state;                       // State of the job, FPM_JOB_*
+} fpm_job_t;
+
+void fpm_job_submit(fpm_job_t *job);
+bool fpm_job_done(fpm_job_t *job);
+int fpm_job_wait(fpm_job_t *job);
+
 //
 // Forbid standard routines.
 //
@@ -8,6 +8,8 @@
     // Kernel routines.
     FPM_BIND(fpm_alloc),
     FPM_BIND(fpm_alloc_dirty),
+    FPM_BIND(fpm_crc16),
+    FPM_BIND(fpm_crc32),
     FPM_BIND(fpm_delay_msec),
     FPM_BIND(fpm_delay_usec),
     FPM_BIND(fpm_editline),
@@ -16,15 +18,25 @@
     FPM_BIND(fpm_get_datetime),
     FPM_BIND(fpm_get_dotw),
     FPM_BIND(fpm_getchar),
+    FPM_BIND(fpm_getchar_timeout),
     FPM_BIND(fpm_getkey),
     FPM_BIND(fpm_getopt),
     FPM_BIND(fpm_getwch),
     FPM_BIND(fpm_heap_available),
+    FPM_BIND(fpm_history_add),
+    FPM_BIND(fpm_history_add_utf8),
+    FPM_BIND(fpm_history_clear),
+    FPM_BIND(fpm_history_get),
+    FPM_BIND(fpm_history_search),
+    FPM_BIND(fpm_job_done),
+    FPM_BIND(fpm_job_submit),
+    FPM_BIND(fpm_job_wait),
     FPM_BIND(fpm_print_version),
     FPM_BIND(fpm_printf),
     FPM_BIND(fpm_putchar),
     FPM_BIND(fpm_puts),
     FPM_BIND(fpm_putwch),
+    FPM_BIND(fpm_read),
     FPM_BIND(fpm_realloc),
     FPM_BIND(fpm_reboot),
     FPM_BIND(fpm_set_datetime),
@@ -49,6 +61,8 @@
     FPM_BIND(fpm_vsnprintf),
     FPM_BIND(fpm_vsscanf),
     FPM_BIND(fpm_wputs),
+    FPM_BIND(fpm_write),
+    FPM_BIND(fpm_flush),
 
     // FIlesystem routines.
     FPM_BIND(f_chdir),
@@ -96,6 +110,7 @@
     // Standard C library.
     FPM_BIND(atof),
     FPM_BIND(memcmp),
+    FPM_BIND(memcpy),
     FPM_BIND(memmove),
     FPM_BIND(memset),
     FPM_BIND(stpcpy),
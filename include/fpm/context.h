@@ -8,6 +8,11 @@
 extern "C" {
 #endif
 
+//
+// Max number of shared libraries per program.
+//
+#define FPM_MAX_NEEDED 4
+
 //
 // Context of the current program being running.
 //
@@ -26,10 +31,19 @@ typedef struct _fpm_context_t {
     unsigned num_links;      // Number of linked procedures
     const void *rel_section; // Header of .rela.plt section
     int exit_code;           // Return value of invoked object
+    bool bind_now;           // Resolve all symbols before invoking, not on first call
+
+    // Shared libraries needed by the program.
+    struct _fpm_library_t *libs[FPM_MAX_NEEDED];
+    unsigned num_libs;
+
+    // Identity of the mapped file, to detect changes.
+    size_t file_size;    // Size of file in bytes
+    uint32_t file_start; // First block on disk, or inode number on Unix
+    uint32_t file_time;  // Date and time of last modification
 
     // For Unix only.
     int fd;           // File descriptor
-    size_t file_size; // Size of file in bytes
 } fpm_context_t;
 
 #ifdef __cplusplus
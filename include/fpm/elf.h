@@ -116,6 +116,12 @@
 #define ELFOSABI_ARM        97
 #define ELFOSABI_STANDALONE 255
 
+/*
+ * FP/M: ABI version of binaries processed by elfexe,
+ * where PLT stubs pass index of the GOT slot for lazy binding.
+ */
+#define FPM_ABIVERSION_LAZY 1
+
 /* OS ABI Aliases. */
 
 #define ELFOSABI_LINUX ELFOSABI_GNU
@@ -450,6 +456,13 @@ typedef struct {
     } d_un;
 } Elf64_Dyn;
 
+/*
+ * Dynamic section tags.
+ */
+
+#define DT_NULL   0 /* Marks end of dynamic section. */
+#define DT_NEEDED 1 /* String table offset of a needed library. */
+
 /*
  * The executable header (EHDR).
  */
@@ -680,6 +693,19 @@ typedef struct {
 #define ELF32_ST_VISIBILITY(O) ((O) & 0x3)
 #define ELF64_ST_VISIBILITY(O) ((O) & 0x3)
 
+/* Symbol binding. */
+#define STB_LOCAL  0
+#define STB_GLOBAL 1
+#define STB_WEAK   2
+
+/* Symbol type. */
+#define STT_NOTYPE 0
+#define STT_OBJECT 1
+#define STT_FUNC   2
+
+/* Undefined section index. */
+#define SHN_UNDEF  0
+
 /*
  * Syminfo descriptors, containing additional symbol information.
  */
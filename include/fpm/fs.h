@@ -145,6 +145,16 @@ fs_result_t f_forward(file_t *fp, unsigned (*func)(const uint8_t *, unsigned),
 // Allocate a contiguous block to the file.
 fs_result_t f_expand(file_t *fp, fs_size_t fsz, uint8_t opt);
 
+// Check whether the file occupies a contiguous block.
+fs_result_t f_contiguous(file_t *fp, int *contiguous);
+
+// Count contiguous fragments of the file.
+fs_result_t f_fragments(file_t *fp, unsigned *nfrag);
+
+// Move the file into the lowest free block which can hold it contiguously.
+// The file must be open for writing, with no pending changes.
+fs_result_t f_relocate(file_t *fp, void *buf, unsigned bufsize, int *moved);
+
 // Get a string from the file.
 char *f_gets(char *buff, int len, file_t *fp);
 
@@ -169,6 +179,9 @@ int f_eof(file_t *fp);
 // Return nonzero if the error indicator is set.
 int f_error(file_t *fp);
 
+// Get cluster size of the volume where the file resides, in bytes.
+unsigned f_cluster_size(file_t *fp);
+
 // Set the file position to the beginning of the file.
 #define f_rewind(fp) f_lseek((fp), 0)
 
@@ -193,6 +206,9 @@ fs_result_t f_findfirst(directory_t *dp, file_info_t *fno, const char *path, con
 // Find next file.
 fs_result_t f_findnext(directory_t *dp, file_info_t *fno);
 
+// Open a sub-directory, last read from the open directory.
+fs_result_t f_opendirat(directory_t *dp, directory_t *parent);
+
 // Reset the position of the directory to the beginning of the directory.
 #define f_rewinddir(dp) f_readdir((dp), 0)
 
@@ -206,6 +222,22 @@ fs_result_t f_stat(const char *path, file_info_t *fno);
 // Delete an existing file or directory.
 fs_result_t f_unlink(const char *path);
 
+//
+// Cluster chains of deleted entries, to be freed in one pass.
+//
+#define FS_CHAINS_MAX 64
+typedef struct {
+    unsigned count;                // Number of pending chains
+    uint32_t start[FS_CHAINS_MAX]; // First cluster of every chain
+} fs_chains_t;
+
+// Delete the file or empty directory, last read from the open directory.
+// When chains are given, clusters are released later by f_freechains().
+fs_result_t f_unlinkat(directory_t *dp, fs_chains_t *chains);
+
+// Release pending cluster chains of deleted entries.
+fs_result_t f_freechains(directory_t *dp, fs_chains_t *chains);
+
 // Rename/Move a file or directory.
 fs_result_t f_rename(const char *path_old, const char *path_new);
 
@@ -246,6 +278,26 @@ fs_result_t f_unmount(const char *path);
 // Get filesystem status.
 fs_result_t f_statfs(const char *path, fs_info_t *fsinfo);
 
+// Get number of free block runs and size of the largest one.
+fs_result_t f_freeruns(const char *path, uint32_t *nruns, uint32_t *largest);
+
+// Get counter of directory changes on all volumes, to validate cached listings.
+uint32_t f_dirchanges(void);
+
+// Identity of a directory: volume mount ID and first cluster.
+typedef struct {
+    uint16_t fsid;
+    uint32_t sclust;
+} fs_dirid_t;
+
+// Get identity of the open directory.
+void f_dirid(const directory_t *dp, fs_dirid_t *id);
+
+// Has the directory changed since f_dirchanges() returned given count?
+// Creating, renaming or removing any directory, or a mount, counts as a change
+// of every directory. Without identity, only such changes are reported.
+int f_dirchanged(const fs_dirid_t *id, uint32_t since);
+
 // Get volume label.
 fs_result_t f_getlabel(const char *path, char *label, uint32_t *vsn);
 
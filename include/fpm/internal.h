@@ -2,6 +2,8 @@
 #define FPM_INTERNAL_H
 
 #include <setjmp.h>
+#include <string.h>
+#include <strings.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -16,10 +18,19 @@ extern jmp_buf fpm_saved_point;
 
 //
 // Context of the current program being running.
+// Every core has its own chain of contexts: core 0 runs the shell
+// and foreground programs, core 1 runs background jobs and programs.
 //
 struct _fpm_context_t;
 typedef struct _fpm_context_t fpm_context_t;
-extern volatile fpm_context_t *fpm_context;
+#define FPM_NUM_CORES 2
+extern volatile fpm_context_t *fpm_core_context[FPM_NUM_CORES];
+#define fpm_context fpm_core_context[fpm_core_num()]
+
+//
+// Get number of the current core: 0 for foreground, 1 for background.
+//
+unsigned fpm_core_num(void);
 
 //
 // Initialize region of memory for dynamic allocation.
@@ -33,6 +44,146 @@ void fpm_heap_print_free_list(void);
 bool fpm_context_push(fpm_context_t *ctx);
 void fpm_context_pop(void);
 
+//
+// Background worker for jobs.
+//
+void fpm_jobs_start(void);
+bool fpm_jobs_process(void);
+void fpm_job_submit_program(struct _fpm_job_t *job);
+
+//
+// Internal platform-dependent helpers for background jobs.
+//
+bool fpm_jobs_active_arch(void);
+void fpm_jobs_wakeup_arch(void);
+void fpm_jobs_idle_arch(void);
+
+//
+// Execute external program in background, on core 1.
+//
+void fpm_exec_background(int argc, char *argv[]);
+const char *fpm_find_exe(const char *cmdname, char *buf, unsigned buf_size);
+
+//
+// Build index of commands in PATH directories, after volumes are mounted.
+//
+void fpm_path_index(void);
+
+//
+// Control of background program.
+//
+bool fpm_background_start(const char *path, int argc, char *argv[]);
+bool fpm_background_running(void);
+void fpm_background_status(void);
+void fpm_background_poll(void);
+int fpm_background_wait(void);
+
+//
+// Separate console stream for background program.
+//
+bool fpm_background_write(const char *buf, unsigned len);
+
+//
+// Platform-dependent unbuffered console output.
+//
+void fpm_write_arch(const char *buf, unsigned len);
+
+//
+// Flush stale console output, called by platform timer on core 0.
+//
+void fpm_flush_idle(void);
+
+//
+// Platform-dependent checksum of a block in hardware.
+// Update the CRC register and return true, or return false to compute
+// in software. CRC-32 register is passed without final inversion.
+//
+bool fpm_crc32_arch(uint32_t *crc, const void *buf, unsigned len);
+bool fpm_crc16_arch(uint16_t *crc, const void *buf, unsigned len);
+
+//
+// SHA-256 hash of data in pieces.
+//
+typedef struct {
+    uint32_t state[8];  // Intermediate hash
+    uint64_t count;     // Bytes hashed so far
+    uint8_t block[64];  // Pending partial block
+} fpm_sha256_t;
+
+void fpm_sha256_init(fpm_sha256_t *ctx);
+void fpm_sha256_update(fpm_sha256_t *ctx, const void *data, unsigned len);
+void fpm_sha256_final(fpm_sha256_t *ctx, uint8_t digest[32]);
+
+//
+// Split command line into arguments, and mark arguments with wildcards
+// and redirections. Expand wildcards into names of matching files.
+//
+#define FPM_ARG_WILD     1 // Argument has wildcards
+#define FPM_ARG_REDIRECT 2 // Operator <, >, >> or |
+const char *fpm_tokenize_shell(char *argv[], int *argc, char *cmd_line, uint8_t flags[]);
+char **fpm_glob(int *argc, char *argv[], const uint8_t flags[], const char **error);
+
+//
+// Exit code of the last command.
+//
+extern int fpm_exit_code;
+
+//
+// Environment variables.
+//
+const char *fpm_getenv(const char *name);
+bool fpm_setenv(const char *name, const char *value);
+const char *fpm_nextenv(const char *prev);
+
+//
+// Execute command line with pipes and redirections.
+// Console input and output of redirected command: return -1 or false
+// when not redirected. Close files and remove pipes after ^C.
+//
+void fpm_exec_line(int argc, char *argv[], uint8_t flags[]);
+int fpm_redirect_read(char *buf, unsigned len);
+bool fpm_redirect_write(const char *buf, unsigned len);
+void fpm_redirect_reset(void);
+
+//
+// Run batch script with given arguments.
+// Forget running scripts and the cache after ^C.
+//
+void fpm_script_run(const char *path, int argc, char *argv[]);
+void fpm_script_reset(void);
+
+//
+// Write pending lines of command history to the file, before reboot.
+//
+void fpm_history_save(void);
+
+//
+// Allocate a large block for temporary use: a half of the free heap.
+// Free space may be fragmented, so the size is reduced until it fits.
+// Return NULL when less than min_size bytes are available.
+//
+void *fpm_alloc_arena(unsigned min_size, unsigned *size);
+
+//
+// Heap sort of an array, in place. Compare function returns negative value
+// when element a goes before element b. The heap keeps the last element at the root.
+//
+typedef int (*fpm_compare_t)(void *arg, const void *a, const void *b);
+void fpm_heap_sort(void *base, unsigned count, unsigned size, fpm_compare_t compare, void *arg);
+void fpm_sift_down(void *base, unsigned size, unsigned root, unsigned count,
+                   fpm_compare_t compare, void *arg);
+
+//
+// Does the file name end with given extension, like ".exe"?
+// Case is ignored.
+//
+static inline bool fpm_has_extension(const char *name, const char *ext)
+{
+    size_t len = strlen(name);
+    size_t ext_len = strlen(ext);
+    return len >= ext_len && strcasecmp(name + len - ext_len, ext) == 0;
+}
+
 //
 // Shell commands.
 //
@@ -41,11 +192,13 @@ void fpm_cmd_cd(int argc, char *argv[]);
 void fpm_cmd_clear(int argc, char *argv[]);
 void fpm_cmd_copy(int argc, char *argv[]);
 void fpm_cmd_date(int argc, char *argv[]);
+void fpm_cmd_defrag(int argc, char *argv[]);
 void fpm_cmd_dir(int argc, char *argv[]);
 void fpm_cmd_echo(int argc, char *argv[]);
 void fpm_cmd_eject(int argc, char *argv[]);
 void fpm_cmd_format(int argc, char *argv[]);
 void fpm_cmd_help(int argc, char *argv[]);
+void fpm_cmd_jobs(int argc, char *argv[]);
 void fpm_cmd_mkdir(int argc, char *argv[]);
 void fpm_cmd_mount(int argc, char *argv[]);
 void fpm_cmd_pwd(int argc, char *argv[]);
@@ -53,9 +206,13 @@ void fpm_cmd_reboot(int argc, char *argv[]);
 void fpm_cmd_remove(int argc, char *argv[]);
 void fpm_cmd_rename(int argc, char *argv[]);
 void fpm_cmd_rmdir(int argc, char *argv[]);
+void fpm_cmd_set(int argc, char *argv[]);
+void fpm_cmd_start(int argc, char *argv[]);
+void fpm_cmd_sum(int argc, char *argv[]);
 void fpm_cmd_time(int argc, char *argv[]);
 void fpm_cmd_ver(int argc, char *argv[]);
 void fpm_cmd_vol(int argc, char *argv[]);
+void fpm_cmd_wait(int argc, char *argv[]);
 
 #ifdef __cplusplus
 }
@@ -42,6 +42,7 @@ void fpm_unload(fpm_context_t *ctx);
 //
 bool fpm_load_arch(fpm_context_t *ctx, const char *filename);
 void fpm_unload_arch(fpm_context_t *ctx);
+bool fpm_stat_arch(fpm_context_t *ctx, const char *filename);
 
 //
 // Get names of linked procedures.
@@ -5,6 +5,7 @@
 #include <fpm/fs.h>
 #include <fpm/getopt.h>
 #include <fpm/internal.h>
+#include <stddef.h>
 #include <stdlib.h>
 
 //
@@ -17,49 +18,143 @@ typedef struct {
 } options_t;
 
 //
-// Copy one file.
+// Statistics of recursive copy.
+//
+typedef struct {
+    unsigned nfiles;  // Number of files copied
+    uint64_t nbytes;  // Number of bytes copied
+} stats_t;
+
+//
+// Item of the work list: file to copy, or directory to update.
+// Path is relative to the source and destination roots.
+//
+typedef struct {
+    uint16_t fdate; // Modification date of the source
+    uint16_t ftime; // Modification time of the source
+    uint8_t is_dir; // Directory: only update the timestamp
+    uint8_t done;   // File copied successfully
+    char path[1];   // Relative path, dynamically allocated, zero terminated
+} work_item_t;
+
+//
+// Level of the directory tree being walked.
+// Followed by directory object of size f_sizeof_directory_t().
+//
+typedef struct {
+    unsigned path_len; // Length of relative path of this directory
+    uint16_t fdate;    // Modification date of the source directory
+    uint16_t ftime;    // Modification time of the source directory
+} level_t;
+
+//
+// State of recursive copy.
+// The tree is walked without recursion: open directories are kept
+// on an explicit stack in the heap. Files found are collected into
+// a work list, which is processed when full: data of all files
+// is copied first, and then timestamps of all directory entries
+// are updated in one sweep.
+//
+typedef struct {
+    const char *source;      // Root of the source tree
+    const char *destination; // Root of the destination tree
+    const options_t *options;
+
+    char *stack;             // Stack of open directories
+    unsigned level_size;     // Size of one level on the stack
+    unsigned depth;          // Number of open directories
+    unsigned max_depth;      // Allocated number of levels
+
+    char *path;              // Relative path of the current entry
+    unsigned path_size;      // Allocated size of the path
+    char *from;              // Full path of the source
+    char *to;                // Full path of the destination
+    unsigned full_size;      // Allocated size of full paths
+
+    char *work;              // Work list
+    unsigned work_len;       // Bytes used in the work list
+
+    stats_t stats;
+} copy_t;
+
+//
+// Size of the work list, bytes.
+//
+#define WORK_LIST_SIZE 4096
+
+//
+// Size of a work item with path of given length.
 //
-static void copy_file(const char *source, const char *destination, const options_t *options)
+static inline unsigned work_item_size(unsigned path_len)
 {
-    fs_result_t result;
+    return (offsetof(work_item_t, path) + path_len + 1 + 3) & ~3;
+}
 
-    // If file exists, ask user if it should be replaced.
-    if (!options->force) {
-        file_info_t info;
-        result = f_stat(destination, &info);
-        if (result == FR_OK) {
-            char prompt[32 + strlen(destination)];
-            uint16_t reply[32];
-            fpm_snprintf(prompt, sizeof(prompt), "Overwrite %s? y/n [n] ", destination);
-            fpm_editline(reply, sizeof(reply), 1, prompt, 0);
-            fpm_puts("\r\n");
+//
+// Ask user if existing file should be replaced.
+//
+static bool ask_overwrite(const char *destination)
+{
+    char prompt[32 + strlen(destination)];
+    uint16_t reply[32];
+    fpm_snprintf(prompt, sizeof(prompt), "Overwrite %s? y/n [n] ", destination);
+    fpm_editline(reply, sizeof(reply), 1, prompt, 0);
+    fpm_puts("\r\n");
 
-            if (reply[0] != 'y' && reply[0] != 'Y') {
-                fpm_puts("Not overwritten.\r\n");
-                return;
-            }
-        }
+    if (reply[0] != 'y' && reply[0] != 'Y') {
+        fpm_puts("Not overwritten.\r\n");
+        return false;
     }
+    return true;
+}
+
+//
+// Copy one file.
+// Destination is allocated in advance as one contiguous block, when possible.
+// Return false on error.
+//
+static bool copy_file(const char *source, const char *destination, const options_t *options,
+                      stats_t *stats)
+{
+    fs_result_t result;
 
     // Open source file.
     file_t *fsrc = alloca(f_sizeof_file_t());
     result = f_open(fsrc, source, FA_READ);
     if (result != FR_OK) {
         fpm_printf("%s: %s\r\n", source, f_strerror(result));
-        return;
+        return false;
     }
 
     // Open destination file.
+    // If file exists, ask user if it should be replaced.
     file_t *fdest = alloca(f_sizeof_file_t());
-    result = f_open(fdest, destination, FA_WRITE | FA_CREATE_ALWAYS);
+    result = f_open(fdest, destination, FA_WRITE | (options->force ? FA_CREATE_ALWAYS : FA_CREATE_NEW));
+    if (result == FR_EXIST) {
+        if (!ask_overwrite(destination)) {
+            f_close(fsrc);
+            return false;
+        }
+        result = f_open(fdest, destination, FA_WRITE | FA_CREATE_ALWAYS);
+    }
     if (result != FR_OK) {
         fpm_printf("%s: %s\r\n", destination, f_strerror(result));
         f_close(fsrc);
-        return;
+        return false;
+    }
+
+    // Allocate contiguous space for the file.
+    // When not possible, clusters are allocated while writing.
+    fs_size_t size = f_size(fsrc);
+    bool expanded = (size > 0 && f_expand(fdest, size, 1) == FR_OK);
+    if (!expanded && size > 0 && fpm_has_extension(destination, ".exe")) {
+        // Programs are executed in place, and must be contiguous.
+        fpm_printf("%s: No contiguous space, run defrag to make it executable\r\n", destination);
     }
 
     // Copy contents.
     char buf[4096];
+    fs_size_t nbytes = 0;
     for (;;) {
         unsigned nbytes_read = 0;
         result = f_read(fsrc, buf, sizeof(buf), &nbytes_read);
@@ -68,7 +163,10 @@ static void copy_file(const char *source, const char *destination, const options
             fpm_printf("%s: %s\r\n", source, f_strerror(result));
 fatal:      f_close(fsrc);
             f_close(fdest);
-            return;
+
+            // Do not leave incomplete file, nor preallocated space.
+            f_unlink(destination);
+            return false;
         }
         if (nbytes_read == 0) {
             // End of file.
@@ -86,6 +184,11 @@ fatal:      f_close(fsrc);
             fpm_printf("%s: Not enough space on device\r\n", destination);
             goto fatal;
         }
+        nbytes += nbytes_written;
+    }
+    if (expanded && nbytes < size) {
+        // Source became shorter: release the rest.
+        f_truncate(fdest);
     }
 
     // Copied successfully.
@@ -93,72 +196,293 @@ fatal:      f_close(fsrc);
     f_close(fdest);
     if (options->verbose)
         fpm_printf("%s -> %s\r\n", source, destination);
+    if (stats) {
+        stats->nfiles++;
+        stats->nbytes += nbytes;
+    }
+    return true;
 }
 
 //
-// Copy directory recursively.
+// Enlarge memory block, keeping the contents.
+// Unlike fpm_realloc(), the old block is kept when out of memory.
 //
-static void copy_recursive(const char *source, const char *destination, const options_t *options)
+static bool grow(char **ptr, unsigned size)
 {
-    // Allocate from/to paths.
-    unsigned src_len = strlen(source);
-    unsigned dest_len = strlen(destination);
-    char from[src_len + 1 + FF_LFN_BUF + 1];
-    char to[dest_len + 1 + FF_LFN_BUF + 1];
-    char *from_last = from + src_len;
-    char *to_last = to + dest_len;
-    strcpy(from, source);
-    strcpy(to, destination);
-    if (from_last[-1] != '/')
-        *from_last++ = '/';
-    if (to_last[-1] != '/')
-        *to_last++ = '/';
-
-    // Check destination existence and type.
-    file_info_t info;
-    fs_result_t result = f_stat(destination, &info);
+    char *block = fpm_alloc_dirty(size);
+    if (!block) {
+        return false;
+    }
+    if (*ptr) {
+        unsigned old_size = fpm_sizeof(*ptr);
+        memcpy(block, *ptr, old_size < size ? old_size : size);
+        fpm_free(*ptr);
+    }
+    *ptr = block;
+    return true;
+}
+
+//
+// Make sure the path buffers can hold given length of relative path.
+// Return false when out of memory.
+//
+static bool copy_reserve_path(copy_t *c, unsigned path_len)
+{
+    if (path_len + 1 <= c->path_size) {
+        return true;
+    }
+    unsigned path_size = path_len + 1 + FF_LFN_BUF + 1;
+    unsigned full_size = path_size + 1 + strlen(c->source) + strlen(c->destination);
+    if (!grow(&c->path, path_size) || !grow(&c->from, full_size) || !grow(&c->to, full_size)) {
+        return false;
+    }
+    c->path_size = path_size;
+    c->full_size = full_size;
+    return true;
+}
+
+//
+// Build full path from root and relative path.
+//
+static void make_path(char *buf, const char *root, const char *path)
+{
+    strcpy(buf, root);
+    if (*path) {
+        unsigned len = strlen(buf);
+        if (len > 0 && buf[len - 1] != '/') {
+            buf[len++] = '/';
+        }
+        strcpy(buf + len, path);
+    }
+}
+
+//
+// Get directory object at given level of the stack.
+//
+static inline level_t *copy_level(copy_t *c, unsigned index)
+{
+    return (level_t *)(c->stack + index * c->level_size);
+}
+
+static inline directory_t *level_dir(level_t *level)
+{
+    return (directory_t *)(level + 1);
+}
+
+//
+// Open source directory with relative path of given length, and push it on the stack.
+// Return false on error.
+//
+static bool copy_push(copy_t *c, unsigned path_len, const file_info_t *info)
+{
+    if (c->depth == c->max_depth) {
+        // Grow the stack.
+        unsigned max_depth = c->max_depth ? 2 * c->max_depth : 4;
+        if (!grow(&c->stack, max_depth * c->level_size)) {
+            fpm_printf("%s: Out of memory\r\n", c->from);
+            return false;
+        }
+        c->max_depth = max_depth;
+    }
+
+    level_t *level = copy_level(c, c->depth);
+    fs_result_t result = f_opendir(level_dir(level), c->from);
     if (result != FR_OK) {
-        // Create destination directory.
-        result = f_mkdir(destination);
-        if (result != FR_OK) {
-            // Cannot create destination directory.
-            fpm_printf("%s: %s\r\n", destination, f_strerror(result));
-            return;
+        fpm_printf("%s: %s\r\n", c->from, f_strerror(result));
+        return false;
+    }
+    level->path_len = path_len;
+    level->fdate = info->fdate;
+    level->ftime = info->ftime;
+    c->depth++;
+    return true;
+}
+
+//
+// Create destination directory.
+// Return false on error.
+//
+static bool copy_mkdir(copy_t *c)
+{
+    fs_result_t result = f_mkdir(c->to);
+    if (result == FR_EXIST) {
+        // Directory already exists.
+        file_info_t info;
+        result = f_stat(c->to, &info);
+        if (result == FR_INVALID_NAME) {
+            // Cannot stat current directory - fake it.
+            info.fattrib = AM_DIR;
+            result = FR_OK;
         }
-    } else {
-        if (!(info.fattrib & AM_DIR)) {
+        if (result == FR_OK && !(info.fattrib & AM_DIR)) {
             // Destination must be a directory.
-            fpm_printf("%s: Destination is not a directory, cannot copy\r\n", destination);
-            return;
+            fpm_printf("%s: Destination is not a directory, cannot copy\r\n", c->to);
+            return false;
         }
     }
-
-    // Scan the directory.
-    directory_t *dir = alloca(f_sizeof_directory_t());
-    result = f_opendir(dir, source);
     if (result != FR_OK) {
-        fpm_printf("%s: %s\r\n", source, f_strerror(result));
+        // Cannot create destination directory.
+        fpm_printf("%s: %s\r\n", c->to, f_strerror(result));
+        return false;
+    }
+    return true;
+}
+
+//
+// Process the work list: copy files, then update timestamps.
+//
+static void copy_flush(copy_t *c)
+{
+    unsigned offset;
+    work_item_t *item;
+
+    // Copy contents of files.
+    for (offset = 0; offset < c->work_len; offset += work_item_size(strlen(item->path))) {
+        item = (work_item_t *)(c->work + offset);
+        if (!item->is_dir) {
+            make_path(c->from, c->source, item->path);
+            make_path(c->to, c->destination, item->path);
+            item->done = copy_file(c->from, c->to, c->options, &c->stats);
+        }
+    }
+
+    // Update directory entries, in one sweep.
+    for (offset = 0; offset < c->work_len; offset += work_item_size(strlen(item->path))) {
+        item = (work_item_t *)(c->work + offset);
+        if (item->is_dir || item->done) {
+            file_info_t info;
+            info.fdate = item->fdate;
+            info.ftime = item->ftime;
+            make_path(c->to, c->destination, item->path);
+            f_utime(c->to, &info);
+        }
+    }
+    c->work_len = 0;
+}
+
+//
+// Append item to the work list.
+// When the list is full, process it first.
+//
+static void copy_add_work(copy_t *c, const char *path, const file_info_t *info, bool is_dir)
+{
+    unsigned size = work_item_size(strlen(path));
+    if (size > WORK_LIST_SIZE) {
+        // Path does not fit in the work list.
+        fpm_printf("%s: Path too long\r\n", path);
         return;
     }
-    for (;;) {
-        // Get directory entry.
-        result = f_readdir(dir, &info);
+    if (c->work_len + size > WORK_LIST_SIZE) {
+        copy_flush(c);
+    }
+    work_item_t *item = (work_item_t *)(c->work + c->work_len);
+    item->fdate = info->fdate;
+    item->ftime = info->ftime;
+    item->is_dir = is_dir;
+    item->done = 0;
+    strcpy(item->path, path);
+    c->work_len += size;
+}
+
+//
+// Walk the source tree, create directories and collect files.
+//
+static void copy_walk(copy_t *c, const file_info_t *root_info)
+{
+    // Create destination root and open the source.
+    c->path[0] = 0;
+    make_path(c->from, c->source, "");
+    make_path(c->to, c->destination, "");
+    if (!copy_mkdir(c) || !copy_push(c, 0, root_info)) {
+        return;
+    }
+
+    file_info_t info;
+    while (c->depth > 0) {
+        level_t *level = copy_level(c, c->depth - 1);
+        fs_result_t result = f_readdir(level_dir(level), &info);
         if (result != FR_OK || !info.fname[0]) {
-            // End of directory.
-            break;
+            // End of directory: set timestamp when done with contents.
+            f_closedir(level_dir(level));
+            c->path[level->path_len] = 0;
+            info.fdate = level->fdate;
+            info.ftime = level->ftime;
+            copy_add_work(c, c->path, &info, true);
+            c->depth--;
+            continue;
         }
 
-        // Update from/to paths.
-        strcpy(from_last, info.fname);
-        strcpy(to_last, info.fname);
+        // Append name to the relative path.
+        unsigned path_len = level->path_len;
+        if (!copy_reserve_path(c, path_len + 1 + strlen(info.fname))) {
+            fpm_printf("%s: Out of memory\r\n", info.fname);
+            continue;
+        }
+        if (path_len > 0) {
+            c->path[path_len++] = '/';
+        }
+        strcpy(c->path + path_len, info.fname);
+        path_len += strlen(info.fname);
 
         if (info.fattrib & AM_DIR) {
-            copy_recursive(from, to, options);
+            // Descend into subdirectory.
+            make_path(c->from, c->source, c->path);
+            make_path(c->to, c->destination, c->path);
+            if (copy_mkdir(c)) {
+                copy_push(c, path_len, &info);
+            }
         } else {
-            copy_file(from, to, options);
+            copy_add_work(c, c->path, &info, false);
         }
     }
-    f_closedir(dir);
+    copy_flush(c);
+}
+
+//
+// Print number as integer with two decimals.
+//
+static void print_rate(uint64_t value_x100, const char *units)
+{
+    fpm_printf("%ju.%02u %s", (uintmax_t)(value_x100 / 100), (unsigned)(value_x100 % 100), units);
+}
+
+//
+// Copy directory recursively.
+// Timestamps of the source are preserved.
+//
+static void copy_recursive(const char *source, const char *destination, const options_t *options,
+                           const file_info_t *info)
+{
+    copy_t c = {};
+    c.source = source;
+    c.destination = destination;
+    c.options = options;
+    c.level_size = (sizeof(level_t) + f_sizeof_directory_t() + sizeof(void *) - 1) & -sizeof(void *);
+    c.work = fpm_alloc_dirty(WORK_LIST_SIZE);
+    if (!c.work || !copy_reserve_path(&c, 0)) {
+        fpm_printf("%s: Out of memory\r\n", source);
+        goto done;
+    }
+
+    uint64_t start_usec = fpm_time_usec();
+    copy_walk(&c, info);
+    uint64_t usec = fpm_time_usec() - start_usec;
+
+    // Report speed.
+    if (usec == 0) {
+        usec = 1;
+    }
+    fpm_printf("%u files, %ju bytes copied in %u.%03u seconds: ", c.stats.nfiles,
+               (uintmax_t)c.stats.nbytes, (unsigned)(usec / 1000000),
+               (unsigned)(usec / 1000 % 1000));
+    print_rate(c.stats.nfiles * 100000000ull / usec, "files/sec, ");
+    print_rate(c.stats.nbytes * 100 / usec, "Mbytes/sec\r\n");
+done:
+    fpm_free(c.work);
+    fpm_free(c.stack);
+    fpm_free(c.path);
+    fpm_free(c.from);
+    fpm_free(c.to);
 }
 
 //
@@ -177,12 +501,12 @@ static void copy_object(const char *source, const char *destination, const optio
     }
     if (info.fattrib & AM_DIR) {
         if (options->recursive) {
-            copy_recursive(source, destination, options);
+            copy_recursive(source, destination, options, &info);
         } else {
             fpm_printf("%s: Cannot copy directory without -r option\r\n", source);
         }
     } else {
-        copy_file(source, destination, options);
+        copy_file(source, destination, options, NULL);
     }
 }
 
@@ -282,7 +606,8 @@ usage:      fpm_puts("Usage:\r\n"
                      "    copy [options] source ... destination\r\n"
                      "Options:\r\n"
                      "    -f      Force, do not ask for confirmation to overwrite\r\n"
-                     "    -r      Recursively copy directories and their contents\r\n"
+                     "    -r      Recursively copy directories and their contents,\r\n"
+                     "            keeping modification times\r\n"
                      "    -v      Verbose: show files as they are copied\r\n"
                      "\n");
             return;
@@ -0,0 +1,358 @@
+//
+// Defragment files on a disk.
+//
+// Programs are executed in place from flash memory, so every .exe file
+// must occupy one contiguous run of clusters. Besides, deletes and rewrites
+// scatter both files and free space over the disk.
+//
+// The target layout has every file contiguous, packed towards the start of
+// the disk, with free space collected in one run at the end. Files are moved
+// one at a time by f_relocate(), which copies the data into free space and
+// then switches the directory entry over, so a power loss during the copy
+// leaves the old file intact. It does not protect against a failing device,
+// nor against a power loss in the middle of a FAT update. Fragmented programs
+// are handled first. Then passes over all files are repeated, while any file
+// can be moved into a better place.
+//
+// Programs and libraries run in place from flash, so nothing must be moved
+// while a background program is running. Resident libraries notice that
+// their file has moved, and are loaded again on next use.
+//
+// Every move is complete by itself, so the work can be split: when the time
+// limit is reached, the next run of the command continues from there.
+//
+#include <fpm/api.h>
+#include <fpm/fs.h>
+#include <fpm/getopt.h>
+#include <fpm/internal.h>
+#include <alloca.h>
+
+//
+// Fragmentation of the disk.
+//
+typedef struct {
+    unsigned nfiles;      // number of non-empty files
+    unsigned nfragmented; // number of files in more than one piece
+    unsigned nfragments;  // number of pieces in all files
+    unsigned nprograms;   // number of fragmented programs
+    uint32_t nruns;       // number of free space runs
+    uint32_t largest;     // largest free run, in blocks
+} report_t;
+
+typedef struct {
+    bool verbose;           // -v option: show every file moved
+    bool programs_only;     // pass over programs only
+    bool time_out;          // time limit reached
+    uint64_t start_usec;    // time when moves started
+    uint64_t budget_usec;   // time limit
+    unsigned moved;         // number of files moved
+    unsigned pass_moved;    // number of files moved in current pass
+    report_t report;        // fragmentation, when analyzing
+    char *buf;              // buffer for data transfer
+    unsigned buf_size;      // size of buffer
+} defrag_t;
+
+typedef void (*visit_t)(defrag_t *d, const char *path, const file_info_t *info);
+
+//
+// Call the visitor for every non-empty file in the directory and below.
+//
+static void walk_directory(defrag_t *d, const char *path, visit_t visit)
+{
+    directory_t *dir = alloca(f_sizeof_directory_t());
+    fs_result_t result = f_opendir(dir, path);
+    if (result != FR_OK) {
+        fpm_printf("%s: %s\r\n", path, f_strerror(result));
+        return;
+    }
+
+    unsigned path_len = strlen(path);
+    bool need_slash = (path_len > 0 && path[path_len - 1] != '/' && path[path_len - 1] != ':');
+    char *name = alloca(path_len + 1 + FF_LFN_BUF + 1);
+    strcpy(name, path);
+    if (need_slash) {
+        name[path_len++] = '/';
+    }
+
+    while (!d->time_out) {
+        file_info_t info;
+        result = f_readdir(dir, &info);
+        if (result != FR_OK) {
+            fpm_printf("%s: %s\r\n", path, f_strerror(result));
+            break;
+        }
+        if (info.fname[0] == 0) {
+            // End of directory.
+            break;
+        }
+        strcpy(name + path_len, info.fname);
+
+        if (info.fattrib & AM_DIR) {
+            walk_directory(d, name, visit);
+        } else if (info.fsize > 0) {
+            visit(d, name, &info);
+        }
+    }
+    f_closedir(dir);
+}
+
+//
+// Count fragments of one file.
+//
+static void analyze_file(defrag_t *d, const char *path, const file_info_t *info)
+{
+    file_t *fp = alloca(f_sizeof_file_t());
+    fs_result_t result = f_open(fp, path, FA_READ);
+    if (result != FR_OK) {
+        fpm_printf("%s: %s\r\n", path, f_strerror(result));
+        return;
+    }
+    unsigned nfrag = 0;
+    result = f_fragments(fp, &nfrag);
+    f_close(fp);
+    if (result != FR_OK) {
+        fpm_printf("%s: %s\r\n", path, f_strerror(result));
+        return;
+    }
+
+    d->report.nfiles++;
+    d->report.nfragments += nfrag;
+    if (nfrag > 1) {
+        d->report.nfragmented++;
+        if (fpm_has_extension(info->fname, ".exe")) {
+            d->report.nprograms++;
+        }
+        if (d->verbose) {
+            fpm_printf("%s: %u fragments\r\n", path, nfrag);
+        }
+    }
+}
+
+//
+// Collect and print fragmentation of the disk.
+//
+static bool analyze(defrag_t *d, const char *drive, const char *when)
+{
+    memset(&d->report, 0, sizeof(d->report));
+    walk_directory(d, drive, analyze_file);
+
+    fs_info_t info;
+    fs_result_t result = f_statfs(drive, &info);
+    if (result == FR_OK) {
+        result = f_freeruns(drive, &d->report.nruns, &d->report.largest);
+    }
+    if (result != FR_OK) {
+        fpm_printf("%s: %s\r\n", drive, f_strerror(result));
+        return false;
+    }
+
+    const report_t *r = &d->report;
+    fpm_printf("%s %u file%s, %u fragmented, %u fragments in total\r\n", when, r->nfiles,
+               r->nfiles == 1 ? "" : "s", r->nfragmented, r->nfragments);
+    fpm_printf("%*s Free %u kbytes in %u run%s, largest %u kbytes\r\n", (int)strlen(when), "",
+               (unsigned)(info.f_bfree * (info.f_bsize / 1024)), (unsigned)r->nruns,
+               r->nruns == 1 ? "" : "s", (unsigned)(r->largest * (info.f_bsize / 1024)));
+    if (r->nprograms > 0) {
+        fpm_printf("%*s %u program%s cannot be executed\r\n", (int)strlen(when), "",
+                   r->nprograms, r->nprograms == 1 ? "" : "s");
+    }
+    return true;
+}
+
+//
+// Move one file into a better place, when possible.
+//
+static void move_file(defrag_t *d, const char *path, const file_info_t *info)
+{
+    if (d->programs_only && !fpm_has_extension(info->fname, ".exe")) {
+        return;
+    }
+
+    // At least one file is moved per run, so repeated runs make progress.
+    if (d->moved > 0 && fpm_time_usec() - d->start_usec >= d->budget_usec) {
+        d->time_out = true;
+        return;
+    }
+
+    // Read-only files must be opened for writing, so drop the flag for a while.
+    // It is restored as soon as the file is open, before any data is moved:
+    // a power loss between the two updates leaves the file writable.
+    bool readonly = (info->fattrib & AM_RDO);
+    if (readonly) {
+        f_chmod(path, 0, AM_RDO);
+    }
+    file_t *fp = alloca(f_sizeof_file_t());
+    fs_result_t result = f_open(fp, path, FA_READ | FA_WRITE);
+    if (readonly) {
+        f_chmod(path, AM_RDO, AM_RDO);
+    }
+
+    int moved = 0;
+    if (result == FR_OK) {
+        result = f_relocate(fp, d->buf, d->buf_size, &moved);
+        f_close(fp);
+    }
+
+    if (result == FR_LOCKED) {
+        // File is in use: leave it for the next time.
+        if (d->verbose) {
+            fpm_printf("%s: Skipped, file is open\r\n", path);
+        }
+        return;
+    }
+    if (result != FR_OK) {
+        fpm_printf("%s: %s\r\n", path, f_strerror(result));
+        return;
+    }
+    if (moved) {
+        if (d->verbose) {
+            fpm_printf("%s: Moved\r\n", path);
+        }
+        d->moved++;
+        d->pass_moved++;
+    }
+}
+
+//
+// Defragment one disk.
+//
+static void defrag_drive(defrag_t *d, const char *drive, bool analyze_only)
+{
+    // Walk from the root directory, rather than the current one.
+    unsigned len = strlen(drive);
+    char *root = alloca(len + 2);
+    strcpy(root, drive);
+    if (len > 0 && root[len - 1] == ':') {
+        strcpy(root + len, "/");
+    }
+    drive = root;
+
+    if (!analyze(d, drive, drive)) {
+        return;
+    }
+    if (analyze_only || (d->report.nfragmented == 0 && d->report.nruns <= 1)) {
+        return;
+    }
+
+    d->moved = 0;
+    d->time_out = false;
+    d->start_usec = fpm_time_usec();
+
+    // Programs first, as they cannot be executed until contiguous.
+    if (d->report.nprograms > 0) {
+        d->programs_only = true;
+        walk_directory(d, drive, move_file);
+        d->programs_only = false;
+    }
+
+    // Every move puts a file lower, or makes it contiguous, so passes converge.
+    do {
+        d->pass_moved = 0;
+        walk_directory(d, drive, move_file);
+    } while (d->pass_moved > 0 && !d->time_out);
+
+    uint64_t usec = fpm_time_usec() - d->start_usec;
+    fpm_printf("Moved %u file%s in %u.%03u seconds\r\n", d->moved, d->moved == 1 ? "" : "s",
+               (unsigned)(usec / 1000000), (unsigned)(usec / 1000 % 1000));
+    bool time_out = d->time_out;
+    d->time_out = false;
+    analyze(d, drive, "After:");
+    if (time_out) {
+        fpm_puts("Time limit reached, run defrag again to continue\r\n");
+    }
+}
+
+void fpm_cmd_defrag(int argc, char *argv[])
+{
+    static const struct fpm_option long_opts[] = {
+        { "verbose", FPM_NO_ARG,       NULL, 'v' },
+        { "analyze", FPM_NO_ARG,       NULL, 'n' },
+        { "time",    FPM_REQUIRED_ARG, NULL, 't' },
+        { "help",    FPM_NO_ARG,       NULL, 'h' },
+        {},
+    };
+    struct fpm_opt opt = {};
+    defrag_t d = { .budget_usec = UINT64_MAX };
+    bool analyze_only = false;
+    const char *drives[8];
+    unsigned ndrives = 0;
+
+    while (fpm_getopt(argc, argv, "vnt:h", long_opts, &opt) >= 0) {
+        switch (opt.ret) {
+        case 1:
+            if (ndrives == sizeof(drives) / sizeof(drives[0])) {
+                fpm_printf("%s: Too many disks\r\n\n", opt.arg);
+                return;
+            }
+            drives[ndrives++] = opt.arg;
+            break;
+
+        case 'v':
+            d.verbose = true;
+            break;
+
+        case 'n':
+            analyze_only = true;
+            break;
+
+        case 't': {
+            unsigned long seconds;
+            if (fpm_strtoul(&seconds, opt.arg, NULL, 10)) {
+                fpm_printf("%s: Bad time limit\r\n\n", opt.arg);
+                return;
+            }
+            d.budget_usec = seconds * 1000000ull;
+            break;
+        }
+
+        case '?':
+            // Unknown option: message already printed.
+            fpm_puts("\r\n");
+            return;
+
+        case 'h':
+            fpm_puts("Usage:\r\n"
+                     "    defrag [-v] [-n] [-t seconds] [flash: | sd:] ...\r\n"
+                     "Options:\r\n"
+                     "    -v, --verbose   Show every file moved\r\n"
+                     "    -n, --analyze   Only report fragmentation\r\n"
+                     "    -t, --time      Stop after given number of seconds\r\n"
+                     "\n"
+                     "Make files contiguous, and collect free space in one run.\r\n"
+                     "Programs must be contiguous to be executed in place.\r\n"
+                     "By default, flash: is defragmented.\r\n"
+                     "\n");
+            return;
+        }
+    }
+    if (ndrives == 0) {
+        drives[ndrives++] = "flash:";
+    }
+
+    if (!analyze_only && fpm_background_running()) {
+        // Programs are executed in place: their files must stay where they are.
+        fpm_puts(argv[0]);
+        fpm_puts(": Background program is running, use 'wait'\r\n\n");
+        return;
+    }
+
+    // Buffer for moving data: the larger the better, but a block will do.
+    if (!analyze_only) {
+        for (d.buf_size = 32 * 1024;; d.buf_size /= 2) {
+            d.buf = fpm_alloc_dirty(d.buf_size);
+            if (d.buf || d.buf_size <= 4096) {
+                break;
+            }
+        }
+        if (!d.buf) {
+            fpm_puts("Out of memory\r\n\n");
+            return;
+        }
+    }
+
+    for (unsigned i = 0; i < ndrives; i++) {
+        defrag_drive(&d, drives[i], analyze_only);
+    }
+    fpm_free(d.buf);
+    fpm_puts("\r\n");
+}
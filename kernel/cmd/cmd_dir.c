@@ -19,217 +19,471 @@ typedef struct {
     bool reversesort;   // reverse whatever sort is used
     bool singlecol;     // use single column output
     bool timesort;      // sort by time vice name
+    bool unsorted;      // output in directory order, as read
     bool type;          // add type character for non-regular files
     bool toplevel;      // at top level
     bool any_output;    // if emitted any output
 } options_t;
 
 //
-// Item in the single-linked list: info about one file or directory.
+// Info about one file or directory: a fixed-size record in the listing.
 //
-typedef struct _list_item_t {
-    struct _list_item_t *next; // Next file in the list
-    uint64_t nbytes;           // File size
-    uint32_t mtime;            // Modification time
-    uint32_t namelen;          // Strlen of the file name
-    uint8_t attrib;            // Dir/System/Hidden/Readonly
-    uint8_t no_print;          // Don't print
-    char name[1];              // File name, dynamically allocated, zero terminated
-} list_item_t;
+typedef struct {
+    uint64_t nbytes;  // File size
+    uint32_t mtime;   // Modification time
+    uint32_t name;    // Offset of the file name in the arena
+    uint16_t namelen; // Length of the file name, in characters
+    uint8_t attrib;   // Dir/System/Hidden/Readonly
+    uint8_t no_print; // Don't print
+} entry_t;
+
+//
+// Listing of a directory, in one block of memory.
+// Records are stored as array at the bottom of the arena, growing up.
+// File names are packed into a string pool at the top, growing down.
+// When the two meet, the listing is full.
+//
+// A directory which does not fit is listed in chunks. On every pass
+// over the directory, the records are kept as a heap, which retains
+// the first entries in sort order, following the last entry of
+// the previous chunk. This way memory is bounded, at a cost of
+// re-reading the directory once per chunk. Unsorted listing is cut
+// into chunks by position in the directory instead.
+//
+typedef struct {
+    char *arena;        // Block of memory
+    entry_t *entries;   // Array of records at the bottom of the arena
+    unsigned count;     // Number of records
+    unsigned pool;      // Offset of the string pool
+    unsigned size;      // Size of the arena
+    bool overflow;      // Not all entries fit: records are kept as a heap
+    unsigned position;  // Unsorted overflow: index of the first entry not listed
+    options_t *options; // Sort order
+} listing_t;
+
+//
+// Totals for all printable entries of a directory.
+//
+typedef struct {
+    uint64_t kbytes_total; // Total size in kbytes
+    uint64_t maxsize;      // Size of the largest file
+    unsigned maxlen;       // Length of the longest file name
+} totals_t;
 
 //
-// Single-linked list of files.
+// Position in a directory listed in chunks.
 //
 typedef struct {
-    list_item_t *head; // First file in the list
-    list_item_t *tail; // Last file in the list
-} file_list_t;
+    bool valid;                // There was a previous chunk
+    unsigned position;         // Unsorted: index of the first entry of this chunk
+    entry_t last;              // Last entry of the previous chunk
+    char name[FF_LFN_BUF + 1]; // File name of the last entry
+} cursor_t;
+
+//
+// Function to compare two records.
+//
+typedef fpm_compare_t compare_t;
+
+//
+// Arena must fit at least this many records with longest names.
+//
+#define MIN_ENTRIES 2
+#define MIN_ARENA_SIZE (MIN_ENTRIES * (sizeof(entry_t) + FF_LFN_BUF + 1))
 
 // Forward declaration of a recursive routine.
 static void show_dir(const char *path, options_t *options);
 
 //
-// Is the list empty?
+// Get file name of the record.
 //
-static bool list_is_empty(file_list_t *list)
+static inline char *entry_name(const listing_t *list, const entry_t *e)
 {
-    return list->head == 0;
+    return list->arena + e->name;
 }
 
 //
-// Free the list.
+// Allocate memory for the listing: half of the free heap.
+// Free space may be fragmented, so reduce the size until allocation succeeds.
+// Return false when not enough memory.
 //
-static void list_delete(file_list_t *list)
+static bool listing_open(listing_t *list, options_t *options, const char *path)
 {
-    list_item_t *item, *next;
-    for (item = list->head; item != 0; item = next) {
-        next = item->next;
-        fpm_free(item);
+    unsigned size;
+    char *arena = fpm_alloc_arena(MIN_ARENA_SIZE, &size);
+    if (!arena) {
+        fpm_printf("%s: Out of memory\r\n", path);
+        return false;
     }
-    list->head = 0;
-    list->tail = 0;
+    list->arena = arena;
+    list->entries = (entry_t *)arena;
+    list->count = 0;
+    list->pool = size;
+    list->size = size;
+    list->overflow = false;
+    list->position = 0;
+    list->options = options;
+    return true;
 }
 
 //
-// Append file info to the list.
-// Ignore if no such file exists.
+// Deallocate the listing.
 //
-static void list_append_file_info(file_list_t *list, const file_info_t *info)
+static void listing_close(listing_t *list)
 {
-    // Get file name.
-    const char *file_name = info->fname[0] ? info->fname : info->altname;
-    const unsigned name_nbytes = strlen(file_name);
+    fpm_free(list->arena);
+    list->arena = NULL;
+}
 
-    // Allocate list item.
-    list_item_t *file = fpm_alloc(sizeof(list_item_t) + name_nbytes);
-    if (!file) {
-        fpm_printf("%s: Out of memory\r\n", file_name);
+//
+// Get amount of free space in the arena.
+//
+static inline unsigned listing_free_space(const listing_t *list)
+{
+    return list->pool - list->count * sizeof(entry_t);
+}
+
+//
+// Move the string pool down to the records, and give the rest of the arena back to the heap.
+// No entries can be added after that.
+//
+static void listing_compact(listing_t *list)
+{
+    unsigned pool_start = list->count * sizeof(entry_t);
+    unsigned delta = list->pool - pool_start;
+    if (delta == 0) {
         return;
     }
-
-    // Fill file data.
-    strcpy(file->name, file_name);
-    file->next = 0;
-    file->namelen = fpm_utf8len(file_name);
-    file->nbytes = info->fsize;
-    file->mtime = (uint32_t)info->fdate << 16 | info->ftime;
-    file->attrib = info->fattrib;
-
-    // Append to the list.
-    if (list->head == 0) {
-        list->head = file;
-        list->tail = file;
-    } else {
-        list->tail->next = file;
-        list->tail = file;
+    memmove(list->arena + pool_start, list->arena + list->pool, list->size - list->pool);
+    for (unsigned i = 0; i < list->count; i++) {
+        list->entries[i].name -= delta;
     }
+    list->pool = pool_start;
+    list->size -= delta;
+    fpm_truncate(list->arena, list->size);
 }
 
 //
-// Append file name to the list.
-// Ignore if no such file exists.
+// Compare entries in the order of the listing.
+// Return negative value when entry a goes before entry b.
 //
-static void list_append_name(file_list_t *list, const char *name)
+static int compare_keys(const options_t *options, const entry_t *a, const char *a_name,
+                        const entry_t *b, const char *b_name)
 {
-    // Get file info.
-    file_info_t info = {};
-    fs_result_t result = f_stat(name, &info);
-    if (result == FR_INVALID_NAME) {
-        // Cannot stat current directory - fake it.
-        info.fattrib = AM_DIR;
-        strcpy(info.fname, name);
-    } else if (result != FR_OK) {
-        fpm_printf("%s: %s\r\n", name, f_strerror(result));
-        return;
+    if (a->no_print != b->no_print) {
+        // Entries not to be printed go last.
+        return a->no_print - b->no_print;
+    }
+    if (options->reversesort) {
+        const entry_t *e = a;
+        const char *name = a_name;
+        a = b;
+        a_name = b_name;
+        b = e;
+        b_name = name;
     }
+    if (options->timesort && a->mtime != b->mtime) {
+        // Use modification time, newest first.
+        return (a->mtime > b->mtime) ? -1 : 1;
+    }
+    return strcmp(a_name, b_name);
+}
+
+//
+// Compare records in the order of the listing.
+//
+static int compare_entries(void *arg, const void *a, const void *b)
+{
+    const listing_t *list = arg;
+    return compare_keys(list->options, a, entry_name(list, a), b, entry_name(list, b));
+}
 
-    list_append_file_info(list, &info);
+//
+// Compare records by offset of the name, highest first.
+//
+static int compare_offsets(void *arg, const void *a, const void *b)
+{
+    unsigned a_name = ((const entry_t *)a)->name;
+    unsigned b_name = ((const entry_t *)b)->name;
+    return (a_name > b_name) ? -1 : (a_name < b_name);
 }
 
 //
-// Compare list items.
-// Return -1 when item a is less that item b.
+// Swap two records.
 //
-static int compare_list_items(const list_item_t *a, const list_item_t *b, options_t *options)
+static inline void swap_entries(entry_t *a, entry_t *b)
 {
-    if (!options->reversesort) {
-        if (options->timesort && a->mtime != b->mtime) {
-            // Use modification time.
-            return (int)b->mtime - (int)a->mtime;
-        }
-        return strcmp(a->name, b->name);
-    } else {
-        if (options->timesort && a->mtime != b->mtime) {
-            // Use modification time.
-            return (int)a->mtime - (int)b->mtime;
+    entry_t t = *a;
+    *a = *b;
+    *b = t;
+}
+
+//
+// Restore the heap property below given record.
+// The heap keeps the record which goes last at the root.
+//
+static void sift_down(listing_t *list, unsigned root, unsigned count, compare_t compare)
+{
+    fpm_sift_down(list->entries, sizeof(entry_t), root, count, compare, list);
+}
+
+//
+// Restore the heap property above given record.
+//
+static void sift_up(listing_t *list, unsigned index)
+{
+    entry_t *e = list->entries;
+    while (index > 0) {
+        unsigned parent = (index - 1) / 2;
+        if (compare_entries(list, &e[parent], &e[index]) >= 0) {
+            break;
         }
-        return strcmp(b->name, a->name);
+        swap_entries(&e[parent], &e[index]);
+        index = parent;
     }
 }
 
 //
-// Merge two single linked lists in ascending order.
+// Arrange records as a heap.
 //
-static list_item_t *chain_merge(list_item_t *a, list_item_t *b, options_t *options)
+static void heapify(listing_t *list, compare_t compare)
 {
-    if (!a) {
-        return b;
+    for (unsigned i = list->count / 2; i-- > 0;) {
+        sift_down(list, i, list->count, compare);
     }
-    if (!b) {
-        return a;
+}
+
+//
+// Sort records in place, using heap sort.
+// No recursion and no extra memory.
+//
+static void heap_sort(listing_t *list, compare_t compare)
+{
+    fpm_heap_sort(list->entries, list->count, sizeof(entry_t), compare, list);
+}
+
+//
+// Remove the root record from the heap.
+//
+static void heap_pop(listing_t *list)
+{
+    list->count--;
+    list->entries[0] = list->entries[list->count];
+    sift_down(list, 0, list->count, compare_entries);
+}
+
+//
+// Reclaim space of names of records which were dropped from the heap.
+//
+static void listing_collect(listing_t *list)
+{
+    // Pack names to the top of the arena, highest first.
+    heap_sort(list, compare_offsets);
+    unsigned pool = list->size;
+    for (unsigned i = 0; i < list->count; i++) {
+        entry_t *e = &list->entries[i];
+        unsigned nbytes = strlen(entry_name(list, e)) + 1;
+        pool -= nbytes;
+        memmove(list->arena + pool, entry_name(list, e), nbytes);
+        e->name = pool;
     }
-    if (compare_list_items(a, b, options) < 0) {
-        a->next = chain_merge(a->next, b, options);
-        return a;
-    } else {
-        b->next = chain_merge(a, b->next, options);
-        return b;
+    list->pool = pool;
+    heapify(list, compare_entries);
+}
+
+//
+// Add record to the listing.
+// Return false when it does not fit.
+//
+static bool listing_append(listing_t *list, const entry_t *e, const char *name)
+{
+    unsigned nbytes = strlen(name) + 1;
+    if (listing_free_space(list) < sizeof(entry_t) + nbytes) {
+        return false;
     }
+    list->pool -= nbytes;
+    memcpy(list->arena + list->pool, name, nbytes);
+
+    entry_t *item = &list->entries[list->count++];
+    *item = *e;
+    item->name = list->pool;
+    return true;
 }
 
 //
-// Find middle point of a single linked list.
+// Add record to the heap, when it goes before the last record kept.
 //
-static list_item_t *chain_mid_point(list_item_t *head)
+static void listing_push(listing_t *list, const entry_t *e, const char *name)
 {
-    if (!head || !head->next) {
-        return head;
+    entry_t *root = &list->entries[0];
+    char *root_name = entry_name(list, root);
+    if (compare_keys(list->options, e, name, root, root_name) >= 0) {
+        return;
+    }
+
+    unsigned nbytes = strlen(name) + 1;
+    if (strlen(root_name) + 1 >= nbytes) {
+        // Replace the root, reusing space of the name.
+        unsigned offset = root->name;
+        memcpy(root_name, name, nbytes);
+        *root = *e;
+        root->name = offset;
+        sift_down(list, 0, list->count, compare_entries);
+        return;
     }
-    list_item_t *fast = head;
-    list_item_t *slow = head;
-    while (fast && fast->next) {
-        fast = fast->next;
-        if (!fast->next) {
+
+    // Drop the root, and more records going after the new one if needed
+    // to fit the name. Dropped records are listed in the next chunk.
+    heap_pop(list);
+    while (listing_free_space(list) < sizeof(entry_t) + nbytes) {
+        listing_collect(list);
+        if (listing_free_space(list) >= sizeof(entry_t) + nbytes) {
             break;
         }
-        fast = fast->next;
-        slow = slow->next;
+        root = &list->entries[0];
+        if (list->count == 0 ||
+            compare_keys(list->options, e, name, root, entry_name(list, root)) >= 0) {
+            // Remaining records go before the new one: drop the new one instead.
+            return;
+        }
+        heap_pop(list);
     }
-    return slow;
+    list->pool -= nbytes;
+    memcpy(list->arena + list->pool, name, nbytes);
+
+    entry_t *item = &list->entries[list->count];
+    *item = *e;
+    item->name = list->pool;
+    sift_up(list, list->count++);
 }
 
 //
-// Sort a linked list using recursive merge algorithm.
+// Add record to the listing.
+// When it does not fit, switch to keeping first entries as a heap.
 //
-static list_item_t *chain_sort(list_item_t *head, options_t *options)
+static void listing_add(listing_t *list, const entry_t *e, const char *name)
 {
-    if (!head || !head->next) {
-        return head;
+    if (!list->overflow) {
+        if (listing_append(list, e, name)) {
+            return;
+        }
+        list->overflow = true;
+        heapify(list, compare_entries);
     }
+    listing_push(list, e, name);
+}
 
-    // Divide the linked list into two equal linked lists.
-    list_item_t *mid = chain_mid_point(head);
-    list_item_t *a = head;
-    list_item_t *b = mid->next;
-    mid->next = 0;
+//
+// Sort the listing.
+//
+static void listing_sort(listing_t *list)
+{
+    if (list->options->unsorted) {
+        return;
+    }
+    if (list->overflow) {
+        // Records are already a heap: just finish the sort.
+        for (unsigned n = list->count; n > 1;) {
+            n--;
+            swap_entries(&list->entries[0], &list->entries[n]);
+            sift_down(list, 0, n, compare_entries);
+        }
+    } else {
+        heap_sort(list, compare_entries);
+    }
+}
 
-    // Recursively sort the smaller linked lists.
-    a = chain_sort(a, options);
-    b = chain_sort(b, options);
+//
+// Fill record from file info.
+// Return the file name.
+//
+static const char *make_entry(entry_t *e, const file_info_t *info)
+{
+    const char *file_name = info->fname[0] ? info->fname : info->altname;
 
-    // Merge the sorted linked lists.
-    return chain_merge(a, b, options);
+    e->nbytes = info->fsize;
+    e->mtime = (uint32_t)info->fdate << 16 | info->ftime;
+    e->name = 0;
+    e->namelen = fpm_utf8len(file_name);
+    e->attrib = info->fattrib;
+    e->no_print = 0;
+    return file_name;
 }
 
 //
-// Sort a linked list.
+// Decide whether the entry is to be printed.
+// Update totals for printable entries.
 //
-static void list_sort(file_list_t *list, options_t *options)
+static void mark_entry(entry_t *e, options_t *options, totals_t *totals)
 {
-    list->head = chain_sort(list->head, options);
+    if ((e->attrib & AM_HID) && !options->showhidden) {
+        // Only display hidden files if -a set.
+        e->no_print = 1;
+        return;
+    }
+    if ((e->attrib & AM_DIR) && options->toplevel) {
+        // At top level, directories will be displayed later.
+        e->no_print = 1;
+        return;
+    }
+    if (!totals) {
+        return;
+    }
+    if (e->namelen > totals->maxlen)
+        totals->maxlen = e->namelen;
 
-    // Restore tail.
-    for (list->tail = list->head; list->tail != 0; list->tail = list->tail->next) {
-        if (list->tail->next == 0) {
-            break;
-        }
+    if (e->nbytes > totals->maxsize)
+        totals->maxsize = e->nbytes;
+
+    totals->kbytes_total += (e->nbytes + 1023) / 1024;
+}
+
+//
+// Append file name to the list.
+// Ignore if no such file exists.
+//
+static void list_append_name(listing_t *list, const char *name)
+{
+    // Get file info.
+    file_info_t info = {};
+    fs_result_t result = f_stat(name, &info);
+    if (result == FR_INVALID_NAME) {
+        // Cannot stat current directory - fake it.
+        info.fattrib = AM_DIR;
+        strcpy(info.fname, name);
+    } else if (result != FR_OK) {
+        fpm_printf("%s: %s\r\n", name, f_strerror(result));
+        return;
+    }
+
+    entry_t e;
+    const char *file_name = make_entry(&e, &info);
+    if (!listing_append(list, &e, file_name)) {
+        fpm_printf("%s: Out of memory\r\n", file_name);
+    }
+}
+
+//
+// Remember the last entry of the chunk.
+//
+static void cursor_advance(cursor_t *cursor, const listing_t *list)
+{
+    cursor->valid = true;
+    if (list->options->unsorted) {
+        // Continue from the first entry not listed.
+        cursor->position = list->position;
+        return;
     }
+
+    const entry_t *last = &list->entries[list->count - 1];
+    cursor->last = *last;
+    strcpy(cursor->name, entry_name(list, last));
 }
 
 //
 // Return true when the file is a symlink.
 //
-static bool is_link(list_item_t *item)
+static bool is_link(const entry_t *item)
 {
     // TODO: implement symlinks in FP/M.
     return false;
@@ -238,7 +492,7 @@ static bool is_link(list_item_t *item)
 //
 // Print symbol for file type.
 //
-static int print_type(list_item_t *item)
+static int print_type(const entry_t *item)
 {
     if (item->attrib & AM_DIR) {
         fpm_putchar('/');
@@ -255,9 +509,9 @@ static int print_type(list_item_t *item)
 // Print file name and, optionally, file type symbol.
 // return # of characters printed, no trailing characters.
 //
-static int print_filename(list_item_t *item, options_t *options)
+static int print_filename(const entry_t *item, const char *name, options_t *options)
 {
-    fpm_puts(item->name);
+    fpm_puts(name);
     int chcnt = item->namelen;
     if (options->type)
         chcnt += print_type(item);
@@ -305,7 +559,7 @@ static void print_time(unsigned mtime)
 //
 // Print symlink.
 //
-static void print_link(list_item_t *item)
+static void print_link(const entry_t *item)
 {
     // TODO: read link contents from the file and print the path.
 }
@@ -313,14 +567,14 @@ static void print_link(list_item_t *item)
 //
 // Print files in -1 format.
 //
-static void print_single_column(file_list_t *list, options_t *options)
+static void print_single_column(listing_t *list, options_t *options)
 {
-    list_item_t *item;
-    for (item = list->head; item; item = item->next) {
+    for (unsigned i = 0; i < list->count; i++) {
+        const entry_t *item = &list->entries[i];
         if (item->no_print)
             continue;
 
-        print_filename(item, options);
+        print_filename(item, entry_name(list, item), options);
         fpm_puts("\r\n");
     }
 }
@@ -361,61 +615,59 @@ static unsigned size_len(uint64_t n)
     return len;
 }
 
+//
+// Print one file in -l format.
+//
+static void print_long_entry(const entry_t *item, const char *name, options_t *options,
+                             unsigned size_width)
+{
+    print_attrib(item->attrib);
+    fpm_puts("  ");
+    if (item->attrib & AM_DIR) {
+        fpm_printf("%*s", size_width, "-");
+    } else {
+        print_size(item->nbytes, size_width);
+    }
+    fpm_puts("  ");
+    print_time(item->mtime);
+    fpm_puts(name);
+    if (options->type) {
+        print_type(item);
+    }
+    if (is_link(item)) {
+        print_link(item);
+    }
+    fpm_puts("\r\n");
+}
+
 //
 // Print files in -l format.
 //
-static void print_long(file_list_t *list, options_t *options, uint64_t kbytes_total,
-                       uint64_t maxsize)
+static void print_long(listing_t *list, options_t *options, const totals_t *totals,
+                       bool first_chunk)
 {
-    if (!options->toplevel && options->longform)
-        fpm_printf("Total %ju kbytes\r\n", (uintmax_t)kbytes_total);
+    if (!options->toplevel && options->longform && first_chunk)
+        fpm_printf("Total %ju kbytes\r\n", (uintmax_t)totals->kbytes_total);
 
-    unsigned size_width = size_len(maxsize);
-    list_item_t *item;
-    for (item = list->head; item; item = item->next) {
+    unsigned size_width = size_len(totals->maxsize);
+    for (unsigned i = 0; i < list->count; i++) {
+        const entry_t *item = &list->entries[i];
         if (item->no_print)
             continue;
 
-        print_attrib(item->attrib);
-        fpm_puts("  ");
-        if (item->attrib & AM_DIR) {
-            fpm_printf("%*s", size_width, "-");
-        } else {
-            print_size(item->nbytes, size_width);
-        }
-        fpm_puts("  ");
-        print_time(item->mtime);
-        fpm_puts(item->name);
-        if (options->type) {
-            print_type(item);
-        }
-        if (is_link(item)) {
-            print_link(item);
-        }
-        fpm_puts("\r\n");
+        print_long_entry(item, entry_name(list, item), options, size_width);
     }
 }
 
 //
 // Print files in columns.
+// Printable entries are sorted first, so the array can be accessed directly.
 //
-static void print_columnized(file_list_t *list, options_t *options, int printable_entries,
-                             unsigned maxlen, uint64_t kbytes_total)
-{
-    //
-    // Have to do random access in the linked list -- build a table of pointers.
-    //
-    list_item_t **array = alloca(printable_entries * sizeof(list_item_t *));
-    unsigned num = 0;
-    list_item_t *item;
-    for (item = list->head; item; item = item->next) {
-        if (!item->no_print) {
-            array[num++] = item;
-        }
-    }
-
+static void print_columnized(listing_t *list, options_t *options, unsigned num,
+                             const totals_t *totals, bool first_chunk)
+{
     // Compute column width.
-    unsigned colwidth = maxlen;
+    unsigned colwidth = totals->maxlen;
     if (options->type) {
         colwidth += 1;
     }
@@ -433,8 +685,8 @@ static void print_columnized(file_list_t *list, options_t *options, int printabl
         ++numrows;
     }
 
-    if (!options->toplevel && options->longform)
-        fpm_printf("Total %ju kbytes\r\n", (uintmax_t)kbytes_total);
+    if (!options->toplevel && options->longform && first_chunk)
+        fpm_printf("Total %ju kbytes\r\n", (uintmax_t)totals->kbytes_total);
 
     unsigned row;
     for (row = 0; row < numrows; ++row) {
@@ -444,7 +696,8 @@ static void print_columnized(file_list_t *list, options_t *options, int printabl
         unsigned col;
 
         for (col = 0; col < numcols; ++col) {
-            char_count += print_filename(array[base], options);
+            const entry_t *item = &list->entries[base];
+            char_count += print_filename(item, entry_name(list, item), options);
             base += numrows;
             if (base >= num)
                 break;
@@ -460,46 +713,17 @@ static void print_columnized(file_list_t *list, options_t *options, int printabl
 }
 
 //
-// Print list of files, according to given options.
+// Print sorted list of files, according to given options.
+// Totals are computed for the whole directory, which may be listed in several chunks.
 //
-static void show_files(file_list_t *list, options_t *options)
+static void show_files(listing_t *list, options_t *options, const totals_t *totals,
+                       bool first_chunk)
 {
-    if (list_is_empty(list)) {
-        return;
-    }
-
-    // Sort the list.
-    list_sort(list, options);
-
-    uint64_t kbytes_total = 0;
-    uint64_t maxsize = 0;
-    unsigned maxlen = 0;
-    int printable_entries = 0;
-    list_item_t *item;
-    for (item = list->head; item; item = item->next) {
-        if (item->attrib & AM_HID) {
-            // Only display hidden files if -a set.
-            if (!options->showhidden) {
-                item->no_print = 1;
-                continue;
-            }
+    unsigned printable_entries = 0;
+    for (unsigned i = 0; i < list->count; i++) {
+        if (!list->entries[i].no_print) {
+            ++printable_entries;
         }
-        if (item->attrib & AM_DIR) {
-            // At top level, directories will be displayed later.
-            if (options->toplevel) {
-                item->no_print = 1;
-                continue;
-            }
-        }
-        if (item->namelen > maxlen)
-            maxlen = item->namelen;
-
-        if (item->nbytes > maxsize)
-            maxsize = item->nbytes;
-
-        kbytes_total += (item->nbytes + 1023) / 1024;
-
-        ++printable_entries;
     }
 
     if (!printable_entries)
@@ -509,9 +733,9 @@ static void show_files(file_list_t *list, options_t *options)
     if (options->singlecol) {
         print_single_column(list, options);
     } else if (options->longform) {
-        print_long(list, options, kbytes_total, maxsize);
+        print_long(list, options, totals, first_chunk);
     } else {
-        print_columnized(list, options, printable_entries, maxlen, kbytes_total);
+        print_columnized(list, options, printable_entries, totals, first_chunk);
     }
 
     options->any_output = 1;
@@ -520,9 +744,9 @@ static void show_files(file_list_t *list, options_t *options)
 //
 // For every directory in the list, call show_dir().
 //
-static void show_directories(file_list_t *list, options_t *options, const char *parent)
+static void show_directories(listing_t *list, options_t *options, const char *parent)
 {
-    if (list_is_empty(list)) {
+    if (list->count == 0) {
         return;
     }
 
@@ -533,16 +757,16 @@ static void show_directories(file_list_t *list, options_t *options, const char *
     strcpy(path, parent);
     path[parent_len] = '/';
 
-    list_item_t *item;
-    for (item = list->head; item; item = item->next) {
+    for (unsigned i = 0; i < list->count; i++) {
+        const entry_t *item = &list->entries[i];
         if (item->attrib & AM_DIR) {
-            strcpy(path + offset, item->name);
+            strcpy(path + offset, entry_name(list, item));
 
             // Print directory path.
             if (options->any_output) {
                 // If already output something, put out a newline as a separator.
                 fpm_printf("\r\n%s:\r\n", path);
-            } else if (!options->toplevel || list->head->next != 0) {
+            } else if (!options->toplevel || list->count > 1) {
                 // If multiple arguments, precede each directory with its name.
                 fpm_printf("%s:\r\n", path);
                 options->any_output = 1;
@@ -555,17 +779,22 @@ static void show_directories(file_list_t *list, options_t *options, const char *
 
 //
 // Get contents of directory with given path.
+// Only entries following the cursor are kept.
+// When totals are given, compute them for the whole directory.
+// Return false on error.
 //
-static void scan_directory(file_list_t *list, const char *path)
+static bool scan_directory(listing_t *list, const char *path, const cursor_t *cursor,
+                           bool dirs_only, totals_t *totals)
 {
     // Scan the directory.
     directory_t *dir = alloca(f_sizeof_directory_t());
     fs_result_t result = f_opendir(dir, path);
     if (result != FR_OK) {
         fpm_printf("%s: %s\r\n", path, f_strerror(result));
-        return;
+        return false;
     }
     file_info_t info = {};
+    unsigned position = 0;
     for (;;) {
         // Get directory entry.
         result = f_readdir(dir, &info);
@@ -573,7 +802,128 @@ static void scan_directory(file_list_t *list, const char *path)
             // End of directory.
             break;
         }
-        list_append_file_info(list, &info);
+        entry_t e;
+        const char *name = make_entry(&e, &info);
+        if (dirs_only && !(e.attrib & AM_DIR)) {
+            continue;
+        }
+        mark_entry(&e, list->options, totals);
+        if (list->options->unsorted) {
+            // Directory order: skip previous chunks, keep what fits.
+            unsigned index = position++;
+            if (index >= cursor->position && !list->overflow &&
+                !listing_append(list, &e, name)) {
+                list->overflow = true;
+                list->position = index;
+            }
+            continue;
+        }
+        if (cursor->valid &&
+            compare_keys(list->options, &e, name, &cursor->last, cursor->name) <= 0) {
+            // Listed in previous chunk.
+            continue;
+        }
+        listing_add(list, &e, name);
+    }
+    f_closedir(dir);
+    return true;
+}
+
+//
+// Print contents of the directory, in chunks when it does not fit in memory.
+// Set whole to true when the listing contains the whole directory: it is left open.
+// Return false on error.
+//
+static bool show_chunks(listing_t *list, const char *path, options_t *options, bool *whole)
+{
+    totals_t totals = {};
+    cursor_t cursor = {};
+    for (;;) {
+        if (!listing_open(list, options, path)) {
+            return false;
+        }
+        if (!scan_directory(list, path, &cursor, false, cursor.valid ? NULL : &totals)) {
+            listing_close(list);
+            return false;
+        }
+        listing_sort(list);
+        show_files(list, options, &totals, !cursor.valid);
+        if (!list->overflow) {
+            break;
+        }
+
+        // Next chunk.
+        cursor_advance(&cursor, list);
+        listing_close(list);
+    }
+    *whole = !cursor.valid;
+    if (!*whole) {
+        listing_close(list);
+    }
+    return true;
+}
+
+//
+// Call show_dir() for every subdirectory, in chunks when they do not fit in memory.
+//
+static void show_subdirectories(const char *path, options_t *options)
+{
+    cursor_t cursor = {};
+    listing_t list;
+    do {
+        if (!listing_open(&list, options, path)) {
+            return;
+        }
+        if (!scan_directory(&list, path, &cursor, true, NULL)) {
+            listing_close(&list);
+            return;
+        }
+        listing_sort(&list);
+        if (list.overflow) {
+            cursor_advance(&cursor, &list);
+        }
+        listing_compact(&list);
+        show_directories(&list, options, path);
+        listing_close(&list);
+    } while (list.overflow);
+}
+
+//
+// Print contents of the directory as it is read, without sorting.
+//
+static void stream_directory(const char *path, options_t *options)
+{
+    directory_t *dir = alloca(f_sizeof_directory_t());
+    fs_result_t result = f_opendir(dir, path);
+    if (result != FR_OK) {
+        fpm_printf("%s: %s\r\n", path, f_strerror(result));
+        return;
+    }
+
+    // Sizes are not known in advance: reserve space for 4 Gbytes.
+    unsigned size_width = size_len(UINT32_MAX);
+    file_info_t info = {};
+    for (;;) {
+        result = f_readdir(dir, &info);
+        if (result != FR_OK || !info.fname[0]) {
+            break;
+        }
+        entry_t e;
+        const char *name = make_entry(&e, &info);
+        mark_entry(&e, options, NULL);
+        if (e.no_print) {
+            continue;
+        }
+        if (options->longform) {
+            if (size_len(e.nbytes) > size_width) {
+                size_width = size_len(e.nbytes);
+            }
+            print_long_entry(&e, name, options, size_width);
+        } else {
+            print_filename(&e, name, options);
+            fpm_puts("\r\n");
+        }
+        options->any_output = 1;
     }
     f_closedir(dir);
 }
@@ -583,17 +933,30 @@ static void scan_directory(file_list_t *list, const char *path)
 //
 static void show_dir(const char *path, options_t *options)
 {
-    // Scan the directory.
-    file_list_t list = {};
-    scan_directory(&list, path);
-
-    // Print contents.
     options->toplevel = false;
-    show_files(&list, options);
-    if (options->recursive) {
-        show_directories(&list, options, path);
+    if (options->unsorted) {
+        stream_directory(path, options);
+        if (options->recursive) {
+            show_subdirectories(path, options);
+        }
+        return;
+    }
+
+    listing_t list;
+    bool whole;
+    if (!show_chunks(&list, path, options, &whole)) {
+        return;
+    }
+    if (whole) {
+        // Whole directory is in memory.
+        if (options->recursive) {
+            listing_compact(&list);
+            show_directories(&list, options, path);
+        }
+        listing_close(&list);
+    } else if (options->recursive) {
+        show_subdirectories(path, options);
     }
-    list_delete(&list);
 }
 
 void fpm_cmd_dir(int argc, char *argv[])
@@ -602,7 +965,7 @@ void fpm_cmd_dir(int argc, char *argv[])
         { "help", FPM_NO_ARG, NULL, 'h' },
         {},
     };
-    file_list_t list = {};
+    listing_t list;
     options_t options = {};
     struct fpm_opt opt = {};
     unsigned argcount = 0;
@@ -618,7 +981,10 @@ void fpm_cmd_dir(int argc, char *argv[])
         options.columnated = true;
     }
 
-    while (fpm_getopt(argc, argv, "1lRahrt", long_opts, &opt) >= 0) {
+    if (!listing_open(&list, &options, argv[0])) {
+        return;
+    }
+    while (fpm_getopt(argc, argv, "1lRahrtf", long_opts, &opt) >= 0) {
         switch (opt.ret) {
         case 1:
             list_append_name(&list, opt.arg);
@@ -646,9 +1012,13 @@ void fpm_cmd_dir(int argc, char *argv[])
         case 't':
             options.timesort = true;
             break;
+        case 'f':
+            options.unsorted = true;
+            break;
         case '?':
             // Unknown option: message already printed.
             fpm_puts("\r\n");
+            listing_close(&list);
             return;
         case 'h':
             fpm_puts(
@@ -661,8 +1031,10 @@ void fpm_cmd_dir(int argc, char *argv[])
                 "    -R      Recursively list subdirectories\r\n"
                 "    -r      Reverse the order of the sort\r\n"
                 "    -t      Sort by modification time\r\n"
+                "    -f      Do not sort, list entries in directory order\r\n"
                 "    -1      Force output to be one entry per line\r\n"
                 "\n");
+            listing_close(&list);
             return;
         }
     }
@@ -670,16 +1042,21 @@ void fpm_cmd_dir(int argc, char *argv[])
     if (argcount == 0) {
         // Called without arguments - list current directory.
         list_append_name(&list, ".");
-    } else if (list_is_empty(&list)) {
-        // No valid arguments.
-        return;
     }
-    options.toplevel = true;
-    show_files(&list, &options);
-    show_directories(&list, &options, "");
+    if (list.count > 0) {
+        totals_t totals = {};
+        options.toplevel = true;
+        for (unsigned i = 0; i < list.count; i++) {
+            mark_entry(&list.entries[i], &options, &totals);
+        }
+        listing_sort(&list);
+        listing_compact(&list);
+        show_files(&list, &options, &totals, true);
+        show_directories(&list, &options, "");
+    }
 
     // Deallocate.
-    list_delete(&list);
+    listing_close(&list);
 
     if (options.any_output)
         fpm_puts("\r\n");
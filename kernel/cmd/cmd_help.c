@@ -34,10 +34,12 @@ void fpm_cmd_help(int argc, char *argv[])
     fpm_puts("clear or cls    Clear the console screen\r\n");
     fpm_puts("cp or copy      Copy files or directories\r\n");
     fpm_puts("date            Show or change the system date\r\n");
+    fpm_puts("defrag          Defragment files on a disk\r\n");
     fpm_puts("echo            Copy text directly to the console output\r\n");
     fpm_puts("eject           Release removable disk device\r\n");
     fpm_puts("format          Create filesystem on a disk device\r\n");
     fpm_puts("help or ?       Show all built-in commands\r\n");
+    fpm_puts("jobs            Show status of background program\r\n");
     fpm_puts("ls or dir       List the contents of a directory\r\n");
     fpm_puts("mkdir           Create a directory\r\n");
     fpm_puts("mount           Engage removable disk device\r\n");
@@ -45,11 +47,17 @@ void fpm_cmd_help(int argc, char *argv[])
     fpm_puts("reboot          Restart the FP/M kernel\r\n");
     fpm_puts("rm or erase     Delete a file or set of files\r\n");
     fpm_puts("rmdir           Remove a directory\r\n");
+    fpm_puts("set             Set or show environment variables\r\n");
+    fpm_puts("start           Run external program in background\r\n");
+    fpm_puts("sum or crc32    Compute checksums of files, also sha256\r\n");
     fpm_puts("time            Set or show the current system time\r\n");
     fpm_puts("ver             Show the version of FP/M software\r\n");
     fpm_puts("vol             Show the volume label of a disk device\r\n");
+    fpm_puts("wait            Wait for background program to finish\r\n");
     fpm_puts("exit            Close down the command interpreter\r\n");
     fpm_puts("\r\n");
     fpm_puts("Enter 'command -h' for more information on any of the above commands.\r\n");
+    fpm_puts("Use 'command > file' or '>> file' to save output, '< file' to read input,\r\n");
+    fpm_puts("and 'command1 | command2' to pass output of one command to another.\r\n");
     fpm_puts("\r\n");
 }
@@ -30,6 +30,7 @@ static void mount(const char *path)
         fpm_puts("\r\n\n");
         return;
     }
+    fpm_path_index();
 
     // Print media info.
     const char *filename = path;
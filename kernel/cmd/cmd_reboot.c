@@ -30,6 +30,9 @@ void fpm_cmd_reboot(int argc, char *argv[])
         }
     }
 
+    // Keep the last commands of this session.
+    fpm_history_save();
+
     fpm_puts("Reboot....\r\n\r\n");
     fpm_reboot();
 }
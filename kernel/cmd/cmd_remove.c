@@ -46,29 +46,44 @@ static void remove_file(const char *filename, const options_t *options)
     }
 }
 
+static fs_result_t remove_contents(directory_t *dir, const char *dirname, const options_t *options,
+                                   fs_chains_t *chains);
+
 //
-// Remove directory recursively.
+// Remove sub-directory, last read from the parent directory.
 //
-static fs_result_t remove_recursive(const char *dirname, const options_t *options)
+static fs_result_t remove_subdirectory(directory_t *parent, const char *dirname,
+                                       const options_t *options, fs_chains_t *chains)
 {
-    // Try to remove directory, assuming it's empty.
-    fs_result_t result = f_unlink(dirname);
-    if (result == FR_OK) {
-        // Succeeded.
-        if (options->verbose) {
-            fpm_printf("%s\r\n", dirname);
-        }
-        return FR_OK;
-    }
-
-    // Scan directory and remove files and sub-directories recursively.
     directory_t *dir = alloca(f_sizeof_directory_t());
-    result = f_opendir(dir, dirname);
+    fs_result_t result = f_opendirat(dir, parent);
     if (result != FR_OK) {
         fpm_printf("%s: %s\r\n", dirname, f_strerror(result));
         return result;
     }
+    result = remove_contents(dir, dirname, options, chains);
+    f_closedir(dir);
 
+    if (result == FR_OK) {
+        // Now the directory is empty: delete it.
+        result = f_unlinkat(parent, chains);
+        if (result != FR_OK) {
+            fpm_printf("%s: %s\r\n", dirname, f_strerror(result));
+        } else if (options->verbose) {
+            fpm_printf("%s\r\n", dirname);
+        }
+    }
+    return result;
+}
+
+//
+// Remove all files and sub-directories in the open directory.
+// Entries are deleted through the directory handle, so paths are never
+// followed from the root again, and clusters are released in batches.
+//
+static fs_result_t remove_contents(directory_t *dir, const char *dirname, const options_t *options,
+                                   fs_chains_t *chains)
+{
     // Allocate path for child.
     unsigned baselen = strlen(dirname);
     char child[baselen + FF_LFN_BUF + 2];
@@ -76,10 +91,15 @@ static fs_result_t remove_recursive(const char *dirname, const options_t *option
     char *child_last = child + baselen;
     *child_last++ = '/';
 
+    fs_result_t result;
     for (;;) {
         file_info_t info;
         result = f_readdir(dir, &info); /* Get a directory item */
-        if (result != FR_OK || !info.fname[0]) {
+        if (result != FR_OK) {
+            fpm_printf("%s: %s\r\n", dirname, f_strerror(result));
+            break;
+        }
+        if (!info.fname[0]) {
             // End of directory.
             break;
         }
@@ -87,10 +107,10 @@ static fs_result_t remove_recursive(const char *dirname, const options_t *option
         strcpy(child_last, info.fname);
         if (info.fattrib & AM_DIR) {
             // Delete sub-directory.
-            result = remove_recursive(child, options);
+            result = remove_subdirectory(dir, child, options, chains);
         } else {
             // Delete file.
-            result = f_unlink(child);
+            result = f_unlinkat(dir, chains);
             if (result != FR_OK) {
                 fpm_printf("%s: %s\r\n", child, f_strerror(result));
             } else if (options->verbose) {
@@ -101,6 +121,31 @@ static fs_result_t remove_recursive(const char *dirname, const options_t *option
         if (result != FR_OK)
             break;
     }
+    return result;
+}
+
+//
+// Remove directory recursively.
+//
+static fs_result_t remove_recursive(const char *dirname, const options_t *options)
+{
+    directory_t *dir = alloca(f_sizeof_directory_t());
+    fs_result_t result = f_opendir(dir, dirname);
+    if (result != FR_OK) {
+        fpm_printf("%s: %s\r\n", dirname, f_strerror(result));
+        return result;
+    }
+
+    fs_chains_t chains;
+    chains.count = 0;
+    result = remove_contents(dir, dirname, options, &chains);
+
+    // Release clusters of the deleted entries.
+    fs_result_t freed = f_freechains(dir, &chains);
+    if (freed != FR_OK && result == FR_OK) {
+        fpm_printf("%s: %s\r\n", dirname, f_strerror(freed));
+        result = freed;
+    }
     f_closedir(dir);
 
     if (result == FR_OK) {
@@ -109,7 +154,7 @@ static fs_result_t remove_recursive(const char *dirname, const options_t *option
         if (result != FR_OK) {
             fpm_printf("%s: %s\r\n", dirname, f_strerror(result));
         } else if (options->verbose) {
-            fpm_printf("%s\r\n", child);
+            fpm_printf("%s\r\n", dirname);
         }
     }
     return result;
@@ -0,0 +1,84 @@
+//
+// Set or show environment variables
+//
+#include <fpm/api.h>
+#include <fpm/getopt.h>
+#include <fpm/internal.h>
+
+void fpm_cmd_set(int argc, char *argv[])
+{
+    static const struct fpm_option long_opts[] = {
+        { "help", FPM_NO_ARG, NULL, 'h' },
+        {},
+    };
+    struct fpm_opt opt = {};
+    char line[3 * FPM_CMDLINE_SIZE];
+    unsigned len = 0;
+
+    while (fpm_getopt(argc, argv, "h", long_opts, &opt) >= 0) {
+        switch (opt.ret) {
+        case 1:
+            // Join arguments with spaces.
+            if (len > 0 && len < sizeof(line) - 1) {
+                line[len++] = ' ';
+            }
+            len += fpm_strlcpy(line + len, opt.arg, sizeof(line) - len);
+            if (len >= sizeof(line)) {
+                fpm_puts("set: Line too long\r\n\n");
+                return;
+            }
+            break;
+
+        case '?':
+            // Unknown option: message already printed.
+            fpm_puts("\r\n");
+            return;
+
+        case 'h':
+            fpm_puts("Usage:\r\n"
+                     "    set\r\n"
+                     "    set name\r\n"
+                     "    set name=value\r\n"
+                     "    set name=\r\n"
+                     "\n"
+                     "Show all variables, show one variable, assign a value,\r\n"
+                     "or remove the variable. Scripts get values as %name%.\r\n"
+                     "PATH lists directories to search for commands, separated\r\n"
+                     "by ';'. By default, PATH is flash:/bin.\r\n"
+                     "When BINDNOW is set, programs resolve all symbols at start,\r\n"
+                     "so a missing one is reported before the program runs.\r\n"
+                     "\n");
+            return;
+        }
+    }
+
+    if (len == 0) {
+        // Show all variables.
+        for (const char *var = fpm_nextenv(NULL); var; var = fpm_nextenv(var)) {
+            fpm_printf("%s\r\n", var);
+        }
+        fpm_puts("\r\n");
+        return;
+    }
+    line[len] = 0;
+
+    char *value = strchr(line, '=');
+    if (!value) {
+        // Show one variable.
+        const char *found = fpm_getenv(line);
+        if (found) {
+            fpm_printf("%s=%s\r\n\n", line, found);
+        } else {
+            fpm_printf("%s: Not defined\r\n\n", line);
+        }
+        return;
+    }
+    *value++ = 0;
+    if (line[0] == 0) {
+        fpm_puts("set: Missing variable name\r\n\n");
+        return;
+    }
+    if (!fpm_setenv(line, value)) {
+        fpm_printf("%s: No space for variable\r\n\n", line);
+    }
+}
@@ -0,0 +1,42 @@
+//
+// Run external program in background
+//
+#include <fpm/api.h>
+#include <fpm/getopt.h>
+#include <fpm/internal.h>
+
+void fpm_cmd_start(int argc, char *argv[])
+{
+    static const struct fpm_option long_opts[] = {
+        { "help", FPM_NO_ARG, NULL, 'h' },
+        {},
+    };
+    struct fpm_opt opt = {};
+
+    while (fpm_getopt(argc, argv, "h", long_opts, &opt) >= 0) {
+        switch (opt.ret) {
+        case 1:
+            // First non-option argument: the rest belongs to the program.
+            fpm_exec_background(argc - opt.ind + 1, &argv[opt.ind - 1]);
+            return;
+
+        case '?':
+            // Unknown option: message already printed.
+            fpm_puts("\r\n");
+            return;
+
+        case 'h':
+usage:      fpm_puts("Usage:\r\n"
+                     "    start program [argument ...]\r\n"
+                     "    program [argument ...] &\r\n"
+                     "\n"
+                     "Run the program in background, while the shell stays live.\r\n"
+                     "Use 'jobs' to see its output, 'wait' to wait for completion.\r\n"
+                     "\n");
+            return;
+        }
+    }
+
+    // Nothing to run.
+    goto usage;
+}
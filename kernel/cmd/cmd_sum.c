@@ -0,0 +1,287 @@
+//
+// Compute checksums of files
+//
+// Files are read in large chunks, many sectors at once, so FatFs moves
+// whole clusters straight into the buffer. Two chunks alternate: while
+// one is hashed, the next one is read by a background job, so on RP2040
+// the second core keeps the disk busy.
+//
+#include <fpm/api.h>
+#include <fpm/fs.h>
+#include <fpm/getopt.h>
+#include <fpm/internal.h>
+#include <alloca.h>
+
+#define MAX_CHUNK_SIZE (32 * 1024)
+#define MIN_CHUNK_SIZE 512
+
+//
+// Options for checksums.
+//
+typedef struct {
+    bool sha256;    // SHA-256 instead of CRC-32
+    bool recursive; // hash files in directories
+} options_t;
+
+//
+// Chunk of file data, read in background.
+//
+typedef struct {
+    fpm_job_t job;  // Background read
+    file_t *file;   // File to read from
+    char *data;     // Buffer
+    unsigned len;   // Bytes read
+} chunk_t;
+
+//
+// Buffers for both chunks, allocated once per command.
+//
+typedef struct {
+    chunk_t chunk[2];
+    unsigned size;  // Size of each buffer
+} reader_t;
+
+//
+// Read next chunk of the file.
+// Executed in background.
+//
+static void read_chunk(fpm_job_t *job)
+{
+    reader_t *r = job->arg;
+    chunk_t *c = (job == &r->chunk[0].job) ? &r->chunk[0] : &r->chunk[1];
+
+    job->result = f_read(c->file, c->data, r->size, &c->len);
+}
+
+//
+// Start reading the chunk in background.
+//
+static void chunk_submit(reader_t *r, chunk_t *c, file_t *file)
+{
+    c->file = file;
+    c->job.func = read_chunk;
+    c->job.arg = r;
+    fpm_job_submit(&c->job);
+}
+
+//
+// Hash contents of the file and print the result.
+//
+static void sum_file(reader_t *r, const char *path, const options_t *options)
+{
+    file_t *file = alloca(f_sizeof_file_t());
+    fs_result_t result = f_open(file, path, FA_READ);
+    if (result != FR_OK) {
+        fpm_printf("%s: %s\r\n", path, f_strerror(result));
+        return;
+    }
+
+    uint32_t crc = 0;
+    fpm_sha256_t sha;
+    if (options->sha256) {
+        fpm_sha256_init(&sha);
+    }
+
+    // Hash one chunk while the other one is being read.
+    unsigned k = 0;
+    chunk_submit(r, &r->chunk[k], file);
+    for (;;) {
+        chunk_t *c = &r->chunk[k];
+        result = fpm_job_wait(&c->job);
+        if (result != FR_OK || c->len == 0) {
+            break;
+        }
+        if (c->len == r->size) {
+            chunk_submit(r, &r->chunk[k ^ 1], file);
+        }
+        if (options->sha256) {
+            fpm_sha256_update(&sha, c->data, c->len);
+        } else {
+            crc = fpm_crc32(crc, c->data, c->len);
+        }
+        if (c->len < r->size) {
+            // End of file.
+            break;
+        }
+        k ^= 1;
+    }
+    f_close(file);
+
+    if (result != FR_OK) {
+        fpm_printf("%s: %s\r\n", path, f_strerror(result));
+        return;
+    }
+    if (options->sha256) {
+        uint8_t digest[32];
+        fpm_sha256_final(&sha, digest);
+        for (unsigned i = 0; i < sizeof(digest); i++) {
+            fpm_printf("%02x", digest[i]);
+        }
+        fpm_printf("  %s\r\n", path);
+    } else {
+        fpm_printf("%08x  %s\r\n", crc, path);
+    }
+}
+
+//
+// Hash all files in the directory and its sub-directories.
+//
+static void sum_directory(reader_t *r, const char *dirname, const options_t *options)
+{
+    directory_t *dir = alloca(f_sizeof_directory_t());
+    fs_result_t result = f_opendir(dir, dirname);
+    if (result != FR_OK) {
+        fpm_printf("%s: %s\r\n", dirname, f_strerror(result));
+        return;
+    }
+
+    // Allocate path for child.
+    unsigned baselen = strlen(dirname);
+    char child[baselen + FF_LFN_BUF + 2];
+    strcpy(child, dirname);
+    char *child_last = child + baselen;
+    if (baselen == 0 || child_last[-1] != '/') {
+        *child_last++ = '/';
+    }
+
+    for (;;) {
+        file_info_t info;
+        result = f_readdir(dir, &info);
+        if (result != FR_OK) {
+            fpm_printf("%s: %s\r\n", dirname, f_strerror(result));
+            break;
+        }
+        if (!info.fname[0]) {
+            // End of directory.
+            break;
+        }
+        strcpy(child_last, info.fname);
+        if (info.fattrib & AM_DIR) {
+            sum_directory(r, child, options);
+        } else {
+            sum_file(r, child, options);
+        }
+    }
+    f_closedir(dir);
+}
+
+//
+// Hash one file or directory.
+//
+static void sum(reader_t *r, const char *path, const options_t *options)
+{
+    file_info_t info;
+    fs_result_t result = f_stat(path, &info);
+    if (result != FR_OK) {
+        // Root directory has no entry: try to open it.
+        directory_t *dir = alloca(f_sizeof_directory_t());
+        if (f_opendir(dir, path) != FR_OK) {
+            fpm_printf("%s: %s\r\n", path, f_strerror(result));
+            return;
+        }
+        f_closedir(dir);
+        info.fattrib = AM_DIR;
+    }
+    if (!(info.fattrib & AM_DIR)) {
+        sum_file(r, path, options);
+    } else if (options->recursive) {
+        sum_directory(r, path, options);
+    } else {
+        fpm_printf("%s: Is a directory, use -r\r\n", path);
+    }
+}
+
+//
+// Allocate buffers for both chunks: as large as possible, up to MAX_CHUNK_SIZE.
+// Return false when out of memory.
+//
+static bool reader_alloc(reader_t *r)
+{
+    for (unsigned size = MAX_CHUNK_SIZE; size >= MIN_CHUNK_SIZE; size /= 2) {
+        char *buf = fpm_alloc_dirty(2 * size);
+        if (buf) {
+            memset(r, 0, sizeof(*r));
+            r->chunk[0].data = buf;
+            r->chunk[1].data = buf + size;
+            r->size = size;
+            return true;
+        }
+    }
+    return false;
+}
+
+void fpm_cmd_sum(int argc, char *argv[])
+{
+    static const struct fpm_option long_opts[] = {
+        { "algorithm", FPM_REQUIRED_ARG, NULL, 'a' },
+        { "recursive", FPM_NO_ARG, NULL, 'r' },
+        { "help", FPM_NO_ARG, NULL, 'h' },
+        {},
+    };
+    options_t options = {
+        .sha256 = (strcasecmp(argv[0], "sha256") == 0),
+    };
+    struct fpm_opt opt = {};
+    unsigned argcount = 0;
+    reader_t reader;
+    bool allocated = false;
+
+    while (fpm_getopt(argc, argv, "a:rh", long_opts, &opt) >= 0) {
+        switch (opt.ret) {
+        case 1:
+            if (!allocated) {
+                allocated = reader_alloc(&reader);
+                if (!allocated) {
+                    fpm_puts("Out of memory\r\n\n");
+                    return;
+                }
+            }
+            sum(&reader, opt.arg, &options);
+            argcount++;
+            break;
+
+        case 'a':
+            if (strcasecmp(opt.arg, "sha256") == 0) {
+                options.sha256 = true;
+            } else if (strcasecmp(opt.arg, "crc32") == 0) {
+                options.sha256 = false;
+            } else {
+                fpm_printf("%s: Unknown algorithm `%s`\r\n\n", argv[0], opt.arg);
+                goto done;
+            }
+            break;
+
+        case 'r':
+            options.recursive = true;
+            break;
+
+        case '?':
+            // Unknown option: message already printed.
+            fpm_puts("\r\n");
+            goto done;
+
+        case 'h':
+usage:      fpm_puts("Usage:\r\n"
+                     "    sum [options] filename ...\r\n"
+                     "    crc32 [options] filename ...\r\n"
+                     "    sha256 [options] filename ...\r\n"
+                     "Options:\r\n"
+                     "    -a name     Algorithm: crc32 or sha256\r\n"
+                     "    -r          Checksum files in directories recursively\r\n"
+                     "\n"
+                     "By default, sum and crc32 compute CRC-32, as in zip and zlib.\r\n"
+                     "\n");
+            goto done;
+        }
+    }
+
+    if (argcount == 0) {
+        // Nothing to checksum.
+        goto usage;
+    }
+    fpm_puts("\r\n");
+done:
+    if (allocated) {
+        fpm_free(reader.chunk[0].data);
+    }
+}
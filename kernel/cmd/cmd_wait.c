@@ -0,0 +1,37 @@
+//
+// Wait for background program to finish
+//
+#include <fpm/api.h>
+#include <fpm/getopt.h>
+#include <fpm/internal.h>
+
+void fpm_cmd_wait(int argc, char *argv[])
+{
+    static const struct fpm_option long_opts[] = {
+        { "help", FPM_NO_ARG, NULL, 'h' },
+        {},
+    };
+    struct fpm_opt opt = {};
+
+    while (fpm_getopt(argc, argv, "h", long_opts, &opt) >= 0) {
+        switch (opt.ret) {
+        case 1:
+            fpm_printf("%s: Unexpected argument `%s`\r\n\n", argv[0], opt.arg);
+            return;
+        case '?':
+            // Unknown option: message already printed.
+            fpm_puts("\r\n");
+            return;
+        case 'h':
+            fpm_puts("Usage: wait\r\n"
+                     "\n"
+                     "Wait for background program to finish, and show its exit code.\r\n"
+                     "Press ESC or ^C to stop waiting: the program keeps running.\r\n"
+                     "\n");
+            return;
+        }
+    }
+
+    fpm_exit_code = fpm_background_wait();
+    fpm_puts("\r\n");
+}
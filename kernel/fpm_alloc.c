@@ -55,9 +55,9 @@ enum {
 static unsigned const SIZEOF_POINTER = sizeof(void *);
 
 //
-// Descriptor of current program being running.
+// Descriptor of current program being running, on each core.
 //
-volatile fpm_context_t *fpm_context;
+volatile fpm_context_t *fpm_core_context[FPM_NUM_CORES];
 
 //
 // Memory alignment.
@@ -356,8 +356,9 @@ void fpm_heap_init(fpm_context_t *ctx, size_t start, size_t nbytes)
     // fpm_printf("fpm_heap_init: start=0x%zx, size %zu bytes\n", start, nbytes);
 
     // Link this context into the chain.
-    memset(ctx, 0, sizeof(*ctx));
+    // Info about loaded program, if any, is kept intact.
     ctx->parent = fpm_context;
+    ctx->free_list = NULL;
     fpm_context = ctx;
 
     fpm_heap_setup(start, nbytes);
@@ -409,3 +410,20 @@ void fpm_context_pop()
 {
     fpm_context = fpm_context->parent;
 }
+
+//
+// Allocate a half of the free heap, or less when free space is fragmented.
+//
+void *fpm_alloc_arena(unsigned min_size, unsigned *size)
+{
+    unsigned nbytes = (fpm_heap_available() / 2) & -sizeof(uint64_t);
+    while (nbytes >= min_size) {
+        void *arena = fpm_alloc_dirty(nbytes);
+        if (arena) {
+            *size = nbytes;
+            return arena;
+        }
+        nbytes = (nbytes / 2) & -sizeof(uint64_t);
+    }
+    return NULL;
+}
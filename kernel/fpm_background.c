@@ -0,0 +1,302 @@
+//
+// External program running in background, on core 1.
+//
+// The shell stays live on core 0 while the program runs.
+// The program gets its own heap, carved from the shell's heap,
+// its own stack (the stack of core 1) and its own GOT pointer.
+// Console output of the program goes to a separate stream:
+// a ring buffer, which is displayed by 'jobs' and 'wait' commands,
+// or when the program finishes. The program has no console input.
+//
+// Only one background program can run at a time.
+// The ring is written by core 1 and read by core 0,
+// same as the job queue in fpm_jobs.c.
+//
+#include <fpm/api.h>
+#include <fpm/internal.h>
+#include <fpm/loader.h>
+#include <fpm/context.h>
+
+//
+// Size of console output buffer, must be a power of two.
+//
+#define OUTPUT_SIZE 1024
+
+static const unsigned MIN_STACK_SIZE = 8*1024;
+static const unsigned MIN_HEAP_SIZE  = 8*1024;
+
+//
+// State of the background program.
+// Allocated in the shell's heap, followed by the arguments,
+// the output buffer and the heap of the program.
+//
+typedef struct {
+    fpm_job_t job;          // Job for core 1
+    fpm_context_t ctx;      // Context of the program
+    unsigned id;            // Job number, for user
+    bool invoked;           // Program has been successfully started
+    const char *path;       // File name of the program
+    int argc;               // Arguments
+    char **argv;
+    size_t heap_start;      // Memory for the program
+    size_t heap_size;
+    char *output;           // Ring buffer for console output
+    unsigned output_head;   // Next byte to write, owned by core 1
+    unsigned output_tail;   // Next byte to display, owned by core 0
+    unsigned output_lost;   // Bytes dropped when buffer was full
+} background_t;
+
+static background_t *bg;
+static unsigned last_id;
+
+//
+// Align size on pointer-sized boundary.
+//
+static inline size_t size_align(size_t nbytes)
+{
+    return (nbytes + sizeof(void *) - 1) & -sizeof(void *);
+}
+
+//
+// Run the program on core 1.
+//
+static void run_program(fpm_job_t *job)
+{
+    background_t *b = job->arg;
+    fpm_context_t *ctx = &b->ctx;
+
+    job->result = -1;
+    if (fpm_stack_available() < MIN_STACK_SIZE) {
+        fpm_printf("%s: No space for stack\r\n", b->argv[0]);
+        return;
+    }
+
+    // Link the program into context chain of this core.
+    fpm_heap_init(ctx, b->heap_start, b->heap_size);
+    if (fpm_invoke(ctx, fpm_bindings, b->argc, b->argv)) {
+        b->invoked = true;
+        job->result = ctx->exit_code;
+    }
+    fpm_context_pop();
+}
+
+//
+// Start external program in background.
+// Return false on failure.
+//
+bool fpm_background_start(const char *path, int argc, char *argv[])
+{
+    if (bg) {
+        // Release previous program when it has finished.
+        fpm_background_poll();
+        if (bg) {
+            fpm_printf("%s: Background program is already running, use 'wait'\r\n", argv[0]);
+            return false;
+        }
+    }
+
+    // Compute space for state and arguments.
+    size_t args_size = strlen(path) + 1;
+    for (int i = 0; i < argc; i++) {
+        args_size += strlen(argv[i]) + 1;
+    }
+    size_t header_size = size_align(sizeof(background_t) + (argc + 1) * sizeof(char *) + args_size);
+    size_t min_size = header_size + OUTPUT_SIZE + MIN_HEAP_SIZE;
+
+    // Give half of free memory to the program.
+    // Free space may be fragmented, so reduce the size until allocation succeeds.
+    size_t size = size_align(fpm_heap_available() / 2);
+    background_t *b = NULL;
+    while (size >= min_size) {
+        b = fpm_alloc_dirty(size);
+        if (b) {
+            break;
+        }
+        size = size_align(size / 2);
+    }
+    if (!b) {
+        fpm_printf("%s: No space for heap\r\n", argv[0]);
+        return false;
+    }
+
+    // Copy arguments.
+    memset(b, 0, sizeof(*b));
+    b->argc = argc;
+    b->argv = (char **)(b + 1);
+    char *str = (char *)&b->argv[argc + 1];
+    for (int i = 0; i < argc; i++) {
+        b->argv[i] = str;
+        strcpy(str, argv[i]);
+        str += strlen(str) + 1;
+    }
+    b->argv[argc] = NULL;
+    b->path = strcpy(str, path);
+
+    // Map the program on this core, as shared libraries are managed by core 0.
+    b->ctx.bind_now = (fpm_getenv("BINDNOW") != NULL);
+    if (!fpm_load(&b->ctx, b->path)) {
+        // Failed: error message already printed.
+        fpm_free(b);
+        return false;
+    }
+
+    // Split the rest between output buffer and heap.
+    b->output = (char *)b + header_size;
+    b->heap_start = (size_t)b->output + OUTPUT_SIZE;
+    b->heap_size = size - header_size - OUTPUT_SIZE;
+
+    // Publish the state, then start the job.
+    b->id = ++last_id;
+    __atomic_store_n(&bg, b, __ATOMIC_RELEASE);
+    b->job.func = run_program;
+    b->job.arg = b;
+    fpm_printf("[%u] %s\r\n", b->id, b->path);
+    fpm_job_submit_program(&b->job);
+    return true;
+}
+
+//
+// Is background program still running?
+//
+bool fpm_background_running()
+{
+    return bg && !fpm_job_done(&bg->job);
+}
+
+//
+// Save console output of background program.
+// Called on core 1.
+// Return false when no background program is running.
+//
+bool fpm_background_write(const char *buf, unsigned len)
+{
+    background_t *b = __atomic_load_n(&bg, __ATOMIC_ACQUIRE);
+    if (!b || !fpm_context) {
+        // Not a program: background job.
+        return false;
+    }
+
+    unsigned head = __atomic_load_n(&b->output_head, __ATOMIC_RELAXED);
+    unsigned tail = __atomic_load_n(&b->output_tail, __ATOMIC_ACQUIRE);
+    unsigned avail = OUTPUT_SIZE - (head - tail);
+    if (len > avail) {
+        // Buffer is full: drop the rest.
+        b->output_lost += len - avail;
+        len = avail;
+    }
+    while (len-- > 0) {
+        b->output[head++ % OUTPUT_SIZE] = *buf++;
+    }
+    __atomic_store_n(&b->output_head, head, __ATOMIC_RELEASE);
+    return true;
+}
+
+//
+// Display output of background program, collected so far.
+//
+static void show_output(background_t *b)
+{
+    unsigned tail = __atomic_load_n(&b->output_tail, __ATOMIC_RELAXED);
+    unsigned head = __atomic_load_n(&b->output_head, __ATOMIC_ACQUIRE);
+    while (tail != head) {
+        // Write contiguous part of the ring.
+        unsigned offset = tail % OUTPUT_SIZE;
+        unsigned len = head - tail;
+        if (len > OUTPUT_SIZE - offset) {
+            len = OUTPUT_SIZE - offset;
+        }
+        fpm_write(&b->output[offset], len);
+        tail += len;
+    }
+    __atomic_store_n(&b->output_tail, tail, __ATOMIC_RELEASE);
+}
+
+//
+// Display status line of background program.
+//
+static void show_status(background_t *b)
+{
+    fpm_printf("[%u] ", b->id);
+    if (!fpm_job_done(&b->job)) {
+        fpm_puts("Running");
+    } else if (b->invoked) {
+        fpm_printf("Done, exit code %d", b->job.result);
+    } else {
+        fpm_puts("Failed");
+    }
+    for (int i = 0; i < b->argc; i++) {
+        fpm_putchar(' ');
+        fpm_puts(b->argv[i]);
+    }
+    if (b->output_lost > 0) {
+        fpm_printf(" (%u bytes of output lost)", b->output_lost);
+    }
+    fpm_puts("\r\n");
+}
+
+//
+// Display final status and release memory of finished program.
+// Return exit code.
+//
+static int finish(background_t *b)
+{
+    show_output(b);
+    show_status(b);
+
+    int exit_code = b->job.result;
+    fpm_unload(&b->ctx);
+    __atomic_store_n(&bg, NULL, __ATOMIC_RELEASE);
+    fpm_free(b);
+    return exit_code;
+}
+
+//
+// Show status and output of background program.
+//
+void fpm_background_status()
+{
+    if (!bg) {
+        fpm_puts("No background jobs\r\n");
+        return;
+    }
+    if (fpm_job_done(&bg->job)) {
+        finish(bg);
+        return;
+    }
+    show_output(bg);
+    show_status(bg);
+}
+
+//
+// Report completion of background program.
+// Called by the shell before the prompt.
+//
+void fpm_background_poll()
+{
+    if (bg && fpm_job_done(&bg->job)) {
+        finish(bg);
+        fpm_puts("\r\n");
+    }
+}
+
+//
+// Wait for background program to finish, displaying its output.
+// ESC stops waiting, ^C too, while the program keeps running.
+// Return exit code, or -1 when nothing is running.
+//
+int fpm_background_wait()
+{
+    if (!bg) {
+        fpm_puts("No background jobs\r\n");
+        return -1;
+    }
+    while (!fpm_job_done(&bg->job)) {
+        show_output(bg);
+        if (fpm_getchar_timeout(0) == '\33') {
+            show_status(bg);
+            return -1;
+        }
+        fpm_delay_msec(10);
+    }
+    return finish(bg);
+}
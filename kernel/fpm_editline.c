@@ -1,51 +1,301 @@
 //
 // Interactive line editor.
 //
+// Each keystroke produces a minimal terminal update: cursor moves use
+// escape sequences with a count when shorter than backspaces or
+// reprinted text, and a recalled line is redrawn only from the first
+// difference with the displayed one.
+//
 #include <fpm/api.h>
 
 #define CTRL(c) (c & 037)
 
+//
+// Terminal update, collected in a buffer and written at once,
+// so that one keystroke results in one transfer over USB.
+//
+typedef struct {
+    char data[128];
+    unsigned len;
+} render_t;
+
+//
+// Write collected update to the console.
+//
+static void render_flush(render_t *r)
+{
+    if (r->len > 0) {
+        fpm_write(r->data, r->len);
+        r->len = 0;
+    }
+}
+
+//
+// Append bytes to the update.
+//
+static void render_bytes(render_t *r, const char *str, unsigned len)
+{
+    while (len-- > 0) {
+        if (r->len >= sizeof(r->data)) {
+            render_flush(r);
+        }
+        r->data[r->len++] = *str++;
+    }
+}
+
+static void render_str(render_t *r, const char *str)
+{
+    render_bytes(r, str, strlen(str));
+}
+
+//
+// Length of Unicode character in UTF-8 encoding.
+//
+static unsigned utf8_size(uint16_t ch)
+{
+    return (ch < 0x80) ? 1 : (ch < 0x800) ? 2 : 3;
+}
+
+//
+// Append Unicode characters, encoded as UTF-8.
+//
+static void render_wchars(render_t *r, const uint16_t *str, unsigned count)
+{
+    while (count-- > 0) {
+        unsigned ch = *str++;
+        char buf[3];
+        if (ch < 0x80) {
+            buf[0] = ch;
+        } else if (ch < 0x800) {
+            buf[0] = ch >> 6 | 0xc0;
+            buf[1] = (ch & 0x3f) | 0x80;
+        } else {
+            buf[0] = ch >> 12 | 0xe0;
+            buf[1] = ((ch >> 6) & 0x3f) | 0x80;
+            buf[2] = (ch & 0x3f) | 0x80;
+        }
+        render_bytes(r, buf, utf8_size(ch));
+    }
+}
+
+//
+// Append escape sequence with a count: ESC [ count cmd.
+// Return length of the sequence, or only compute it when r is NULL.
+//
+static unsigned render_escape(render_t *r, unsigned count, char cmd)
+{
+    char buf[16];
+    unsigned len = sizeof(buf);
+
+    buf[--len] = cmd;
+    do {
+        buf[--len] = '0' + count % 10;
+        count /= 10;
+    } while (count > 0);
+    buf[--len] = '[';
+    buf[--len] = '\33';
+
+    if (r) {
+        render_bytes(r, &buf[len], sizeof(buf) - len);
+    }
+    return sizeof(buf) - len;
+}
+
+//
+// Move cursor left by given number of characters.
+// Use backspaces or escape sequence, whichever is shorter.
+//
+static void cursor_left(render_t *r, unsigned count)
+{
+    if (count == 0) {
+        return;
+    }
+    if (count < render_escape(NULL, count, 'D')) {
+        while (count-- > 0) {
+            render_bytes(r, "\b", 1);
+        }
+    } else {
+        render_escape(r, count, 'D');
+    }
+}
+
+//
+// Move cursor right over given characters.
+// Print them again, or use escape sequence, whichever is shorter.
+//
+static void cursor_right(render_t *r, const uint16_t *str, unsigned count)
+{
+    if (count == 0) {
+        return;
+    }
+    unsigned nbytes = 0;
+    for (unsigned i = 0; i < count; i++) {
+        nbytes += utf8_size(str[i]);
+    }
+    if (nbytes <= render_escape(NULL, count, 'C')) {
+        render_wchars(r, str, count);
+    } else {
+        render_escape(r, count, 'C');
+    }
+}
+
 //
 // Insert a character at current position,
 // move the rest of the line to the right.
 //
-static void insert_character()
+static void insert_character(render_t *r)
 {
-    fpm_puts("\33[@");
+    render_str(r, "\33[@");
 }
 
 //
 // Remove a character at the current position,
 // move the rest of the line to the left.
 //
-static void delete_character()
+static void delete_character(render_t *r)
 {
-    fpm_puts("\33[P");
+    render_str(r, "\33[P");
 }
 
 //
 // Erase the line starting from current position.
 //
-static void erase_till_end_of_line()
+static void erase_till_end_of_line(render_t *r)
 {
-    fpm_puts("\33[K");
+    render_str(r, "\33[K");
 }
 
 //
 // "Unprint" the current line.
 //
-static void erase_line(uint16_t *buffer, unsigned *insert_pos)
+static void erase_line(render_t *r, uint16_t *buffer, unsigned *insert_pos)
 {
-    while (*insert_pos > 0) {
-        fpm_putwch('\b');
-        (*insert_pos)--;
-    }
+    cursor_left(r, *insert_pos);
+    *insert_pos = 0;
     if (buffer[0] != 0) {
-        erase_till_end_of_line();
+        erase_till_end_of_line(r);
         buffer[0] = 0;
     }
 }
 
+//
+// Replace the displayed line with new contents, and copy it to the buffer.
+// Only the part which differs is redrawn. Cursor goes to the end of line.
+//
+static void replace_line(render_t *r, uint16_t *buffer, unsigned *insert_pos,
+                         const uint16_t *new_line, unsigned buffer_size)
+{
+    // Find common prefix.
+    unsigned same = 0;
+    while (buffer[same] != 0 && buffer[same] == new_line[same]) {
+        same++;
+    }
+    unsigned old_len = fpm_strwlen(buffer);
+
+    // Move cursor to the first difference.
+    if (*insert_pos > same) {
+        cursor_left(r, *insert_pos - same);
+    } else {
+        cursor_right(r, &buffer[*insert_pos], same - *insert_pos);
+    }
+
+    fpm_strlcpy_unicode(buffer, new_line, buffer_size);
+    unsigned new_len = fpm_strwlen(buffer);
+    render_wchars(r, &buffer[same], new_len - same);
+    if (old_len > new_len) {
+        erase_till_end_of_line(r);
+    }
+    *insert_pos = new_len;
+}
+
+//
+// Is it a function key, decoded by fpm_getkey()?
+//
+static bool is_function_key(uint16_t key)
+{
+    return (key >= FPM_LEFTWARDS_ARROW && key <= FPM_RIGHTWARDS_TO_BAR) ||
+           key == FPM_DELETE_KEY;
+}
+
+//
+// Redraw prompt and the whole line, with cursor at the end.
+//
+static void redraw_line(render_t *r, const char *prompt, uint16_t *buffer, unsigned *insert_pos)
+{
+    unsigned len = fpm_strwlen(buffer);
+    render_str(r, "\r");
+    render_str(r, prompt);
+    render_wchars(r, buffer, len);
+    erase_till_end_of_line(r);
+    *insert_pos = len;
+}
+
+//
+// Incremental reverse search in history, started by ^R.
+// Typed characters extend the pattern, backspace shortens it,
+// and ^R finds the next older match. Any other key ends the search:
+// the match is copied to the buffer, and the key is returned for processing.
+// On ^G the search is cancelled and 0 is returned.
+// Index of the match is updated.
+//
+static uint16_t reverse_search(render_t *r, fpm_history_t *history, int *index,
+                               uint16_t *buffer, unsigned buffer_size)
+{
+    uint16_t pattern[FPM_CMDLINE_SIZE];
+    uint16_t match[FPM_CMDLINE_SIZE];
+    unsigned pattern_len = 0;
+    int match_index = -1;
+    bool failed = false;
+
+    pattern[0] = 0;
+    fpm_strlcpy_unicode(match, buffer, FPM_CMDLINE_SIZE);
+    for (;;) {
+        // Show the search line.
+        render_str(r, failed ? "\r(failed reverse-i-search)`" : "\r(reverse-i-search)`");
+        render_wchars(r, pattern, pattern_len);
+        render_str(r, "': ");
+        render_wchars(r, match, fpm_strwlen(match));
+        erase_till_end_of_line(r);
+        render_flush(r);
+
+        uint16_t key = fpm_getkey();
+        int from;
+        if (key == CTRL('r')) {
+            // Next older match.
+            from = match_index + 1;
+        } else if (key == '\b' || key == 0x7F) {
+            if (pattern_len == 0) {
+                continue;
+            }
+            pattern[--pattern_len] = 0;
+            from = 0;
+        } else if (key >= ' ' && !is_function_key(key)) {
+            if (pattern_len >= FPM_CMDLINE_SIZE - 1) {
+                continue;
+            }
+            pattern[pattern_len++] = key;
+            pattern[pattern_len] = 0;
+            from = (match_index < 0) ? 0 : match_index;
+        } else if (key == CTRL('g')) {
+            return 0;
+        } else {
+            // Accept the match.
+            if (match_index >= 0) {
+                fpm_strlcpy_unicode(buffer, match, buffer_size);
+                *index = match_index;
+            }
+            return key;
+        }
+
+        int found = (pattern_len > 0) ? fpm_history_search(history, from, pattern) : -1;
+        failed = (found < 0 && pattern_len > 0);
+        if (found >= 0) {
+            match_index = found;
+            fpm_history_get(history, found, match, FPM_CMDLINE_SIZE);
+        }
+    }
+}
+
 //
 // The main line edit function
 // Parameters:
@@ -53,37 +303,51 @@ static void erase_line(uint16_t *buffer, unsigned *insert_pos)
 // - buffer_length: Size of the buffer in bytes
 // - clear: Set to 0 to not clear, 1 to clear on entry
 // - prompt: Print before input
-// - history: Pointer to the line edit buffer
+// - history: Lines for arrows up/down and ^R search, or NULL
 // Returns:
 // - The exit key pressed (ESC or CR)
 //
-int fpm_editline(uint16_t *buffer, unsigned buffer_length, bool clear, const char *prompt, uint16_t *prev_line)
+int fpm_editline(uint16_t *buffer, unsigned buffer_length, bool clear, const char *prompt, fpm_history_t *history)
 {
-    uint16_t next_line[FPM_CMDLINE_SIZE];
-    bool on_prev_line = false;
+    uint16_t edited_line[FPM_CMDLINE_SIZE]; // Line being typed, while browsing history
+    uint16_t history_line[FPM_CMDLINE_SIZE];
+    int history_index = -1;                 // Line shown from history, or -1
+    uint16_t pending_key = 0;               // Key which ended the search
+    render_t r;
 
-    fpm_puts(prompt);
+    // Size of the buffer in characters.
+    unsigned buffer_size = buffer_length / sizeof(uint16_t);
+    if (buffer_size > FPM_CMDLINE_SIZE) {
+        buffer_size = FPM_CMDLINE_SIZE;
+    }
+
+    r.len = 0;
+    render_str(&r, prompt);
     if (clear) {
         buffer[0] = 0;
     } else {
-        fpm_wputs(buffer);
+        render_wchars(&r, buffer, fpm_strwlen(buffer));
     }
 
     unsigned insert_pos = fpm_strwlen(buffer);
     for (;;) {
+        // Show the update before waiting for input.
+        render_flush(&r);
+
         // Get Unicode symbol, with function keys decoded.
-        uint16_t key = fpm_getkey();
+        uint16_t key = pending_key ? pending_key : fpm_getkey();
+        pending_key = 0;
 
         switch (key) {
         default:
             if (key >= ' ') {
                 // Insert character into line.
                 unsigned len = fpm_strwlen(buffer);
-                if (len < buffer_length - 1) {
+                if (len < buffer_size - 1) {
                     if (len > insert_pos) {
-                        insert_character();
+                        insert_character(&r);
                     }
-                    fpm_putwch(key);
+                    render_wchars(&r, &key, 1);
                     memmove(&buffer[insert_pos+1], &buffer[insert_pos], (len - insert_pos + 1) * sizeof(uint16_t));
                     buffer[insert_pos] = key;
                     insert_pos++;
@@ -91,25 +355,22 @@ int fpm_editline(uint16_t *buffer, unsigned buffer_length, bool clear, const cha
             }
             break;
 
-        case '\r': // Return
+        case '\r': { // Return
             // Cursor right for the remainder.
-            for (;; insert_pos++) {
-                uint16_t ch = buffer[insert_pos];
-                if (ch == 0)
-                    break;
-                fpm_putwch(ch);
-            }
+            unsigned len = fpm_strwlen(buffer);
+            cursor_right(&r, &buffer[insert_pos], len - insert_pos);
+            render_flush(&r);
             return key;
-
+        }
         case '\b': // ^H - Backspace on Linux
         case 0x7F: // 0177 - Backspace on Mac
             if (insert_pos > 0) {
                 unsigned len = fpm_strwlen(buffer);
                 if (insert_pos < len) {
-                    fpm_putwch('\b');
-                    delete_character();
+                    cursor_left(&r, 1);
+                    delete_character(&r);
                 } else {
-                    fpm_puts("\b \b");
+                    render_str(&r, "\b \b");
                 }
                 insert_pos--;
                 memmove(&buffer[insert_pos], &buffer[insert_pos+1], (len - insert_pos) * sizeof(uint16_t));
@@ -120,7 +381,7 @@ int fpm_editline(uint16_t *buffer, unsigned buffer_length, bool clear, const cha
         case FPM_DELETE_KEY: { // Delete on Linux
             unsigned len = fpm_strwlen(buffer);
             if (insert_pos < len) {
-                delete_character();
+                delete_character(&r);
                 memmove(&buffer[insert_pos], &buffer[insert_pos+1], (len - insert_pos) * sizeof(uint16_t));
             }
             break;
@@ -128,7 +389,7 @@ int fpm_editline(uint16_t *buffer, unsigned buffer_length, bool clear, const cha
         case CTRL('b'):           // ^B - Cursor Left
         case FPM_LEFTWARDS_ARROW: // Arrow left
             if (insert_pos > 0) {
-                fpm_putwch('\b');
+                cursor_left(&r, 1);
                 insert_pos--;
             }
             break;
@@ -137,68 +398,69 @@ int fpm_editline(uint16_t *buffer, unsigned buffer_length, bool clear, const cha
         case FPM_RIGHTWARDS_ARROW: { // Arrow right
             unsigned len = fpm_strwlen(buffer);
             if (insert_pos < len) {
-                fpm_putwch(buffer[insert_pos]);
+                cursor_right(&r, &buffer[insert_pos], 1);
                 insert_pos++;
             }
             break;
         }
         case CTRL('a'):            // ^A - Beginning of line
         case FPM_LEFTWARDS_TO_BAR: // Home
-            while (insert_pos > 0) {
-                fpm_putwch('\b');
-                insert_pos--;
-            }
+            cursor_left(&r, insert_pos);
+            insert_pos = 0;
             break;
 
         case CTRL('e'):               // ^E - End of line
         case FPM_RIGHTWARDS_TO_BAR: { // End
             unsigned len = fpm_strwlen(buffer);
-            while (insert_pos < len) {
-                fpm_putwch(buffer[insert_pos]);
-                insert_pos++;
-            }
+            cursor_right(&r, &buffer[insert_pos], len - insert_pos);
+            insert_pos = len;
             break;
         }
         case CTRL('u'): // ^U - Erase the line
-            erase_line(buffer, &insert_pos);
+            erase_line(&r, buffer, &insert_pos);
             break;
 
-        case CTRL('l'): // ^L - Refresh the line
-            fpm_puts("\r\n");
-            fpm_puts(prompt);
-            fpm_wputs(buffer);
-            for (int i = fpm_strwlen(buffer); i > insert_pos; i--) {
-                fpm_putwch('\b');
-            }
+        case CTRL('l'): { // ^L - Refresh the line
+            unsigned len = fpm_strwlen(buffer);
+            render_str(&r, "\r\n");
+            render_str(&r, prompt);
+            render_wchars(&r, buffer, len);
+            cursor_left(&r, len - insert_pos);
             break;
-
+        }
         case CTRL('p'):         // ^P - previous line from history
         case FPM_UPWARDS_ARROW: // Arrow up
-            if (!on_prev_line && prev_line != 0) {
-                // Save current line.
-                fpm_strlcpy_unicode(next_line, buffer, sizeof(next_line)/sizeof(uint16_t));
-                erase_line(buffer, &insert_pos);
-
-                // Restore previous line.
-                fpm_strlcpy_unicode(buffer, prev_line, sizeof(next_line)/sizeof(uint16_t));
-                fpm_wputs(buffer);
-                insert_pos = fpm_strwlen(buffer);
-                on_prev_line = true;
+            if (history && fpm_history_get(history, history_index + 1, history_line, FPM_CMDLINE_SIZE)) {
+                if (history_index < 0) {
+                    // Save current line.
+                    fpm_strlcpy_unicode(edited_line, buffer, FPM_CMDLINE_SIZE);
+                }
+                replace_line(&r, buffer, &insert_pos, history_line, buffer_size);
+                history_index++;
             }
             break;
 
         case CTRL('n'):           // ^N - next line from history
         case FPM_DOWNWARDS_ARROW: // Arrow down
-            if (on_prev_line && prev_line != 0) {
-                // Save current line.
-                fpm_strlcpy_unicode(prev_line, buffer, sizeof(next_line)/sizeof(uint16_t));
-                erase_line(buffer, &insert_pos);
-
-                // Restore next line.
-                fpm_strlcpy_unicode(buffer, next_line, sizeof(next_line)/sizeof(uint16_t));
-                fpm_wputs(buffer);
-                insert_pos = fpm_strwlen(buffer);
-                on_prev_line = false;
+            if (history_index == 0) {
+                // Back to the line being typed.
+                replace_line(&r, buffer, &insert_pos, edited_line, buffer_size);
+                history_index = -1;
+            } else if (history_index > 0 &&
+                       fpm_history_get(history, history_index - 1, history_line, FPM_CMDLINE_SIZE)) {
+                replace_line(&r, buffer, &insert_pos, history_line, buffer_size);
+                history_index--;
+            }
+            break;
+
+        case CTRL('r'): // ^R - search history
+            if (history) {
+                if (history_index < 0) {
+                    // Save current line.
+                    fpm_strlcpy_unicode(edited_line, buffer, FPM_CMDLINE_SIZE);
+                }
+                pending_key = reverse_search(&r, history, &history_index, buffer, buffer_size);
+                redraw_line(&r, prompt, buffer, &insert_pos);
             }
             break;
         }
@@ -0,0 +1,89 @@
+//
+// Environment variables of the shell.
+//
+// Variables are kept as "NAME=value" strings, terminated by NUL,
+// packed one after another in a buffer of FPM_ENV_SIZE bytes.
+// An empty string marks the end. Names are case insensitive.
+//
+#include <fpm/api.h>
+#include <fpm/internal.h>
+
+#ifndef FPM_ENV_SIZE
+#define FPM_ENV_SIZE 1024
+#endif
+
+static char env[FPM_ENV_SIZE];
+
+//
+// Find variable by name.
+// Return pointer to "NAME=value" string, or NULL when not defined.
+//
+static char *find_var(const char *name)
+{
+    unsigned name_len = strlen(name);
+    for (char *p = env; *p; p += strlen(p) + 1) {
+        if (strncasecmp(p, name, name_len) == 0 && p[name_len] == '=') {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+//
+// Get value of the variable, or NULL when not defined.
+//
+const char *fpm_getenv(const char *name)
+{
+    const char *var = find_var(name);
+    return var ? var + strlen(name) + 1 : NULL;
+}
+
+//
+// Set value of the variable.
+// Empty or NULL value removes the variable.
+// Return false when there is no space.
+//
+bool fpm_setenv(const char *name, const char *value)
+{
+    // Find end of the list.
+    char *end = env;
+    while (*end) {
+        end += strlen(end) + 1;
+    }
+
+    // Check space for the new value, counting the old one as freed,
+    // and keeping room for the final empty string.
+    char *var = find_var(name);
+    unsigned old_len = var ? strlen(var) + 1 : 0;
+    unsigned name_len = strlen(name);
+    unsigned value_len = (value != NULL) ? strlen(value) : 0;
+    if (value_len > 0 && end - old_len + name_len + 1 + value_len + 2 > env + sizeof(env)) {
+        return false;
+    }
+
+    // Remove old value.
+    if (var) {
+        memmove(var, var + old_len, end + 1 - (var + old_len));
+        end -= old_len;
+    }
+    if (value_len == 0) {
+        return true;
+    }
+
+    // Append new value.
+    memcpy(end, name, name_len);
+    end[name_len] = '=';
+    strcpy(end + name_len + 1, value);
+    end[name_len + 1 + value_len + 1] = 0;
+    return true;
+}
+
+//
+// Iterate over variables: get "NAME=value" string after the given one.
+// Start with NULL. Return NULL at the end.
+//
+const char *fpm_nextenv(const char *prev)
+{
+    const char *p = prev ? prev + strlen(prev) + 1 : env;
+    return *p ? p : NULL;
+}
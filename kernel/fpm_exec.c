@@ -15,83 +15,76 @@ static const bool debug_trace = false;
 
 static const unsigned MIN_STACK_SIZE = 8*1024;
 
-static const char *find_exe(const char *cmdname, char *buf)
-{
-    if (strchr(cmdname, '/') != NULL) {
-        // Full path name or relative path name - use as is.
-        return cmdname;
-    }
-
-    if (strchr(cmdname, '.') != NULL) {
-        // Extension is explicitly present.
-        return cmdname;
-    }
-
-    // Copy filename, append extension.
-    strcpy(buf, cmdname);
-    strcat(buf, ".exe");
-
-    // Check whether file exists.
-    file_info_t info;
-    fs_result_t result = f_stat(buf, &info);
-    if (result == FR_OK) {
-        return buf;
-    }
+//
+// Exit code of the last command.
+//
+int fpm_exit_code;
 
-    // Look in flash:/bin/ directory.
-    strcpy(buf, "flash:/bin/");
-    strcat(buf, cmdname);
-    strcat(buf, ".exe");
+//
+// Table of internal commands.
+//
+typedef struct {
+    const char *name;
+    void (*func)(int argc, char *argv[]);
+} command_table_t;
+static const command_table_t cmd_tab[] = {
+    { "?",      fpm_cmd_help },   // also HELP
+    { "cat",    fpm_cmd_cat },    // also TYPE
+    { "cd",     fpm_cmd_cd },     //
+    { "clear",  fpm_cmd_clear },  // also CLS
+    { "cls",    fpm_cmd_clear },  // also CLEAR
+    { "copy",   fpm_cmd_copy },   // also CP
+    { "cp",     fpm_cmd_copy },   // also COPY
+    { "crc32",  fpm_cmd_sum },    // also SUM
+    { "date",   fpm_cmd_date },   //
+    { "defrag", fpm_cmd_defrag }, //
+    { "dir",    fpm_cmd_dir },    // also LS
+    { "echo",   fpm_cmd_echo },   //
+    { "eject",  fpm_cmd_eject },  //
+    { "erase",  fpm_cmd_remove }, // also RM
+    { "format", fpm_cmd_format }, //
+    { "help",   fpm_cmd_help },   // also ?
+    { "jobs",   fpm_cmd_jobs },   //
+    { "ls",     fpm_cmd_dir },    // also DIR
+    { "mkdir",  fpm_cmd_mkdir },  //
+    { "mount",  fpm_cmd_mount },  //
+    { "mv",     fpm_cmd_rename }, // also RENAME
+    { "reboot", fpm_cmd_reboot }, //
+    { "rename", fpm_cmd_rename }, // also MV
+    { "rm",     fpm_cmd_remove }, // also ERASE
+    { "rmdir",  fpm_cmd_rmdir },  //
+    { "set",    fpm_cmd_set },    //
+    { "sha256", fpm_cmd_sum },    // also SUM -a sha256
+    { "start",  fpm_cmd_start },  //
+    { "sum",    fpm_cmd_sum },    // also CRC32, SHA256
+    { "time",   fpm_cmd_time },   //
+    { "type",   fpm_cmd_cat },    // also CAT
+    { "ver",    fpm_cmd_ver },    //
+    { "vol",    fpm_cmd_vol },    //
+    { "wait",   fpm_cmd_wait },   //
+    { 0,        0 },
+};
 
-    // Check whether file exists.
-    result = f_stat(buf, &info);
-    if (result == FR_OK) {
-        return buf;
+//
+// Find internal command by name.
+// Note: command name is case insensitive.
+//
+static const command_table_t *find_command(const char *name)
+{
+    for (const command_table_t *p = cmd_tab; p->name; p++) {
+        if (strcasecmp(p->name, name) == 0) {
+            return p;
+        }
     }
-
     return NULL;
 }
 
 //
 // Execute internal command or external program with given arguments.
+// When the last argument is "&", run the program in background.
 //
 void fpm_exec(int argc, char *argv[])
 {
-    // Table of internal commands.
-    typedef struct {
-        const char *name;
-        void (*func)(int argc, char *argv[]);
-    } command_table_t;
-    static const command_table_t cmd_tab[] = {
-        { "?",      fpm_cmd_help },   // also HELP
-        { "cat",    fpm_cmd_cat },    // also TYPE
-        { "cd",     fpm_cmd_cd },     //
-        { "clear",  fpm_cmd_clear },  // also CLS
-        { "cls",    fpm_cmd_clear },  // also CLEAR
-        { "copy",   fpm_cmd_copy },   // also CP
-        { "cp",     fpm_cmd_copy },   // also COPY
-        { "date",   fpm_cmd_date },   //
-        { "dir",    fpm_cmd_dir },    // also LS
-        { "echo",   fpm_cmd_echo },   //
-        { "eject",  fpm_cmd_eject },  //
-        { "erase",  fpm_cmd_remove }, // also RM
-        { "format", fpm_cmd_format }, //
-        { "help",   fpm_cmd_help },   // also ?
-        { "ls",     fpm_cmd_dir },    // also DIR
-        { "mkdir",  fpm_cmd_mkdir },  //
-        { "mount",  fpm_cmd_mount },  //
-        { "mv",     fpm_cmd_rename }, // also RENAME
-        { "reboot", fpm_cmd_reboot }, //
-        { "rename", fpm_cmd_rename }, // also MV
-        { "rm",     fpm_cmd_remove }, // also ERASE
-        { "rmdir",  fpm_cmd_rmdir },  //
-        { "time",   fpm_cmd_time },   //
-        { "type",   fpm_cmd_cat },    // also CAT
-        { "ver",    fpm_cmd_ver },    //
-        { "vol",    fpm_cmd_vol },    //
-        { 0,        0 },
-    };
-
     if (debug_trace) {
         // Print command before execution.
         fpm_printf("[%d] ", argc);
@@ -114,40 +107,66 @@ void fpm_exec(int argc, char *argv[])
         return;
     }
 
+    // Trailing ampersand: run in background.
+    if (argc > 1 && strcmp(argv[argc - 1], "&") == 0) {
+        argv[argc - 1] = NULL;
+        fpm_exec_background(argc - 1, argv);
+        return;
+    }
+
     // Find internal command.
-    for (const command_table_t *p = cmd_tab; p->name; p++) {
-        // Note: command name is case insensitive.
-        if (strcasecmp(p->name, argv[0]) == 0) {
-            p->func(argc, argv);
-            return;
-        }
+    const command_table_t *cmd = find_command(argv[0]);
+    if (cmd) {
+        fpm_exit_code = 0;
+        cmd->func(argc, argv);
+        return;
     }
 
     // Find file path of external command.
-    // Try .exe extension, search flash:/bin directory.
-    unsigned const buf_size = strlen(argv[0]) + sizeof(".exe") + sizeof("flash:/bin");
-    char buf[buf_size];
-    const char *path = find_exe(argv[0], buf);
+    char buf[FF_LFN_BUF + 1];
+    const char *path = fpm_find_exe(argv[0], buf, sizeof(buf));
     if (!path) {
         fpm_puts(argv[0]);
         fpm_puts(": Command not found\r\n\n");
+        fpm_exit_code = 1;
         return;
     }
 
+    // Batch script.
+    if (fpm_has_extension(path, ".cmd")) {
+        fpm_script_run(path, argc, argv);
+        return;
+    }
+
+    // Failed, unless the program runs to completion.
+    fpm_exit_code = 1;
+#if __ARM_ARCH_6M__
+    // On RP2040 the GOT pointer is kept in a memory slot shared by both cores.
+    // Only one external program can use it at a time.
+    if (fpm_background_running()) {
+        fpm_puts(argv[0]);
+        fpm_puts(": Background program is running, use 'wait'\r\n\n");
+        return;
+    }
+#endif
+
     // Allocate program context.
     fpm_context_t ctx;
     memset(&ctx, 0, sizeof(ctx));
+    ctx.bind_now = (fpm_getenv("BINDNOW") != NULL);
     if (!fpm_load(&ctx, path)) {
         // Failed: error message already printed.
         fpm_puts("\r\n");
         return;
     }
     if (fpm_stack_available() < MIN_STACK_SIZE) {
+        fpm_unload(&ctx);
         fpm_puts(argv[0]);
         fpm_puts(": No space for stack\r\n\n");
         return;
     }
     if (!fpm_context_push(&ctx)) {
+        fpm_unload(&ctx);
         fpm_puts(argv[0]);
         fpm_puts(": No space for heap\r\n\n");
         return;
@@ -165,14 +184,42 @@ void fpm_exec(int argc, char *argv[])
     }
 
     // External binary successfully executed.
-    //TODO: save ctx.exit_code somehow.
+    fpm_exit_code = ctx.exit_code;
+    fpm_puts("\r\n");
+}
+
+//
+// Execute external program in background, on core 1.
+// Internal commands always run in foreground.
+//
+void fpm_exec_background(int argc, char *argv[])
+{
+    if (find_command(argv[0])) {
+        fpm_puts(argv[0]);
+        fpm_puts(": Cannot run built-in command in background\r\n\n");
+        return;
+    }
+
+    char buf[FF_LFN_BUF + 1];
+    const char *path = fpm_find_exe(argv[0], buf, sizeof(buf));
+    if (!path) {
+        fpm_puts(argv[0]);
+        fpm_puts(": Command not found\r\n\n");
+        return;
+    }
+    if (fpm_has_extension(path, ".cmd")) {
+        fpm_puts(argv[0]);
+        fpm_puts(": Cannot run script in background\r\n\n");
+        return;
+    }
+
+    // On failure, error message is printed.
+    fpm_background_start(path, argc, argv);
     fpm_puts("\r\n");
 }
 
 #if 0
 //TODO: environment variables and commands
-PATH            Set or show the search path
-SET             Set or show environment variables
 PROMPT          Change the command prompt
 
 //TODO: symbolic links
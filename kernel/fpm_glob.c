@@ -0,0 +1,190 @@
+//
+// Expand wildcards in arguments of a command line.
+//
+// An argument with unquoted '*' or '?' is a pattern, like "*.log" or
+// "data/2026-*". It is replaced by names of matching files, sorted.
+// Wildcards are allowed only in the last component of a path.
+// Every pattern takes one scan of its directory: entries are filtered
+// by f_findnext(), which rejects most of them by the raw directory entry,
+// before the name is converted. Hidden and system files are not matched.
+// When nothing matches, the pattern is passed as is.
+//
+// New argument vector is built in one arena: pointers at the bottom,
+// growing up, and names at the top, growing down. At the end, names
+// are moved down to the pointers, and the rest of the arena is given
+// back to the heap.
+//
+#include <fpm/api.h>
+#include <fpm/fs.h>
+#include <fpm/internal.h>
+#include <alloca.h>
+
+//
+// Limit for number of arguments after expansion.
+//
+#ifndef FPM_GLOB_MAX
+#define FPM_GLOB_MAX 1024
+#endif
+
+#define MIN_ARENA_SIZE 1024
+
+typedef struct {
+    char *arena;    // Block of memory
+    char **argv;    // Vector of arguments at the bottom of the arena
+    unsigned count; // Number of arguments
+    unsigned pool;  // Offset of the names at the top
+    unsigned size;  // Size of the arena
+} arglist_t;
+
+//
+// Append argument to the vector.
+// When name is not NULL, copy prefix and name into the arena.
+// Return error message, or NULL on success.
+//
+static const char *arglist_add(arglist_t *list, const char *prefix, unsigned prefix_len,
+                               const char *name)
+{
+    if (list->count >= FPM_GLOB_MAX) {
+        return "Too many matches";
+    }
+
+    // Keep room for terminating NULL pointer.
+    unsigned vec_end = (list->count + 2) * sizeof(char *);
+    if (!name) {
+        if (vec_end > list->pool) {
+            return "Out of memory";
+        }
+        list->argv[list->count++] = (char *)prefix;
+        return NULL;
+    }
+
+    unsigned nbytes = prefix_len + strlen(name) + 1;
+    if (vec_end + nbytes > list->pool) {
+        return "Out of memory";
+    }
+    list->pool -= nbytes;
+    char *str = list->arena + list->pool;
+    memcpy(str, prefix, prefix_len);
+    strcpy(str + prefix_len, name);
+    list->argv[list->count++] = str;
+    return NULL;
+}
+
+//
+// Compare arguments by name.
+//
+static int compare_names(void *arg, const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+//
+// Replace the pattern by names of matching files.
+// Return error message, or NULL on success.
+//
+static const char *expand_pattern(arglist_t *list, char *pattern)
+{
+    // Split into directory and name pattern.
+    unsigned prefix_len = 0;
+    for (unsigned i = 0; pattern[i]; i++) {
+        if (pattern[i] == '/' || pattern[i] == ':') {
+            prefix_len = i + 1;
+        }
+    }
+    const char *name_pattern = pattern + prefix_len;
+
+    // Directory path without trailing slash, unless it's a root.
+    char path[prefix_len + 1];
+    memcpy(path, pattern, prefix_len);
+    path[prefix_len] = 0;
+    if (prefix_len > 1 && path[prefix_len - 1] == '/' && path[prefix_len - 2] != ':') {
+        path[prefix_len - 1] = 0;
+    }
+
+    // Cleared, so it can be closed even when not opened.
+    directory_t *dir = alloca(f_sizeof_directory_t());
+    memset(dir, 0, f_sizeof_directory_t());
+    file_info_t info;
+    unsigned first = list->count;
+    fs_result_t result = f_findfirst(dir, &info, path, name_pattern);
+    while (result == FR_OK && info.fname[0] != 0) {
+        if (!(info.fattrib & (AM_HID | AM_SYS))) {
+            const char *error = arglist_add(list, pattern, prefix_len, info.fname);
+            if (error) {
+                f_closedir(dir);
+                return error;
+            }
+        }
+        result = f_findnext(dir, &info);
+    }
+    f_closedir(dir);
+
+    if (list->count == first) {
+        // No match: keep the pattern.
+        return arglist_add(list, pattern, 0, NULL);
+    }
+    fpm_heap_sort(&list->argv[first], list->count - first, sizeof(char *), compare_names, NULL);
+    return NULL;
+}
+
+//
+// Expand wildcards in the argument vector.
+// Flag FPM_ARG_WILD marks arguments with wildcards, as set by fpm_tokenize_shell().
+// Return new vector allocated in heap, to be released by fpm_free().
+// Return NULL when there is nothing to expand, or on error.
+//
+char **fpm_glob(int *argc, char *argv[], const uint8_t flags[], const char **error)
+{
+    *error = NULL;
+
+    int i = 0;
+    while (i < *argc && !(flags[i] & FPM_ARG_WILD)) {
+        i++;
+    }
+    if (i == *argc) {
+        // No wildcards.
+        return NULL;
+    }
+
+    // Take a half of available memory, or less.
+    unsigned size;
+    char *arena = fpm_alloc_arena(MIN_ARENA_SIZE, &size);
+    if (!arena) {
+        *error = "Out of memory";
+        return NULL;
+    }
+    arglist_t list = {
+        .arena = arena,
+        .argv  = (char **)arena,
+        .pool  = size,
+        .size  = size,
+    };
+
+    for (i = 0; i < *argc; i++) {
+        if (flags[i] & FPM_ARG_WILD) {
+            *error = expand_pattern(&list, argv[i]);
+        } else {
+            *error = arglist_add(&list, argv[i], 0, NULL);
+        }
+        if (*error) {
+            fpm_free(arena);
+            return NULL;
+        }
+    }
+
+    // Move names down to the vector, and release the rest of the arena.
+    unsigned vec_end = (list.count + 1) * sizeof(char *);
+    unsigned delta = list.pool - vec_end;
+    memmove(arena + vec_end, arena + list.pool, size - list.pool);
+    for (unsigned k = 0; k < list.count; k++) {
+        char *str = list.argv[k];
+        if (str >= arena + list.pool && str < arena + size) {
+            list.argv[k] = str - delta;
+        }
+    }
+    list.argv[list.count] = NULL;
+    fpm_truncate(arena, size - delta);
+
+    *argc = list.count;
+    return list.argv;
+}
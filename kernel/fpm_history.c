@@ -0,0 +1,165 @@
+//
+// Command history.
+//
+// Lines are kept in a ring of FPM_HISTORY_SIZE bytes, encoded as UTF-8
+// and terminated by NUL, oldest first. When a new line doesn't fit,
+// the oldest lines are dropped. Offsets of the ring are free-running
+// counters, reduced modulo the size on access.
+//
+#include <fpm/api.h>
+
+#define RING(h, pos) ((h)->data[(pos) % FPM_HISTORY_SIZE])
+
+//
+// Forget all lines.
+//
+void fpm_history_clear(fpm_history_t *h)
+{
+    h->start = 0;
+    h->end = 0;
+}
+
+//
+// Move from start of a line (or end of the ring) to start of the previous one.
+// Return false when there are no more lines.
+//
+static bool prev_line(fpm_history_t *h, unsigned *pos)
+{
+    unsigned p = *pos;
+    if (p == h->start) {
+        return false;
+    }
+
+    // Skip back over the terminating NUL and the text.
+    p--;
+    while (p != h->start && RING(h, p - 1) != 0) {
+        p--;
+    }
+    *pos = p;
+    return true;
+}
+
+//
+// Copy line at given offset as UTF-8 string.
+//
+static void copy_line(fpm_history_t *h, unsigned pos, char *buf, unsigned buf_size)
+{
+    unsigned len = 0;
+    while (RING(h, pos) != 0) {
+        if (len < buf_size - 1) {
+            buf[len++] = RING(h, pos);
+        }
+        pos++;
+    }
+    buf[len] = 0;
+}
+
+//
+// Get line with given index as UTF-8 string, 0 for the newest.
+// Return false when there is no such line.
+//
+static bool get_utf8(fpm_history_t *h, unsigned index, char *buf, unsigned buf_size)
+{
+    unsigned pos = h->end;
+    do {
+        if (!prev_line(h, &pos)) {
+            return false;
+        }
+    } while (index-- > 0);
+
+    copy_line(h, pos, buf, buf_size);
+    return true;
+}
+
+//
+// Append UTF-8 line to the history.
+// Empty lines and repeats of the newest line are ignored.
+//
+void fpm_history_add_utf8(fpm_history_t *h, const char *line)
+{
+    unsigned len = strlen(line) + 1;
+    if (len == 1 || len > FPM_HISTORY_SIZE) {
+        return;
+    }
+
+    char newest[3 * FPM_CMDLINE_SIZE];
+    if (get_utf8(h, 0, newest, sizeof(newest)) && strcmp(newest, line) == 0) {
+        return;
+    }
+
+    // Drop oldest lines to make room.
+    while (h->end - h->start + len > FPM_HISTORY_SIZE) {
+        while (RING(h, h->start) != 0) {
+            h->start++;
+        }
+        h->start++;
+    }
+
+    // Copy in up to two pieces, as the line may wrap around.
+    while (len > 0) {
+        unsigned offset = h->end % FPM_HISTORY_SIZE;
+        unsigned n = FPM_HISTORY_SIZE - offset;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(&h->data[offset], line, n);
+        line += n;
+        len -= n;
+        h->end += n;
+    }
+}
+
+//
+// Append Unicode line to the history.
+//
+void fpm_history_add(fpm_history_t *h, const uint16_t *line)
+{
+    char buf[3 * FPM_CMDLINE_SIZE];
+
+    fpm_strlcpy_to_utf8(buf, line, sizeof(buf));
+    fpm_history_add_utf8(h, buf);
+}
+
+//
+// Get line with given index, 0 for the newest.
+// Return false when there is no such line.
+//
+bool fpm_history_get(fpm_history_t *h, unsigned index, uint16_t *line, unsigned line_size)
+{
+    char buf[3 * FPM_CMDLINE_SIZE];
+
+    if (!get_utf8(h, index, buf, sizeof(buf))) {
+        return false;
+    }
+    fpm_strlcpy_from_utf8(line, buf, line_size);
+    return true;
+}
+
+//
+// Find the newest line containing the pattern, starting from given index.
+// Return index of the line, or -1 when not found.
+//
+int fpm_history_search(fpm_history_t *h, unsigned index, const uint16_t *pattern)
+{
+    char pat[3 * FPM_CMDLINE_SIZE];
+    char buf[3 * FPM_CMDLINE_SIZE];
+
+    fpm_strlcpy_to_utf8(pat, pattern, sizeof(pat));
+
+    // Skip lines before the index.
+    unsigned pos = h->end;
+    for (unsigned i = 0; i < index; i++) {
+        if (!prev_line(h, &pos)) {
+            return -1;
+        }
+    }
+
+    while (prev_line(h, &pos)) {
+        copy_line(h, pos, buf, sizeof(buf));
+        if (strstr(buf, pat)) {
+            return index;
+        }
+        index++;
+    }
+    return -1;
+}
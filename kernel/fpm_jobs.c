@@ -0,0 +1,135 @@
+//
+// Queue of background jobs.
+//
+// Jobs are submitted by the foreground program (core 0) and executed
+// by a background worker: core 1 on RP2040, or a separate thread on Unix.
+// The queue is a lock-free ring with a single producer and a single consumer:
+// the producer advances only the head index, the consumer - only the tail.
+// Only atomic loads and stores are used, as Cortex-M0+ has no atomic
+// read-modify-write instructions.
+//
+#include <fpm/api.h>
+#include <fpm/internal.h>
+
+//
+// Size of the ring, must be a power of two.
+//
+#define JOB_RING_SIZE 16
+
+static fpm_job_t *job_ring[JOB_RING_SIZE];
+static unsigned job_head; // Next slot to fill, owned by producer
+static unsigned job_tail; // Next slot to execute, owned by consumer
+
+//
+// Execute the job and mark it as completed.
+//
+static void run_job(fpm_job_t *job)
+{
+    job->func(job);
+    __atomic_store_n(&job->state, FPM_JOB_DONE, __ATOMIC_RELEASE);
+}
+
+//
+// Long-running job which holds the worker: background program.
+//
+static fpm_job_t *worker_owner;
+
+//
+// Is the worker taken by a long-running job?
+//
+static bool worker_taken()
+{
+    fpm_job_t *owner = __atomic_load_n(&worker_owner, __ATOMIC_ACQUIRE);
+    return owner && !fpm_job_done(owner);
+}
+
+//
+// Put the job into the queue.
+// Return false when it must be executed immediately.
+//
+static bool job_enqueue(fpm_job_t *job)
+{
+    __atomic_store_n(&job->state, FPM_JOB_QUEUED, __ATOMIC_RELAXED);
+
+    unsigned head = __atomic_load_n(&job_head, __ATOMIC_RELAXED);
+    unsigned tail = __atomic_load_n(&job_tail, __ATOMIC_ACQUIRE);
+    if (head - tail >= JOB_RING_SIZE || !fpm_jobs_active_arch() || fpm_core_num() != 0) {
+        // No space in the queue, or no background worker,
+        // or called by background program.
+        return false;
+    }
+
+    // Publish the job, then advance the head.
+    job_ring[head % JOB_RING_SIZE] = job;
+    __atomic_store_n(&job_head, head + 1, __ATOMIC_RELEASE);
+    fpm_jobs_wakeup_arch();
+    return true;
+}
+
+//
+// Submit a job for execution in background.
+// When the queue is full, or when called on core 1, or when the worker
+// is taken by background program, run the job immediately.
+// Otherwise the caller would wait until the background program exits.
+//
+void fpm_job_submit(fpm_job_t *job)
+{
+    if (worker_taken() || !job_enqueue(job)) {
+        run_job(job);
+    }
+}
+
+//
+// Submit a job which holds the worker until it completes: background program.
+// Meanwhile, other jobs are executed by the caller.
+//
+void fpm_job_submit_program(fpm_job_t *job)
+{
+    __atomic_store_n(&worker_owner, job, __ATOMIC_RELEASE);
+    if (!job_enqueue(job)) {
+        run_job(job);
+    }
+}
+
+//
+// Check whether the job has completed.
+//
+bool fpm_job_done(fpm_job_t *job)
+{
+    return __atomic_load_n(&job->state, __ATOMIC_ACQUIRE) == FPM_JOB_DONE;
+}
+
+//
+// Wait for the job to complete.
+// Return result of the job.
+//
+int fpm_job_wait(fpm_job_t *job)
+{
+    while (!fpm_job_done(job)) {
+        fpm_jobs_idle_arch();
+    }
+    return job->result;
+}
+
+//
+// Execute all pending jobs.
+// Called by the background worker.
+// Return true when at least one job has been executed.
+//
+bool fpm_jobs_process()
+{
+    bool done_something = false;
+    for (;;) {
+        unsigned tail = __atomic_load_n(&job_tail, __ATOMIC_RELAXED);
+        unsigned head = __atomic_load_n(&job_head, __ATOMIC_ACQUIRE);
+        if (tail == head) {
+            // Queue is empty.
+            return done_something;
+        }
+
+        fpm_job_t *job = job_ring[tail % JOB_RING_SIZE];
+        run_job(job);
+        __atomic_store_n(&job_tail, tail + 1, __ATOMIC_RELEASE);
+        done_something = true;
+    }
+}
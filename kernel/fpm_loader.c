@@ -5,6 +5,7 @@
 #include <fpm/loader.h>
 #include <fpm/context.h>
 #include <fpm/elf.h>
+#include <setjmp.h>
 
 #if (__x86_64__ || __i386__) && __unix__
     // MacOS/x86 is not supported
@@ -19,16 +20,22 @@
     typedef Elf64_Rela Native_Rela;
     typedef Elf64_Rel Native_Rel;
     typedef Elf64_Sym Native_Sym;
+    typedef Elf64_Dyn Native_Dyn;
 #   define NATIVE_R_TYPE(x) ELF64_R_TYPE(x)
 #   define NATIVE_R_SYM(x) ELF64_R_SYM(x)
+#   define NATIVE_ST_BIND(x) ELF64_ST_BIND(x)
+#   define NATIVE_ST_TYPE(x) ELF64_ST_TYPE(x)
 #else
     typedef Elf32_Ehdr Native_Ehdr;
     typedef Elf32_Shdr Native_Shdr;
     typedef Elf32_Rela Native_Rela;
     typedef Elf32_Rel Native_Rel;
     typedef Elf32_Sym Native_Sym;
+    typedef Elf32_Dyn Native_Dyn;
 #   define NATIVE_R_TYPE(x) ELF32_R_TYPE(x)
 #   define NATIVE_R_SYM(x) ELF32_R_SYM(x)
+#   define NATIVE_ST_BIND(x) ELF32_ST_BIND(x)
+#   define NATIVE_ST_TYPE(x) ELF32_ST_TYPE(x)
 #endif
 
 //
@@ -60,9 +67,9 @@ static const Native_Shdr *fpm_section_by_index(fpm_context_t *ctx, unsigned inde
 }
 
 //
-// Map ELF binary into memory.
+// Map ELF binary into memory and check the header.
 //
-bool fpm_load(fpm_context_t *ctx, const char *filename)
+static bool load_elf(fpm_context_t *ctx, const char *filename)
 {
     if (!fpm_load_arch(ctx, filename)) {
 err:    fpm_unload_arch(ctx);
@@ -130,26 +137,214 @@ err:    fpm_unload_arch(ctx);
     }
 
     // Find relocation section.
+    // Binary without external references has none.
     const Native_Shdr *rel_section = fpm_section_by_type_flags(ctx, SHT_RELA, SHF_INFO_LINK);
     if (rel_section == NULL) {
         rel_section = fpm_section_by_type_flags(ctx, SHT_REL, SHF_INFO_LINK);
-        if (rel_section == NULL) {
-            fpm_printf("%s: No relocation section\r\n", filename);
-            goto err;
-        }
     }
     ctx->rel_section = rel_section;
 
     // Number of linked procedures.
-    ctx->num_links = rel_section->sh_size / rel_section->sh_entsize;
+    ctx->num_links = rel_section ? rel_section->sh_size / rel_section->sh_entsize : 0;
+
+    // Binary is mapped read-only, so data relocations (.rela.dyn or .rel.dyn)
+    // cannot be applied. Typically they come from pointers in initialized data.
+    const Native_Shdr *section = (const Native_Shdr *) (hdr->e_shoff + (char*)ctx->base);
+    for (unsigned i = 0; i < hdr->e_shnum; i++) {
+        if ((section[i].sh_type == SHT_RELA || section[i].sh_type == SHT_REL) &&
+            !(section[i].sh_flags & SHF_INFO_LINK) && section[i].sh_size > 0) {
+            fpm_printf("%s: Dynamic relocations are not supported\r\n", filename);
+            goto err;
+        }
+    }
+    return true;
+}
+
+//
+// Shared libraries.
+//
+// A library is an ELF binary in flash:/lib directory, loaded once and kept
+// resident across program launches. Programs reference it by DT_NEEDED
+// entries. Exported symbols are taken from .dynsym section of the library.
+// Code of the library is shared, so it cannot have GOT of its own:
+// libraries must be self-contained, without external references.
+// A resident library is loaded again when size, time or location
+// of its file changes. All library operations are performed on core 0.
+//
+#define MAX_LIBRARIES 8
+
+typedef struct _fpm_library_t {
+    fpm_context_t ctx;  // Mapping of the library file
+    char name[64];      // Name as referenced by programs
+    unsigned refcount;  // Number of programs using it
+} fpm_library_t;
+
+static fpm_library_t library_tab[MAX_LIBRARIES];
+
+//
+// Does the resident library still match its file?
+// The file could be rewritten, deleted or moved by defrag.
+//
+static bool library_current(fpm_library_t *lib, const char *path)
+{
+    fpm_context_t probe;
+    memset(&probe, 0, sizeof(probe));
+    if (!fpm_stat_arch(&probe, path)) {
+        return false;
+    }
+    return probe.file_start == lib->ctx.file_start &&
+           probe.file_size == lib->ctx.file_size &&
+           probe.file_time == lib->ctx.file_time;
+}
+
+//
+// Find resident library, or load it into a free slot.
+// Unused libraries are evicted when no free slot remains.
+// Return NULL on failure.
+//
+static fpm_library_t *library_open(const char *name)
+{
+    if (strlen(name) >= sizeof(library_tab[0].name)) {
+        fpm_printf("%s: Library name too long\r\n", name);
+        return NULL;
+    }
+
+    // Library name without path is searched in flash:/lib directory.
+    char path[sizeof(library_tab[0].name) + sizeof("flash:/lib/")];
+    if (strchr(name, '/') != NULL || strchr(name, ':') != NULL) {
+        strcpy(path, name);
+    } else {
+        strcpy(path, "flash:/lib/");
+        strcat(path, name);
+    }
+
+    fpm_library_t *slot = NULL;
+    for (fpm_library_t *lib = library_tab; lib < &library_tab[MAX_LIBRARIES]; lib++) {
+        if (lib->ctx.base != NULL && strcmp(lib->name, name) == 0) {
+            if (library_current(lib, path)) {
+                // Already resident.
+                lib->refcount++;
+                return lib;
+            }
+
+            // Stale: keep it for programs still running, but never share again.
+            lib->name[0] = '\0';
+        }
+        if (lib->refcount == 0 && (slot == NULL || slot->ctx.base != NULL)) {
+            // Prefer empty slot over unused library.
+            slot = lib;
+        }
+    }
+    if (slot == NULL) {
+        fpm_printf("%s: Too many libraries\r\n", name);
+        return NULL;
+    }
+    if (slot->ctx.base != NULL) {
+        fpm_unload_arch(&slot->ctx);
+    }
+    memset(slot, 0, sizeof(*slot));
+
+    if (!load_elf(&slot->ctx, path)) {
+        memset(slot, 0, sizeof(*slot));
+        return NULL;
+    }
+    if (slot->ctx.num_links > 0) {
+        fpm_printf("%s: Library must not have external references\r\n", path);
+        fpm_unload_arch(&slot->ctx);
+        memset(slot, 0, sizeof(*slot));
+        return NULL;
+    }
+    strcpy(slot->name, name);
+    slot->refcount = 1;
+    return slot;
+}
+
+//
+// Find symbol exported by the library.
+// Return NULL when not found.
+//
+static void *library_lookup(fpm_library_t *lib, const char *name)
+{
+    const Native_Shdr *dyn_section = fpm_section_by_type_flags(&lib->ctx, SHT_DYNSYM, 0);
+    if (dyn_section == NULL) {
+        return NULL;
+    }
+    const Native_Sym *symbols  = (const Native_Sym *) (dyn_section->sh_offset + (char*)lib->ctx.base);
+    const Native_Shdr *str_section = fpm_section_by_index(&lib->ctx, dyn_section->sh_link);
+    const char *strings        = str_section->sh_offset + (char*)lib->ctx.base;
+    unsigned num_symbols       = dyn_section->sh_size / dyn_section->sh_entsize;
+
+    for (unsigned i = 1; i < num_symbols; i++) {
+        const Native_Sym *sym = &symbols[i];
+        unsigned bind = NATIVE_ST_BIND(sym->st_info);
+        unsigned type = NATIVE_ST_TYPE(sym->st_info);
+        if (sym->st_shndx != SHN_UNDEF &&
+            (bind == STB_GLOBAL || bind == STB_WEAK) &&
+            (type == STT_FUNC || type == STT_OBJECT) &&
+            strcmp(&strings[sym->st_name], name) == 0) {
+            return sym->st_value + (char*)lib->ctx.base;
+        }
+    }
+    return NULL;
+}
+
+//
+// Open shared libraries, referenced by DT_NEEDED entries of the program.
+// Return false on failure.
+//
+static bool load_needed(fpm_context_t *ctx, const char *filename)
+{
+    const Native_Shdr *dynamic = fpm_section_by_type_flags(ctx, SHT_DYNAMIC, 0);
+    if (dynamic == NULL) {
+        return true;
+    }
+    const Native_Dyn *entry   = (const Native_Dyn *) (dynamic->sh_offset + (char*)ctx->base);
+    const Native_Shdr *str_section = fpm_section_by_index(ctx, dynamic->sh_link);
+    const char *strings       = str_section->sh_offset + (char*)ctx->base;
+
+    for (; entry->d_tag != DT_NULL; entry++) {
+        if (entry->d_tag != DT_NEEDED) {
+            continue;
+        }
+        if (ctx->num_libs >= FPM_MAX_NEEDED) {
+            fpm_printf("%s: Too many libraries needed\r\n", filename);
+            return false;
+        }
+        fpm_library_t *lib = library_open(&strings[entry->d_un.d_val]);
+        if (lib == NULL) {
+            return false;
+        }
+        ctx->libs[ctx->num_libs++] = lib;
+    }
+    return true;
+}
+
+//
+// Map ELF binary into memory, together with shared libraries it needs.
+//
+bool fpm_load(fpm_context_t *ctx, const char *filename)
+{
+    ctx->num_libs = 0;
+    if (!load_elf(ctx, filename)) {
+        return false;
+    }
+    if (!load_needed(ctx, filename)) {
+        fpm_unload(ctx);
+        return false;
+    }
     return true;
 }
 
 //
 // Unmap ELF binary from memory.
+// Shared libraries stay resident.
 //
 void fpm_unload(fpm_context_t *ctx)
 {
+    while (ctx->num_libs > 0) {
+        fpm_library_t *lib = ctx->libs[--ctx->num_libs];
+        lib->refcount--;
+    }
     fpm_unload_arch(ctx);
 }
 
@@ -220,6 +415,21 @@ static void *find_address_by_name(const fpm_binding_t *linkmap, const char *name
     }
 }
 
+//
+// Search shared libraries of the program, then the linkmap.
+// Return address of the symbol, or NULL on failure.
+//
+static void *find_symbol(fpm_context_t *ctx, const fpm_binding_t *linkmap, const char *name)
+{
+    for (unsigned i = 0; i < ctx->num_libs; i++) {
+        void *address = library_lookup(ctx->libs[i], name);
+        if (address != NULL) {
+            return address;
+        }
+    }
+    return find_address_by_name(linkmap, name);
+}
+
 //
 // Setup arch-dependent GOT register.
 //
@@ -252,13 +462,162 @@ static inline void set_got_pointer(void *addr)
 static inline void *get_got_pointer()
 {
     void *addr = NULL;
-#if __ARM_ARCH_ISA_A64
+#if __ARM_ARCH_6M__
+    addr = *(void* volatile*) 0x20000010;
+
+#elif (__x86_64__ || __i386__) && __unix__
+    syscall(SYS_arch_prctl, ARCH_GET_GS, &addr);
+
+#elif __ARM_ARCH_ISA_A64
     // For arm64 Linux or MacOS: use TPIDR_EL0 register.
     asm volatile("mrs %0, tpidr_el0" : "=r" (addr) : : "memory");
 #endif
     return addr;
 }
 
+//
+// State of lazy binding, referenced by the slot just before the GOT.
+//
+typedef struct {
+    fpm_context_t *ctx;         // Program being executed
+    fpm_binding_t *linkmap;     // Where to look for symbols
+    jmp_buf abort_point;        // Return here when symbol not found
+} lazy_binding_t;
+
+//
+// Resolve symbol on first call via PLT and patch the GOT slot.
+// Called from resolver trampoline with index of the GOT slot.
+// Return address of the symbol.
+//
+__attribute__((used))
+static void *lazy_resolve(unsigned index)
+{
+    void **got = get_got_pointer();
+    lazy_binding_t *lazy = got[-1];
+
+    if (index >= lazy->ctx->num_links) {
+        // Corrupted binary.
+        fpm_printf("Bad index %u of dynamic symbol\r\n", index);
+        longjmp(lazy->abort_point, 1);
+    }
+
+    unsigned value = 0;
+    const char *name = fpm_get_name(lazy->ctx, index, &value);
+    void *address;
+    if (value != 0) {
+        // Internally defined symbol.
+        address = value + (char*)lazy->ctx->base;
+    } else {
+        address = find_symbol(lazy->ctx, lazy->linkmap, name);
+        if (address == NULL) {
+            fpm_printf("%s: Symbol not found\r\n", name);
+            longjmp(lazy->abort_point, 1);
+        }
+    }
+    got[index] = address;
+    return address;
+}
+
+//
+// Resolver trampoline: all GOT slots point here until resolved.
+// It saves argument registers, calls lazy_resolve() and jumps
+// to the resolved address. PLT stubs, modified by elfexe utility,
+// leave the GOT index in %r11 on x86-64, or address of the GOT slot
+// in x16 on arm64. Other platforms use eager binding only.
+//
+#if __x86_64__ && __linux__
+#define LAZY_BINDING 1
+void fpm_lazy_trampoline(void) __attribute__((visibility("hidden")));
+asm(
+    ".text\n"
+    ".globl fpm_lazy_trampoline\n"
+    ".hidden fpm_lazy_trampoline\n"
+    ".p2align 4\n"
+"fpm_lazy_trampoline:\n"
+    "push %rax\n"
+    "push %rdi\n"
+    "push %rsi\n"
+    "push %rdx\n"
+    "push %rcx\n"
+    "push %r8\n"
+    "push %r9\n"
+    "sub $128, %rsp\n"
+    "movdqu %xmm0, 0(%rsp)\n"
+    "movdqu %xmm1, 16(%rsp)\n"
+    "movdqu %xmm2, 32(%rsp)\n"
+    "movdqu %xmm3, 48(%rsp)\n"
+    "movdqu %xmm4, 64(%rsp)\n"
+    "movdqu %xmm5, 80(%rsp)\n"
+    "movdqu %xmm6, 96(%rsp)\n"
+    "movdqu %xmm7, 112(%rsp)\n"
+    "mov %r11d, %edi\n"
+    "call lazy_resolve\n"
+    "mov %rax, %r11\n"
+    "movdqu 0(%rsp), %xmm0\n"
+    "movdqu 16(%rsp), %xmm1\n"
+    "movdqu 32(%rsp), %xmm2\n"
+    "movdqu 48(%rsp), %xmm3\n"
+    "movdqu 64(%rsp), %xmm4\n"
+    "movdqu 80(%rsp), %xmm5\n"
+    "movdqu 96(%rsp), %xmm6\n"
+    "movdqu 112(%rsp), %xmm7\n"
+    "add $128, %rsp\n"
+    "pop %r9\n"
+    "pop %r8\n"
+    "pop %rcx\n"
+    "pop %rdx\n"
+    "pop %rsi\n"
+    "pop %rdi\n"
+    "pop %rax\n"
+    "jmp *%r11\n"
+);
+
+#elif __ARM_ARCH_ISA_A64
+#define LAZY_BINDING 1
+#if __APPLE__
+#   define ASM_NAME(name) "_" #name
+#   define ASM_HIDDEN(name) ".private_extern _" #name "\n"
+#else
+#   define ASM_NAME(name) #name
+#   define ASM_HIDDEN(name) ".hidden " #name "\n"
+#endif
+void fpm_lazy_trampoline(void) __attribute__((visibility("hidden")));
+asm(
+    ".text\n"
+    ".globl " ASM_NAME(fpm_lazy_trampoline) "\n"
+    ASM_HIDDEN(fpm_lazy_trampoline)
+    ".p2align 2\n"
+ASM_NAME(fpm_lazy_trampoline) ":\n"
+    "stp x29, x30, [sp, #-224]!\n"
+    "mov x29, sp\n"
+    "stp x0, x1, [sp, #16]\n"
+    "stp x2, x3, [sp, #32]\n"
+    "stp x4, x5, [sp, #48]\n"
+    "stp x6, x7, [sp, #64]\n"
+    "str x8, [sp, #80]\n"
+    "stp q0, q1, [sp, #96]\n"
+    "stp q2, q3, [sp, #128]\n"
+    "stp q4, q5, [sp, #160]\n"
+    "stp q6, q7, [sp, #192]\n"
+    "mrs x9, tpidr_el0\n"
+    "sub x0, x16, x9\n"
+    "lsr x0, x0, #3\n"
+    "bl " ASM_NAME(lazy_resolve) "\n"
+    "mov x16, x0\n"
+    "ldp q6, q7, [sp, #192]\n"
+    "ldp q4, q5, [sp, #160]\n"
+    "ldp q2, q3, [sp, #128]\n"
+    "ldp q0, q1, [sp, #96]\n"
+    "ldr x8, [sp, #80]\n"
+    "ldp x6, x7, [sp, #64]\n"
+    "ldp x4, x5, [sp, #48]\n"
+    "ldp x2, x3, [sp, #32]\n"
+    "ldp x0, x1, [sp, #16]\n"
+    "ldp x29, x30, [sp], #224\n"
+    "br x16\n"
+);
+#endif
+
 //
 // Invoke entry address of the ELF binary with argc, argv arguments.
 // Bind dynamic symbols of the binary according to the given linkmap.
@@ -271,34 +630,50 @@ static inline void *get_got_pointer()
 bool fpm_invoke(fpm_context_t *ctx, fpm_binding_t linkmap[], int argc, char *argv[])
 {
     // Build a Global Offset Table on stack.
-    volatile void *got[ctx->num_links];
-
-    // Bind dynamic symbols.
-    unsigned fail_count = 0;
-    for (unsigned index = 0; index < ctx->num_links; index++) {
+    // The slot before the table points to state of lazy binding.
+    volatile void *got_area[1 + ctx->num_links];
+    volatile void **got = &got_area[1];
+    lazy_binding_t lazy = { ctx, linkmap };
+    got_area[0] = &lazy;
+    const Native_Ehdr *hdr = ctx->base;
 
-        // Find symbol's name and address.
-        unsigned value = 0;
-        const char *name = fpm_get_name(ctx, index, &value);
-        if (value != 0) {
-            // Internally defined symbol.
-            got[index] = value + (char*)ctx->base;
-            continue;
+#if LAZY_BINDING
+    // Binaries processed by older elfexe pass no index of the slot: bind them now.
+    if (!ctx->bind_now && hdr->e_ident[EI_ABIVERSION] >= FPM_ABIVERSION_LAZY) {
+        // Bind dynamic symbols on first call.
+        for (unsigned index = 0; index < ctx->num_links; index++) {
+            got[index] = fpm_lazy_trampoline;
         }
+    } else
+#endif
+    {
+        // Bind all dynamic symbols now.
+        unsigned fail_count = 0;
+        for (unsigned index = 0; index < ctx->num_links; index++) {
+
+            // Find symbol's name and address.
+            unsigned value = 0;
+            const char *name = fpm_get_name(ctx, index, &value);
+            if (value != 0) {
+                // Internally defined symbol.
+                got[index] = value + (char*)ctx->base;
+                continue;
+            }
 
-        void *address = find_address_by_name(linkmap, name);
-        if (address == NULL) {
-            fpm_printf("%s: Symbol not found\r\n", name);
-            fail_count++;
+            void *address = find_symbol(ctx, linkmap, name);
+            if (address == NULL) {
+                fpm_printf("%s: Symbol not found\r\n", name);
+                fail_count++;
+            }
+            if (fail_count == 0) {
+                got[index] = address;
+            }
         }
-        if (fail_count == 0) {
-            got[index] = address;
+        if (fail_count > 0) {
+            // Cannot map some symbols.
+            return false;
         }
     }
-    if (fail_count > 0) {
-        // Cannot map some symbols.
-        return false;
-    }
 #if __APPLE__ && __x86_64__
     {
         // This platform is not supported.
@@ -307,11 +682,15 @@ bool fpm_invoke(fpm_context_t *ctx, fpm_binding_t linkmap[], int argc, char *arg
     }
 #endif
     void *save_got = get_got_pointer();
+    if (setjmp(lazy.abort_point) != 0) {
+        // Symbol not found by lazy binding: program aborted.
+        set_got_pointer(save_got);
+        return false;
+    }
     set_got_pointer(got);
 
     // Compute entry address.
     typedef int (*entry_t)(int, char **);
-    const Native_Ehdr *hdr = ctx->base;
     const entry_t entry    = (entry_t) (hdr->e_entry + (char*)ctx->base);
 
     // Invoke ELF binary.
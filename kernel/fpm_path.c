@@ -0,0 +1,346 @@
+//
+// Search path for external commands.
+//
+// Programs (.exe) and scripts (.cmd) are searched in the current directory,
+// then in directories listed in PATH variable, separated by ';'.
+// By default, PATH is flash:/bin.
+//
+// To avoid a walk of every directory for every command, names of programs
+// and scripts are kept in an index: names in PATH directories, followed by
+// names in the current directory. The index is built at mount, and built
+// again when PATH is changed, or when f_dirchanged() reports a change in one
+// of PATH directories. Creating, renaming or removing any directory, or
+// mounting a volume, also counts, as a missing directory could appear.
+// Names in the current directory are collected again when it's changed.
+//
+// When names don't fit, directories from the first incomplete one onwards
+// are searched with f_stat(), so that earlier directories still win.
+//
+#include <fpm/api.h>
+#include <fpm/fs.h>
+#include <fpm/internal.h>
+#include <alloca.h>
+
+//
+// Size of the index in bytes.
+//
+#ifndef FPM_PATH_INDEX_SIZE
+#define FPM_PATH_INDEX_SIZE 1024
+#endif
+
+#define DEFAULT_PATH "flash:/bin"
+#define MAX_DIRS     16
+
+//
+// Index of names in PATH directories and in the current directory.
+// Every entry is a byte with number of the directory in PATH,
+// followed by file name with extension, terminated by NUL.
+//
+static struct {
+    bool valid;                     // Index is built
+    bool complete;                  // All PATH directories are indexed
+    uint32_t changes;               // Value of f_dirchanges() when last checked
+    unsigned ndirs;                 // Number of PATH directories indexed in full
+    bool present[MAX_DIRS];         // Directory exists
+    fs_dirid_t dirid[MAX_DIRS];     // Identity of existing directory
+    char path[FPM_CMDLINE_SIZE];    // Value of PATH when built
+    unsigned path_size;             // Bytes used by PATH directories
+    bool cwd_valid;                 // Current directory is indexed
+    bool cwd_complete;              // All names of current directory fit
+    fs_dirid_t cwd;                 // Identity of current directory
+    unsigned size;                  // Bytes used in data
+    char data[FPM_PATH_INDEX_SIZE]; // Entries
+} exe_index;
+
+//
+// Get value of PATH.
+//
+static const char *search_path()
+{
+    const char *path = fpm_getenv("PATH");
+    return path ? path : DEFAULT_PATH;
+}
+
+//
+// Get next directory from the search path.
+// Return NULL at the end.
+//
+static const char *next_dir(const char **path, unsigned *len)
+{
+    const char *dir = *path;
+    while (*dir == ';') {
+        dir++;
+    }
+    if (*dir == 0) {
+        return NULL;
+    }
+    *len = strcspn(dir, ";");
+    *path = dir + *len;
+    return dir;
+}
+
+//
+// Does the file name end with .exe or .cmd extension?
+//
+static bool is_command(const char *name)
+{
+    return strlen(name) > 4 && (fpm_has_extension(name, ".exe") ||
+                                fpm_has_extension(name, ".cmd"));
+}
+
+//
+// Compose path from directory and file name.
+// Return false when it doesn't fit.
+//
+static bool make_path(char *buf, unsigned buf_size, const char *dir, unsigned dir_len,
+                      const char *name, const char *ext)
+{
+    bool need_slash = (dir_len > 0 && dir[dir_len - 1] != '/' && dir[dir_len - 1] != ':');
+    if (dir_len + need_slash + strlen(name) + strlen(ext) >= buf_size) {
+        return false;
+    }
+    memcpy(buf, dir, dir_len);
+    if (need_slash) {
+        buf[dir_len++] = '/';
+    }
+    strcpy(buf + dir_len, name);
+    strcat(buf, ext);
+    return true;
+}
+
+//
+// Append names of programs and scripts from the open directory to the index.
+// Return false when they don't fit.
+//
+static bool index_directory(directory_t *dir, unsigned n)
+{
+    unsigned start = exe_index.size;
+    for (;;) {
+        file_info_t info;
+        if (f_readdir(dir, &info) != FR_OK || info.fname[0] == 0) {
+            return true;
+        }
+        if ((info.fattrib & AM_DIR) || !is_command(info.fname)) {
+            continue;
+        }
+        unsigned nbytes = 1 + strlen(info.fname) + 1;
+        if (exe_index.size + nbytes > sizeof(exe_index.data)) {
+            // Partial contents of the directory are of no use.
+            exe_index.size = start;
+            return false;
+        }
+        exe_index.data[exe_index.size] = n;
+        strcpy(&exe_index.data[exe_index.size + 1], info.fname);
+        exe_index.size += nbytes;
+    }
+}
+
+//
+// Collect names of programs and scripts in PATH directories,
+// up to the first directory which doesn't fit.
+//
+static void build_index(const char *path, directory_t *dir)
+{
+    exe_index.valid = false;
+    exe_index.complete = true;
+    exe_index.ndirs = 0;
+    exe_index.path_size = 0;
+    exe_index.size = 0;
+    exe_index.cwd_valid = false;
+    if (fpm_strlcpy(exe_index.path, path, sizeof(exe_index.path)) >= sizeof(exe_index.path)) {
+        // PATH is too long to be cached.
+        exe_index.complete = false;
+        return;
+    }
+
+    char dirname[FF_LFN_BUF + 1];
+    const char *d;
+    unsigned len;
+    for (unsigned n = 0; n < MAX_DIRS && (d = next_dir(&path, &len)); n++) {
+        exe_index.present[n] = false;
+        if (len >= sizeof(dirname)) {
+            exe_index.complete = false;
+            break;
+        }
+        memcpy(dirname, d, len);
+        dirname[len] = 0;
+        if (f_opendir(dir, dirname) != FR_OK) {
+            // Missing directory, or the disk is not present.
+            exe_index.ndirs = n + 1;
+            continue;
+        }
+        exe_index.present[n] = true;
+        f_dirid(dir, &exe_index.dirid[n]);
+        bool fits = index_directory(dir, n);
+        f_closedir(dir);
+        if (!fits) {
+            exe_index.complete = false;
+            break;
+        }
+        exe_index.ndirs = n + 1;
+    }
+    exe_index.path_size = exe_index.size;
+    exe_index.valid = true;
+}
+
+//
+// Is the index built for this PATH, with no changes in its directories since?
+//
+static bool index_current(const char *path)
+{
+    if (!exe_index.valid || strcmp(exe_index.path, path) != 0) {
+        return false;
+    }
+    for (unsigned n = 0; n < exe_index.ndirs; n++) {
+        if (f_dirchanged(exe_index.present[n] ? &exe_index.dirid[n] : NULL, exe_index.changes)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//
+// Collect names of programs and scripts in the current directory,
+// unless they are already in the index.
+//
+static void index_cwd(directory_t *dir)
+{
+    if (f_opendir(dir, "") != FR_OK) {
+        exe_index.size = exe_index.path_size;
+        exe_index.cwd_valid = false;
+        exe_index.cwd_complete = false;
+        return;
+    }
+    fs_dirid_t id;
+    f_dirid(dir, &id);
+    if (!exe_index.cwd_valid || id.fsid != exe_index.cwd.fsid ||
+        id.sclust != exe_index.cwd.sclust || f_dirchanged(&id, exe_index.changes)) {
+        exe_index.size = exe_index.path_size;
+        exe_index.cwd = id;
+        exe_index.cwd_valid = true;
+        exe_index.cwd_complete = index_directory(dir, 0);
+    }
+    f_closedir(dir);
+}
+
+//
+// Bring the index up to date.
+//
+static const char *update_index()
+{
+    directory_t *dir = alloca(f_sizeof_directory_t());
+    const char *path = search_path();
+    if (!index_current(path)) {
+        build_index(path, dir);
+    }
+    index_cwd(dir);
+
+    // Directories were opened, so volumes are mounted by now.
+    // Changes so far are in other directories: no need to check them again.
+    exe_index.changes = f_dirchanges();
+    return path;
+}
+
+//
+// Build the index of commands, when volumes are mounted.
+//
+void fpm_path_index()
+{
+    update_index();
+}
+
+//
+// Find the command in given part of the index.
+// Return number of the directory in PATH, or -1 when not found.
+//
+static int index_lookup(const char *cmdname, unsigned start, unsigned end, const char **found)
+{
+    unsigned len = strlen(cmdname);
+    int best_rank = -1;
+    for (unsigned pos = start; pos < end;) {
+        unsigned n = (uint8_t)exe_index.data[pos];
+        const char *name = &exe_index.data[pos + 1];
+        pos += 1 + strlen(name) + 1;
+
+        if (strlen(name) != len + 4 || strncasecmp(name, cmdname, len) != 0) {
+            continue;
+        }
+
+        // Earlier directory wins, and program wins over script.
+        int rank = 2 * n + (strcasecmp(name + len, ".cmd") == 0);
+        if (best_rank < 0 || rank < best_rank) {
+            best_rank = rank;
+            *found = name;
+        }
+    }
+    return best_rank < 0 ? -1 : best_rank / 2;
+}
+
+//
+// Check whether file exists, with .exe or .cmd extension appended.
+//
+static bool stat_with_extension(char *buf, unsigned buf_size, const char *dir, unsigned dir_len,
+                                const char *cmdname)
+{
+    static const char *const extensions[] = { ".exe", ".cmd" };
+    file_info_t info;
+
+    for (unsigned i = 0; i < 2; i++) {
+        if (make_path(buf, buf_size, dir, dir_len, cmdname, extensions[i]) &&
+            f_stat(buf, &info) == FR_OK) {
+            return true;
+        }
+    }
+    return false;
+}
+
+//
+// Find file path of external command.
+// Try .exe and .cmd extensions in the current directory,
+// then search directories from PATH variable.
+// Return NULL when not found.
+//
+const char *fpm_find_exe(const char *cmdname, char *buf, unsigned buf_size)
+{
+    if (strchr(cmdname, '/') != NULL) {
+        // Full path name or relative path name - use as is.
+        return cmdname;
+    }
+
+    if (strchr(cmdname, '.') != NULL) {
+        // Extension is explicitly present.
+        return cmdname;
+    }
+
+    // Look in the current directory.
+    const char *path = update_index();
+    const char *name;
+    if (index_lookup(cmdname, exe_index.path_size, exe_index.size, &name) >= 0) {
+        return make_path(buf, buf_size, "", 0, name, "") ? buf : NULL;
+    }
+    if (!exe_index.cwd_complete && stat_with_extension(buf, buf_size, "", 0, cmdname)) {
+        return buf;
+    }
+
+    // Directories before the first incomplete one are in the index.
+    int dirnum = index_lookup(cmdname, 0, exe_index.path_size, &name);
+    const char *d;
+    unsigned len, n;
+    for (n = 0; n < exe_index.ndirs; n++) {
+        d = next_dir(&path, &len);
+        if (dirnum == (int)n) {
+            return make_path(buf, buf_size, d, len, name, "") ? buf : NULL;
+        }
+    }
+    if (exe_index.complete) {
+        return NULL;
+    }
+
+    // Names don't fit into the index: look in the remaining directories.
+    for (; n < MAX_DIRS && (d = next_dir(&path, &len)); n++) {
+        if (stat_with_extension(buf, buf_size, d, len, cmdname)) {
+            return buf;
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,46 @@
+//
+// Posix-compatible formatted output to console.
+//
+// Text is formatted into a buffer on stack and written in one piece.
+// Long text is formatted into a temporary buffer on heap.
+//
+#include <fpm/api.h>
+
+int fpm_vprintf(const char *format, va_list args)
+{
+    char buf[128];
+    va_list args2;
+    va_copy(args2, args);
+    int len = fpm_vsnprintf(buf, sizeof(buf), format, args);
+    if (len <= 0) {
+        va_end(args2);
+        return len;
+    }
+    if (len < sizeof(buf)) {
+        fpm_write(buf, len);
+        va_end(args2);
+        return len;
+    }
+
+    // Does not fit.
+    char *ptr = fpm_alloc_dirty(len + 1);
+    if (ptr) {
+        fpm_vsnprintf(ptr, len + 1, format, args2);
+        fpm_write(ptr, len);
+        fpm_free(ptr);
+    } else {
+        // No memory: print truncated text.
+        fpm_write(buf, sizeof(buf) - 1);
+    }
+    va_end(args2);
+    return len;
+}
+
+int fpm_printf(const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int retval = fpm_vprintf(format, args);
+    va_end(args);
+    return retval;
+}
@@ -10,14 +10,19 @@
 
 void fpm_putwch(uint16_t ch)
 {
+    char buf[3];
+
     if (ch < 0x80) {
-        fpm_putchar(ch);
+        buf[0] = ch;
+        fpm_write(buf, 1);
     } else if (ch < 0x800) {
-        fpm_putchar(ch >> 6 | 0xc0);
-        fpm_putchar((ch & 0x3f) | 0x80);
+        buf[0] = ch >> 6 | 0xc0;
+        buf[1] = (ch & 0x3f) | 0x80;
+        fpm_write(buf, 2);
     } else {
-        fpm_putchar(ch >> 12 | 0xe0);
-        fpm_putchar(((ch >> 6) & 0x3f) | 0x80);
-        fpm_putchar((ch & 0x3f) | 0x80);
+        buf[0] = ch >> 12 | 0xe0;
+        buf[1] = ((ch >> 6) & 0x3f) | 0x80;
+        buf[2] = (ch & 0x3f) | 0x80;
+        fpm_write(buf, 3);
     }
 }
@@ -0,0 +1,438 @@
+//
+// Redirection of console input and output, and pipes.
+//
+// Syntax of the shell and scripts:
+//
+//      command > file          write output to the file
+//      command >> file         append output to the file
+//      command < file          read input from the file
+//      command1 | command2     output of command1 is input of command2
+//
+// Output of the redirected command is collected in a heap buffer of the
+// cluster size, and written to the file by whole clusters, so the volume
+// is written in large batches. Input is read the same way, and line ends
+// are converted to '\r', as typed on the console.
+//
+// Commands of a pipeline run one after another: output of the command
+// goes to a temporary hidden file, which becomes input of the next one.
+// Temporary files are created in directory given by TEMP variable,
+// by default flash:/, and removed when not needed anymore.
+// Redirections can be nested, like a redirected script running
+// redirected commands: the state of outer level is saved on the heap,
+// in a chain of levels, so that all of them are closed after ^C.
+//
+#include <fpm/api.h>
+#include <fpm/fs.h>
+#include <fpm/internal.h>
+
+#define DEFAULT_TEMP  "flash:/"
+#define MIN_BUF_SIZE  512
+#define MAX_BUF_SIZE  (32 * 1024)
+
+//
+// Redirected stream.
+//
+typedef struct {
+    file_t *fp;          // Open file, or NULL when not redirected
+    char *buf;           // Buffer for data
+    unsigned size;       // Size of the buffer
+    unsigned len;        // Bytes in the buffer
+    unsigned pos;        // Input: next byte to read
+    bool last_cr;        // Input: last byte was '\r'
+    fs_result_t result;  // Status of the last operation
+} stream_t;
+
+static stream_t output, input;
+
+//
+// Saved redirections of outer level.
+//
+typedef struct level_t {
+    stream_t input;         // Saved input
+    stream_t output;        // Saved output
+    struct level_t *outer;  // Next outer level, or NULL
+} level_t;
+
+static level_t *levels;
+
+//
+// Temporary files of pipelines, numbered from 0.
+//
+static unsigned num_pipes;
+
+//
+// Build name of the temporary file.
+//
+static void pipe_name(char *buf, unsigned buf_size, unsigned num)
+{
+    const char *dir = fpm_getenv("TEMP");
+    if (!dir) {
+        dir = DEFAULT_TEMP;
+    }
+    unsigned len = strlen(dir);
+    const char *slash = (len > 0 && dir[len - 1] != '/' && dir[len - 1] != ':') ? "/" : "";
+    fpm_snprintf(buf, buf_size, "%s%spipe%u.tmp", dir, slash, num);
+}
+
+//
+// Open file for the stream, and allocate a buffer of cluster size.
+//
+static fs_result_t stream_open(stream_t *s, const char *path, uint8_t mode)
+{
+    memset(s, 0, sizeof(*s));
+    s->fp = fpm_alloc_dirty(f_sizeof_file_t());
+    if (!s->fp) {
+        return FR_NOT_ENOUGH_CORE;
+    }
+    fs_result_t result = f_open(s->fp, path, mode);
+    if (result != FR_OK) {
+        fpm_free(s->fp);
+        s->fp = NULL;
+        return result;
+    }
+
+    // Less than a cluster is fine, when memory is short.
+    unsigned size = f_cluster_size(s->fp);
+    if (size > MAX_BUF_SIZE) {
+        size = MAX_BUF_SIZE;
+    }
+    for (; size >= MIN_BUF_SIZE; size /= 2) {
+        s->buf = fpm_alloc_dirty(size);
+        if (s->buf) {
+            s->size = size;
+            return FR_OK;
+        }
+    }
+    f_close(s->fp);
+    fpm_free(s->fp);
+    s->fp = NULL;
+    return FR_NOT_ENOUGH_CORE;
+}
+
+//
+// Write pending output to the file.
+// After an error, output is dropped.
+//
+static void stream_flush(stream_t *s)
+{
+    if (s->len > 0 && s->result == FR_OK) {
+        unsigned nbytes;
+        s->result = f_write(s->fp, s->buf, s->len, &nbytes);
+        if (s->result == FR_OK && nbytes < s->len) {
+            s->result = FR_DENIED; // Disk full
+        }
+    }
+    s->len = 0;
+}
+
+//
+// Flush, close the file and release memory.
+// Return status of the stream.
+//
+static fs_result_t stream_close(stream_t *s)
+{
+    if (!s->fp) {
+        return FR_OK;
+    }
+    stream_flush(s);
+    fs_result_t result = f_close(s->fp);
+    if (s->result == FR_OK) {
+        s->result = result;
+    }
+    fpm_free(s->buf);
+    fpm_free(s->fp);
+    s->fp = NULL;
+    return s->result;
+}
+
+//
+// Send console output to the file, when redirected.
+// Return false when output goes to the console.
+//
+bool fpm_redirect_write(const char *buf, unsigned len)
+{
+    stream_t *s = &output;
+    if (!s->fp) {
+        return false;
+    }
+    if (s->len == 0 && len >= s->size && s->result == FR_OK) {
+        // Whole clusters go directly to the file.
+        unsigned n = len - len % s->size;
+        unsigned nbytes;
+        s->result = f_write(s->fp, buf, n, &nbytes);
+        if (s->result == FR_OK && nbytes < n) {
+            s->result = FR_DENIED; // Disk full
+        }
+        buf += n;
+        len -= n;
+    }
+    while (len > 0) {
+        unsigned n = s->size - s->len;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(s->buf + s->len, buf, n);
+        s->len += n;
+        buf += n;
+        len -= n;
+        if (s->len == s->size) {
+            stream_flush(s);
+        }
+    }
+    return true;
+}
+
+//
+// Get console input from the file, when redirected.
+// Return number of bytes, 0 at end of file,
+// or -1 when input comes from the console.
+//
+int fpm_redirect_read(char *buf, unsigned len)
+{
+    stream_t *s = &input;
+    if (!s->fp) {
+        return -1;
+    }
+    unsigned count = 0;
+    while (count < len) {
+        if (s->pos == s->len) {
+            if (count > 0) {
+                // Don't wait for more.
+                break;
+            }
+            s->pos = 0;
+            s->len = 0;
+            if (s->result == FR_OK) {
+                s->result = f_read(s->fp, s->buf, s->size, &s->len);
+            }
+            if (s->len == 0) {
+                // End of file.
+                break;
+            }
+        }
+
+        // Line ends "\r\n" and "\n" become '\r', like Enter key.
+        char ch = s->buf[s->pos++];
+        bool skip = (ch == '\n' && s->last_cr);
+        s->last_cr = (ch == '\r');
+        if (skip) {
+            continue;
+        }
+        buf[count++] = (ch == '\n') ? '\r' : ch;
+    }
+    return count;
+}
+
+//
+// Report error of redirection.
+//
+static void report(const char *path, const char *message)
+{
+    if (path) {
+        fpm_printf("%s: %s\r\n\n", path, message);
+    } else {
+        fpm_printf("%s\r\n\n", message);
+    }
+    fpm_exit_code = 1;
+}
+
+//
+// Execute one command of pipeline, with redirections.
+// Input and output are files of the pipe, or NULL.
+// Return false on error.
+//
+static bool exec_command(int argc, char *argv[], uint8_t flags[], const char *in_path,
+                         const char *out_path)
+{
+    // Take redirections out of arguments.
+    const char *out_file = out_path;
+    bool append = false;
+    int n = 0;
+    for (int i = 0; i < argc; i++) {
+        if (!(flags[i] & FPM_ARG_REDIRECT)) {
+            argv[n] = argv[i];
+            flags[n] = flags[i];
+            n++;
+            continue;
+        }
+        const char *op = argv[i];
+        if (i + 1 >= argc || (flags[i + 1] & FPM_ARG_REDIRECT)) {
+            report(op, "Missing file name");
+            return false;
+        }
+        if (op[0] == '<') {
+            if (in_path) {
+                report(NULL, "Ambiguous input redirect");
+                return false;
+            }
+            in_path = argv[++i];
+        } else {
+            if (out_file) {
+                report(NULL, "Ambiguous output redirect");
+                return false;
+            }
+            out_file = argv[++i];
+            append = (op[1] == '>');
+        }
+    }
+    argv[n] = NULL;
+    if (n == 0) {
+        report(NULL, "Missing command");
+        return false;
+    }
+    if ((in_path || out_file) && n > 1 && strcmp(argv[n - 1], "&") == 0) {
+        report(NULL, "Cannot redirect background program");
+        return false;
+    }
+
+    // Expand wildcards, but not in the command name: '?' is an alias of help.
+    const char *error;
+    flags[0] &= ~FPM_ARG_WILD;
+    char **expanded = fpm_glob(&n, argv, flags, &error);
+    if (error) {
+        report(NULL, error);
+        return false;
+    }
+
+    // Save redirections of outer level.
+    level_t *level = NULL;
+    if (in_path || out_file) {
+        level = fpm_alloc(sizeof(level_t));
+        if (!level) {
+            report(NULL, f_strerror(FR_NOT_ENOUGH_CORE));
+            fpm_free(expanded);
+            return false;
+        }
+        level->input = input;
+        level->output = output;
+        level->outer = levels;
+        levels = level;
+    }
+    bool ok = true;
+    fs_result_t result;
+
+    if (in_path) {
+        result = stream_open(&input, in_path, FA_READ);
+        if (result != FR_OK) {
+            input = level->input;
+            report(in_path, f_strerror(result));
+            ok = false;
+        }
+    }
+    if (ok && out_file) {
+        // Show pending output before it goes to the file.
+        fpm_flush();
+        result = stream_open(&output, out_file,
+                             FA_WRITE | (append ? FA_OPEN_APPEND : FA_CREATE_ALWAYS));
+        if (result != FR_OK) {
+            output = level->output;
+            report(out_file, f_strerror(result));
+            ok = false;
+        } else if (out_file == out_path) {
+            // Don't show the pipe in directory listings.
+            f_chmod(out_file, AM_HID, AM_HID);
+        }
+    }
+
+    if (ok) {
+        fpm_exec(n, expanded ? expanded : argv);
+    }
+
+    // Restore outer level, in reverse order of allocation.
+    if (out_file && output.fp != level->output.fp) {
+        result = stream_close(&output);
+        output = level->output;
+        if (result != FR_OK) {
+            report(out_file, f_strerror(result));
+            ok = false;
+        }
+    }
+    if (in_path && input.fp != level->input.fp) {
+        stream_close(&input);
+        input = level->input;
+    }
+    if (level) {
+        levels = level->outer;
+        fpm_free(level);
+    }
+    fpm_free(expanded);
+    return ok;
+}
+
+//
+// Execute command line, split into arguments by fpm_tokenize_shell():
+// handle pipes and redirections, expand wildcards.
+// Arrays of arguments and flags are modified.
+//
+void fpm_exec_line(int argc, char *argv[], uint8_t flags[])
+{
+    // Reserve two temporary files: input and output of a command.
+    unsigned first_pipe = num_pipes;
+    num_pipes += 2;
+
+    char pipe_path[2][FF_LFN_BUF + 1];
+    const char *in_path = NULL;
+    for (unsigned k = 0;; k++) {
+        // Find end of the command.
+        int n = 0;
+        while (n < argc && !((flags[n] & FPM_ARG_REDIRECT) && argv[n][0] == '|')) {
+            n++;
+        }
+        const char *out_path = NULL;
+        if (n < argc) {
+            out_path = pipe_path[k % 2];
+            pipe_name(pipe_path[k % 2], sizeof(pipe_path[0]), first_pipe + k % 2);
+        }
+
+        bool ok = exec_command(n, argv, flags, in_path, out_path);
+        if (in_path) {
+            f_unlink(in_path);
+        }
+        if (!out_path) {
+            break;
+        }
+        if (!ok) {
+            f_unlink(out_path);
+            break;
+        }
+
+        // Output of this command is input of the next one.
+        in_path = out_path;
+        argc -= n + 1;
+        argv += n + 1;
+        flags += n + 1;
+    }
+    num_pipes = first_pipe;
+}
+
+//
+// Close redirected files after ^C, and remove temporary files.
+//
+void fpm_redirect_reset()
+{
+    // Close every level, from inner to outer.
+    // Streams not redirected at a level are the same as at outer one.
+    for (;;) {
+        level_t *level = levels;
+        if (output.fp != (level ? level->output.fp : NULL)) {
+            stream_close(&output);
+        }
+        if (input.fp != (level ? level->input.fp : NULL)) {
+            stream_close(&input);
+        }
+        if (!level) {
+            break;
+        }
+        output = level->output;
+        input = level->input;
+        levels = level->outer;
+        fpm_free(level);
+    }
+
+    char path[FF_LFN_BUF + 1];
+    for (unsigned num = 0; num < num_pipes; num++) {
+        pipe_name(path, sizeof(path), num);
+        f_unlink(path);
+    }
+    num_pipes = 0;
+}
@@ -0,0 +1,751 @@
+//
+// Batch scripts: files with .cmd extension.
+//
+// A script is read in whole and compiled once into a single heap block:
+// a table of commands, a table of labels and the text. Lines without '%'
+// are split into arguments at compile time, so running them takes only
+// a copy. Lines with '%' are kept as text, as variables must be expanded
+// every time, and so are lines with redirections '<', '>' or '|'.
+// Comments and empty lines are dropped. The most recent script stays
+// cached while size and timestamp of the file are the same, so a script
+// called in a loop is not read again.
+//
+// Syntax, in the style of DOS batch files:
+//
+//      rem comment                         also lines with '#' or '::'
+//      :label                              target for goto
+//      goto label                          continue from the label
+//      if [not] errorlevel N command       exit code of last command is N or more
+//      if [not] exist path command         path can have wildcards
+//      if [not] string1==string2 command
+//      for %%v in (item ...) do command    items can have wildcards
+//      shift                               move %1..%9 down to %0..%8
+//      exit [code]                         stop the script
+//      %0 .. %9                            script name and arguments
+//      %name%                              environment variable, see 'set'
+//      %errorlevel%                        exit code of the last command
+//      %%                                  percent sign
+//      command > file, command | command   redirections and pipes, see fpm_redirect.c
+//
+#include <fpm/api.h>
+#include <fpm/fs.h>
+#include <fpm/internal.h>
+#include <alloca.h>
+
+#define MAX_ARGS  64                     // Arguments per line, to fit the wildcard mask
+#define MAX_DEPTH 8                      // Nesting of scripts
+#define LINE_SIZE (3 * FPM_CMDLINE_SIZE) // Max line in bytes, with variables expanded
+
+//
+// Command of the script.
+//
+typedef struct {
+    uint64_t wild;   // Arguments with wildcards, as bit mask
+    uint32_t text;   // Offset of the text in the block
+    uint16_t lineno; // Line number in the file, for messages
+    uint8_t argc;    // Number of arguments, or 0 when text has variables
+} line_t;
+
+//
+// Label for goto.
+//
+typedef struct {
+    uint32_t name;  // Offset of the name in the block
+    uint32_t index; // Index of the next command
+} label_t;
+
+//
+// Compiled script: header of the heap block.
+//
+typedef struct {
+    uint32_t fsize;   // Size of the file
+    uint16_t fdate;   // Date of the file
+    uint16_t ftime;   // Time of the file
+    unsigned nlines;  // Number of commands
+    unsigned nlabels; // Number of labels
+    line_t *lines;    // Table of commands
+    label_t *labels;  // Table of labels
+    char *key;        // Full path of the file, or empty when not cached
+} script_t;
+
+#define HEADER_SIZE ((sizeof(script_t) + 7) & ~7u)
+
+//
+// State of a running script.
+//
+typedef struct {
+    script_t *script; // Compiled script
+    const char *path; // File name, for messages
+    unsigned pc;      // Index of the next command
+    int argc;         // Arguments of the script, %0..%9
+    char **argv;
+    bool jump;        // Goto was executed
+    bool stop;        // Exit, or error
+} frame_t;
+
+static script_t *cached;            // Most recent script
+static script_t *active[MAX_DEPTH]; // Scripts being run
+static unsigned depth;              // Number of running scripts
+
+//
+// Get text of the script by offset.
+//
+static inline char *block_text(script_t *s, uint32_t offset)
+{
+    return (char *)s + offset;
+}
+
+//
+// Get next line of the text, without leading and trailing spaces.
+// Text is not modified: length of the line is returned.
+//
+static const char *next_line(const char **next, const char *end, unsigned *len)
+{
+    const char *line = *next;
+    const char *eol = line;
+    while (eol < end && *eol != '\n') {
+        eol++;
+    }
+    *next = eol + 1;
+
+    while (line < eol && (*line == ' ' || *line == '\t')) {
+        line++;
+    }
+    while (eol > line && (eol[-1] == ' ' || eol[-1] == '\t' || eol[-1] == '\r')) {
+        eol--;
+    }
+    *len = eol - line;
+    return line;
+}
+
+//
+// Is the line a comment?
+//
+static bool is_comment(const char *line)
+{
+    if (line[0] == '#' || (line[0] == ':' && line[1] == ':')) {
+        return true;
+    }
+    return strncasecmp(line, "rem", 3) == 0 && (line[3] == 0 || line[3] == ' ' || line[3] == '\t');
+}
+
+//
+// Get upper limit for number of arguments of the line:
+// every argument starts after a space.
+//
+static unsigned count_args(const char *line)
+{
+    unsigned count = 0;
+    bool seen_space = true;
+    for (; *line; line++) {
+        if (*line == ' ') {
+            seen_space = true;
+        } else if (strchr("<>|", *line)) {
+            // Operator may be glued to neighbours.
+            count++;
+            seen_space = true;
+        } else if (seen_space) {
+            count++;
+            seen_space = false;
+        }
+    }
+    return count;
+}
+
+//
+// Build a key for the cache: full path of the file.
+// Return false when it doesn't fit.
+//
+static bool make_key(char *key, unsigned key_size, const char *path)
+{
+    if (strchr(path, ':')) {
+        // Drive is specified.
+        return fpm_strlcpy(key, path, key_size) < key_size;
+    }
+    if (f_getcwd(key, key_size) != FR_OK) {
+        return false;
+    }
+    unsigned len = strlen(key);
+    if (path[0] == '/') {
+        // From the root of the current drive.
+        char *root = strchr(key, ':');
+        len = root ? root + 1 - key : 0;
+    } else if (len > 0 && key[len - 1] != '/') {
+        key[len++] = '/';
+    }
+    return fpm_strlcpy(key + len, path, key_size - len) < key_size - len;
+}
+
+//
+// Report error in the script.
+//
+static void report(const char *path, unsigned lineno, const char *message)
+{
+    fpm_printf("%s:%u: %s\r\n", path, lineno, message);
+}
+
+//
+// Compile the text of the script into a heap block.
+// Return NULL on error, with message printed.
+//
+static script_t *compile(const char *path, const char *key, const char *text, unsigned text_size)
+{
+    const char *end = text + text_size;
+
+    // Count commands and labels, and space they need.
+    unsigned nlines = 0, nlabels = 0, nbytes = strlen(key) + 1;
+    unsigned lineno = 0, len;
+    for (const char *next = text; next < end;) {
+        const char *line = next_line(&next, end, &len);
+        lineno++;
+        if (len >= LINE_SIZE) {
+            report(path, lineno, "Line too long");
+            return NULL;
+        }
+        char buf[LINE_SIZE];
+        memcpy(buf, line, len);
+        buf[len] = 0;
+        if (len == 0 || is_comment(buf)) {
+            continue;
+        }
+        if (buf[0] == ':') {
+            nlabels++;
+        } else if (count_args(buf) > MAX_ARGS) {
+            report(path, lineno, "Too many arguments");
+            return NULL;
+        } else {
+            nlines++;
+        }
+        nbytes += len + 2;
+    }
+
+    // Allocate the block.
+    unsigned lines_offset = HEADER_SIZE;
+    unsigned labels_offset = lines_offset + nlines * sizeof(line_t);
+    unsigned key_offset = labels_offset + nlabels * sizeof(label_t);
+    script_t *s = fpm_alloc_dirty(key_offset + nbytes);
+    if (!s) {
+        fpm_printf("%s: Out of memory\r\n", path);
+        return NULL;
+    }
+    s->nlines = 0;
+    s->nlabels = 0;
+    s->lines = (line_t *)((char *)s + lines_offset);
+    s->labels = (label_t *)((char *)s + labels_offset);
+    s->key = (char *)s + key_offset;
+    strcpy(s->key, key);
+    unsigned pos = key_offset + strlen(key) + 1;
+
+    // Split commands into arguments, collect labels.
+    lineno = 0;
+    for (const char *next = text; next < end;) {
+        const char *line = next_line(&next, end, &len);
+        lineno++;
+        char *dest = block_text(s, pos);
+        memcpy(dest, line, len);
+        dest[len] = 0;
+        if (len == 0 || is_comment(dest)) {
+            continue;
+        }
+        if (dest[0] == ':') {
+            // Label: name up to space.
+            unsigned name_len = strcspn(dest + 1, " \t");
+            memmove(dest, dest + 1, name_len);
+            dest[name_len] = 0;
+            s->labels[s->nlabels].name = pos;
+            s->labels[s->nlabels].index = s->nlines;
+            s->nlabels++;
+            pos += name_len + 1;
+            continue;
+        }
+
+        line_t *cmd = &s->lines[s->nlines];
+        cmd->text = pos;
+        cmd->lineno = lineno;
+        cmd->argc = 0;
+        cmd->wild = 0;
+        if (strpbrk(dest, "%<>|")) {
+            // Variables are expanded when run, redirections are parsed.
+            pos += len + 1;
+            s->nlines++;
+            continue;
+        }
+
+        char *argv[MAX_ARGS + 1];
+        uint8_t flags[MAX_ARGS];
+        int argc;
+        const char *error = fpm_tokenize_shell(argv, &argc, dest, flags);
+        if (error) {
+            report(path, lineno, error);
+            fpm_free(s);
+            return NULL;
+        }
+        if (argc == 0) {
+            continue;
+        }
+        cmd->argc = argc;
+        for (int i = 0; i < argc; i++) {
+            if (flags[i] & FPM_ARG_WILD) {
+                cmd->wild |= 1ull << i;
+            }
+        }
+        pos = argv[argc - 1] + strlen(argv[argc - 1]) + 1 - (char *)s;
+        s->nlines++;
+    }
+
+    fpm_truncate(s, pos);
+    return s;
+}
+
+//
+// Release the script when it's not needed anymore.
+//
+static void release(script_t *s)
+{
+    if (s == cached) {
+        return;
+    }
+    for (unsigned i = 0; i < depth; i++) {
+        if (active[i] == s) {
+            return;
+        }
+    }
+    fpm_free(s);
+}
+
+//
+// Read and compile the script, or get it from the cache.
+// Return NULL on error, with message printed.
+//
+static script_t *load(const char *path)
+{
+    file_info_t info;
+    fs_result_t result = f_stat(path, &info);
+    if (result != FR_OK) {
+        fpm_printf("%s: %s\r\n", path, f_strerror(result));
+        return NULL;
+    }
+
+    char key[FF_LFN_BUF + 1];
+    if (!make_key(key, sizeof(key), path)) {
+        key[0] = 0;
+    }
+    if (cached && key[0] && strcmp(cached->key, key) == 0 && cached->fsize == info.fsize &&
+        cached->fdate == info.fdate && cached->ftime == info.ftime) {
+        return cached;
+    }
+
+    // Read the whole file at once.
+    char *text = fpm_alloc_dirty(info.fsize + 1);
+    if (!text) {
+        fpm_printf("%s: Out of memory\r\n", path);
+        return NULL;
+    }
+    file_t *fp = alloca(f_sizeof_file_t());
+    result = f_open(fp, path, FA_READ);
+    if (result == FR_OK) {
+        unsigned nbytes = 0;
+        result = f_read(fp, text, info.fsize, &nbytes);
+        f_close(fp);
+        if (result == FR_OK && nbytes != info.fsize) {
+            result = FR_INT_ERR;
+        }
+    }
+    if (result != FR_OK) {
+        fpm_printf("%s: %s\r\n", path, f_strerror(result));
+        fpm_free(text);
+        return NULL;
+    }
+
+    script_t *s = compile(path, key, text, info.fsize);
+    fpm_free(text);
+    if (!s) {
+        return NULL;
+    }
+    s->fsize = info.fsize;
+    s->fdate = info.fdate;
+    s->ftime = info.ftime;
+
+    // Replace the cached script, unless it's not cacheable.
+    if (key[0]) {
+        script_t *old = cached;
+        cached = s;
+        if (old) {
+            release(old);
+        }
+    }
+    return s;
+}
+
+//
+// Expand variables in the line.
+// Return false when result doesn't fit.
+//
+static bool expand_variables(frame_t *f, char *dest, unsigned dest_size, const char *src)
+{
+    unsigned len = 0;
+    while (*src) {
+        const char *value = NULL;
+        char buf[16];
+        if (*src != '%') {
+            buf[0] = *src++;
+            buf[1] = 0;
+            value = buf;
+        } else if (src[1] == '%') {
+            // Percent sign.
+            value = "%";
+            src += 2;
+        } else if (src[1] >= '0' && src[1] <= '9') {
+            // Argument of the script.
+            int index = src[1] - '0';
+            value = (index < f->argc) ? f->argv[index] : "";
+            src += 2;
+        } else {
+            const char *end = strchr(src + 1, '%');
+            char name[32];
+            if (!end || end == src + 1 || end - src - 1 >= (int)sizeof(name)) {
+                // Not a variable.
+                value = "%";
+                src++;
+            } else {
+                memcpy(name, src + 1, end - src - 1);
+                name[end - src - 1] = 0;
+                src = end + 1;
+                value = fpm_getenv(name);
+                if (!value && strcasecmp(name, "errorlevel") == 0) {
+                    fpm_snprintf(buf, sizeof(buf), "%d", fpm_exit_code);
+                    value = buf;
+                }
+                if (!value) {
+                    value = "";
+                }
+            }
+        }
+        len += fpm_strlcpy(dest + len, value, dest_size - len);
+        if (len >= dest_size) {
+            return false;
+        }
+    }
+    dest[len] = 0;
+    return true;
+}
+
+//
+// Does any file match the path, which can have wildcards?
+//
+static bool exists(const char *path)
+{
+    file_info_t info;
+    if (!strchr(path, '*') && !strchr(path, '?')) {
+        return f_stat(path, &info) == FR_OK;
+    }
+
+    // Split into directory and name pattern.
+    const char *name = path;
+    for (const char *p = path; *p; p++) {
+        if (*p == '/' || *p == ':') {
+            name = p + 1;
+        }
+    }
+    unsigned dir_len = name - path;
+    if (dir_len > 1 && path[dir_len - 1] == '/' && path[dir_len - 2] != ':') {
+        dir_len--;
+    }
+    char dirname[dir_len + 1];
+    memcpy(dirname, path, dir_len);
+    dirname[dir_len] = 0;
+
+    directory_t *dir = alloca(f_sizeof_directory_t());
+    if (f_findfirst(dir, &info, dirname, name) != FR_OK) {
+        return false;
+    }
+    f_closedir(dir);
+    return info.fname[0] != 0;
+}
+
+//
+// Evaluate condition of the 'if' command.
+// Return number of arguments consumed, or 0 on syntax error.
+//
+static int eval_condition(int argc, char *argv[], bool *result)
+{
+    int i = 1;
+    bool negate = false;
+    if (i < argc && strcasecmp(argv[i], "not") == 0) {
+        negate = true;
+        i++;
+    }
+    if (i + 1 < argc && strcasecmp(argv[i], "errorlevel") == 0) {
+        long level;
+        if (fpm_strtol(&level, argv[i + 1], NULL, 10)) {
+            return 0;
+        }
+        *result = (fpm_exit_code >= level);
+        i += 2;
+    } else if (i + 1 < argc && strcasecmp(argv[i], "exist") == 0) {
+        *result = exists(argv[i + 1]);
+        i += 2;
+    } else if (i + 2 < argc && strcmp(argv[i + 1], "==") == 0) {
+        *result = (strcmp(argv[i], argv[i + 2]) == 0);
+        i += 3;
+    } else if (i < argc && strstr(argv[i], "==")) {
+        char *eq = strstr(argv[i], "==");
+        *eq = 0;
+        *result = (strcmp(argv[i], eq + 2) == 0);
+        i += 1;
+    } else {
+        return 0;
+    }
+    if (i >= argc) {
+        // No command.
+        return 0;
+    }
+    *result ^= negate;
+    return i;
+}
+
+static void run_command(frame_t *f, const line_t *line, int argc, char *argv[], uint8_t flags[]);
+
+//
+// Execute 'for' command: for %v in (item ...) do command
+//
+static void run_for(frame_t *f, const line_t *line, int argc, char *argv[], uint8_t flags[])
+{
+    const char *var = argv[1];
+    if (argc < 6 || var[0] != '%' || var[1] == 0 || var[2] != 0 || strcasecmp(argv[2], "in") != 0 ||
+        argv[3][0] != '(') {
+        report(f->path, line->lineno, "Bad for command");
+        f->stop = true;
+        return;
+    }
+
+    // Collect items in parentheses.
+    argv[3]++;
+    int first = 3, last;
+    for (last = first; last < argc; last++) {
+        unsigned len = strlen(argv[last]);
+        if (len > 0 && argv[last][len - 1] == ')') {
+            argv[last][len - 1] = 0;
+            break;
+        }
+    }
+    if (last + 2 >= argc || strcasecmp(argv[last + 1], "do") != 0) {
+        report(f->path, line->lineno, "Bad for command");
+        f->stop = true;
+        return;
+    }
+    int nitems = last + 1 - first;
+    const char *error;
+    char **expanded = fpm_glob(&nitems, &argv[first], &flags[first], &error);
+    if (error) {
+        report(f->path, line->lineno, error);
+        f->stop = true;
+        return;
+    }
+    char **items = expanded ? expanded : &argv[first];
+
+    // Run the command for every item.
+    int cmd_argc = argc - (last + 2);
+    char **cmd_argv = &argv[last + 2];
+    for (int k = 0; k < nitems && !f->stop && !f->jump; k++) {
+        if (items[k][0] == 0) {
+            // Empty item, like in "( a b )".
+            continue;
+        }
+        char buf[LINE_SIZE];
+        char *args[MAX_ARGS + 1];
+        uint8_t args_flags[MAX_ARGS];
+        unsigned len = 0;
+        for (int i = 0; i < cmd_argc; i++) {
+            // Substitute the variable.
+            args[i] = buf + len;
+            args_flags[i] = flags[last + 2 + i];
+            for (const char *p = cmd_argv[i]; *p && len < sizeof(buf) - 1;) {
+                if (p[0] == '%' && p[1] == var[1]) {
+                    len += fpm_strlcpy(buf + len, items[k], sizeof(buf) - len);
+                    p += 2;
+                } else {
+                    buf[len++] = *p++;
+                }
+            }
+            if (len >= sizeof(buf) - 1) {
+                report(f->path, line->lineno, "Line too long");
+                f->stop = true;
+                break;
+            }
+            buf[len++] = 0;
+        }
+        if (f->stop) {
+            break;
+        }
+        args[cmd_argc] = NULL;
+        run_command(f, line, cmd_argc, args, args_flags);
+    }
+    fpm_free(expanded);
+}
+
+//
+// Execute one command of the script.
+//
+static void run_command(frame_t *f, const line_t *line, int argc, char *argv[], uint8_t flags[])
+{
+    // Conditions.
+    while (argc > 0 && strcasecmp(argv[0], "if") == 0) {
+        bool result = false;
+        int n = eval_condition(argc, argv, &result);
+        if (n == 0) {
+            report(f->path, line->lineno, "Bad condition");
+            f->stop = true;
+            return;
+        }
+        if (!result) {
+            return;
+        }
+        argc -= n;
+        argv += n;
+        flags += n;
+    }
+
+    if (strcasecmp(argv[0], "goto") == 0) {
+        if (argc != 2) {
+            report(f->path, line->lineno, "Usage: goto label");
+            f->stop = true;
+            return;
+        }
+        const char *label = argv[1] + (argv[1][0] == ':');
+        script_t *s = f->script;
+        for (unsigned i = 0; i < s->nlabels; i++) {
+            if (strcasecmp(block_text(s, s->labels[i].name), label) == 0) {
+                f->pc = s->labels[i].index;
+                f->jump = true;
+                return;
+            }
+        }
+        report(f->path, line->lineno, "Label not found");
+        f->stop = true;
+        return;
+    }
+
+    if (strcasecmp(argv[0], "exit") == 0) {
+        if (argc > 1) {
+            long code;
+            if (argc > 2 || fpm_strtol(&code, argv[1], NULL, 10)) {
+                report(f->path, line->lineno, "Usage: exit [code]");
+                code = 1;
+            }
+            fpm_exit_code = code;
+        }
+        f->stop = true;
+        return;
+    }
+
+    if (strcasecmp(argv[0], "shift") == 0) {
+        if (f->argc > 0) {
+            f->argc--;
+            f->argv++;
+        }
+        return;
+    }
+
+    if (strcasecmp(argv[0], "for") == 0) {
+        run_for(f, line, argc, argv, flags);
+        return;
+    }
+
+    // Execute, with wildcards, pipes and redirections.
+    fpm_exec_line(argc, argv, flags);
+}
+
+//
+// Execute one line of the script.
+//
+static void run_line(frame_t *f, const line_t *line)
+{
+    char buf[LINE_SIZE];
+    char *argv[MAX_ARGS + 1];
+    uint8_t flags[MAX_ARGS];
+    int argc;
+    const char *text = block_text(f->script, line->text);
+
+    if (line->argc == 0) {
+        // Expand variables and split.
+        if (!expand_variables(f, buf, sizeof(buf), text)) {
+            report(f->path, line->lineno, "Line too long");
+            f->stop = true;
+            return;
+        }
+        if (count_args(buf) > MAX_ARGS) {
+            report(f->path, line->lineno, "Too many arguments");
+            f->stop = true;
+            return;
+        }
+        const char *error = fpm_tokenize_shell(argv, &argc, buf, flags);
+        if (error) {
+            report(f->path, line->lineno, error);
+            f->stop = true;
+            return;
+        }
+        if (argc == 0) {
+            return;
+        }
+    } else {
+        // Copy arguments, as commands may modify them.
+        char *dest = buf;
+        argc = line->argc;
+        for (int i = 0; i < argc; i++) {
+            unsigned len = strlen(text) + 1;
+            memcpy(dest, text, len);
+            argv[i] = dest;
+            flags[i] = ((line->wild >> i) & 1) ? FPM_ARG_WILD : 0;
+            dest += len;
+            text += len;
+        }
+        argv[argc] = NULL;
+    }
+    run_command(f, line, argc, argv, flags);
+}
+
+//
+// Run the script with given arguments.
+//
+void fpm_script_run(const char *path, int argc, char *argv[])
+{
+    if (depth >= MAX_DEPTH) {
+        fpm_printf("%s: Too many nested scripts\r\n\n", path);
+        fpm_exit_code = 1;
+        return;
+    }
+    script_t *s = load(path);
+    if (!s) {
+        fpm_puts("\r\n");
+        fpm_exit_code = 1;
+        return;
+    }
+    active[depth++] = s;
+
+    frame_t f = { .script = s, .path = path, .argc = argc, .argv = argv };
+    while (!f.stop && f.pc < s->nlines) {
+        f.jump = false;
+        run_line(&f, &s->lines[f.pc++]);
+    }
+
+    depth--;
+    release(s);
+}
+
+//
+// Forget running scripts and the cache, after ^C.
+//
+void fpm_script_reset()
+{
+    script_t *s = cached;
+    cached = NULL;
+    if (s) {
+        release(s);
+    }
+    while (depth > 0) {
+        s = active[--depth];
+        active[depth] = NULL;
+        release(s);
+    }
+}
@@ -0,0 +1,124 @@
+//
+// SHA-256 hash, as defined in FIPS 180-4.
+//
+// To hash data in pieces: call fpm_sha256_init(), then fpm_sha256_update()
+// for every piece, and fpm_sha256_final() to get the digest. Whole blocks
+// of 64 bytes are hashed directly from the caller's buffer, without a copy.
+//
+#include <fpm/api.h>
+#include <fpm/internal.h>
+
+static const uint32_t round_const[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static inline uint32_t ror(uint32_t x, unsigned n)
+{
+    return (x >> n) | (x << (32 - n));
+}
+
+//
+// Process one block of 64 bytes.
+// Message schedule is kept in a ring of 16 words.
+//
+static void sha256_block(uint32_t state[8], const uint8_t *p)
+{
+    uint32_t w[16];
+    for (unsigned i = 0; i < 16; i++, p += 4) {
+        w[i] = (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (unsigned i = 0; i < 64; i++) {
+        if (i >= 16) {
+            uint32_t w15 = w[(i - 15) & 15];
+            uint32_t w2  = w[(i - 2) & 15];
+            w[i & 15] += (ror(w15, 7) ^ ror(w15, 18) ^ (w15 >> 3)) + w[(i - 7) & 15] +
+                         (ror(w2, 17) ^ ror(w2, 19) ^ (w2 >> 10));
+        }
+        uint32_t t1 = h + (ror(e, 6) ^ ror(e, 11) ^ ror(e, 25)) + ((e & f) ^ (~e & g)) +
+                      round_const[i] + w[i & 15];
+        uint32_t t2 = (ror(a, 2) ^ ror(a, 13) ^ ror(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+void fpm_sha256_init(fpm_sha256_t *ctx)
+{
+    static const uint32_t initial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+    memcpy(ctx->state, initial, sizeof(initial));
+    ctx->count = 0;
+}
+
+void fpm_sha256_update(fpm_sha256_t *ctx, const void *data, unsigned len)
+{
+    const uint8_t *p = data;
+    unsigned used = ctx->count % 64;
+    ctx->count += len;
+
+    // Complete the pending block.
+    if (used > 0) {
+        unsigned n = 64 - used;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(&ctx->block[used], p, n);
+        p += n;
+        len -= n;
+        if (used + n < 64) {
+            return;
+        }
+        sha256_block(ctx->state, ctx->block);
+    }
+
+    // Whole blocks from the caller's buffer.
+    for (; len >= 64; p += 64, len -= 64) {
+        sha256_block(ctx->state, p);
+    }
+    memcpy(ctx->block, p, len);
+}
+
+void fpm_sha256_final(fpm_sha256_t *ctx, uint8_t digest[32])
+{
+    // Append bit 1, zeros, and length in bits.
+    uint64_t nbits = ctx->count * 8;
+    uint8_t pad[72] = { 0x80 };
+    unsigned npad = 64 - (ctx->count + 8) % 64;
+    for (unsigned i = 0; i < 8; i++) {
+        pad[npad + i] = nbits >> (56 - 8 * i);
+    }
+    fpm_sha256_update(ctx, pad, npad + 8);
+
+    for (unsigned i = 0; i < 8; i++) {
+        digest[4 * i]     = ctx->state[i] >> 24;
+        digest[4 * i + 1] = ctx->state[i] >> 16;
+        digest[4 * i + 2] = ctx->state[i] >> 8;
+        digest[4 * i + 3] = ctx->state[i];
+    }
+}
@@ -6,12 +6,146 @@
 #include <fpm/fs.h>
 #include <fpm/diskio.h>
 #include <fpm/internal.h>
+#include <stdlib.h>
 
 //
 // Area of system data.
 //
 jmp_buf fpm_saved_point;
-uint16_t fpm_history[FPM_CMDLINE_SIZE];
+fpm_history_t fpm_history;
+
+//
+// File to keep command history between sessions, or NULL.
+//
+#ifndef FPM_HISTORY_FILE
+#define FPM_HISTORY_FILE "flash:/history"
+#endif
+
+//
+// Script to run at startup, or NULL.
+//
+#ifndef FPM_AUTOEXEC_FILE
+#define FPM_AUTOEXEC_FILE "flash:/autoexec.cmd"
+#endif
+
+//
+// To spare the flash, new lines are appended to the history file
+// in batches, and the file is rewritten only when it grows too big.
+//
+#define HISTORY_SAVE_LINES 8
+#define HISTORY_FILE_MAX   (2 * FPM_HISTORY_SIZE)
+
+static unsigned history_saved;      // Ring offset up to which lines are in the file
+static unsigned history_unsaved;    // Number of lines not saved yet
+
+//
+// Load history from file.
+//
+static void history_load()
+{
+    const char *path = FPM_HISTORY_FILE;
+
+    fpm_history_clear(&fpm_history);
+    history_saved = 0;
+    history_unsaved = 0;
+    if (!path) {
+        return;
+    }
+    file_t *fp = alloca(f_sizeof_file_t());
+    if (f_open(fp, path, FA_READ) != FR_OK) {
+        return;
+    }
+
+    // Split into lines. The ring keeps only the newest ones.
+    char line[3 * FPM_CMDLINE_SIZE];
+    unsigned len = 0;
+    char chunk[128];
+    unsigned nbytes;
+    while (f_read(fp, chunk, sizeof(chunk), &nbytes) == FR_OK && nbytes > 0) {
+        for (unsigned i = 0; i < nbytes; i++) {
+            if (chunk[i] == '\n') {
+                line[len] = 0;
+                fpm_history_add_utf8(&fpm_history, line);
+                len = 0;
+            } else if (len < sizeof(line) - 1) {
+                line[len++] = chunk[i];
+            }
+        }
+    }
+    f_close(fp);
+    history_saved = fpm_history.end;
+}
+
+//
+// Write new lines to the history file.
+// Append to the file when possible, otherwise rewrite it from the ring.
+//
+void fpm_history_save()
+{
+    const char *path = FPM_HISTORY_FILE;
+
+    if (!path || history_unsaved == 0) {
+        return;
+    }
+    history_unsaved = 0;
+
+    file_t *fp = alloca(f_sizeof_file_t());
+    if (f_open(fp, path, FA_WRITE | FA_OPEN_APPEND) != FR_OK) {
+        return;
+    }
+    unsigned pos = history_saved;
+    if ((int)(fpm_history.start - pos) > 0 ||
+        f_size(fp) + (fpm_history.end - pos) > HISTORY_FILE_MAX) {
+        // Saved lines are lost from the ring, or file is too big.
+        pos = fpm_history.start;
+        f_lseek(fp, 0);
+        f_truncate(fp);
+    }
+
+    // Lines are terminated by newline instead of NUL.
+    char chunk[128];
+    unsigned len = 0;
+    for (; pos != fpm_history.end; pos++) {
+        char ch = fpm_history.data[pos % FPM_HISTORY_SIZE];
+        chunk[len++] = (ch == 0) ? '\n' : ch;
+        if (len == sizeof(chunk) || pos + 1 == fpm_history.end) {
+            unsigned written;
+            if (f_write(fp, chunk, len, &written) != FR_OK || written != len) {
+                break;
+            }
+            len = 0;
+        }
+    }
+    f_close(fp);
+    history_saved = fpm_history.end;
+}
+
+//
+// Add the line to the history, and save in batches.
+//
+static void history_add(const uint16_t *line)
+{
+    unsigned end = fpm_history.end;
+    fpm_history_add(&fpm_history, line);
+    if (fpm_history.end != end && ++history_unsaved >= HISTORY_SAVE_LINES) {
+        fpm_history_save();
+    }
+}
+
+//
+// Run the startup script, when present.
+//
+static void run_autoexec()
+{
+    const char *path = FPM_AUTOEXEC_FILE;
+    file_info_t info;
+
+    if (!path || f_stat(path, &info) != FR_OK) {
+        return;
+    }
+    char *argv[] = { (char *)path, NULL };
+    fpm_script_run(path, 1, argv);
+}
 
 //
 // Build the prompt string.
@@ -50,28 +184,35 @@ void fpm_shell()
 {
     // TODO: Mount the SD card.
 
-    // TODO: Load the autoexec.bat config file.
-    //if (coldBoot > 0) {
-    //    source("autoexec.cmd");
-    //}
-
-    // Clear history.
-    fpm_history[0] = 0;
+    // Restore history of previous sessions.
+    history_load();
 
     // Restart on ^C.
+    volatile bool startup = true;
     if (setjmp(fpm_saved_point) != 0) {
         // TODO: Re-initialize internal state.
+        fpm_script_reset();
+        fpm_redirect_reset();
+    }
+
+    // Run the startup script, once.
+    if (startup) {
+        startup = false;
+        run_autoexec();
     }
 
     // The main loop.
     for (;;) {
+        // Report completion of background program, if any.
+        fpm_background_poll();
+
         // Create prompt.
         char prompt[FPM_CMDLINE_SIZE];
         build_prompt(prompt, sizeof(prompt));
 
         // Call the line editor.
         uint16_t buf_unicode[FPM_CMDLINE_SIZE];
-        fpm_editline(buf_unicode, sizeof(buf_unicode), 1, prompt, fpm_history);
+        fpm_editline(buf_unicode, sizeof(buf_unicode), 1, prompt, &fpm_history);
         fpm_puts("\r\n");
 
         // Encode as utf8.
@@ -79,15 +220,17 @@ void fpm_shell()
         fpm_strlcpy_to_utf8(cmd_line, buf_unicode, sizeof(cmd_line));
 
         // Split into argument vector.
-        char *argv[FPM_CMDLINE_SIZE / 3];
+        // Operators like "a>b" take no space, so every symbol can be an argument.
+        char *argv[FPM_CMDLINE_SIZE + 1];
+        uint8_t flags[FPM_CMDLINE_SIZE];
         int argc;
-        const char *error = fpm_tokenize(argv, &argc, cmd_line);
+        const char *error = fpm_tokenize_shell(argv, &argc, cmd_line, flags);
         if (error) {
             fpm_puts(error);
             fpm_puts("\r\n");
 
             // Save wrong line to the history.
-            fpm_strlcpy_unicode(fpm_history, buf_unicode, sizeof(fpm_history)/sizeof(uint16_t));
+            history_add(buf_unicode);
             continue;
         }
 
@@ -97,17 +240,18 @@ void fpm_shell()
         }
 
         // Add the line to the history.
-        fpm_strlcpy_unicode(fpm_history, buf_unicode, sizeof(fpm_history)/sizeof(uint16_t));
+        history_add(buf_unicode);
 
         if (strcmp(argv[0], "exit") == 0) {
             if (argc > 1) {
                 fpm_puts("Usage: exit\r\n\r\n");
                 continue;
             }
+            fpm_history_save();
             return;
         }
 
-        // Execute the command.
-        fpm_exec(argc, argv);
+        // Execute the command, with wildcards, pipes and redirections.
+        fpm_exec_line(argc, argv, flags);
     }
 }
@@ -0,0 +1,59 @@
+//
+// Heap sort of an array, in place.
+//
+// No recursion and no extra memory, unlike qsort() of the C library.
+// The heap keeps the element which goes last at the root, so it can
+// also serve as a bounded priority queue, as in the ls command.
+//
+#include <fpm/api.h>
+#include <fpm/internal.h>
+
+//
+// Swap two elements of given size.
+//
+static inline void swap_elements(char *a, char *b, unsigned size)
+{
+    while (size-- > 0) {
+        char t = *a;
+        *a++ = *b;
+        *b++ = t;
+    }
+}
+
+//
+// Restore the heap property below given element.
+//
+void fpm_sift_down(void *base, unsigned size, unsigned root, unsigned count,
+                   fpm_compare_t compare, void *arg)
+{
+    char *e = base;
+    for (;;) {
+        unsigned child = 2 * root + 1;
+        if (child >= count) {
+            break;
+        }
+        if (child + 1 < count && compare(arg, e + child * size, e + (child + 1) * size) < 0) {
+            child++;
+        }
+        if (compare(arg, e + root * size, e + child * size) >= 0) {
+            break;
+        }
+        swap_elements(e + root * size, e + child * size, size);
+        root = child;
+    }
+}
+
+//
+// Arrange elements as a heap, then take the root off it one by one.
+//
+void fpm_heap_sort(void *base, unsigned count, unsigned size, fpm_compare_t compare, void *arg)
+{
+    for (unsigned i = count / 2; i-- > 0;) {
+        fpm_sift_down(base, size, i, count, compare, arg);
+    }
+    for (unsigned n = count; n > 1;) {
+        n--;
+        swap_elements(base, (char *)base + n * size, size);
+        fpm_sift_down(base, size, 0, n, compare, arg);
+    }
+}
@@ -4,9 +4,15 @@
 // Fill an argument vector.
 // On error, return a message.
 //
+// When flags[] is not NULL, the line is parsed as shell command, and
+// flags[] is filled with a value per argument: FPM_ARG_WILD when the
+// argument has unquoted wildcards '*' or '?'. Unquoted '<', '>', '>>'
+// and '|' become separate arguments with flag FPM_ARG_REDIRECT.
+//
 #include <fpm/api.h>
+#include <fpm/internal.h>
 
-const char *fpm_tokenize(char *argv[], int *argc, char *cmd_line)
+const char *fpm_tokenize_shell(char *argv[], int *argc, char *cmd_line, uint8_t flags[])
 {
     const char *src = cmd_line; // Copy from here...
     char *dest = cmd_line;      // ...to there
@@ -72,10 +78,49 @@ const char *fpm_tokenize(char *argv[], int *argc, char *cmd_line)
             seen_quote = !seen_quote;
             break;
 
+        case '*':
+        case '?':
+            // Wildcard, unless quoted.
+            if (flags && !seen_apostrophe && !seen_quote) {
+                if (seen_space) {
+                    // Next argument.
+                    flags[*argc] = 0;
+                    argv[(*argc)++] = dest;
+                    seen_space = false;
+                }
+                flags[*argc - 1] |= FPM_ARG_WILD;
+            }
+            goto consume;
+
+        case '<':
+        case '>':
+        case '|':
+            // Redirection or pipe, unless quoted.
+            if (!flags || seen_apostrophe || seen_quote) {
+                goto consume;
+            }
+            if (! seen_space) {
+                *dest++ = '\0';
+                seen_space = true;
+            }
+            // The operator may be glued to neighbours, like "dir>log",
+            // so there is no room for it in the line: use a constant.
+            if (ch == '>' && src[1] == '>') {
+                argv[*argc] = (char *)">>";
+                src++;
+            } else {
+                argv[*argc] = (char *)(ch == '<' ? "<" : ch == '>' ? ">" : "|");
+            }
+            flags[(*argc)++] = FPM_ARG_REDIRECT;
+            break;
+
         default:
 consume:    // Ordinary symbol.
             if (seen_space) {
                 // Next argument.
+                if (flags) {
+                    flags[*argc] = 0;
+                }
                 argv[(*argc)++] = dest;
                 seen_space = false;
             }
@@ -84,3 +129,8 @@ consume:    // Ordinary symbol.
         }
     }
 }
+
+const char *fpm_tokenize(char *argv[], int *argc, char *cmd_line)
+{
+    return fpm_tokenize_shell(argv, argc, cmd_line, NULL);
+}
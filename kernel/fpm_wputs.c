@@ -1,11 +1,34 @@
 //
-// Write UTF-8 string to output.
+// Write Unicode string to output.
+// Encode as UTF-8 into a local buffer, and write it in chunks.
 //
 #include <fpm/api.h>
 
 void fpm_wputs(const uint16_t *input)
 {
+    char buf[64];
+    unsigned len = 0;
+
     while (*input) {
-        fpm_putwch(*input++);
+        if (len > sizeof(buf) - 3) {
+            // No space for longest character.
+            fpm_write(buf, len);
+            len = 0;
+        }
+
+        unsigned ch = *input++;
+        if (ch < 0x80) {
+            buf[len++] = ch;
+        } else if (ch < 0x800) {
+            buf[len++] = ch >> 6 | 0xc0;
+            buf[len++] = (ch & 0x3f) | 0x80;
+        } else {
+            buf[len++] = ch >> 12 | 0xe0;
+            buf[len++] = ((ch >> 6) & 0x3f) | 0x80;
+            buf[len++] = (ch & 0x3f) | 0x80;
+        }
+    }
+    if (len > 0) {
+        fpm_write(buf, len);
     }
 }
@@ -0,0 +1,123 @@
+//
+// Buffered console output.
+//
+// Output of the foreground program is collected in a buffer and passed
+// to the console driver in large blocks. The buffer is flushed:
+//  - when it becomes full;
+//  - before waiting for console input, so prompts and echo of the line
+//    editor appear immediately;
+//  - before delays, and on write when pending data are older than FLUSH_USEC;
+//  - by periodic timer on core 0, when pending data are older than FLUSH_USEC,
+//    so output of a busy program appears while it computes;
+//  - on explicit call of fpm_flush().
+//
+// The timer interrupts core 0 at any point, so it leaves the buffer alone
+// while fpm_write() or fpm_flush() is in progress.
+//
+// The buffer is owned by core 0. Output of background program goes
+// to its own stream, see fpm_background.c. Redirected output goes
+// to a file, see fpm_redirect.c.
+//
+#include <fpm/api.h>
+#include <fpm/internal.h>
+
+//
+// Size of output buffer.
+//
+#define OUTPUT_SIZE 512
+
+//
+// Max time to keep data in the buffer, in microseconds.
+//
+#define FLUSH_USEC 20000
+
+static char output_buf[OUTPUT_SIZE];
+static unsigned output_len;     // Bytes pending in buffer
+static uint64_t output_time;    // When first pending byte was written
+static bool output_busy;        // Buffer is being updated
+
+//
+// Guard the buffer against the timer.
+//
+static inline void set_busy(bool busy)
+{
+    __atomic_store_n(&output_busy, busy, __ATOMIC_SEQ_CST);
+}
+
+//
+// Pass pending output to the console driver.
+//
+static void flush_buffer()
+{
+    if (output_len > 0) {
+        fpm_write_arch(output_buf, output_len);
+        output_len = 0;
+    }
+}
+
+void fpm_flush()
+{
+    if (fpm_core_num() != 0) {
+        // Background output is not buffered.
+        return;
+    }
+    set_busy(true);
+    flush_buffer();
+    set_busy(false);
+}
+
+//
+// Pass stale output to the console driver.
+// Called by periodic timer on core 0.
+//
+void fpm_flush_idle()
+{
+    if (__atomic_load_n(&output_busy, __ATOMIC_SEQ_CST) || output_len == 0) {
+        return;
+    }
+    if (fpm_time_usec() - output_time >= FLUSH_USEC) {
+        flush_buffer();
+    }
+}
+
+//
+// Write a block of bytes to the console.
+//
+void fpm_write(const char *buf, unsigned len)
+{
+    if (fpm_core_num() != 0) {
+        // Output of background program goes to a separate stream.
+        if (!fpm_background_write(buf, len)) {
+            fpm_write_arch(buf, len);
+        }
+        return;
+    }
+    if (fpm_redirect_write(buf, len)) {
+        // Output of redirected command.
+        return;
+    }
+
+    set_busy(true);
+    if (output_len + len > OUTPUT_SIZE) {
+        flush_buffer();
+        if (len >= OUTPUT_SIZE) {
+            // Too large for the buffer: write directly.
+            fpm_write_arch(buf, len);
+            set_busy(false);
+            return;
+        }
+    }
+
+    uint64_t now = fpm_time_usec();
+    if (output_len == 0) {
+        output_time = now;
+    }
+    memcpy(&output_buf[output_len], buf, len);
+    output_len += len;
+
+    if (now - output_time >= FLUSH_USEC) {
+        // Don't keep the user waiting.
+        flush_buffer();
+    }
+    set_busy(false);
+}
@@ -0,0 +1,301 @@
+//
+// Console input and output, implemented with Pico SDK.
+//
+// Received bytes are collected into a ring buffer by the interrupt
+// handler of the console driver (USB CDC or UART), so input is not lost
+// while the program is busy, for example writing to flash.
+// The handler is installed as "chars available" callback of Pico stdio.
+//
+// When the ring is full, the handler stops reading from the driver.
+// The data stay in the driver, and the host is held back by the transport:
+// USB CDC endpoint is NAKed, and UART deasserts RTS when hardware
+// flow control is enabled (FPM_CONSOLE_RTSCTS). With FPM_CONSOLE_XONXOFF,
+// XOFF is sent to UART when the ring is nearly full, and XON when it
+// has been drained.
+//
+// The ring is filled in the interrupt handler, or on core 0 with
+// interrupts disabled, and drained by core 0.
+//
+#include <fpm/api.h>
+#include <fpm/internal.h>
+#include "pico/stdlib.h"
+#if LIB_PICO_STDIO_USB
+#include "tusb.h"
+#endif
+#if LIB_PICO_STDIO_UART
+#include "hardware/uart.h"
+#endif
+
+//
+// Size of receive ring, must be a power of two.
+// Can be redefined in CMakeLists.txt.
+//
+#ifndef FPM_CONSOLE_RX_SIZE
+#define FPM_CONSOLE_RX_SIZE 1024
+#endif
+
+//
+// Pins for UART hardware flow control: GP2 and GP3 for uart0.
+//
+#ifndef FPM_CONSOLE_CTS_PIN
+#define FPM_CONSOLE_CTS_PIN 2
+#endif
+#ifndef FPM_CONSOLE_RTS_PIN
+#define FPM_CONSOLE_RTS_PIN 3
+#endif
+
+static char rx_ring[FPM_CONSOLE_RX_SIZE];
+static unsigned rx_head;        // Next byte to fill, owned by interrupt handler
+static unsigned rx_tail;        // Next byte to read, owned by core 0
+static bool rx_started;         // Interrupt handler has been installed
+
+#if FPM_CONSOLE_XONXOFF && LIB_PICO_STDIO_UART
+//
+// Fill levels for XON/XOFF flow control.
+//
+#define RX_HIGH_WATER (FPM_CONSOLE_RX_SIZE * 3 / 4)
+#define RX_LOW_WATER  (FPM_CONSOLE_RX_SIZE / 4)
+
+#define XON  0x11
+#define XOFF 0x13
+
+static bool rx_stopped;         // XOFF has been sent
+#endif
+
+//
+// Read received data from the driver in interrupt context.
+// Pico stdio can't be used here, as it locks the driver.
+//
+static int read_driver(char *buf, int len)
+{
+#if LIB_PICO_STDIO_USB
+    // Reached through tud_cdc_rx_cb() while tud_task() runs in the
+    // low-priority USB worker interrupt. The worker runs tud_task() only
+    // after taking the stdio USB mutex, so TinyUSB is safe to call here.
+    if (tud_cdc_available()) {
+        return tud_cdc_read(buf, len);
+    }
+#endif
+#if LIB_PICO_STDIO_UART
+    int nbytes = 0;
+    while (nbytes < len && uart_is_readable(uart_default)) {
+        buf[nbytes++] = uart_getc(uart_default);
+    }
+    return nbytes;
+#else
+    return 0;
+#endif
+}
+
+//
+// Read received data from the driver on core 0.
+//
+static int read_stdio(char *buf, int len)
+{
+    int nbytes = stdio_get_until(buf, len, get_absolute_time());
+    return (nbytes < 0) ? 0 : nbytes;
+}
+
+//
+// Move received data from the driver to the ring, while space is available.
+// Send XON/XOFF according to the fill level.
+//
+static void rx_fill(int (*read)(char *, int))
+{
+    unsigned head = __atomic_load_n(&rx_head, __ATOMIC_RELAXED);
+    unsigned tail = __atomic_load_n(&rx_tail, __ATOMIC_ACQUIRE);
+    for (;;) {
+        // Fill contiguous part of the ring.
+        unsigned offset = head % FPM_CONSOLE_RX_SIZE;
+        unsigned space = FPM_CONSOLE_RX_SIZE - (head - tail);
+        if (space > FPM_CONSOLE_RX_SIZE - offset) {
+            space = FPM_CONSOLE_RX_SIZE - offset;
+        }
+        if (space == 0) {
+            // Ring is full: leave the rest in the driver.
+            break;
+        }
+        int nbytes = read(&rx_ring[offset], space);
+        if (nbytes <= 0) {
+            break;
+        }
+        head += nbytes;
+    }
+    __atomic_store_n(&rx_head, head, __ATOMIC_RELEASE);
+
+#if FPM_CONSOLE_XONXOFF && LIB_PICO_STDIO_UART
+    unsigned level = head - tail;
+    if (!rx_stopped && level >= RX_HIGH_WATER) {
+        uart_putc_raw(uart_default, XOFF);
+        rx_stopped = true;
+    } else if (rx_stopped && level <= RX_LOW_WATER) {
+        uart_putc_raw(uart_default, XON);
+        rx_stopped = false;
+    }
+#endif
+#if LIB_PICO_STDIO_UART
+    if (head - tail < FPM_CONSOLE_RX_SIZE) {
+        // Stdio disables UART interrupt before calling the handler.
+        uart_set_irq_enables(uart_default, true, false);
+    }
+#endif
+}
+
+//
+// Interrupt handler: new data received.
+//
+static void rx_callback(void *param)
+{
+    rx_fill(read_driver);
+}
+
+//
+// Fetch received data on core 0.
+// Interrupts are disabled, as the handler modifies the same state.
+//
+static void rx_poll()
+{
+    if (!rx_started) {
+        // Install handler on first use.
+        // Data received before are kept by the driver.
+        rx_started = true;
+#if FPM_CONSOLE_RTSCTS && LIB_PICO_STDIO_UART
+        gpio_set_function(FPM_CONSOLE_CTS_PIN, GPIO_FUNC_UART);
+        gpio_set_function(FPM_CONSOLE_RTS_PIN, GPIO_FUNC_UART);
+        uart_set_hw_flow(uart_default, true, true);
+#endif
+        stdio_set_chars_available_callback(rx_callback, NULL);
+    }
+
+    uint32_t saved = save_and_disable_interrupts();
+    rx_fill(read_stdio);
+    restore_interrupts(saved);
+}
+
+//
+// Read up to len bytes from the console.
+// Wait for the first byte up to timeout_msec, or forever when negative.
+// Return number of bytes received, 0 on timeout.
+//
+int fpm_read(char *buf, unsigned len, int timeout_msec)
+{
+    if (fpm_core_num() != 0) {
+        // Background program has no console input.
+        return 0;
+    }
+
+    // Input from file or pipe.
+    int count = fpm_redirect_read(buf, len);
+    if (count >= 0) {
+        return count;
+    }
+
+    // Show pending output before waiting.
+    fpm_flush();
+
+    absolute_time_t until = (timeout_msec < 0) ? at_the_end_of_time :
+                                                 make_timeout_time_ms(timeout_msec);
+    unsigned tail = __atomic_load_n(&rx_tail, __ATOMIC_RELAXED);
+    for (;;) {
+        rx_poll();
+        if (__atomic_load_n(&rx_head, __ATOMIC_ACQUIRE) != tail) {
+            break;
+        }
+        // Sleep until interrupt.
+        if (best_effort_wfe_or_timeout(until)) {
+            return 0;
+        }
+    }
+
+    // Copy data from the ring.
+    unsigned head = __atomic_load_n(&rx_head, __ATOMIC_ACQUIRE);
+    unsigned nbytes = 0;
+    while (nbytes < len && tail != head) {
+        buf[nbytes++] = rx_ring[tail++ % FPM_CONSOLE_RX_SIZE];
+    }
+    __atomic_store_n(&rx_tail, tail, __ATOMIC_RELEASE);
+
+    // Space is available: get data held by the driver, resume the sender.
+    rx_poll();
+    return nbytes;
+}
+
+//
+// Wait for console input, up to given number of milliseconds,
+// or forever when negative.
+// Return ASCII keycode, or -1 on timeout.
+//
+int fpm_getchar_timeout(int timeout_msec)
+{
+    if (fpm_core_num() != 0) {
+        // Background program has no console input: end of transmission.
+        return '\4';
+    }
+
+    // Input from file or pipe: end of transmission at end of file.
+    char data;
+    int count = fpm_redirect_read(&data, 1);
+    if (count >= 0) {
+        return (count > 0) ? (uint8_t) data : '\4';
+    }
+
+    absolute_time_t until = (timeout_msec < 0) ? at_the_end_of_time :
+                                                 make_timeout_time_ms(timeout_msec);
+    char ch;
+    for (;;) {
+#if LIB_PICO_STDIO_USB
+        // Make sure console is connected.
+        while (!stdio_usb_connected()) {
+            if (time_reached(until)) {
+                return -1;
+            }
+            sleep_ms(100);
+        }
+#endif
+        // Read one byte.
+        int64_t msec = absolute_time_diff_us(get_absolute_time(), until) / 1000;
+        if (msec < 0) {
+            msec = 0;
+        }
+        if (fpm_read(&ch, 1, (msec < 100) ? msec : 100) > 0) {
+            break;
+        }
+        if (time_reached(until)) {
+            return -1;
+        }
+    }
+#if 0
+    // ^C - kill the process.
+    if (ch == '\3') {
+        fpm_puts("^C\r\n");
+        longjmp(fpm_saved_point, 1);
+    }
+#endif
+    return (uint8_t) ch;
+}
+
+//
+// Wait for console input.
+// Return ASCII keycode.
+//
+char fpm_getchar()
+{
+    return fpm_getchar_timeout(-1);
+}
+
+//
+// Write byte to the console.
+//
+void fpm_putchar(char ch)
+{
+    fpm_write(&ch, 1);
+}
+
+//
+// Write a block of bytes to the console, bypassing the output buffer.
+// The whole block is passed to stdio drivers (USB CDC or UART) at once.
+//
+void fpm_write_arch(const char *buf, unsigned len)
+{
+    stdio_put_string(buf, len, false, true);
+}
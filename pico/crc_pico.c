@@ -0,0 +1,98 @@
+//
+// Checksums in hardware, with the DMA sniffer.
+//
+// The block is copied by DMA to a dummy location, and the sniffer
+// computes CRC of the data on the fly, at one byte per clock.
+// The sniffer is a single resource: when it's busy on the other core,
+// or no DMA channel is free, checksum is computed in software.
+//
+#include <fpm/api.h>
+#include <fpm/internal.h>
+#include "hardware/dma.h"
+#include "pico/mutex.h"
+
+//
+// Blocks shorter than this are faster in software.
+//
+#define DMA_MIN_LEN 64
+
+auto_init_mutex(sniffer_mutex);
+
+//
+// Reverse order of bits in a word.
+//
+static uint32_t bit_reverse(uint32_t x)
+{
+    x = ((x >> 1) & 0x55555555) | ((x & 0x55555555) << 1);
+    x = ((x >> 2) & 0x33333333) | ((x & 0x33333333) << 2);
+    x = ((x >> 4) & 0x0f0f0f0f) | ((x & 0x0f0f0f0f) << 4);
+    x = ((x >> 8) & 0x00ff00ff) | ((x & 0x00ff00ff) << 8);
+    return (x >> 16) | (x << 16);
+}
+
+//
+// Pass data through the sniffer in given mode.
+// Return false when hardware is not available.
+//
+static bool sniff(unsigned mode, bool reverse, uint32_t *crc, const void *buf, unsigned len)
+{
+    if (len < DMA_MIN_LEN) {
+        return false;
+    }
+    if (!mutex_try_enter(&sniffer_mutex, NULL)) {
+        return false;
+    }
+    int chan = dma_claim_unused_channel(false);
+    if (chan < 0) {
+        mutex_exit(&sniffer_mutex);
+        return false;
+    }
+
+    dma_channel_config cfg = dma_channel_get_default_config(chan);
+    channel_config_set_transfer_data_size(&cfg, DMA_SIZE_8);
+    channel_config_set_read_increment(&cfg, true);
+    channel_config_set_write_increment(&cfg, false);
+    channel_config_set_sniff_enable(&cfg, true);
+
+    dma_sniffer_enable(chan, mode, true);
+    dma_sniffer_set_output_reverse_enabled(reverse);
+    dma_hw->sniff_data = *crc;
+
+    static uint8_t dummy;
+    dma_channel_configure(chan, &cfg, &dummy, buf, len, true);
+    dma_channel_wait_for_finish_blocking(chan);
+    *crc = dma_hw->sniff_data;
+
+    dma_sniffer_disable();
+    dma_channel_unclaim(chan);
+    mutex_exit(&sniffer_mutex);
+    return true;
+}
+
+//
+// CRC-32 with reflected polynomial.
+// The sniffer computes non-reflected CRC of bit-reversed data,
+// so the register is reversed on input, and output is reversed by hardware.
+//
+bool fpm_crc32_arch(uint32_t *crc, const void *buf, unsigned len)
+{
+    uint32_t reg = bit_reverse(*crc);
+    if (!sniff(DMA_SNIFF_CTRL_CALC_VALUE_CRC32R, true, &reg, buf, len)) {
+        return false;
+    }
+    *crc = reg;
+    return true;
+}
+
+//
+// CRC-16-CCITT, computed in low half of the sniffer register.
+//
+bool fpm_crc16_arch(uint16_t *crc, const void *buf, unsigned len)
+{
+    uint32_t reg = *crc;
+    if (!sniff(DMA_SNIFF_CTRL_CALC_VALUE_CRC16, false, &reg, buf, len)) {
+        return false;
+    }
+    *crc = reg;
+    return true;
+}
@@ -24,11 +24,13 @@
 #include <fpm/context.h>
 #include <fpm/internal.h>
 #include <fpm/fs.h>
+#include <alloca.h>
 #include <stdio.h>      // For debug printfs
 #include "pico/stdlib.h"
 #include "flash.h"
 #include "hardware/sync.h"
 #include "hardware/flash.h"
+#include "pico/flash.h"
 
 static char *flash_disk_image = 0;
 static unsigned flash_base_offset;
@@ -40,6 +42,47 @@ static unsigned flash_bytes_per_block = 4096;
 extern char __flash_binary_start[];
 extern char __flash_binary_end[];
 
+//
+// Parameters of Flash erase or program operation.
+//
+typedef struct {
+    unsigned offset;      // Offset from start of Flash memory
+    const uint8_t *buf;   // Data to program, or NULL to erase
+    unsigned nbytes;      // Size in bytes
+    const uint8_t *txbuf; // Command to send, for flash_do_cmd()
+    uint8_t *rxbuf;       // Reply from Flash chip
+} flash_op_t;
+
+static void flash_op_erase(void *arg)
+{
+    const flash_op_t *op = arg;
+    flash_range_erase(op->offset, op->nbytes);
+}
+
+static void flash_op_program(void *arg)
+{
+    const flash_op_t *op = arg;
+    flash_range_program(op->offset, op->buf, op->nbytes);
+}
+
+static void flash_op_cmd(void *arg)
+{
+    const flash_op_t *op = arg;
+    flash_do_cmd(op->txbuf, op->rxbuf, op->nbytes);
+}
+
+//
+// Run Flash operation with interrupts disabled.
+// When core 1 is running, it is paused for the duration,
+// as code cannot be executed from Flash while it is being erased or programmed.
+//
+static void flash_execute(void (*func)(void *), flash_op_t *op)
+{
+    if (flash_safe_execute(func, op, UINT32_MAX) != PICO_OK) {
+        panic("Flash operation failed");
+    }
+}
+
 //
 // Read Flash unique ID as 64-bit integer value.
 //
@@ -48,9 +91,8 @@ static uint64_t flash_read_unique_id()
     // Read Unique ID instruction: 4Bh command prefix, 32 dummy bits, 64 data bits.
     uint8_t txbuf[1 + 4 + 8] = { 0x4b };
     uint8_t rxbuf[1 + 4 + 8] = {};
-    uint32_t irqsave = save_and_disable_interrupts();
-    flash_do_cmd(txbuf, rxbuf, sizeof(txbuf));
-    restore_interrupts(irqsave);
+    flash_op_t op = { .txbuf = txbuf, .rxbuf = rxbuf, .nbytes = sizeof(txbuf) };
+    flash_execute(flash_op_cmd, &op);
 
     return (uint64_t)rxbuf[5] << 56 | (uint64_t)rxbuf[6] << 48 |
            (uint64_t)rxbuf[7] << 40 | (uint64_t)rxbuf[8] << 32 |
@@ -66,9 +108,8 @@ static void flash_read_mf_dev_id(uint8_t *mf_id, uint16_t *dev_id)
     // JEDEC ID instruction: 9Fh command prefix, 24 data bits.
     uint8_t txbuf[1 + 3] = { 0x9f };
     uint8_t rxbuf[1 + 3] = {};
-    uint32_t irqsave = save_and_disable_interrupts();
-    flash_do_cmd(txbuf, rxbuf, sizeof(txbuf));
-    restore_interrupts(irqsave);
+    flash_op_t op = { .txbuf = txbuf, .rxbuf = rxbuf, .nbytes = sizeof(txbuf) };
+    flash_execute(flash_op_cmd, &op);
 
     *mf_id = rxbuf[1];
     *dev_id = rxbuf[2] << 8 | rxbuf[3];
@@ -179,14 +220,11 @@ disk_result_t flash_write(const uint8_t *buf, unsigned block, unsigned count)
         return DISK_PARERR;
 
     // Erase flash.
-    uint32_t irqsave = save_and_disable_interrupts();
-    flash_range_erase(flash_base_offset + offset, nbytes);
-    restore_interrupts(irqsave);
+    flash_op_t op = { .offset = flash_base_offset + offset, .buf = buf, .nbytes = nbytes };
+    flash_execute(flash_op_erase, &op);
 
     // Write to flash.
-    irqsave = save_and_disable_interrupts();
-    flash_range_program(flash_base_offset + offset, buf, nbytes);
-    restore_interrupts(irqsave);
+    flash_execute(flash_op_program, &op);
     return DISK_OK;
 }
 
@@ -222,13 +260,40 @@ bool fpm_load_arch(fpm_context_t *ctx, const char *filename)
         return false;
     }
 
-    if (file_info.fstartblk == 0) {
-        fpm_printf("%s: File is fragmented\r\n", filename);
+    // Contents are mapped directly from flash: clusters must be contiguous.
+    file_t *fp = alloca(f_sizeof_file_t());
+    int contiguous = 0;
+    result = f_open(fp, filename, FA_READ);
+    if (result == FR_OK) {
+        result = f_contiguous(fp, &contiguous);
+        f_close(fp);
+    }
+    if (file_info.fstartblk == 0 || result != FR_OK || !contiguous) {
+        fpm_printf("%s: File is fragmented, run defrag\r\n", filename);
         return false;
     }
 
     // Compute address of file contents.
     ctx->base = &flash_disk_image[file_info.fstartblk * fs_info.f_bsize];
+    ctx->file_size = file_info.fsize;
+    ctx->file_start = file_info.fstartblk;
+    ctx->file_time = (file_info.fdate << 16) | file_info.ftime;
+    return true;
+}
+
+//
+// Get identity of the file, without mapping it.
+// Return false when the file does not exist.
+//
+bool fpm_stat_arch(fpm_context_t *ctx, const char *filename)
+{
+    file_info_t file_info;
+    if (f_stat(filename, &file_info) != FR_OK) {
+        return false;
+    }
+    ctx->file_size = file_info.fsize;
+    ctx->file_start = file_info.fstartblk;
+    ctx->file_time = (file_info.fdate << 16) | file_info.ftime;
     return true;
 }
 
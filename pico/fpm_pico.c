@@ -7,70 +7,6 @@
 #include "pico/stdlib.h"
 #include "hardware/watchdog.h"
 
-//
-// Wait for console input.
-// Return ASCII keycode.
-//
-char fpm_getchar()
-{
-    int ch;
-
-    for (;;) {
-#if LIB_PICO_STDIO_USB
-        // Make sure console is connected.
-        while (!stdio_usb_connected()) {
-            sleep_ms(100);
-        }
-#endif
-        // Read one byte.
-        ch = getchar();
-        if (ch >= 0) {
-            break;
-        }
-    }
-#if 0
-    // ^C - kill the process.
-    if (ch == '\3') {
-        fpm_puts("^C\r\n");
-        longjmp(fpm_saved_point, 1);
-    }
-#endif
-    return ch;
-}
-
-//
-// Write Unicode character to the console.
-//
-// Convert to UTF-8 encoding:
-// 00000000.0xxxxxxx -> 0xxxxxxx
-// 00000xxx.xxyyyyyy -> 110xxxxx, 10yyyyyy
-// xxxxyyyy.yyzzzzzz -> 1110xxxx, 10yyyyyy, 10zzzzzz
-//
-void fpm_putchar(char ch)
-{
-    putchar(ch);
-}
-
-//
-// Posix-compatible formatted output to console.
-//
-int fpm_printf(const char *format, ...)
-{
-    va_list args;
-    va_start(args, format);
-    int retval = vprintf(format, args);
-    va_end(args);
-    fflush(stdout);
-    return retval;
-}
-
-int fpm_vprintf(const char *format, va_list args)
-{
-    int retval = vprintf(format, args);
-    fflush(stdout);
-    return retval;
-}
-
 //
 // Posix-compatible formatted output to string.
 //
@@ -135,6 +71,7 @@ uint64_t fpm_time_usec()
 //
 void fpm_delay_usec(uint64_t microseconds)
 {
+     fpm_flush();
      busy_wait_us(microseconds);
 }
 
@@ -143,6 +80,7 @@ void fpm_delay_usec(uint64_t microseconds)
 //
 void fpm_delay_msec(unsigned milliseconds)
 {
+     fpm_flush();
      busy_wait_ms(milliseconds);
 }
 
@@ -152,7 +90,11 @@ void fpm_delay_msec(unsigned milliseconds)
 size_t fpm_stack_available()
 {
     extern char __StackBottom[];
+    extern uint32_t fpm_core1_stack[];
     char *sp = NULL;
     asm volatile("mov %0, sp" : "=r"(sp));
+    if (get_core_num() != 0) {
+        return sp - (char *)fpm_core1_stack;
+    }
     return sp - __StackBottom;
 }
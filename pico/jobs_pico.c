@@ -0,0 +1,86 @@
+//
+// Background jobs on RP2040: executed by core 1.
+//
+#include <fpm/api.h>
+#include <fpm/internal.h>
+#include "pico/stdlib.h"
+#include "pico/multicore.h"
+#include "pico/flash.h"
+
+//
+// Stack for core 1: enough for FatFs calls with long file names,
+// and for external programs running in background.
+//
+uint32_t fpm_core1_stack[16 * 1024 / sizeof(uint32_t)];
+
+static volatile bool core1_started;
+
+//
+// Main loop of core 1.
+//
+static void core1_main()
+{
+    // Allow core 0 to pause this core while Flash memory is being written.
+    flash_safe_execute_core_init();
+    core1_started = true;
+
+    for (;;) {
+        if (fpm_jobs_process()) {
+            // Wake up core 0, in case it waits for completion.
+            __sev();
+        } else {
+            // Sleep until new job is submitted.
+            __wfe();
+        }
+    }
+}
+
+//
+// Start core 1.
+//
+void fpm_jobs_start()
+{
+    if (core1_started) {
+        return;
+    }
+
+    // Allow core 1 to pause this core while Flash memory is being written.
+    flash_safe_execute_core_init();
+
+    multicore_launch_core1_with_stack(core1_main, fpm_core1_stack, sizeof(fpm_core1_stack));
+    while (!core1_started) {
+        tight_loop_contents();
+    }
+}
+
+//
+// Get number of the current core.
+//
+unsigned fpm_core_num()
+{
+    return get_core_num();
+}
+
+//
+// Is core 1 running?
+//
+bool fpm_jobs_active_arch()
+{
+    return core1_started;
+}
+
+//
+// Notify core 1 about new job in the queue.
+//
+void fpm_jobs_wakeup_arch()
+{
+    __sev();
+}
+
+//
+// Sleep until core 1 completes a job.
+//
+void fpm_jobs_idle_arch()
+{
+    __wfe();
+}
@@ -30,22 +30,42 @@ void setup_date_time()
 #endif
 }
 
+//
+// Periodic timer on core 0: show output of a busy program.
+//
+static bool flush_timer_callback(repeating_timer_t *timer)
+{
+    fpm_flush_idle();
+    return true;
+}
+
+void setup_flush_timer()
+{
+    static repeating_timer_t flush_timer;
+    add_repeating_timer_ms(10, flush_timer_callback, NULL, &flush_timer);
+}
+
 int main()
 {
     // Initialize chosen serial port.
     stdio_init_all();
 
     // Setup heap area.
-    fpm_context_t context_base;
+    fpm_context_t context_base = {};
     extern char end[], __HeapLimit[];
     fpm_heap_init(&context_base, (size_t)&end[0], __HeapLimit - end);
 
     setup_date_time();
+    setup_flush_timer();
     disk_setup();
 
     // Try to mount flash at startup.
     // It may fail, which is OK.
     f_mount("flash:");
+    fpm_path_index();
+
+    // Start core 1 for background jobs.
+    fpm_jobs_start();
 
     // Start interactive dialog.
     for (;;) {
@@ -0,0 +1,277 @@
+//
+// Test background program: start, jobs and wait commands, trailing '&'.
+//
+#include <gtest/gtest.h>
+#include <fpm/api.h>
+#include <fpm/diskio.h>
+#include <fpm/internal.h>
+#include <fpm/loader.h>
+#include <fpm/context.h>
+#include <regex>
+#include <thread>
+#include "util.h"
+
+static std::string console;     // Output of the shell, on core 0
+static const char *keys = "";   // Console input for fpm_getchar_timeout()
+static bool release;            // Lets blocked program finish
+
+//
+// Console output, like in fpm_write.c.
+//
+void fpm_write(const char *buf, unsigned len)
+{
+    if (fpm_core_num() != 0 && fpm_background_write(buf, len)) {
+        return;
+    }
+    console.append(buf, len);
+}
+
+void fpm_flush()
+{
+}
+
+void fpm_putchar(char ch)
+{
+    fpm_write(&ch, 1);
+}
+
+int fpm_snprintf(char *str, size_t size, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int retval = vsnprintf(str, size, format, args);
+    va_end(args);
+    return retval;
+}
+
+int fpm_printf(const char *format, ...)
+{
+    char buf[200];
+    va_list args;
+    va_start(args, format);
+    int retval = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    fpm_write(buf, strlen(buf));
+    return retval;
+}
+
+//
+// Console input: given keys, then timeout.
+//
+int fpm_getchar_timeout(int timeout_msec)
+{
+    if (*keys == 0) {
+        return -1;
+    }
+    return *keys++;
+}
+
+char fpm_getchar()
+{
+    return fpm_getchar_timeout(-1);
+}
+
+void fpm_delay_msec(unsigned msec)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(msec));
+}
+
+size_t fpm_stack_available()
+{
+    return 64 * 1024;
+}
+
+//
+// Needed by other built-in commands, not used here.
+//
+int fpm_sscanf(const char *str, const char *format, ...)
+{
+    return 0;
+}
+
+void fpm_set_datetime(int year, int month, int day, int hour, int min, int sec)
+{
+}
+
+disk_result_t disk_identify(uint8_t pdrv, disk_info_t *output)
+{
+    return DISK_ERROR;
+}
+
+void fpm_reboot()
+{
+}
+
+void fpm_print_version()
+{
+}
+
+bool fpm_crc32_arch(uint32_t *crc, const void *buf, unsigned len)
+{
+    return false;
+}
+
+bool fpm_crc16_arch(uint16_t *crc, const void *buf, unsigned len)
+{
+    return false;
+}
+
+//
+// Instead of real programs:
+//  - hello.exe prints greeting, exits with code given as argument;
+//  - flood.exe prints more than fits into the output buffer;
+//  - block.exe waits until released;
+//  - crash.exe fails.
+//
+fpm_binding_t fpm_bindings[] = { {} };
+
+bool fpm_load(fpm_context_t *ctx, const char *filename)
+{
+    if (strcmp(filename, "missing.exe") == 0) {
+        fpm_printf("%s: File not found\r\n", filename);
+        return false;
+    }
+    return true;
+}
+
+void fpm_unload(fpm_context_t *ctx)
+{
+}
+
+bool fpm_invoke(fpm_context_t *ctx, fpm_binding_t linkmap[], int argc, char *argv[])
+{
+    EXPECT_EQ(argv[argc], nullptr);
+    ctx->exit_code = 0;
+    if (strcmp(argv[0], "hello.exe") == 0) {
+        fpm_puts("hello\r\n");
+        if (argc > 1) {
+            ctx->exit_code = atoi(argv[1]);
+        }
+    } else if (strcmp(argv[0], "flood.exe") == 0) {
+        char piece[100];
+        memset(piece, 'x', sizeof(piece));
+        for (unsigned i = 0; i < 30; i++) {
+            fpm_write(piece, sizeof(piece));
+        }
+    } else if (strcmp(argv[0], "block.exe") == 0) {
+        while (!__atomic_load_n(&release, __ATOMIC_ACQUIRE)) {
+            std::this_thread::yield();
+        }
+    } else {
+        return false;
+    }
+    return true;
+}
+
+//
+// Execute command, return the output with job number replaced by '#'.
+//
+static std::string run(std::vector<const char *> args)
+{
+    int argc = args.size();
+    args.push_back(nullptr);
+    console.clear();
+    fpm_exec(argc, (char **)args.data());
+    return std::regex_replace(console, std::regex("\\[[0-9]+\\]"), "[#]");
+}
+
+//
+// Heap for the programs, worker on core 1.
+//
+static void background_setup()
+{
+    heap_setup();
+    fpm_jobs_start();
+    keys = "";
+    __atomic_store_n(&release, false, __ATOMIC_RELEASE);
+}
+
+//
+// Wait until background program finishes, without displaying its output.
+//
+static void wait_finished()
+{
+    while (fpm_background_running()) {
+        std::this_thread::yield();
+    }
+}
+
+TEST(background, start_and_wait)
+{
+    background_setup();
+    size_t heap_free = fpm_heap_available();
+
+    EXPECT_EQ(run({ "start", "hello.exe", "5" }), "[#] hello.exe\r\n\r\n");
+    EXPECT_EQ(run({ "wait" }), "hello\r\n[#] Done, exit code 5 hello.exe 5\r\n\r\n");
+    EXPECT_EQ(fpm_exit_code, 5);
+
+    // Memory of the program is released.
+    EXPECT_EQ(fpm_heap_available(), heap_free);
+    EXPECT_EQ(run({ "wait" }), "No background jobs\r\n\r\n");
+    EXPECT_EQ(fpm_exit_code, -1);
+}
+
+TEST(background, trailing_ampersand)
+{
+    background_setup();
+
+    EXPECT_EQ(run({ "hello.exe", "7", "&" }), "[#] hello.exe\r\n\r\n");
+    wait_finished();
+    EXPECT_EQ(run({ "jobs" }), "hello\r\n[#] Done, exit code 7 hello.exe 7\r\n\r\n");
+    EXPECT_EQ(run({ "jobs" }), "No background jobs\r\n\r\n");
+
+    // Built-in commands and missing programs.
+    EXPECT_EQ(run({ "ls", "&" }), "ls: Cannot run built-in command in background\r\n\n");
+    EXPECT_EQ(run({ "start", "missing.exe" }), "missing.exe: File not found\r\n\r\n");
+}
+
+TEST(background, jobs_while_running)
+{
+    background_setup();
+
+    EXPECT_EQ(run({ "start", "block.exe", "a", "b" }), "[#] block.exe\r\n\r\n");
+    EXPECT_EQ(run({ "jobs" }), "[#] Running block.exe a b\r\n\r\n");
+
+    // Only one program at a time.
+    EXPECT_EQ(run({ "hello.exe", "&" }),
+              "hello.exe: Background program is already running, use 'wait'\r\n\r\n");
+
+    __atomic_store_n(&release, true, __ATOMIC_RELEASE);
+    EXPECT_EQ(run({ "wait" }), "[#] Done, exit code 0 block.exe a b\r\n\r\n");
+    EXPECT_EQ(fpm_exit_code, 0);
+}
+
+TEST(background, wait_interrupted)
+{
+    background_setup();
+    run({ "start", "block.exe" });
+
+    // ESC stops waiting, and the program keeps running.
+    keys = "x\33";
+    EXPECT_EQ(run({ "wait" }), "[#] Running block.exe\r\n\r\n");
+    EXPECT_EQ(fpm_exit_code, -1);
+    EXPECT_TRUE(fpm_background_running());
+
+    __atomic_store_n(&release, true, __ATOMIC_RELEASE);
+    EXPECT_EQ(run({ "wait" }), "[#] Done, exit code 0 block.exe\r\n\r\n");
+}
+
+TEST(background, output_lost)
+{
+    background_setup();
+    run({ "start", "flood.exe" });
+    wait_finished();
+
+    // Output buffer keeps first 1024 bytes.
+    std::string expect = std::string(1024, 'x') +
+                         "[#] Done, exit code 0 flood.exe (1976 bytes of output lost)\r\n\r\n";
+    EXPECT_EQ(run({ "wait" }), expect);
+}
+
+TEST(background, failed)
+{
+    background_setup();
+    run({ "start", "crash.exe" });
+    EXPECT_EQ(run({ "wait" }), "[#] Failed crash.exe\r\n\r\n");
+    EXPECT_EQ(fpm_exit_code, -1);
+}
@@ -3,6 +3,7 @@
 //
 #include <gtest/gtest.h>
 #include <fpm/api.h>
+#include <fpm/internal.h>
 #include "util.h"
 
 const char *input;       // Input stream for the current test, utf-8 encoded
@@ -28,6 +29,22 @@ void fpm_putchar(char ch)
     fflush(stdout);
 }
 
+//
+// Write bytes to stdout.
+//
+void fpm_write(const char *buf, unsigned len)
+{
+    fwrite(buf, 1, len, stdout);
+    fflush(stdout);
+}
+
+//
+// Output is not buffered.
+//
+void fpm_flush()
+{
+}
+
 //
 // Posix-compatible formatted output to string.
 //
@@ -52,3 +69,11 @@ int fpm_printf(const char *format, ...)
     fflush(stdout);
     return retval;
 }
+
+//
+// Tests run on core 0.
+//
+unsigned fpm_core_num()
+{
+    return 0;
+}
@@ -10,6 +10,7 @@
 TEST(cmd, copy_file)
 {
     disk_setup();
+    heap_setup();
     write_file("foo.txt", "'Twas brillig, and the slithy toves");
 
     // Copy foo to bar.
@@ -20,9 +21,32 @@ TEST(cmd, copy_file)
     read_file("bar.txt", "'Twas brillig, and the slithy toves");
 }
 
+TEST(cmd, copy_file_no_space)
+{
+    disk_setup();
+    heap_setup();
+    std::string big(1200 * 1024, 'x');
+    write_file("sd:/big", big.c_str());
+
+    const char *argv1[] = { "cp", "sd:/big", "flash:/one", nullptr };
+    fpm_cmd_copy(3, (char**) argv1);
+    file_info_t info;
+    ASSERT_EQ(f_stat("flash:/one", &info), FR_OK);
+    EXPECT_EQ(info.fsize, big.size());
+
+    // Second copy does not fit: incomplete file is removed.
+    testing::internal::CaptureStdout();
+    const char *argv2[] = { "cp", "sd:/big", "flash:/two", nullptr };
+    fpm_cmd_copy(3, (char**) argv2);
+    EXPECT_EQ(testing::internal::GetCapturedStdout(),
+              "flash:/two: Not enough space on device\r\n\r\n");
+    EXPECT_EQ(f_stat("flash:/two", &info), FR_NO_FILE);
+}
+
 TEST(cmd, copy_recursive_existing_target)
 {
     disk_setup();
+    heap_setup();
     create_directory("a");
     create_directory("a/b");
     create_directory("x");
@@ -39,6 +63,7 @@ TEST(cmd, copy_recursive_existing_target)
 TEST(cmd, copy_recursive_nonexisting_target)
 {
     disk_setup();
+    heap_setup();
     create_directory("a");
     create_directory("a/b");
     create_directory("x");
@@ -55,6 +80,7 @@ TEST(cmd, copy_recursive_nonexisting_target)
 TEST(cmd, copy_recursive_trailing_slash_existing_target)
 {
     disk_setup();
+    heap_setup();
     create_directory("a");
     create_directory("a/b");
     create_directory("x");
@@ -71,6 +97,7 @@ TEST(cmd, copy_recursive_trailing_slash_existing_target)
 TEST(cmd, copy_recursive_trailing_slash_nonexisting_target)
 {
     disk_setup();
+    heap_setup();
     create_directory("a");
     create_directory("a/b");
     create_directory("x");
@@ -84,3 +111,79 @@ TEST(cmd, copy_recursive_trailing_slash_nonexisting_target)
     check_directory("y");
     read_file("y/c", "foobar");
 }
+
+TEST(cmd, copy_recursive_tree)
+{
+    disk_setup();
+    heap_setup();
+    create_directory("src");
+    create_directory("src/a");
+    create_directory("src/a/b");
+    create_directory("src/a/b/c");
+    write_file("src/top", "top");
+    write_file("src/a/b/c/deep", "deep");
+    std::string big(10000, 'x');
+    write_file("src/big", big.c_str());
+
+    // Many files: the work list is processed in several batches.
+    for (unsigned i = 0; i < 200; i++) {
+        auto name = "src/a/long-file-name-" + std::to_string(i);
+        write_file(name.c_str(), name.c_str());
+    }
+
+    // Old timestamp on the source.
+    file_info_t info{};
+    info.fdate = (10 << 9) | (5 << 5) | 17; // 1990/05/17
+    info.ftime = (12 << 11) | (34 << 5);    // 12:34
+    ASSERT_EQ(f_utime("src/a/b/c/deep", &info), FR_OK);
+    ASSERT_EQ(f_utime("src/a/b", &info), FR_OK);
+
+    const char *argv[] = { "cp", "-r", "src", "dst", nullptr };
+    fpm_cmd_copy(4, (char**) argv);
+
+    read_file("dst/top", "top");
+    read_file("dst/a/b/c/deep", "deep");
+
+    // Large file is written to preallocated space.
+    auto fp = (file_t*) alloca(f_sizeof_file_t());
+    ASSERT_EQ(f_open(fp, "dst/big", FA_READ), FR_OK);
+    std::string data(20000, 0);
+    unsigned nbytes_read = 0;
+    ASSERT_EQ(f_read(fp, &data[0], data.size(), &nbytes_read), FR_OK);
+    data.resize(nbytes_read);
+    EXPECT_EQ(data, big);
+    f_close(fp);
+    for (unsigned i = 0; i < 200; i++) {
+        auto name = "src/a/long-file-name-" + std::to_string(i);
+        read_file(("dst/a/long-file-name-" + std::to_string(i)).c_str(), name.c_str());
+    }
+
+    // Timestamps are preserved.
+    file_info_t copy{};
+    ASSERT_EQ(f_stat("dst/a/b/c/deep", &copy), FR_OK);
+    EXPECT_EQ(copy.fdate, info.fdate);
+    EXPECT_EQ(copy.ftime, info.ftime);
+    ASSERT_EQ(f_stat("dst/a/b", &copy), FR_OK);
+    EXPECT_EQ(copy.fdate, info.fdate);
+    EXPECT_EQ(copy.ftime, info.ftime);
+}
+
+TEST(cmd, copy_recursive_deep)
+{
+    disk_setup();
+    heap_setup();
+
+    // Deeper than initial size of the directory stack.
+    std::string path = "src";
+    create_directory(path.c_str());
+    for (unsigned i = 0; i < 10; i++) {
+        path += "/d" + std::to_string(i);
+        create_directory(path.c_str());
+    }
+    write_file((path + "/file").c_str(), "bottom");
+
+    const char *argv[] = { "cp", "-r", "src", "dst", nullptr };
+    fpm_cmd_copy(4, (char**) argv);
+
+    read_file(("dst" + path.substr(3) + "/file").c_str(), "bottom");
+}
@@ -0,0 +1,152 @@
+//
+// Test checksums: fpm_crc32(), fpm_crc16() and SHA-256.
+//
+#include <gtest/gtest.h>
+#include <fpm/api.h>
+#include <fpm/internal.h>
+
+//
+// No hardware: compute in software.
+//
+bool fpm_crc32_arch(uint32_t *crc, const void *buf, unsigned len)
+{
+    return false;
+}
+
+bool fpm_crc16_arch(uint16_t *crc, const void *buf, unsigned len)
+{
+    return false;
+}
+
+//
+// Reference implementations, one bit at a time.
+//
+static uint32_t ref_crc32(const uint8_t *buf, unsigned len)
+{
+    uint32_t crc = ~0u;
+    while (len-- > 0) {
+        crc ^= *buf++;
+        for (int i = 0; i < 8; i++) {
+            crc = (crc >> 1) ^ ((crc & 1) ? 0xedb88320 : 0);
+        }
+    }
+    return ~crc;
+}
+
+static uint16_t ref_crc16(const uint8_t *buf, unsigned len)
+{
+    uint16_t crc = 0;
+    while (len-- > 0) {
+        crc ^= *buf++ << 8;
+        for (int i = 0; i < 8; i++) {
+            crc = (crc << 1) ^ ((crc & 0x8000) ? 0x1021 : 0);
+        }
+    }
+    return crc;
+}
+
+//
+// Pseudo-random test data.
+//
+static std::vector<uint8_t> make_data(unsigned len)
+{
+    std::vector<uint8_t> data(len);
+    uint32_t x = 12345;
+    for (auto &byte : data) {
+        x = x * 1103515245 + 12345;
+        byte = x >> 16;
+    }
+    return data;
+}
+
+TEST(crc, check_values)
+{
+    // Standard check values for "123456789".
+    EXPECT_EQ(fpm_crc32(0, "123456789", 9), 0xcbf43926u);
+    EXPECT_EQ(fpm_crc16(0, "123456789", 9), 0x31c3u);
+
+    // Empty block leaves CRC unchanged.
+    EXPECT_EQ(fpm_crc32(0, "", 0), 0u);
+    EXPECT_EQ(fpm_crc32(0x12345678, "", 0), 0x12345678u);
+    EXPECT_EQ(fpm_crc16(0x1234, "", 0), 0x1234u);
+}
+
+TEST(crc, all_lengths)
+{
+    // Every length and alignment, to cover sliced and byte loops.
+    auto data = make_data(300);
+    for (unsigned offset = 0; offset < 4; offset++) {
+        for (unsigned len = 0; len + offset <= data.size(); len += 7) {
+            EXPECT_EQ(fpm_crc32(0, &data[offset], len), ref_crc32(&data[offset], len))
+                << "offset " << offset << ", length " << len;
+            EXPECT_EQ(fpm_crc16(0, &data[offset], len), ref_crc16(&data[offset], len))
+                << "offset " << offset << ", length " << len;
+        }
+    }
+}
+
+TEST(crc, pieces)
+{
+    // Checksum of a block computed in pieces.
+    auto data = make_data(4096);
+    uint32_t crc32 = 0;
+    uint16_t crc16 = 0;
+    unsigned pos = 0;
+    for (unsigned len = 1; pos < data.size(); len = len * 3 + 1) {
+        if (len > data.size() - pos) {
+            len = data.size() - pos;
+        }
+        crc32 = fpm_crc32(crc32, &data[pos], len);
+        crc16 = fpm_crc16(crc16, &data[pos], len);
+        pos += len;
+    }
+    EXPECT_EQ(crc32, ref_crc32(data.data(), data.size()));
+    EXPECT_EQ(crc16, ref_crc16(data.data(), data.size()));
+}
+
+//
+// Compute SHA-256 of data in pieces of given size, return hex string.
+//
+static std::string sha256(const void *data, unsigned len, unsigned piece)
+{
+    fpm_sha256_t ctx;
+    fpm_sha256_init(&ctx);
+    for (unsigned pos = 0; pos < len; pos += piece) {
+        fpm_sha256_update(&ctx, (const char *)data + pos, std::min(piece, len - pos));
+    }
+    uint8_t digest[32];
+    fpm_sha256_final(&ctx, digest);
+
+    std::string hex;
+    char buf[3];
+    for (auto byte : digest) {
+        snprintf(buf, sizeof(buf), "%02x", byte);
+        hex += buf;
+    }
+    return hex;
+}
+
+TEST(sha256, check_values)
+{
+    // Test vectors from FIPS 180-4 examples.
+    EXPECT_EQ(sha256("", 0, 1), "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    EXPECT_EQ(sha256("abc", 3, 3), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+
+    const char *two_blocks = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    EXPECT_EQ(sha256(two_blocks, 56, 56), "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+}
+
+TEST(sha256, pieces)
+{
+    std::vector<uint8_t> data(1000);
+    for (unsigned i = 0; i < data.size(); i++) {
+        data[i] = i * 7 + 3;
+    }
+
+    // Result doesn't depend on how data are split.
+    for (unsigned piece : { 1u, 13u, 63u, 64u, 65u, 1000u }) {
+        EXPECT_EQ(sha256(data.data(), data.size(), piece),
+                  "1e9bc38cbf860b9ec31918b065f9b52476c549a782e0e7990bed8ce3868d2371")
+            << "piece " << piece;
+    }
+}
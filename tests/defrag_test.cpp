@@ -0,0 +1,216 @@
+//
+// Test defrag command.
+//
+#include <gtest/gtest.h>
+#include <fpm/fs.h>
+#include <fpm/diskio.h>
+#include <fpm/internal.h>
+#include "util.h"
+
+//
+// Background program, as seen by defrag.
+//
+static bool background_running;
+
+bool fpm_background_running()
+{
+    return background_running;
+}
+
+//
+// Fill buffer with pattern, specific to the file and the offset.
+//
+static void fill_pattern(char *buf, unsigned nbytes, unsigned seed, unsigned offset)
+{
+    for (unsigned i = 0; i < nbytes; i++) {
+        buf[i] = (char)((offset + i) * 7 + seed);
+    }
+}
+
+//
+// Create two files, with clusters interleaved on disk.
+//
+static void write_interleaved(const char *name1, const char *name2, unsigned nchunks)
+{
+    auto f1 = (file_t*) alloca(f_sizeof_file_t());
+    auto f2 = (file_t*) alloca(f_sizeof_file_t());
+    ASSERT_EQ(f_open(f1, name1, FA_WRITE | FA_CREATE_ALWAYS), FR_OK);
+    ASSERT_EQ(f_open(f2, name2, FA_WRITE | FA_CREATE_ALWAYS), FR_OK);
+
+    char buf[4096];
+    for (unsigned i = 0; i < nchunks; i++) {
+        unsigned nbytes_written = 0;
+        fill_pattern(buf, sizeof(buf), 1, i * sizeof(buf));
+        ASSERT_EQ(f_write(f1, buf, sizeof(buf), &nbytes_written), FR_OK);
+        ASSERT_EQ(nbytes_written, sizeof(buf));
+        ASSERT_EQ(f_sync(f1), FR_OK);
+
+        fill_pattern(buf, sizeof(buf), 2, i * sizeof(buf));
+        ASSERT_EQ(f_write(f2, buf, sizeof(buf), &nbytes_written), FR_OK);
+        ASSERT_EQ(nbytes_written, sizeof(buf));
+        ASSERT_EQ(f_sync(f2), FR_OK);
+    }
+    ASSERT_EQ(f_close(f1), FR_OK);
+    ASSERT_EQ(f_close(f2), FR_OK);
+}
+
+//
+// Check whether the file is contiguous.
+//
+static bool is_contiguous(const char *name)
+{
+    auto fp = (file_t*) alloca(f_sizeof_file_t());
+    EXPECT_EQ(f_open(fp, name, FA_READ), FR_OK);
+
+    int contiguous = 0;
+    EXPECT_EQ(f_contiguous(fp, &contiguous), FR_OK);
+    f_close(fp);
+    return contiguous;
+}
+
+//
+// Verify contents of the file written by write_interleaved().
+//
+static void check_pattern(const char *name, unsigned seed, unsigned nchunks)
+{
+    auto fp = (file_t*) alloca(f_sizeof_file_t());
+    ASSERT_EQ(f_open(fp, name, FA_READ), FR_OK);
+    EXPECT_EQ(f_size(fp), nchunks * 4096);
+
+    char buf[4096], expect[4096];
+    for (unsigned i = 0; i < nchunks; i++) {
+        unsigned nbytes_read = 0;
+        ASSERT_EQ(f_read(fp, buf, sizeof(buf), &nbytes_read), FR_OK);
+        ASSERT_EQ(nbytes_read, sizeof(buf));
+        fill_pattern(expect, sizeof(expect), seed, i * sizeof(buf));
+        ASSERT_EQ(memcmp(buf, expect, sizeof(buf)), 0) << name << ": chunk " << i;
+    }
+    f_close(fp);
+}
+
+//
+// Get number of free space runs.
+//
+static uint32_t free_runs(const char *drive)
+{
+    uint32_t nruns = 0, largest = 0;
+    EXPECT_EQ(f_freeruns(drive, &nruns, &largest), FR_OK);
+    return nruns;
+}
+
+TEST(cmd, defrag_program)
+{
+    disk_setup();
+    heap_setup();
+    create_directory("flash:/bin");
+    write_interleaved("flash:/bin/prog.exe", "flash:/bin/data.txt", 4);
+    ASSERT_FALSE(is_contiguous("flash:/bin/prog.exe"));
+    ASSERT_FALSE(is_contiguous("flash:/bin/data.txt"));
+
+    // Set timestamp and read-only flag.
+    file_info_t info{};
+    info.fdate = (44 << 9) | (2 << 5) | 3; // 2024-02-03
+    info.ftime = (4 << 11) | (5 << 5);     // 04:05
+    ASSERT_EQ(f_utime("flash:/bin/prog.exe", &info), FR_OK);
+    ASSERT_EQ(f_chmod("flash:/bin/prog.exe", AM_RDO, AM_RDO), FR_OK);
+
+    const char *argv[] = { "defrag", "-v", nullptr };
+    fpm_cmd_defrag(2, (char**) argv);
+
+    EXPECT_TRUE(is_contiguous("flash:/bin/prog.exe"));
+    EXPECT_TRUE(is_contiguous("flash:/bin/data.txt"));
+    EXPECT_EQ(free_runs("flash:"), 1u);
+    check_pattern("flash:/bin/prog.exe", 1, 4);
+    check_pattern("flash:/bin/data.txt", 2, 4);
+
+    // Directory entry is intact.
+    ASSERT_EQ(f_stat("flash:/bin/prog.exe", &info), FR_OK);
+    EXPECT_EQ(info.fdate, (44 << 9) | (2 << 5) | 3);
+    EXPECT_EQ(info.ftime, (4 << 11) | (5 << 5));
+    EXPECT_TRUE(info.fattrib & AM_RDO);
+}
+
+TEST(cmd, defrag_free_space)
+{
+    disk_setup();
+    heap_setup();
+    write_interleaved("flash:/a.txt", "flash:/b.txt", 2);
+    write_interleaved("flash:/c.txt", "flash:/d.txt", 2);
+    ASSERT_EQ(f_unlink("flash:/a.txt"), FR_OK);
+    ASSERT_EQ(f_unlink("flash:/c.txt"), FR_OK);
+    ASSERT_GT(free_runs("flash:"), 1u);
+
+    const char *argv[] = { "defrag", nullptr };
+    fpm_cmd_defrag(1, (char**) argv);
+
+    // Free space is collected in one run.
+    EXPECT_EQ(free_runs("flash:"), 1u);
+    EXPECT_TRUE(is_contiguous("flash:/b.txt"));
+    EXPECT_TRUE(is_contiguous("flash:/d.txt"));
+    check_pattern("flash:/b.txt", 2, 2);
+    check_pattern("flash:/d.txt", 2, 2);
+}
+
+TEST(cmd, defrag_time_limit)
+{
+    disk_setup();
+    heap_setup();
+    write_interleaved("flash:/data.txt", "flash:/prog.exe", 4);
+
+    // With no time, only one file is moved: the program goes first.
+    const char *argv[] = { "defrag", "-t", "0", nullptr };
+    fpm_cmd_defrag(3, (char**) argv);
+    EXPECT_TRUE(is_contiguous("flash:/prog.exe"));
+    EXPECT_FALSE(is_contiguous("flash:/data.txt"));
+
+    // Next run continues.
+    fpm_cmd_defrag(3, (char**) argv);
+    EXPECT_TRUE(is_contiguous("flash:/data.txt"));
+    check_pattern("flash:/prog.exe", 2, 4);
+    check_pattern("flash:/data.txt", 1, 4);
+}
+
+TEST(cmd, defrag_analyze_only)
+{
+    disk_setup();
+    heap_setup();
+    write_interleaved("flash:/prog.exe", "flash:/data.txt", 3);
+
+    const char *argv[] = { "defrag", "-n", nullptr };
+    fpm_cmd_defrag(2, (char**) argv);
+
+    EXPECT_FALSE(is_contiguous("flash:/prog.exe"));
+    EXPECT_FALSE(is_contiguous("flash:/data.txt"));
+}
+
+TEST(cmd, defrag_contiguous_program)
+{
+    disk_setup();
+    heap_setup();
+    write_file("flash:/small.exe", "tiny");
+    EXPECT_TRUE(is_contiguous("flash:/small.exe"));
+
+    const char *argv[] = { "defrag", "flash:", nullptr };
+    fpm_cmd_defrag(2, (char**) argv);
+
+    read_file("flash:/small.exe", "tiny");
+}
+
+TEST(cmd, defrag_background_running)
+{
+    disk_setup();
+    heap_setup();
+    write_interleaved("flash:/prog.exe", "flash:/data.txt", 3);
+
+    // Program runs in place: nothing is moved.
+    background_running = true;
+    testing::internal::CaptureStdout();
+    const char *argv[] = { "defrag", nullptr };
+    fpm_cmd_defrag(1, (char**) argv);
+    background_running = false;
+    EXPECT_EQ(testing::internal::GetCapturedStdout(),
+              "defrag: Background program is running, use 'wait'\r\n\n");
+
+    EXPECT_FALSE(is_contiguous("flash:/prog.exe"));
+    EXPECT_FALSE(is_contiguous("flash:/data.txt"));
+}
@@ -0,0 +1,217 @@
+//
+// Test ls/dir command.
+//
+#include <gtest/gtest.h>
+#include <fpm/api.h>
+#include <fpm/fs.h>
+#include <fpm/diskio.h>
+#include <fpm/internal.h>
+#include <algorithm>
+#include "util.h"
+
+class dir : public ::testing::Test {
+protected:
+    void SetUp() override
+    {
+        disk_setup();
+        heap_setup();
+    }
+
+    //
+    // Run ls/dir command and return the output.
+    //
+    std::string run(std::vector<const char *> args)
+    {
+        int argc = args.size();
+        args.push_back(nullptr);
+        testing::internal::CaptureStdout();
+        fpm_cmd_dir(argc, (char **)args.data());
+        return testing::internal::GetCapturedStdout();
+    }
+
+    //
+    // Create files with given names, in order.
+    //
+    void create_files(const std::vector<std::string> &names)
+    {
+        for (auto &name : names) {
+            write_file(name.c_str(), "");
+        }
+    }
+};
+
+//
+// Make a list of file names, in some random order.
+//
+static std::vector<std::string> make_names(unsigned count)
+{
+    std::vector<std::string> names;
+    for (unsigned i = 0; i < count; i++) {
+        // Vary the length, to exercise reuse of the string pool.
+        unsigned n = (i * 7919) % count;
+        names.push_back("f" + std::to_string(n) + std::string(n % 23, 'x'));
+    }
+    return names;
+}
+
+//
+// Format names in -1 style.
+//
+static std::string single_column(std::vector<std::string> names)
+{
+    std::string result;
+    for (auto &name : names) {
+        result += name + "\r\n";
+    }
+    return result + "\r\n";
+}
+
+TEST_F(dir, single_column_sorted)
+{
+    create_files({ "bbb", "ccc", "aaa" });
+
+    EXPECT_EQ(run({ "ls", "-1" }), "aaa\r\nbbb\r\nccc\r\n\r\n");
+    EXPECT_EQ(run({ "ls", "-1", "-r" }), "ccc\r\nbbb\r\naaa\r\n\r\n");
+}
+
+TEST_F(dir, columns)
+{
+    create_files({ "d", "b", "c", "a", "e" });
+    create_directory("sub");
+
+    EXPECT_EQ(run({ "ls" }), "a     b     c     d     e     sub/\r\n\r\n");
+}
+
+TEST_F(dir, hidden_last_in_columns)
+{
+    create_files({ "b", "a", "c" });
+    ASSERT_EQ(f_chmod("b", AM_HID, AM_HID), FR_OK);
+
+    EXPECT_EQ(run({ "ls" }), "a   c\r\n\r\n");
+    EXPECT_EQ(run({ "ls", "-a" }), "a   b   c\r\n\r\n");
+}
+
+TEST_F(dir, large_directory_in_chunks)
+{
+    auto names = make_names(300);
+    create_directory("big");
+    for (auto &name : names) {
+        write_file(("big/" + name).c_str(), "");
+    }
+    std::sort(names.begin(), names.end());
+
+    // Enough memory for all entries.
+    std::string expect = single_column(names);
+    EXPECT_EQ(run({ "ls", "-1", "big" }), expect);
+
+    // Listing does not fit, and is made in several passes.
+    heap_setup(4 * 1024);
+    EXPECT_EQ(run({ "ls", "-1", "big" }), expect);
+
+    // Reverse order.
+    std::reverse(names.begin(), names.end());
+    EXPECT_EQ(run({ "ls", "-1", "-r", "big" }), single_column(names));
+}
+
+TEST_F(dir, recursive_in_chunks)
+{
+    std::vector<std::string> names;
+    create_directory("top");
+    for (unsigned i = 10; i < 110; i++) {
+        names.push_back("d" + std::to_string(i));
+        std::string path = "top/" + names.back();
+        create_directory(path.c_str());
+        write_file((path + "/file").c_str(), "");
+    }
+    std::sort(names.begin(), names.end());
+
+    std::string listing, contents;
+    for (auto &name : names) {
+        listing += name + "/\r\n";
+        contents += "\r\ntop/" + name + ":\r\nfile\r\n";
+    }
+    std::string expect = listing + contents + "\r\n";
+
+    EXPECT_EQ(run({ "ls", "-1", "-R", "top" }), expect);
+
+    // Subdirectories are visited in several passes.
+    heap_setup(4 * 1024);
+    EXPECT_EQ(run({ "ls", "-1", "-R", "top" }), expect);
+}
+
+TEST_F(dir, unsorted)
+{
+    auto names = make_names(50);
+    create_files(names);
+
+    // Entries are printed in directory order, which is creation order here.
+    heap_setup(2 * 1024);
+    EXPECT_EQ(run({ "ls", "-f" }), single_column(names));
+}
+
+TEST_F(dir, long_name_after_full_chunk)
+{
+    // Long name comes last, when the chunk is already full,
+    // and goes in the middle of the listing. Entries going before
+    // it must not be lost.
+    std::vector<std::string> names;
+    for (unsigned i = 10; i < 99; i++) {
+        names.push_back("a" + std::to_string(i));
+    }
+    names.push_back("a5" + std::string(198, 'x'));
+    create_files(names);
+    std::sort(names.begin(), names.end());
+
+    heap_setup(3000);
+    EXPECT_EQ(run({ "ls", "-1" }), single_column(names));
+}
+
+TEST_F(dir, unsorted_recursive_in_chunks)
+{
+    std::vector<std::string> names;
+    create_directory("top");
+    for (unsigned i = 0; i < 100; i++) {
+        names.push_back("d" + std::to_string((i * 37) % 100 + 10));
+        std::string path = "top/" + names.back();
+        create_directory(path.c_str());
+        write_file((path + "/file").c_str(), "");
+    }
+
+    // Directory order, which is creation order here.
+    std::string listing, contents;
+    for (auto &name : names) {
+        listing += name + "/\r\n";
+        contents += "\r\ntop/" + name + ":\r\nfile\r\n";
+    }
+    std::string expect = listing + contents + "\r\n";
+
+    EXPECT_EQ(run({ "ls", "-f", "-R", "top" }), expect);
+
+    // Subdirectories are visited in several passes.
+    heap_setup(4 * 1024);
+    EXPECT_EQ(run({ "ls", "-f", "-R", "top" }), expect);
+}
+
+TEST_F(dir, long_format_total)
+{
+    write_file("foo", std::string(2000, 'x').c_str());
+    write_file("bar", "x");
+
+    std::string out = run({ "dir", "." });
+    EXPECT_EQ(out.substr(0, 18), "Total 3 kbytes\r\na-");
+    EXPECT_NE(out.find("  1  "), std::string::npos);
+    EXPECT_NE(out.find("2,000  "), std::string::npos);
+    EXPECT_LT(out.find("bar"), out.find("foo"));
+}
+
+TEST_F(dir, unsorted_long_files)
+{
+    write_file("foo", std::string(2000, 'x').c_str());
+    write_file("bar", "x");
+
+    // File arguments keep the long format with -f.
+    std::string out = run({ "ls", "-l", "-f", "foo", "bar" });
+    EXPECT_EQ(out.substr(0, 2), "a-");
+    EXPECT_NE(out.find("2,000  "), std::string::npos);
+    EXPECT_NE(out.find("  1  "), std::string::npos);
+}
@@ -35,6 +35,16 @@ void fpm_putchar(char ch)
     output[output_ptr] = 0;
 }
 
+//
+// Write bytes to output buffer.
+//
+void fpm_write(const char *buf, unsigned len)
+{
+    while (len-- > 0) {
+        fpm_putchar(*buf++);
+    }
+}
+
 //
 // Run one test with given input.
 //
@@ -62,12 +72,31 @@ static void editline_append(const char *initial, const char *inp)
 static void editline_history(const char *prev_line, const char *inp)
 {
     uint16_t cmd_line[FPM_CMDLINE_SIZE];
-    uint16_t history[FPM_CMDLINE_SIZE];
+    fpm_history_t history;
+    input = inp;
+    output_ptr = 0;
+    output[0] = 0;
+    fpm_history_clear(&history);
+    fpm_history_add_utf8(&history, prev_line);
+    fpm_editline(cmd_line, sizeof(cmd_line), true, ">", &history);
+    fpm_strlcpy_to_utf8(result, cmd_line, sizeof(result));
+}
+
+//
+// History of several lines, oldest first.
+//
+static void editline_history_list(std::initializer_list<const char *> lines, const char *inp)
+{
+    uint16_t cmd_line[FPM_CMDLINE_SIZE];
+    fpm_history_t history;
     input = inp;
     output_ptr = 0;
     output[0] = 0;
-    fpm_strlcpy_from_utf8(history, prev_line, sizeof(history)/sizeof(uint16_t));
-    fpm_editline(cmd_line, sizeof(cmd_line), true, ">", history);
+    fpm_history_clear(&history);
+    for (auto line : lines) {
+        fpm_history_add_utf8(&history, line);
+    }
+    fpm_editline(cmd_line, sizeof(cmd_line), true, ">", &history);
     fpm_strlcpy_to_utf8(result, cmd_line, sizeof(result));
 }
 
@@ -186,42 +215,42 @@ TEST(editline, delete_linux_in_the_middle)
 TEST(editline, beginning_of_line_ctrlA)
 {
     editline_test(">", "foobar\1\r");
-    EXPECT_STREQ(output, ">foobar\b\b\b\b\b\bfoobar");
+    EXPECT_STREQ(output, ">foobar\33[6D\33[6C");
     EXPECT_STREQ(result, "foobar");
 }
 
 TEST(editline, beginning_of_line_home1)
 {
     editline_test(">", "foobar\33[H\r");
-    EXPECT_STREQ(output, ">foobar\b\b\b\b\b\bfoobar");
+    EXPECT_STREQ(output, ">foobar\33[6D\33[6C");
     EXPECT_STREQ(result, "foobar");
 }
 
 TEST(editline, beginning_of_line_home2)
 {
     editline_test(">", "foobar\33OH\r");
-    EXPECT_STREQ(output, ">foobar\b\b\b\b\b\bfoobar");
+    EXPECT_STREQ(output, ">foobar\33[6D\33[6C");
     EXPECT_STREQ(result, "foobar");
 }
 
 TEST(editline, end_of_line_ctrlE)
 {
     editline_test(">", "foobar\1x\5y\r");
-    EXPECT_STREQ(output, ">foobar\b\b\b\b\b\b\33[@xfoobary");
+    EXPECT_STREQ(output, ">foobar\33[6D\33[@x\33[6Cy");
     EXPECT_STREQ(result, "xfoobary");
 }
 
 TEST(editline, end_of_line_home1)
 {
     editline_test(">", "foobar\1x\33[Fy\r");
-    EXPECT_STREQ(output, ">foobar\b\b\b\b\b\b\33[@xfoobary");
+    EXPECT_STREQ(output, ">foobar\33[6D\33[@x\33[6Cy");
     EXPECT_STREQ(result, "xfoobary");
 }
 
 TEST(editline, end_of_line_home2)
 {
     editline_test(">", "foobar\1x\33OFy\r");
-    EXPECT_STREQ(output, ">foobar\b\b\b\b\b\b\33[@xfoobary");
+    EXPECT_STREQ(output, ">foobar\33[6D\33[@x\33[6Cy");
     EXPECT_STREQ(result, "xfoobary");
 }
 
@@ -249,41 +278,105 @@ TEST(editline, unicode_input)
 TEST(editline, arrow_up1)
 {
     editline_history("there", "foobar\33[A\r");
-    EXPECT_STREQ(output, ">foobar\b\b\b\b\b\b\33[Kthere");
+    EXPECT_STREQ(output, ">foobar\33[6Dthere\33[K");
     EXPECT_STREQ(result, "there");
 }
 
 TEST(editline, arrow_up2)
 {
     editline_history("there", "foobar\33OA2\r");
-    EXPECT_STREQ(output, ">foobar\b\b\b\b\b\b\33[Kthere2");
+    EXPECT_STREQ(output, ">foobar\33[6Dthere\33[K2");
     EXPECT_STREQ(result, "there2");
 }
 
 TEST(editline, arrow_down1)
 {
     editline_history("there", "foobar\33[A\33[B\r");
-    EXPECT_STREQ(output, ">foobar\b\b\b\b\b\b\33[Kthere\b\b\b\b\b\33[Kfoobar");
+    EXPECT_STREQ(output, ">foobar\33[6Dthere\33[K\33[5Dfoobar");
     EXPECT_STREQ(result, "foobar");
 }
 
 TEST(editline, arrow_down2)
 {
     editline_history("there", "foobar\33OA\33OB2\r");
-    EXPECT_STREQ(output, ">foobar\b\b\b\b\b\b\33[Kthere\b\b\b\b\b\33[Kfoobar2");
+    EXPECT_STREQ(output, ">foobar\33[6Dthere\33[K\33[5Dfoobar2");
     EXPECT_STREQ(result, "foobar2");
 }
 
 TEST(editline, prev_line_ctrlP)
 {
     editline_history("there", "foobar\20\r");
-    EXPECT_STREQ(output, ">foobar\b\b\b\b\b\b\33[Kthere");
+    EXPECT_STREQ(output, ">foobar\33[6Dthere\33[K");
     EXPECT_STREQ(result, "there");
 }
 
 TEST(editline, next_line_ctrlN)
 {
     editline_history("there", "foobar\20\16\r");
-    EXPECT_STREQ(output, ">foobar\b\b\b\b\b\b\33[Kthere\b\b\b\b\b\33[Kfoobar");
+    EXPECT_STREQ(output, ">foobar\33[6Dthere\33[K\33[5Dfoobar");
     EXPECT_STREQ(result, "foobar");
 }
+
+TEST(editline, arrow_up_common_prefix)
+{
+    // Only the differing tail is redrawn.
+    editline_history("foobaz", "foobar\33[A\r");
+    EXPECT_STREQ(output, ">foobar\bz");
+    EXPECT_STREQ(result, "foobaz");
+}
+
+TEST(editline, arrow_up_shorter_line)
+{
+    editline_history("fo", "foobar\2\2\2\2\2\33[A\r");
+    EXPECT_STREQ(output, ">foobar\b\b\b\b\bo\33[K");
+    EXPECT_STREQ(result, "fo");
+}
+
+TEST(editline, long_cursor_move)
+{
+    editline_test(">", "abcdefghijklmnopqrstuvwxyz\1\r");
+    EXPECT_STREQ(output, ">abcdefghijklmnopqrstuvwxyz\33[26D\33[26C");
+    EXPECT_STREQ(result, "abcdefghijklmnopqrstuvwxyz");
+}
+
+TEST(editline, arrow_up_many)
+{
+    // Walk back over several lines, then forward.
+    editline_history_list({ "one", "two", "three" }, "x\33[A\33[A\33[A\33[A\33[B\r");
+    EXPECT_STREQ(result, "two");
+}
+
+TEST(editline, arrow_down_to_typed_line)
+{
+    editline_history_list({ "one", "two" }, "abc\33[A\33[A\33[B\33[B\33[B\r");
+    EXPECT_STREQ(result, "abc");
+}
+
+TEST(editline, reverse_search)
+{
+    // Find the older of two matches, accept with Return.
+    editline_history_list({ "copy -r a b", "dir", "copy c d", "ver" }, "\22co\22\r");
+    EXPECT_STREQ(result, "copy -r a b");
+    EXPECT_NE(strstr(output, "(reverse-i-search)`co': copy c d"), nullptr);
+    EXPECT_NE(strstr(output, "(reverse-i-search)`co': copy -r a b"), nullptr);
+}
+
+TEST(editline, reverse_search_edit)
+{
+    // Cursor key ends the search and is processed.
+    editline_history_list({ "copy -r a b", "ver" }, "\22-r\33[Dx\r");
+    EXPECT_STREQ(result, "copy -r a xb");
+}
+
+TEST(editline, reverse_search_failed)
+{
+    editline_history_list({ "dir", "ver" }, "\22xyz\r");
+    EXPECT_STREQ(result, "");
+    EXPECT_NE(strstr(output, "(failed reverse-i-search)`xyz': "), nullptr);
+}
+
+TEST(editline, reverse_search_cancel)
+{
+    editline_history_list({ "dir", "ver" }, "abc\22di\7\r");
+    EXPECT_STREQ(result, "abc");
+}
@@ -9,6 +9,8 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <alloca.h>
+#include <thread>
+#include <vector>
 
 //
 // Names of disk volumes.
@@ -311,3 +313,168 @@ TEST(fatfs, fat16)
 {
     test_mkfs_write_read_delete(FM_FAT | FM_SFD);
 }
+
+//
+// Write and read files in a separate directory.
+// Used by several threads simultaneously.
+//
+static void thread_write_read(unsigned thread_index)
+{
+    char dirname[32], filename[64], contents[64];
+    snprintf(dirname, sizeof(dirname), "Thread-%u", thread_index);
+    auto result = f_mkdir(dirname);
+    EXPECT_EQ(result, FR_OK);
+
+    for (unsigned i = 0; i < 50; i++) {
+        snprintf(filename, sizeof(filename), "%s/File-number-%u.txt", dirname, i);
+        snprintf(contents, sizeof(contents), "Contents of file %u from thread %u", i, thread_index);
+        write_file(filename, contents);
+    }
+    for (unsigned i = 0; i < 50; i++) {
+        snprintf(filename, sizeof(filename), "%s/File-number-%u.txt", dirname, i);
+        snprintf(contents, sizeof(contents), "Contents of file %u from thread %u", i, thread_index);
+        read_file(filename, contents);
+    }
+}
+
+//
+// Access the same volume from several threads (FF_FS_REENTRANT).
+//
+TEST(fatfs, threads)
+{
+    char buf[4*1024];
+
+    sector_size = 512;
+    fs_nbytes = sizeof(fs_image);
+    memset(fs_image, 0xff, fs_nbytes);
+    fs_result_t result = f_mkfs("0:", FM_FAT32, buf, sizeof(buf));
+    ASSERT_EQ(result, FR_OK);
+
+    result = f_mount("0:");
+    ASSERT_EQ(result, FR_OK);
+
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < 4; i++) {
+        threads.emplace_back(thread_write_read, i);
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    // Check free space on the drive: 200 files by one cluster,
+    // and 4 directories by 10 clusters (152 entries of 32 bytes).
+    fs_info_t fsinfo;
+    result = f_statfs("", &fsinfo);
+    EXPECT_EQ(result, FR_OK);
+    EXPECT_EQ(fsinfo.f_bavail, 81184 - 200 - 4 * 10);
+
+    result = f_unmount("0:");
+    EXPECT_EQ(result, FR_OK);
+}
+
+//
+// Delete contents of the open directory through the directory handle.
+//
+static void delete_contents(directory_t *dir, fs_chains_t *chains)
+{
+    for (;;) {
+        file_info_t info;
+        ASSERT_EQ(f_readdir(dir, &info), FR_OK);
+        if (!info.fname[0]) {
+            break;
+        }
+        if (info.fattrib & AM_DIR) {
+            auto subdir = (directory_t*) alloca(f_sizeof_directory_t());
+            ASSERT_EQ(f_opendirat(subdir, dir), FR_OK);
+            delete_contents(subdir, chains);
+            ASSERT_EQ(f_closedir(subdir), FR_OK);
+        }
+        ASSERT_EQ(f_unlinkat(dir, chains), FR_OK) << info.fname;
+
+        // Entry is gone.
+        EXPECT_EQ(f_unlinkat(dir, chains), FR_NO_FILE);
+    }
+}
+
+//
+// Remove a directory tree relative to open directory handles.
+//
+static void test_delete_tree(unsigned fmt)
+{
+    char buf[4*1024];
+
+    sector_size = (fmt & FM_FAT32) ? 512 : 4096;
+    fs_nbytes = (fmt & FM_FAT32) ? sizeof(fs_image) : 1*1024*1024;
+    memset(fs_image, 0xff, fs_nbytes);
+    fs_result_t result = f_mkfs("0:", fmt, buf, sizeof(buf));
+    ASSERT_EQ(result, FR_OK);
+    result = f_mount("0:");
+    ASSERT_EQ(result, FR_OK);
+
+    fs_info_t before;
+    ASSERT_EQ(f_statfs("", &before), FR_OK);
+
+    // Three levels of directories with a few files each.
+    char path[128];
+    ASSERT_EQ(f_mkdir("Logs"), FR_OK);
+    ASSERT_EQ(f_mkdir("Logs/Level-one"), FR_OK);
+    ASSERT_EQ(f_mkdir("Logs/Level-one/Level-two"), FR_OK);
+    for (unsigned i = 0; i < 5; i++) {
+        snprintf(path, sizeof(path), "Logs/Log-file-number-%u.txt", i);
+        write_file(path, "one");
+        snprintf(path, sizeof(path), "Logs/Level-one/Log-file-number-%u.txt", i);
+        write_file(path, "two");
+        snprintf(path, sizeof(path), "Logs/Level-one/Level-two/Log-file-number-%u.txt", i);
+        write_file(path, "three");
+    }
+    write_file("Keep.txt", "keep");
+
+    // Locked file cannot be deleted.
+    auto fp = (file_t*) alloca(f_sizeof_file_t());
+    ASSERT_EQ(f_open(fp, "Logs/Log-file-number-0.txt", FA_READ), FR_OK);
+    auto dir = (directory_t*) alloca(f_sizeof_directory_t());
+    ASSERT_EQ(f_opendir(dir, "Logs"), FR_OK);
+    EXPECT_EQ(f_unlinkat(dir, nullptr), FR_NO_FILE);
+    file_info_t info;
+    do {
+        ASSERT_EQ(f_readdir(dir, &info), FR_OK);
+        ASSERT_TRUE(info.fname[0]);
+    } while (strcmp(info.fname, "Log-file-number-0.txt") != 0);
+    EXPECT_EQ(f_unlinkat(dir, nullptr), FR_LOCKED);
+    ASSERT_EQ(f_close(fp), FR_OK);
+    ASSERT_EQ(f_rewinddir(dir), FR_OK);
+
+    // Delete everything under Logs, with clusters released in batches.
+    fs_chains_t chains{};
+    delete_contents(dir, &chains);
+    ASSERT_EQ(f_freechains(dir, &chains), FR_OK);
+    EXPECT_EQ(chains.count, 0u);
+    ASSERT_EQ(f_closedir(dir), FR_OK);
+    ASSERT_EQ(f_unlink("Logs"), FR_OK);
+
+    // All space is back, except the file kept.
+    EXPECT_EQ(f_stat("Logs", &info), FR_NO_FILE);
+    read_file("Keep.txt", "keep");
+    ASSERT_EQ(f_unlink("Keep.txt"), FR_OK);
+    fs_info_t after;
+    ASSERT_EQ(f_statfs("", &after), FR_OK);
+    EXPECT_EQ(after.f_bfree, before.f_bfree);
+
+    result = f_unmount("0:");
+    EXPECT_EQ(result, FR_OK);
+}
+
+TEST(fatfs, delete_tree_fat32)
+{
+    test_delete_tree(FM_FAT32);
+}
+
+TEST(fatfs, delete_tree_exfat)
+{
+    test_delete_tree(FM_EXFAT | FM_SFD);
+}
+
+TEST(fatfs, delete_tree_fat16)
+{
+    test_delete_tree(FM_FAT | FM_SFD);
+}
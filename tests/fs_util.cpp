@@ -1,6 +1,8 @@
 #include <gtest/gtest.h>
 #include <fpm/fs.h>
 #include <fpm/diskio.h>
+#include <fpm/context.h>
+#include <fpm/internal.h>
 #include <alloca.h>
 #include <string.h>
 #include "util.h"
@@ -140,6 +142,15 @@ void fpm_get_datetime(int *year, int *month, int *day, int *dotw, int *hour, int
     *min = 33;
     *sec = 45;
 }
+
+//
+// Get time in microseconds: advance by one millisecond per call.
+//
+uint64_t fpm_time_usec()
+{
+    static uint64_t usec;
+    return usec += 1000;
+}
 };
 
 //
@@ -169,6 +180,18 @@ void disk_setup()
     ASSERT_EQ(result, FR_OK);
 }
 
+//
+// Initialize heap for commands, limited to given size.
+//
+void heap_setup(unsigned nbytes)
+{
+    static fpm_context_t context;
+    alignas(8) static char heap[HEAP_SIZE];
+
+    fpm_context = nullptr;
+    fpm_heap_init(&context, (size_t)&heap[0], nbytes);
+}
+
 //
 // Create a file with given name and contents.
 //
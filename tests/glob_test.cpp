@@ -0,0 +1,132 @@
+//
+// Test fpm_glob() - expand wildcards in arguments.
+//
+#include <gtest/gtest.h>
+#include <fpm/api.h>
+#include <fpm/fs.h>
+#include <fpm/diskio.h>
+#include <fpm/internal.h>
+#include "util.h"
+
+//
+// Split the line, expand wildcards, and join the result with spaces.
+//
+static std::string glob(const char *line, const char *expect_error = nullptr)
+{
+    char buffer[200];
+    char *argv[64];
+    uint8_t flags[64];
+    int argc = 0;
+
+    strncpy(buffer, line, sizeof(buffer));
+    const char *error = fpm_tokenize_shell(argv, &argc, buffer, flags);
+    EXPECT_EQ(error, nullptr);
+
+    char **expanded = fpm_glob(&argc, argv, flags, &error);
+    if (expect_error) {
+        EXPECT_STREQ(error, expect_error);
+        EXPECT_EQ(expanded, nullptr);
+        return "";
+    }
+    EXPECT_EQ(error, nullptr);
+
+    char **vec = expanded ? expanded : argv;
+    std::string result;
+    for (int i = 0; i < argc; i++) {
+        if (i > 0) {
+            result += ' ';
+        }
+        result += vec[i];
+    }
+    if (expanded) {
+        EXPECT_EQ(expanded[argc], nullptr);
+        fpm_free(expanded);
+    }
+    return result;
+}
+
+TEST(glob, no_wildcards)
+{
+    disk_setup();
+    heap_setup();
+    EXPECT_EQ(glob("echo foo bar"), "echo foo bar");
+}
+
+TEST(glob, sorted_matches)
+{
+    disk_setup();
+    heap_setup();
+    write_file("flash:/c.log", "c");
+    write_file("flash:/a.log", "a");
+    write_file("flash:/b.txt", "b");
+    write_file("flash:/Long Name.log", "l");
+    create_directory("flash:/dir.log");
+
+    EXPECT_EQ(glob("rm *.log -v"), "rm Long Name.log a.log c.log dir.log -v");
+    EXPECT_EQ(glob("cat ?.*"), "cat a.log b.txt c.log");
+    EXPECT_EQ(glob("cat '*.log'"), "cat *.log");
+}
+
+TEST(glob, case_insensitive)
+{
+    disk_setup();
+    heap_setup();
+    write_file("flash:/README.TXT", "short name");
+    write_file("flash:/readme.md", "short name, lower case");
+    write_file("flash:/ReadMe.Later", "long name");
+    write_file("flash:/other.txt", "x");
+
+    EXPECT_EQ(glob("ls read*"), "ls README.TXT ReadMe.Later readme.md");
+    EXPECT_EQ(glob("ls READ*.t?t"), "ls README.TXT");
+}
+
+TEST(glob, directory_prefix)
+{
+    disk_setup();
+    heap_setup();
+    create_directory("sd:/data");
+    write_file("sd:/data/2026-01.csv", "1");
+    write_file("sd:/data/2026-02.csv", "2");
+    write_file("sd:/data/2025-12.csv", "3");
+
+    EXPECT_EQ(glob("cp sd:/data/2026-* flash:"), "cp sd:/data/2026-01.csv sd:/data/2026-02.csv flash:");
+    EXPECT_EQ(glob("ls sd:/d*"), "ls sd:/data");
+    ASSERT_EQ(f_chdrive("sd:"), FR_OK);
+    EXPECT_EQ(glob("ls data/*-12.*"), "ls data/2025-12.csv");
+    ASSERT_EQ(f_chdrive("flash:"), FR_OK);
+}
+
+TEST(glob, no_match)
+{
+    disk_setup();
+    heap_setup();
+    write_file("flash:/file.txt", "x");
+
+    // Pattern is kept as is.
+    EXPECT_EQ(glob("ls *.exe nodir/*"), "ls *.exe nodir/*");
+}
+
+TEST(glob, hidden_files)
+{
+    disk_setup();
+    heap_setup();
+    write_file("flash:/shown.txt", "x");
+    write_file("flash:/hidden.txt", "x");
+    ASSERT_EQ(f_chmod("flash:/hidden.txt", AM_HID, AM_HID), FR_OK);
+
+    EXPECT_EQ(glob("ls *.txt"), "ls shown.txt");
+}
+
+TEST(glob, too_many_matches)
+{
+    disk_setup();
+    heap_setup();
+    create_directory("sd:/many");
+    for (unsigned i = 0; i < 1024; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "sd:/many/%04u", i);
+        write_file(name, "");
+    }
+    glob("rm sd:/many/*", "Too many matches");
+    EXPECT_EQ(glob("ls sd:/many/1023"), "ls sd:/many/1023");
+}
@@ -0,0 +1,84 @@
+//
+// Test command history: fpm_history_add() and others.
+//
+#include <gtest/gtest.h>
+#include <fpm/api.h>
+
+//
+// Get line from history as UTF-8 string.
+//
+static std::string get_line(fpm_history_t &history, unsigned index)
+{
+    uint16_t line[FPM_CMDLINE_SIZE];
+    char buf[3 * FPM_CMDLINE_SIZE];
+    if (!fpm_history_get(&history, index, line, FPM_CMDLINE_SIZE)) {
+        return "(none)";
+    }
+    fpm_strlcpy_to_utf8(buf, line, sizeof(buf));
+    return buf;
+}
+
+TEST(history, add_get)
+{
+    fpm_history_t history;
+    fpm_history_clear(&history);
+    EXPECT_EQ(get_line(history, 0), "(none)");
+
+    fpm_history_add_utf8(&history, "one");
+    fpm_history_add_utf8(&history, "two");
+    fpm_history_add_utf8(&history, "");
+    fpm_history_add_utf8(&history, "two");
+    fpm_history_add_utf8(&history, "Γειά");
+
+    // Newest first; empty lines and repeats are not stored.
+    EXPECT_EQ(get_line(history, 0), "Γειά");
+    EXPECT_EQ(get_line(history, 1), "two");
+    EXPECT_EQ(get_line(history, 2), "one");
+    EXPECT_EQ(get_line(history, 3), "(none)");
+}
+
+TEST(history, wrap_around)
+{
+    fpm_history_t history;
+    fpm_history_clear(&history);
+
+    // Many more lines than the ring can hold.
+    for (unsigned i = 0; i < 1000; i++) {
+        std::string line = "line " + std::to_string(i);
+        fpm_history_add_utf8(&history, line.c_str());
+    }
+    EXPECT_LE(history.end - history.start, (unsigned)FPM_HISTORY_SIZE);
+
+    // The newest lines are kept.
+    for (unsigned i = 0; i < 100; i++) {
+        EXPECT_EQ(get_line(history, i), "line " + std::to_string(999 - i));
+    }
+
+    // Oldest line is complete.
+    unsigned count = 0;
+    while (get_line(history, count) != "(none)") {
+        count++;
+    }
+    EXPECT_EQ(get_line(history, count - 1), "line " + std::to_string(1000 - count));
+}
+
+TEST(history, search)
+{
+    fpm_history_t history;
+    fpm_history_clear(&history);
+    fpm_history_add_utf8(&history, "copy -r a b");
+    fpm_history_add_utf8(&history, "dir");
+    fpm_history_add_utf8(&history, "copy c d");
+
+    uint16_t pattern[FPM_CMDLINE_SIZE];
+    fpm_strlcpy_from_utf8(pattern, "copy", FPM_CMDLINE_SIZE);
+    EXPECT_EQ(fpm_history_search(&history, 0, pattern), 0);
+    EXPECT_EQ(fpm_history_search(&history, 1, pattern), 2);
+    EXPECT_EQ(fpm_history_search(&history, 3, pattern), -1);
+
+    fpm_strlcpy_from_utf8(pattern, "-r", FPM_CMDLINE_SIZE);
+    EXPECT_EQ(fpm_history_search(&history, 0, pattern), 2);
+
+    fpm_strlcpy_from_utf8(pattern, "xyz", FPM_CMDLINE_SIZE);
+    EXPECT_EQ(fpm_history_search(&history, 0, pattern), -1);
+}
@@ -0,0 +1,99 @@
+//
+// Test background jobs: fpm_job_submit() and others.
+//
+#include <gtest/gtest.h>
+#include <fpm/api.h>
+#include <fpm/internal.h>
+#include <thread>
+
+//
+// Sum numbers from 1 to N, where N is given as argument.
+//
+static void sum_numbers(fpm_job_t *job)
+{
+    unsigned n = (uintptr_t)job->arg;
+    int sum = 0;
+    for (unsigned i = 1; i <= n; i++) {
+        sum += i;
+    }
+    job->result = sum;
+}
+
+//
+// Remember identifier of the thread which runs the job.
+//
+static void get_thread_id(fpm_job_t *job)
+{
+    *(std::thread::id *)job->arg = std::this_thread::get_id();
+}
+
+TEST(jobs, foreground_and_background)
+{
+    // Without worker, the job is executed immediately.
+    std::thread::id id;
+    fpm_job_t job = { get_thread_id, &id };
+    fpm_job_submit(&job);
+    ASSERT_TRUE(fpm_job_done(&job));
+    EXPECT_EQ(id, std::this_thread::get_id());
+
+    // With worker, the job is executed by another thread.
+    fpm_jobs_start();
+    job = { get_thread_id, &id };
+    fpm_job_submit(&job);
+    fpm_job_wait(&job);
+    EXPECT_NE(id, std::this_thread::get_id());
+}
+
+TEST(jobs, many_jobs)
+{
+    fpm_jobs_start();
+
+    // Submit more jobs than the queue can hold.
+    fpm_job_t jobs[100] = {};
+    for (unsigned i = 0; i < 100; i++) {
+        jobs[i].func = sum_numbers;
+        jobs[i].arg = (void *)(uintptr_t)i;
+        fpm_job_submit(&jobs[i]);
+    }
+
+    // Collect results in reverse order.
+    for (int i = 99; i >= 0; i--) {
+        EXPECT_EQ(fpm_job_wait(&jobs[i]), i * (i + 1) / 2);
+        EXPECT_EQ(jobs[i].state, FPM_JOB_DONE);
+    }
+}
+
+//
+// Hold the worker until released.
+//
+static void hold_worker(fpm_job_t *job)
+{
+    while (!__atomic_load_n((bool *)job->arg, __ATOMIC_ACQUIRE)) {
+        std::this_thread::yield();
+    }
+}
+
+TEST(jobs, worker_taken_by_program)
+{
+    fpm_jobs_start();
+
+    bool release = false;
+    fpm_job_t program = { hold_worker, &release };
+    fpm_job_submit_program(&program);
+
+    // While the worker is busy, jobs are executed by the caller.
+    std::thread::id id;
+    fpm_job_t job = { get_thread_id, &id };
+    fpm_job_submit(&job);
+    ASSERT_TRUE(fpm_job_done(&job));
+    EXPECT_EQ(id, std::this_thread::get_id());
+
+    __atomic_store_n(&release, true, __ATOMIC_RELEASE);
+    fpm_job_wait(&program);
+
+    // Worker is available again.
+    job = { get_thread_id, &id };
+    fpm_job_submit(&job);
+    fpm_job_wait(&job);
+    EXPECT_NE(id, std::this_thread::get_id());
+}
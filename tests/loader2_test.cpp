@@ -7,6 +7,7 @@
 #include <fpm/context.h>
 #include <fpm/elf.h>
 #include <sys/syscall.h>
+#include <fstream>
 
 static std::stringstream puts_result;
 
@@ -71,3 +72,131 @@ TEST(loader, print_version_puts_wputs)
 
     fpm_unload(&ctx);
 }
+
+//
+// Link map without fpm_wputs.
+//
+static fpm_binding_t incomplete_linkmap[] = {
+    { "", NULL },
+    { "fpm_puts", (void*) mock_puts },
+    { "fpm_print_version", (void*) mock_print_version },
+    {},
+};
+
+TEST(loader, bind_now_missing_symbol)
+{
+    fpm_context_t ctx{};
+    ASSERT_TRUE(fpm_load(&ctx, "testputs.exe"));
+    ctx.bind_now = true;
+
+    char filename[] = { "hello" };
+    char *argv[] = { filename };
+    puts_result.str("");
+
+    // Program must not start.
+    bool exec_status = fpm_invoke(&ctx, incomplete_linkmap, 1, argv);
+    ASSERT_FALSE(exec_status);
+    ASSERT_EQ(puts_result.str(), "");
+
+    fpm_unload(&ctx);
+}
+
+#if (__x86_64__ && __linux__) || __aarch64__
+TEST(loader, lazy_missing_symbol)
+{
+    fpm_context_t ctx{};
+    ASSERT_TRUE(fpm_load(&ctx, "testputs.exe"));
+
+    char filename[] = { "hello" };
+    char *argv[] = { filename };
+    puts_result.str("");
+
+    // Program runs until it calls the missing routine.
+    bool exec_status = fpm_invoke(&ctx, incomplete_linkmap, 1, argv);
+    ASSERT_FALSE(exec_status);
+    ASSERT_EQ(puts_result.str(),
+        "Loader Test\r\n"
+        "puts\r\n"
+    );
+
+    // Next run with complete link map succeeds.
+    static fpm_binding_t linkmap[] = {
+        { "", NULL },
+        { "fpm_puts", (void*) mock_puts },
+        { "fpm_wputs", (void*) mock_wputs },
+        { "fpm_print_version", (void*) mock_print_version },
+        {},
+    };
+    puts_result.str("");
+    ASSERT_TRUE(fpm_invoke(&ctx, linkmap, 1, argv));
+    ASSERT_EQ(puts_result.str(),
+        "Loader Test\r\n"
+        "puts\r\n"
+        "wputs\r\n"
+    );
+
+    fpm_unload(&ctx);
+}
+#endif
+
+//
+// Copy binary, and change one byte at given offset.
+//
+static void patch_binary(const char *from, const char *to, size_t offset, uint8_t value)
+{
+    std::ifstream in(from, std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    ASSERT_GT(data.size(), offset);
+    data[offset] = value;
+    std::ofstream out(to, std::ios::binary);
+    out << data;
+}
+
+TEST(loader, unmarked_binary_bound_now)
+{
+    // Binary processed by older elfexe.
+    patch_binary("testputs.exe", "oldputs.exe", EI_ABIVERSION, 0);
+    fpm_context_t ctx{};
+    ASSERT_TRUE(fpm_load(&ctx, "oldputs.exe"));
+
+    char filename[] = { "hello" };
+    char *argv[] = { filename };
+    puts_result.str("");
+
+    // Program must not start.
+    bool exec_status = fpm_invoke(&ctx, incomplete_linkmap, 1, argv);
+    ASSERT_FALSE(exec_status);
+    ASSERT_EQ(puts_result.str(), "");
+
+    fpm_unload(&ctx);
+}
+
+#if __x86_64__ && __linux__
+TEST(loader, lazy_bad_index)
+{
+    // Find first PLT stub: mov $0, %r11d; jmp *%gs:0
+    std::ifstream in("testputs.exe", std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    const std::string stub("\x41\xbb\0\0\0\0\x65\xff\x24\x25\0\0\0\0", 14);
+    size_t offset = data.find(stub);
+    ASSERT_NE(offset, std::string::npos);
+
+    // Index out of range.
+    patch_binary("testputs.exe", "badputs.exe", offset + 3, 1);
+    fpm_context_t ctx{};
+    ASSERT_TRUE(fpm_load(&ctx, "badputs.exe"));
+
+    static fpm_binding_t linkmap[] = {
+        { "", NULL },
+        { "fpm_puts", (void*) mock_puts },
+        { "fpm_wputs", (void*) mock_wputs },
+        { "fpm_print_version", (void*) mock_print_version },
+        {},
+    };
+    char filename[] = { "hello" };
+    char *argv[] = { filename };
+    ASSERT_FALSE(fpm_invoke(&ctx, linkmap, 1, argv));
+
+    fpm_unload(&ctx);
+}
+#endif
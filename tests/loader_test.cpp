@@ -7,6 +7,8 @@
 #include <fpm/context.h>
 #include <fpm/elf.h>
 #include <sys/syscall.h>
+#include <sys/stat.h>
+#include <sys/time.h>
 
 TEST(loader, elf_binary)
 {
@@ -75,3 +77,65 @@ TEST(loader, run_puts)
 
     fpm_unload(&ctx);
 }
+
+TEST(loader, shared_library)
+{
+    fpm_context_t ctx{};
+    ASSERT_TRUE(fpm_load(&ctx, "uselib.exe"));
+    ASSERT_EQ(ctx.num_libs, 1u);
+
+    static fpm_binding_t linkmap[] = {
+        { "", NULL },
+        { "fpm_puts", (void*) mock_puts },
+        {},
+    };
+    char filename[] = { "uselib" };
+    char *argv[] = { filename };
+    puts_result.str("");
+
+    bool exec_status = fpm_invoke(&ctx, linkmap, 1, argv);
+
+#if __APPLE__ && __x86_64__
+    // Cannot set %gs register on MacOS.
+    ASSERT_FALSE(exec_status);
+#else
+    ASSERT_TRUE(exec_status);
+    ASSERT_EQ(ctx.exit_code, 42);
+    ASSERT_EQ(puts_result.str(), "Library message\r\n");
+#endif
+    fpm_unload(&ctx);
+
+    // Library stays resident and is shared by next program.
+    fpm_context_t ctx2{};
+    ASSERT_TRUE(fpm_load(&ctx2, "uselib.exe"));
+    ASSERT_EQ(ctx2.num_libs, 1u);
+    fpm_context_t ctx3{};
+    ASSERT_TRUE(fpm_load(&ctx3, "uselib.exe"));
+    ASSERT_EQ(ctx3.libs[0], ctx2.libs[0]);
+    fpm_unload(&ctx3);
+    fpm_unload(&ctx2);
+}
+
+TEST(loader, stale_library)
+{
+    fpm_context_t ctx{};
+    ASSERT_TRUE(fpm_load(&ctx, "uselib.exe"));
+    ASSERT_EQ(ctx.num_libs, 1u);
+    fpm_unload(&ctx);
+
+    // Pretend the library was rewritten.
+    struct stat sb;
+    ASSERT_EQ(stat("testlib.lib", &sb), 0);
+    struct timeval times[2] = { { sb.st_atime, 0 }, { sb.st_mtime + 10, 0 } };
+    ASSERT_EQ(utimes("testlib.lib", times), 0);
+
+    // Library is loaded again.
+    fpm_context_t ctx2{};
+    ASSERT_TRUE(fpm_load(&ctx2, "uselib.exe"));
+    ASSERT_EQ(ctx2.num_libs, 1u);
+    EXPECT_NE(ctx2.libs[0], ctx.libs[0]);
+
+    times[1].tv_sec = sb.st_mtime;
+    utimes("testlib.lib", times);
+    fpm_unload(&ctx2);
+}
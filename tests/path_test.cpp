@@ -0,0 +1,232 @@
+//
+// Test fpm_find_exe() - search path for external commands.
+//
+#include <gtest/gtest.h>
+#include <fpm/api.h>
+#include <fpm/fs.h>
+#include <fpm/diskio.h>
+#include <fpm/internal.h>
+#include "util.h"
+
+//
+// Find command, return path or empty string.
+//
+static std::string find_exe(const char *cmdname)
+{
+    char buf[FF_LFN_BUF + 1];
+    const char *path = fpm_find_exe(cmdname, buf, sizeof(buf));
+    return path ? path : "";
+}
+
+TEST(path, default_path)
+{
+    disk_setup();
+    fpm_setenv("PATH", nullptr);
+    create_directory("flash:/bin");
+    write_file("flash:/bin/prog.exe", "");
+    write_file("flash:/bin/script.cmd", "");
+    write_file("flash:/bin/data.txt", "");
+
+    EXPECT_EQ(find_exe("prog"), "flash:/bin/prog.exe");
+    EXPECT_EQ(find_exe("PROG"), "flash:/bin/prog.exe");
+    EXPECT_EQ(find_exe("script"), "flash:/bin/script.cmd");
+    EXPECT_EQ(find_exe("data"), "");
+    EXPECT_EQ(find_exe("pro"), "");
+    EXPECT_EQ(find_exe("none"), "");
+
+    // Names with path or extension are used as is.
+    EXPECT_EQ(find_exe("sd:/x/y"), "sd:/x/y");
+    EXPECT_EQ(find_exe("other.exe"), "other.exe");
+}
+
+TEST(path, current_directory_first)
+{
+    disk_setup();
+    fpm_setenv("PATH", nullptr);
+    create_directory("flash:/bin");
+    write_file("flash:/bin/prog.exe", "");
+    write_file("flash:/prog.cmd", "");
+    ASSERT_EQ(f_chdir("flash:/"), FR_OK);
+
+    EXPECT_EQ(find_exe("prog"), "prog.cmd");
+}
+
+TEST(path, search_order)
+{
+    disk_setup();
+    create_directory("flash:/bin");
+    create_directory("sd:/tools");
+    write_file("flash:/bin/both.exe", "");
+    write_file("sd:/tools/both.exe", "");
+    write_file("sd:/tools/mixed.cmd", "");
+    write_file("sd:/tools/mixed.exe", "");
+    write_file("flash:/bin/last.cmd", "");
+    ASSERT_TRUE(fpm_setenv("PATH", "sd:/missing;sd:/tools;;flash:/bin"));
+
+    EXPECT_EQ(find_exe("both"), "sd:/tools/both.exe");
+    EXPECT_EQ(find_exe("mixed"), "sd:/tools/mixed.exe");
+    EXPECT_EQ(find_exe("last"), "flash:/bin/last.cmd");
+
+    // New value of PATH is used at once.
+    ASSERT_TRUE(fpm_setenv("PATH", "flash:/bin"));
+    EXPECT_EQ(find_exe("both"), "flash:/bin/both.exe");
+    EXPECT_EQ(find_exe("mixed"), "");
+    fpm_setenv("PATH", nullptr);
+}
+
+TEST(path, directory_changes)
+{
+    disk_setup();
+    fpm_setenv("PATH", nullptr);
+    create_directory("flash:/bin");
+    EXPECT_EQ(find_exe("new"), "");
+
+    // Index is updated when files are created, renamed or removed.
+    uint32_t changes = f_dirchanges();
+    write_file("flash:/bin/new.exe", "");
+    EXPECT_NE(f_dirchanges(), changes);
+    EXPECT_EQ(find_exe("new"), "flash:/bin/new.exe");
+
+    ASSERT_EQ(f_rename("flash:/bin/new.exe", "flash:/bin/newer.exe"), FR_OK);
+    EXPECT_EQ(find_exe("new"), "");
+    EXPECT_EQ(find_exe("newer"), "flash:/bin/newer.exe");
+
+    ASSERT_EQ(f_unlink("flash:/bin/newer.exe"), FR_OK);
+    EXPECT_EQ(find_exe("newer"), "");
+}
+
+TEST(path, changes_per_directory)
+{
+    disk_setup();
+    create_directory("flash:/bin");
+    auto dir = (directory_t*) alloca(f_sizeof_directory_t());
+    ASSERT_EQ(f_opendir(dir, "flash:/bin"), FR_OK);
+    fs_dirid_t id;
+    f_dirid(dir, &id);
+    f_closedir(dir);
+
+    // Files in other directories don't matter.
+    uint32_t since = f_dirchanges();
+    write_file("flash:/other.txt", "");
+    write_file("sd:/other.txt", "");
+    EXPECT_FALSE(f_dirchanged(&id, since));
+    EXPECT_FALSE(f_dirchanged(nullptr, since));
+
+    write_file("flash:/bin/new.exe", "");
+    EXPECT_TRUE(f_dirchanged(&id, since));
+    EXPECT_FALSE(f_dirchanged(nullptr, since));
+
+    // New directory could be in PATH.
+    since = f_dirchanges();
+    create_directory("sd:/tools");
+    EXPECT_TRUE(f_dirchanged(&id, since));
+    EXPECT_TRUE(f_dirchanged(nullptr, since));
+
+    // Too many changes to tell.
+    since = f_dirchanges();
+    for (unsigned i = 0; i < 20; i++) {
+        write_file(("flash:/file" + std::to_string(i)).c_str(), "");
+    }
+    EXPECT_TRUE(f_dirchanged(&id, since));
+}
+
+TEST(path, missing_directory_created)
+{
+    disk_setup();
+    ASSERT_TRUE(fpm_setenv("PATH", "sd:/tools;flash:/bin"));
+    create_directory("flash:/bin");
+    EXPECT_EQ(find_exe("tool"), "");
+
+    create_directory("sd:/tools");
+    write_file("sd:/tools/tool.exe", "");
+    EXPECT_EQ(find_exe("tool"), "sd:/tools/tool.exe");
+    fpm_setenv("PATH", nullptr);
+}
+
+TEST(path, index_overflow)
+{
+    disk_setup();
+    fpm_setenv("PATH", nullptr);
+    create_directory("flash:/bin");
+
+    // More names than fit into the index.
+    for (unsigned i = 0; i < 40; i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "flash:/bin/program-with-long-name-%02u.exe", i);
+        write_file(name, "");
+    }
+    EXPECT_EQ(find_exe("program-with-long-name-00"), "flash:/bin/program-with-long-name-00.exe");
+    EXPECT_EQ(find_exe("program-with-long-name-39"), "flash:/bin/program-with-long-name-39.exe");
+    EXPECT_EQ(find_exe("program-with-long-name-40"), "");
+}
+
+TEST(path, overflow_keeps_order)
+{
+    disk_setup();
+    create_directory("sd:/big");
+    create_directory("flash:/bin");
+
+    // First directory doesn't fit into the index, while the second one
+    // would. Copy of the program in the first directory must still win.
+    for (unsigned i = 0; i < 28; i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "sd:/big/program-with-long-name-%02u.exe", i);
+        write_file(name, "");
+    }
+    write_file(("sd:/big/" + std::string(200, 'x') + ".exe").c_str(), "");
+    write_file("sd:/big/tool.exe", "");
+    write_file("flash:/bin/tool.exe", "");
+    write_file("flash:/bin/other.exe", "");
+    ASSERT_TRUE(fpm_setenv("PATH", "flash:/bin;sd:/big"));
+    EXPECT_EQ(find_exe("tool"), "flash:/bin/tool.exe");
+
+    ASSERT_TRUE(fpm_setenv("PATH", "sd:/big;flash:/bin"));
+    EXPECT_EQ(find_exe("tool"), "sd:/big/tool.exe");
+    EXPECT_EQ(find_exe("other"), "flash:/bin/other.exe");
+    EXPECT_EQ(find_exe("none"), "");
+    fpm_setenv("PATH", nullptr);
+}
+
+TEST(path, current_directory_changes)
+{
+    disk_setup();
+    fpm_setenv("PATH", nullptr);
+    create_directory("flash:/bin");
+    create_directory("flash:/work");
+    ASSERT_EQ(f_chdir("flash:/work"), FR_OK);
+    fpm_path_index();
+    EXPECT_EQ(find_exe("local"), "");
+
+    // Names in the current directory are collected again when it's changed.
+    write_file("flash:/work/local.cmd", "");
+    EXPECT_EQ(find_exe("local"), "local.cmd");
+    write_file("flash:/work/local.exe", "");
+    EXPECT_EQ(find_exe("local"), "local.exe");
+
+    // Another current directory.
+    ASSERT_EQ(f_chdir("flash:/"), FR_OK);
+    EXPECT_EQ(find_exe("local"), "");
+    ASSERT_EQ(f_chdrive("sd:"), FR_OK);
+    EXPECT_EQ(find_exe("local"), "");
+    write_file("sd:/local.exe", "");
+    EXPECT_EQ(find_exe("local"), "local.exe");
+    ASSERT_EQ(f_chdrive("flash:"), FR_OK);
+    ASSERT_EQ(f_chdir("flash:/work"), FR_OK);
+    ASSERT_EQ(f_unlink("flash:/work/local.exe"), FR_OK);
+    EXPECT_EQ(find_exe("local"), "local.cmd");
+}
+
+TEST(path, current_directory_overflow)
+{
+    disk_setup();
+    fpm_setenv("PATH", nullptr);
+    create_directory("flash:/work");
+    ASSERT_EQ(f_chdir("flash:/work"), FR_OK);
+    for (unsigned i = 0; i < 40; i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "program-with-long-name-%02u.exe", i);
+        write_file(name, "");
+    }
+    EXPECT_EQ(find_exe("program-with-long-name-39"), "program-with-long-name-39.exe");
+    EXPECT_EQ(find_exe("program-with-long-name-40"), "");
+}
@@ -0,0 +1,302 @@
+//
+// Test redirections and pipes.
+//
+#include <gtest/gtest.h>
+#include <fpm/api.h>
+#include <fpm/fs.h>
+#include <fpm/diskio.h>
+#include <fpm/internal.h>
+#include <csetjmp>
+#include "util.h"
+
+static std::string console; // Output not redirected
+static jmp_buf interrupt_point; // Like ^C in the shell
+
+//
+// Heap for buffers, empty console.
+//
+static void redirect_setup()
+{
+    heap_setup();
+    console.clear();
+}
+
+//
+// Console output, like in fpm_write.c.
+//
+void fpm_write(const char *buf, unsigned len)
+{
+    if (!fpm_redirect_write(buf, len)) {
+        console.append(buf, len);
+    }
+}
+
+void fpm_flush()
+{
+}
+
+//
+// Console input, like in platform driver.
+//
+char fpm_getchar()
+{
+    char ch;
+    int count = fpm_redirect_read(&ch, 1);
+    if (count < 0) {
+        throw std::runtime_error("No input in fpm_getchar()");
+    }
+    return (count > 0) ? ch : '\4';
+}
+
+int fpm_snprintf(char *str, size_t size, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int retval = vsnprintf(str, size, format, args);
+    va_end(args);
+    return retval;
+}
+
+int fpm_printf(const char *format, ...)
+{
+    char buf[200];
+    va_list args;
+    va_start(args, format);
+    int retval = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    fpm_write(buf, strlen(buf));
+    return retval;
+}
+
+unsigned fpm_core_num()
+{
+    return 0;
+}
+
+//
+// Split the line and execute it.
+//
+static void run(const char *line)
+{
+    char buffer[200];
+    char *argv[64];
+    uint8_t flags[64];
+    int argc = 0;
+
+    strncpy(buffer, line, sizeof(buffer));
+    const char *error = fpm_tokenize_shell(argv, &argc, buffer, flags);
+    ASSERT_EQ(error, nullptr);
+    fpm_exec_line(argc, argv, flags);
+}
+
+//
+// Instead of real commands:
+//  - echo prints arguments;
+//  - upper copies input to output in upper case;
+//  - fill prints given number of bytes in small pieces;
+//  - nested runs redirected command from inside;
+//  - interrupted runs redirected command, which is interrupted by ^C.
+//
+void fpm_exec(int argc, char *argv[])
+{
+    EXPECT_EQ(argv[argc], nullptr);
+    fpm_exit_code = 0;
+    if (strcmp(argv[0], "echo") == 0) {
+        for (int i = 1; i < argc; i++) {
+            if (i > 1) {
+                fpm_putchar(' ');
+            }
+            fpm_puts(argv[i]);
+        }
+        fpm_puts("\r\n");
+    } else if (strcmp(argv[0], "upper") == 0) {
+        for (;;) {
+            char ch = fpm_getchar();
+            if (ch == '\4') {
+                break;
+            }
+            if (ch == '\r') {
+                fpm_puts("\r\n");
+            } else {
+                fpm_putchar(toupper(ch));
+            }
+        }
+    } else if (strcmp(argv[0], "fill") == 0 && argc == 2) {
+        char piece[100];
+        for (int n = atoi(argv[1]); n > 0; n -= sizeof(piece)) {
+            memset(piece, 'a' + n % 26, sizeof(piece));
+            fpm_write(piece, (n < (int)sizeof(piece)) ? n : sizeof(piece));
+        }
+    } else if (strcmp(argv[0], "nested") == 0) {
+        run("echo inner > flash:/inner.txt");
+        fpm_puts("outer\r\n");
+    } else if (strcmp(argv[0], "interrupted") == 0) {
+        run("interrupt < flash:/in.txt > flash:/inner.txt");
+    } else if (strcmp(argv[0], "interrupt") == 0) {
+        longjmp(interrupt_point, 1);
+    } else {
+        fpm_exit_code = 1;
+    }
+}
+
+void fpm_putchar(char ch)
+{
+    fpm_write(&ch, 1);
+}
+
+int fpm_exit_code;
+
+//
+// Does the file exist?
+//
+static bool exists(const char *path)
+{
+    file_info_t info;
+    return f_stat(path, &info) == FR_OK;
+}
+
+TEST(redirect, output)
+{
+    disk_setup();
+    redirect_setup();
+    run("echo hello>flash:/out.txt");
+    read_file("flash:/out.txt", "hello\r\n");
+
+    run("echo 'world > and | all' >> flash:/out.txt");
+    read_file("flash:/out.txt", "hello\r\nworld > and | all\r\n");
+
+    // File is replaced.
+    run("echo bye > flash:/out.txt");
+    read_file("flash:/out.txt", "bye\r\n");
+    EXPECT_EQ(console, "");
+}
+
+TEST(redirect, input)
+{
+    disk_setup();
+    redirect_setup();
+    write_file("flash:/in.txt", "abc\ndef\r\n\nx");
+    run("upper < flash:/in.txt");
+    EXPECT_EQ(console, "ABC\r\nDEF\r\n\r\nX");
+}
+
+TEST(redirect, pipe)
+{
+    disk_setup();
+    redirect_setup();
+    size_t heap_free = fpm_heap_available();
+
+    run("echo one two | upper | upper > flash:/result.txt");
+    read_file("flash:/result.txt", "ONE TWO\r\n");
+    run("echo three|upper");
+    EXPECT_EQ(console, "THREE\r\n");
+
+    // Temporary files are removed, memory is released.
+    EXPECT_FALSE(exists("flash:/pipe0.tmp"));
+    EXPECT_FALSE(exists("flash:/pipe1.tmp"));
+    EXPECT_EQ(fpm_heap_available(), heap_free);
+
+    // Directory for temporary files.
+    ASSERT_TRUE(fpm_setenv("TEMP", "sd:"));
+    console.clear();
+    run("echo four | upper");
+    fpm_setenv("TEMP", nullptr);
+    EXPECT_EQ(console, "FOUR\r\n");
+    EXPECT_FALSE(exists("sd:/pipe0.tmp"));
+}
+
+TEST(redirect, large_output)
+{
+    disk_setup();
+    redirect_setup();
+    run("fill 20000 > sd:/large.txt");
+
+    file_info_t info;
+    ASSERT_EQ(f_stat("sd:/large.txt", &info), FR_OK);
+    EXPECT_EQ(info.fsize, 20000u);
+    EXPECT_EQ(console, "");
+}
+
+TEST(redirect, nested)
+{
+    disk_setup();
+    redirect_setup();
+    run("nested > flash:/outer.txt");
+    read_file("flash:/inner.txt", "inner\r\n");
+    read_file("flash:/outer.txt", "outer\r\n");
+    EXPECT_EQ(console, "");
+}
+
+TEST(redirect, interrupted)
+{
+    disk_setup();
+    redirect_setup();
+    write_file("flash:/in.txt", "abc");
+    size_t heap_free = fpm_heap_available();
+
+    if (setjmp(interrupt_point) == 0) {
+        run("interrupted > flash:/outer.txt");
+        FAIL() << "Not interrupted";
+    }
+    fpm_redirect_reset();
+
+    // Files of all levels are closed, memory is released.
+    EXPECT_EQ(fpm_heap_available(), heap_free);
+    EXPECT_EQ(f_unlink("flash:/outer.txt"), FR_OK);
+    EXPECT_EQ(f_unlink("flash:/inner.txt"), FR_OK);
+    EXPECT_EQ(f_unlink("flash:/in.txt"), FR_OK);
+    run("echo hello");
+    EXPECT_EQ(console, "hello\r\n");
+}
+
+TEST(redirect, wildcards)
+{
+    disk_setup();
+    redirect_setup();
+    write_file("flash:/a.txt", "");
+    write_file("flash:/b.txt", "");
+    write_file("flash:/echo", "");
+
+    run("echo *.txt");
+    EXPECT_EQ(console, "a.txt b.txt\r\n");
+
+    // Command name is not expanded.
+    console.clear();
+    run("ech? *.txt");
+    EXPECT_EQ(console, "");
+    EXPECT_EQ(fpm_exit_code, 1);
+}
+
+TEST(redirect, errors)
+{
+    disk_setup();
+    redirect_setup();
+
+    run("echo x >");
+    EXPECT_EQ(console, ">: Missing file name\r\n\n");
+    EXPECT_EQ(fpm_exit_code, 1);
+
+    console.clear();
+    run("> flash:/a.txt");
+    EXPECT_EQ(console, "Missing command\r\n\n");
+
+    console.clear();
+    run("echo x > flash:/a.txt > flash:/b.txt");
+    EXPECT_EQ(console, "Ambiguous output redirect\r\n\n");
+
+    console.clear();
+    run("echo x | upper < flash:/a.txt");
+    EXPECT_EQ(console, "Ambiguous input redirect\r\n\n");
+    EXPECT_FALSE(exists("flash:/pipe0.tmp"));
+
+    console.clear();
+    run("echo x > flash:/a.txt &");
+    EXPECT_EQ(console, "Cannot redirect background program\r\n\n");
+    EXPECT_FALSE(exists("flash:/a.txt"));
+
+    // Command is not executed without input.
+    console.clear();
+    run("echo x < flash:/none.txt");
+    EXPECT_EQ(console, std::string("flash:/none.txt: ") + f_strerror(FR_NO_FILE) + "\r\n\n");
+    EXPECT_EQ(fpm_exit_code, 1);
+}
@@ -0,0 +1,254 @@
+//
+// Test batch scripts.
+//
+#include <gtest/gtest.h>
+#include <fpm/api.h>
+#include <fpm/fs.h>
+#include <fpm/diskio.h>
+#include <fpm/internal.h>
+#include "util.h"
+
+//
+// Commands executed by the script.
+//
+static std::vector<std::string> executed;
+
+//
+// Heap for compiled scripts, no scripts running.
+//
+static void script_setup()
+{
+    fpm_script_reset();
+    heap_setup();
+    executed.clear();
+}
+
+//
+// Instead of real commands: remember the command line.
+// Command 'fail N' sets exit code, scripts are run.
+//
+void fpm_exec(int argc, char *argv[])
+{
+    std::string line;
+    for (int i = 0; i < argc; i++) {
+        if (i > 0) {
+            line += ' ';
+        }
+        line += argv[i];
+    }
+    EXPECT_EQ(argv[argc], nullptr);
+    executed.push_back(line);
+
+    unsigned len = strlen(argv[0]);
+    if (len > 4 && strcmp(argv[0] + len - 4, ".cmd") == 0) {
+        fpm_script_run(argv[0], argc, argv);
+    } else if (strcmp(argv[0], "fail") == 0 && argc == 2) {
+        fpm_exit_code = atoi(argv[1]);
+    } else {
+        fpm_exit_code = 0;
+    }
+}
+
+int fpm_exit_code;
+
+//
+// Run the script with arguments.
+//
+static void run_script(const char *path, std::vector<const char *> args = {})
+{
+    args.insert(args.begin(), path);
+    args.push_back(nullptr);
+    fpm_script_run(path, args.size() - 1, (char **)args.data());
+}
+
+TEST(script, commands)
+{
+    disk_setup();
+    script_setup();
+    write_file("flash:/test.cmd", "echo one\r\n"
+                                  "   rem Comment\r\n"
+                                  "# Another comment\n"
+                                  ":: One more\n"
+                                  "\n"
+                                  "  echo 'two  three'   four  \n"
+                                  "echo last");
+    run_script("flash:/test.cmd");
+
+    const std::vector<std::string> expect = { "echo one", "echo two  three four", "echo last" };
+    EXPECT_EQ(executed, expect);
+}
+
+TEST(script, arguments_loop)
+{
+    disk_setup();
+    script_setup();
+    write_file("flash:/loop.cmd", ":loop\n"
+                                  "if \"%1\"==\"\" goto end\n"
+                                  "echo %1\n"
+                                  "shift\n"
+                                  "goto loop\n"
+                                  ":end\n"
+                                  "echo done %0\n");
+    run_script("flash:/loop.cmd", { "a", "b c", "d" });
+
+    const std::vector<std::string> expect = { "echo a", "echo b c", "echo d", "echo done d" };
+    EXPECT_EQ(executed, expect);
+}
+
+TEST(script, variables)
+{
+    disk_setup();
+    script_setup();
+    ASSERT_TRUE(fpm_setenv("Name", "World"));
+    write_file("flash:/vars.cmd", "echo Hello, %NAME%! 100%%\n"
+                                  "echo [%undefined%] 50% off\n");
+    run_script("flash:/vars.cmd");
+    fpm_setenv("Name", nullptr);
+    EXPECT_EQ(fpm_getenv("name"), nullptr);
+
+    const std::vector<std::string> expect = { "echo Hello, World! 100%", "echo [] 50% off" };
+    EXPECT_EQ(executed, expect);
+}
+
+TEST(script, variable_no_space)
+{
+    std::string small(900, 'a'), large(1000, 'b'), huge(2000, 'c');
+    ASSERT_TRUE(fpm_setenv("Big", small.c_str()));
+
+    // Space of the old value is reused.
+    ASSERT_TRUE(fpm_setenv("Big", large.c_str()));
+    EXPECT_EQ(fpm_getenv("big"), large);
+
+    // Old value is kept when the new one does not fit.
+    EXPECT_FALSE(fpm_setenv("Big", huge.c_str()));
+    EXPECT_EQ(fpm_getenv("big"), large);
+    fpm_setenv("Big", nullptr);
+    EXPECT_EQ(fpm_getenv("big"), nullptr);
+}
+
+TEST(script, errorlevel)
+{
+    disk_setup();
+    script_setup();
+    write_file("flash:/err.cmd", "fail 3\n"
+                                 "echo code %errorlevel%\n"
+                                 "fail 3\n"
+                                 "if errorlevel 4 echo four\n"
+                                 "if errorlevel 3 echo three\n"
+                                 "if not errorlevel 1 echo success\n");
+    run_script("flash:/err.cmd");
+
+    const std::vector<std::string> expect = { "fail 3", "echo code 3", "fail 3", "echo three",
+                                              "echo success" };
+    EXPECT_EQ(executed, expect);
+}
+
+TEST(script, exist)
+{
+    disk_setup();
+    script_setup();
+    write_file("flash:/data.log", "x");
+    write_file("flash:/exist.cmd", "if exist flash:/data.log echo file\n"
+                                   "if exist flash:/*.log echo pattern\n"
+                                   "if exist flash:/*.txt echo wrong\n"
+                                   "if not exist flash:/none echo none\n");
+    run_script("flash:/exist.cmd");
+
+    const std::vector<std::string> expect = { "echo file", "echo pattern", "echo none" };
+    EXPECT_EQ(executed, expect);
+}
+
+TEST(script, for_loop)
+{
+    disk_setup();
+    script_setup();
+    write_file("flash:/b.txt", "b");
+    write_file("flash:/a.txt", "a");
+    write_file("flash:/for.cmd", "for %%f in (flash:/*.txt last) do echo file %%f\n"
+                                 "for %%n in ( 1 2 ) do if %%n==2 echo two\n");
+    run_script("flash:/for.cmd");
+
+    const std::vector<std::string> expect = { "echo file flash:/a.txt", "echo file flash:/b.txt",
+                                              "echo file last", "echo two" };
+    EXPECT_EQ(executed, expect);
+}
+
+TEST(script, wildcards)
+{
+    disk_setup();
+    script_setup();
+    write_file("flash:/x1.dat", "1");
+    write_file("flash:/x2.dat", "2");
+    write_file("flash:/glob.cmd", "rm flash:/x*.dat\n"
+                                  "rm 'flash:/x*.dat'\n");
+    run_script("flash:/glob.cmd");
+
+    const std::vector<std::string> expect = { "rm flash:/x1.dat flash:/x2.dat", "rm flash:/x*.dat" };
+    EXPECT_EQ(executed, expect);
+}
+
+TEST(script, nested_exit)
+{
+    disk_setup();
+    script_setup();
+    write_file("flash:/sub.cmd", "echo sub %1\n"
+                                 "exit 5\n"
+                                 "echo never\n");
+    write_file("flash:/main.cmd", "flash:/sub.cmd arg\n"
+                                  "if errorlevel 5 echo five\n"
+                                  "flash:/sub.cmd again\n");
+    run_script("flash:/main.cmd");
+
+    const std::vector<std::string> expect = { "flash:/sub.cmd arg", "echo sub arg", "echo five",
+                                              "flash:/sub.cmd again", "echo sub again" };
+    EXPECT_EQ(executed, expect);
+    EXPECT_EQ(fpm_exit_code, 5);
+}
+
+TEST(script, errors)
+{
+    disk_setup();
+    script_setup();
+
+    // Nothing runs when the script cannot be compiled.
+    write_file("flash:/bad.cmd", "echo before\n"
+                                 "echo 'unterminated\n");
+    run_script("flash:/bad.cmd");
+    EXPECT_TRUE(executed.empty());
+    EXPECT_EQ(fpm_exit_code, 1);
+
+    // Script stops at unknown label.
+    write_file("flash:/label.cmd", "echo before\n"
+                                   "goto nowhere\n"
+                                   "echo after\n");
+    run_script("flash:/label.cmd");
+    const std::vector<std::string> expect = { "echo before" };
+    EXPECT_EQ(executed, expect);
+
+    // Missing file.
+    executed.clear();
+    run_script("flash:/missing.cmd");
+    EXPECT_TRUE(executed.empty());
+    EXPECT_EQ(fpm_exit_code, 1);
+}
+
+TEST(script, cache)
+{
+    disk_setup();
+    script_setup();
+    size_t heap_free = fpm_heap_available();
+
+    write_file("flash:/cached.cmd", "echo first\n");
+    run_script("flash:/cached.cmd");
+    run_script("flash:/cached.cmd");
+
+    // Modified file is compiled again.
+    write_file("flash:/cached.cmd", "echo second\n");
+    run_script("flash:/cached.cmd");
+
+    const std::vector<std::string> expect = { "echo first", "echo first", "echo second" };
+    EXPECT_EQ(executed, expect);
+
+    // Only the last script is kept.
+    EXPECT_LT(heap_free - fpm_heap_available(), 256u);
+}
@@ -0,0 +1,143 @@
+//
+// Test sum/crc32/sha256 command.
+//
+#include <gtest/gtest.h>
+#include <fpm/api.h>
+#include <fpm/fs.h>
+#include <fpm/diskio.h>
+#include <fpm/internal.h>
+#include "util.h"
+
+//
+// No background worker: jobs are executed immediately.
+//
+bool fpm_jobs_active_arch()
+{
+    return false;
+}
+
+void fpm_jobs_wakeup_arch()
+{
+}
+
+void fpm_jobs_idle_arch()
+{
+}
+
+//
+// No hardware: compute in software.
+//
+bool fpm_crc32_arch(uint32_t *crc, const void *buf, unsigned len)
+{
+    return false;
+}
+
+bool fpm_crc16_arch(uint16_t *crc, const void *buf, unsigned len)
+{
+    return false;
+}
+
+class sum : public ::testing::Test {
+protected:
+    void SetUp() override
+    {
+        disk_setup();
+        heap_setup();
+    }
+
+    //
+    // Run the command and return the output.
+    //
+    std::string run(std::vector<const char *> args)
+    {
+        int argc = args.size();
+        args.push_back(nullptr);
+        testing::internal::CaptureStdout();
+        fpm_cmd_sum(argc, (char **)args.data());
+        return testing::internal::GetCapturedStdout();
+    }
+
+    //
+    // Create file with binary contents.
+    //
+    void write_data(const char *path, const std::vector<uint8_t> &data)
+    {
+        file_t *file = (file_t *)alloca(f_sizeof_file_t());
+        ASSERT_EQ(f_open(file, path, FA_WRITE | FA_CREATE_ALWAYS), FR_OK);
+        unsigned nbytes;
+        ASSERT_EQ(f_write(file, data.data(), data.size(), &nbytes), FR_OK);
+        ASSERT_EQ(nbytes, data.size());
+        ASSERT_EQ(f_close(file), FR_OK);
+    }
+};
+
+//
+// Data which differs in every chunk.
+//
+static std::vector<uint8_t> make_data(unsigned len)
+{
+    std::vector<uint8_t> data(len);
+    for (unsigned i = 0; i < len; i++) {
+        data[i] = i * 31 + 7;
+    }
+    return data;
+}
+
+TEST_F(sum, crc32)
+{
+    write_file("flash:/hello.txt", "Hello, world!\n");
+    write_file("flash:/empty.txt", "");
+
+    EXPECT_EQ(run({ "sum", "flash:/hello.txt", "flash:/empty.txt" }),
+              "7b55a718  flash:/hello.txt\r\n"
+              "00000000  flash:/empty.txt\r\n"
+              "\r\n");
+    EXPECT_EQ(run({ "crc32", "flash:/hello.txt" }), "7b55a718  flash:/hello.txt\r\n\r\n");
+}
+
+TEST_F(sum, large_files)
+{
+    write_data("sd:/data.bin", make_data(100000));
+    write_data("sd:/zero.bin", std::vector<uint8_t>(65536));
+
+    EXPECT_EQ(run({ "sum", "sd:/data.bin", "sd:/zero.bin" }),
+              "92858800  sd:/data.bin\r\n"
+              "d7978eeb  sd:/zero.bin\r\n"
+              "\r\n");
+    EXPECT_EQ(run({ "sha256", "sd:/data.bin" }),
+              "731620161155f68e1209f22bc34a726bf5a583f40acf23ae55684b674fdbebf2  sd:/data.bin\r\n\r\n");
+    EXPECT_EQ(run({ "sum", "-a", "sha256", "sd:/data.bin" }),
+              "731620161155f68e1209f22bc34a726bf5a583f40acf23ae55684b674fdbebf2  sd:/data.bin\r\n\r\n");
+
+    // Small chunks give the same result.
+    heap_setup(2048);
+    EXPECT_EQ(run({ "sum", "sd:/data.bin" }), "92858800  sd:/data.bin\r\n\r\n");
+}
+
+TEST_F(sum, recursive)
+{
+    create_directory("flash:/d");
+    create_directory("flash:/d/sub");
+    write_file("flash:/d/a.txt", "Hello, world!\n");
+    write_file("flash:/d/sub/b.txt", "");
+
+    EXPECT_EQ(run({ "sum", "flash:/d" }), "flash:/d: Is a directory, use -r\r\n\r\n");
+    EXPECT_EQ(run({ "sum", "-r", "flash:/d" }),
+              "00000000  flash:/d/sub/b.txt\r\n"
+              "7b55a718  flash:/d/a.txt\r\n"
+              "\r\n");
+
+    // Root directory.
+    write_file("sd:/c.txt", "Hello, world!\n");
+    EXPECT_EQ(run({ "sum", "-r", "sd:" }), "7b55a718  sd:/c.txt\r\n\r\n");
+}
+
+TEST_F(sum, errors)
+{
+    EXPECT_EQ(run({ "sum", "flash:/missing" }),
+              std::string("flash:/missing: ") + f_strerror(FR_NO_FILE) + "\r\n\r\n");
+    EXPECT_EQ(run({ "sum", "-a", "md5", "x" }), "sum: Unknown algorithm `md5`\r\n\n");
+
+    heap_setup(512);
+    EXPECT_EQ(run({ "sum", "flash:/missing" }), "Out of memory\r\n\n");
+}
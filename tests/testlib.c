@@ -0,0 +1,18 @@
+//
+// Shared library with two exported routines,
+// one of them calling another.
+//
+int lib_add(int a, int b)
+{
+    return a + b;
+}
+
+int lib_twice(int a)
+{
+    return lib_add(a, a);
+}
+
+const char *lib_message()
+{
+    return "Library message\r\n";
+}
@@ -3,6 +3,7 @@
 //
 #include <gtest/gtest.h>
 #include <fpm/api.h>
+#include <fpm/internal.h>
 
 static void tokenize_test(const char *input, int expect_argc, const char *expect_argv[], const char *expect_error)
 {
@@ -188,3 +189,60 @@ TEST(tokenize, masked_quote)
     const char *expect_argv[] = { "fo\"o", "bar\"", };
     tokenize_test("fo\\\"o bar\\\"", 2, expect_argv, 0);
 }
+
+//
+// Unquoted '*' and '?' mark the argument as wildcard pattern.
+//
+TEST(tokenize, wildcards)
+{
+    char buffer[100];
+    char *argv[32];
+    uint8_t flags[32];
+    int argc = 0;
+
+    strncpy(buffer, "ls *.log a?c '*' \"x?\" \\* data/2026-* plain", sizeof(buffer));
+    const char *error = fpm_tokenize_shell(argv, &argc, buffer, flags);
+    ASSERT_EQ(error, nullptr);
+    ASSERT_EQ(argc, 8);
+
+    const char *expect_argv[] = { "ls", "*.log", "a?c", "*", "x?", "*", "data/2026-*", "plain" };
+    const uint8_t expect_flags[] = { 0, FPM_ARG_WILD, FPM_ARG_WILD, 0, 0, 0, FPM_ARG_WILD, 0 };
+    for (int i = 0; i < argc; i++) {
+        EXPECT_STREQ(argv[i], expect_argv[i]);
+        EXPECT_EQ(flags[i], expect_flags[i]) << "argument " << i;
+    }
+}
+
+//
+// Unquoted '<', '>', '>>' and '|' are separate arguments, even when glued.
+//
+TEST(tokenize, redirections)
+{
+    char buffer[100];
+    char *argv[32];
+    uint8_t flags[32];
+    int argc = 0;
+
+    strncpy(buffer, "dir -l>log|sort <in >> 'a>b' \\| \"c|d\" *.x>>y", sizeof(buffer));
+    const char *error = fpm_tokenize_shell(argv, &argc, buffer, flags);
+    ASSERT_EQ(error, nullptr);
+    ASSERT_EQ(argc, 15);
+
+    const char *expect_argv[] = { "dir", "-l",  ">", "log", "|",   "sort", "<", "in",
+                                  ">>",  "a>b", "|", "c|d", "*.x", ">>",   "y" };
+    const uint8_t R = FPM_ARG_REDIRECT;
+    const uint8_t expect_flags[] = { 0, 0, R, 0, R, 0, R, 0, R, 0, 0, 0, FPM_ARG_WILD, R, 0 };
+    for (int i = 0; i < argc; i++) {
+        EXPECT_STREQ(argv[i], expect_argv[i]) << "argument " << i;
+        EXPECT_EQ(flags[i], expect_flags[i]) << "argument " << i;
+    }
+    EXPECT_EQ(argv[argc], nullptr);
+
+    // Without flags, operators are ordinary symbols.
+    strncpy(buffer, "echo a>b | c", sizeof(buffer));
+    error = fpm_tokenize(argv, &argc, buffer);
+    ASSERT_EQ(error, nullptr);
+    ASSERT_EQ(argc, 4);
+    EXPECT_STREQ(argv[1], "a>b");
+    EXPECT_STREQ(argv[2], "|");
+}
@@ -0,0 +1,14 @@
+//
+// Invoke routines from shared library testlib.lib
+// and from FP/M.
+//
+#include <fpm/api.h>
+
+int lib_twice(int a);
+const char *lib_message(void);
+
+int main()
+{
+    fpm_puts(lib_message());
+    return lib_twice(21);
+}
@@ -29,3 +29,9 @@ void create_directory(const char *dirname);
 // Make sure directory exists.
 //
 void check_directory(const char *dirname);
+
+//
+// Initialize heap for commands, limited to given size.
+//
+#define HEAP_SIZE (64 * 1024)
+void heap_setup(unsigned nbytes = HEAP_SIZE);
@@ -0,0 +1,151 @@
+//
+// Test buffered console output: fpm_write() and fpm_flush().
+//
+#include <gtest/gtest.h>
+#include <fpm/api.h>
+#include <fpm/internal.h>
+
+static std::string console;     // Data passed to the console driver
+static unsigned num_writes;     // Number of driver calls
+static uint64_t time_usec;      // Simulated time
+static bool timer_in_driver;    // Simulate timer interrupt in the driver
+
+void fpm_write_arch(const char *buf, unsigned len)
+{
+    console.append(buf, len);
+    num_writes++;
+    if (timer_in_driver) {
+        fpm_flush_idle();
+    }
+}
+
+uint64_t fpm_time_usec()
+{
+    return time_usec;
+}
+
+bool fpm_background_write(const char *buf, unsigned len)
+{
+    return false;
+}
+
+bool fpm_redirect_write(const char *buf, unsigned len)
+{
+    return false;
+}
+
+unsigned fpm_core_num()
+{
+    return 0;
+}
+
+//
+// Flush leftovers from previous test, and clear the console.
+//
+static void console_reset()
+{
+    fpm_flush();
+    console.clear();
+    num_writes = 0;
+}
+
+TEST(write, flush)
+{
+    console_reset();
+
+    // Small writes are collected in the buffer.
+    for (char ch = 'a'; ch <= 'z'; ch++) {
+        fpm_write(&ch, 1);
+    }
+    EXPECT_EQ(console, "");
+    EXPECT_EQ(num_writes, 0u);
+
+    // And sent to the console at once.
+    fpm_flush();
+    EXPECT_EQ(console, "abcdefghijklmnopqrstuvwxyz");
+    EXPECT_EQ(num_writes, 1u);
+
+    // Nothing to flush.
+    fpm_flush();
+    EXPECT_EQ(num_writes, 1u);
+}
+
+TEST(write, buffer_full)
+{
+    console_reset();
+
+    // Write much more than the buffer can hold.
+    std::string expect;
+    for (unsigned i = 0; i < 1000; i++) {
+        std::string line = "Line " + std::to_string(i) + "\r\n";
+        fpm_write(line.data(), line.size());
+        expect += line;
+    }
+    fpm_flush();
+    EXPECT_EQ(console, expect);
+    EXPECT_LT(num_writes, 50u);
+}
+
+TEST(write, large_block)
+{
+    console_reset();
+
+    // Block larger than the buffer goes directly, after pending data.
+    std::string block(2000, 'x');
+    fpm_write("abc", 3);
+    fpm_write(block.data(), block.size());
+    EXPECT_EQ(console, "abc" + block);
+    EXPECT_EQ(num_writes, 2u);
+}
+
+TEST(write, timeout)
+{
+    console_reset();
+
+    // Data are kept while fresh.
+    fpm_write("abc", 3);
+    time_usec += 1000;
+    fpm_write("def", 3);
+    EXPECT_EQ(console, "");
+
+    // Old data are flushed on next write.
+    time_usec += 100000;
+    fpm_write("ghi", 3);
+    EXPECT_EQ(console, "abcdefghi");
+}
+
+TEST(write, idle_flush)
+{
+    console_reset();
+
+    // Fresh data stay in the buffer.
+    fpm_write("abc", 3);
+    time_usec += 1000;
+    fpm_flush_idle();
+    EXPECT_EQ(console, "");
+
+    // Timer sends stale data, with no more writes.
+    time_usec += 100000;
+    fpm_flush_idle();
+    EXPECT_EQ(console, "abc");
+    EXPECT_EQ(num_writes, 1u);
+
+    // Nothing to flush.
+    time_usec += 100000;
+    fpm_flush_idle();
+    EXPECT_EQ(num_writes, 1u);
+}
+
+TEST(write, idle_flush_while_busy)
+{
+    console_reset();
+
+    // Timer fires while the buffer is being written to the driver.
+    fpm_write("abc", 3);
+    time_usec += 100000;
+    timer_in_driver = true;
+    fpm_flush();
+    timer_in_driver = false;
+    EXPECT_EQ(console, "abc");
+    EXPECT_EQ(num_writes, 1u);
+}
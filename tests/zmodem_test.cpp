@@ -23,6 +23,7 @@
 // SOFTWARE.
 //
 #include <gtest/gtest.h>
+#include <fpm/internal.h>
 #include "zmodem.h"
 
 #define RECV_LEN 1024
@@ -46,34 +47,62 @@ uint16_t set_buf(const char *buf, int len)
 }
 
 // recv implementation for use in tests
-ZRESULT zm_recv()
+ZRESULT zm_recv(zmodem_t *z)
 {
     if (buf_ptr < buf_limit) {
-        return *buf_ptr++;
+        return (uint8_t) *buf_ptr++;
     } else {
         return CLOSED;
     }
 }
 
-// send implementation for use in tests
-ZRESULT zm_send(uint8_t c)
+// Bulk access to the fake receive buffer
+const uint8_t *zm_recv_peek(zmodem_t *z, unsigned *len)
 {
+    *len = buf_limit - buf_ptr;
+    return (const uint8_t *)buf_ptr;
+}
+
+void zm_recv_skip(zmodem_t *z, unsigned len)
+{
+    buf_ptr += len;
+}
+
+// send implementation for use in tests: loop back to receive buffer
+ZRESULT zm_send(zmodem_t *z, uint8_t c)
+{
+    if (buf_limit >= recv_buf + RECV_LEN) {
+        return OUT_OF_SPACE;
+    }
+    *buf_limit++ = c;
     return OK;
 }
 
+// No hardware for checksums in tests
+bool fpm_crc32_arch(uint32_t *crc, const void *buf, unsigned len)
+{
+    return false;
+}
+
+bool fpm_crc16_arch(uint16_t *crc, const void *buf, unsigned len)
+{
+    return false;
+}
+
 // Tests of the tests
 TEST(rz, recv_buffer)
 {
+    zmodem_t z = {};
     EXPECT_EQ(set_buf("a", 1025), UNSUPPORTED);
 
     set_buf("abc", 3);
 
-    EXPECT_EQ(zm_recv(), 'a');
-    EXPECT_EQ(zm_recv(), 'b');
-    EXPECT_EQ(zm_recv(), 'c');
+    EXPECT_EQ(zm_recv(&z), 'a');
+    EXPECT_EQ(zm_recv(&z), 'b');
+    EXPECT_EQ(zm_recv(&z), 'c');
 
-    EXPECT_EQ(zm_recv(), CLOSED);
-    EXPECT_EQ(zm_recv(), CLOSED);
+    EXPECT_EQ(zm_recv(&z), CLOSED);
+    EXPECT_EQ(zm_recv(&z), CLOSED);
 }
 
 // The actual tests
@@ -258,11 +287,12 @@ TEST(rz, byte_to_hex)
 
 TEST(rz, read_hex_header)
 {
+    zmodem_t z = {};
     ZHDR hdr;
 
     // All zeros - CRC is zero
     set_buf("00000000000000", 14);
-    EXPECT_EQ(zm_read_hex_header(&hdr), OK);
+    EXPECT_EQ(zm_read_hex_header(&z, &hdr), OK);
 
     EXPECT_EQ(hdr.type, 0);
     EXPECT_EQ(hdr.flags.f0, 0);
@@ -274,7 +304,7 @@ TEST(rz, read_hex_header)
 
     // Correct CRC - 01 02 03 04 05 - CRC is 0x8208
     set_buf("01020304058208", 14);
-    EXPECT_EQ(zm_read_hex_header(&hdr), OK);
+    EXPECT_EQ(zm_read_hex_header(&z, &hdr), OK);
 
     EXPECT_EQ(hdr.type, 0x01);
     EXPECT_EQ(hdr.position.p0, 0x02);
@@ -291,7 +321,7 @@ TEST(rz, read_hex_header)
     // Incorrect CRC - 01 02 03 04 05 - CRC is 0x8208, but expect 0xc0c0
     // Note that header left intact for debugging
     set_buf("0102030405c0c0", 14);
-    EXPECT_EQ(zm_read_hex_header(&hdr), BAD_CRC);
+    EXPECT_EQ(zm_read_hex_header(&z, &hdr), BAD_CRC);
 
     EXPECT_EQ(hdr.type, 0x01);
     EXPECT_EQ(hdr.position.p0, 0x02);
@@ -308,7 +338,7 @@ TEST(rz, read_hex_header)
     // Invalid data - 01 02 0Z 04 05
     // Note that header is undefined
     set_buf("01020Z0405c0c0", 14);
-    EXPECT_EQ(zm_read_hex_header(&hdr), BAD_DIGIT);
+    EXPECT_EQ(zm_read_hex_header(&z, &hdr), BAD_DIGIT);
 }
 
 TEST(rz, calc_hdr_crc)
@@ -376,24 +406,133 @@ TEST(rz, to_hex_header)
 
 TEST(rz, read_escaped)
 {
+    zmodem_t z = {};
+
     // simple non-control characters
     set_buf("ABC", 3);
 
-    EXPECT_EQ(zm_read_escaped(), 'A');
-    EXPECT_EQ(zm_read_escaped(), 'B');
-    EXPECT_EQ(zm_read_escaped(), 'C');
+    EXPECT_EQ(zm_read_escaped(&z), 'A');
+    EXPECT_EQ(zm_read_escaped(&z), 'B');
+    EXPECT_EQ(zm_read_escaped(&z), 'C');
 
     // CLOSED if end of stream
-    EXPECT_EQ(zm_read_escaped(), CLOSED);
+    EXPECT_EQ(zm_read_escaped(&z), CLOSED);
 
     // XON/XOFF are skipped
     set_buf("\x11\x11\x13Z", 4);
 
-    EXPECT_EQ(zm_read_escaped(), 'Z');
-    EXPECT_EQ(zm_read_escaped(), CLOSED);
+    EXPECT_EQ(zm_read_escaped(&z), 'Z');
+    EXPECT_EQ(zm_read_escaped(&z), CLOSED);
+
+    // Also with parity bit
+    set_buf("\x91\x93Z\x92", 4);
+
+    EXPECT_EQ(zm_read_escaped(&z), 'Z');
+    EXPECT_EQ(zm_read_escaped(&z), 0x92);
 
     // 5x CAN cancels
     set_buf("\x18\x18\x18\x18\x18ZYX", 8);
-    EXPECT_EQ(zm_read_escaped(), CANCELLED);
-    EXPECT_EQ(zm_read_escaped(), 'Z');
+    EXPECT_EQ(zm_read_escaped(&z), CANCELLED);
+    EXPECT_EQ(zm_read_escaped(&z), 'Z');
+}
+
+static void test_bin_header(bool crc32)
+{
+    zmodem_t z = {};
+    z.out_32bit_block = crc32;
+    set_buf("", 0);
+
+    // Position with bytes which need escaping.
+    EXPECT_EQ(zm_send_bin_pos_hdr(&z, ZDATA, 0x11189013), OK);
+
+    ZHDR hdr;
+    EXPECT_EQ(zm_await_header(&z, &hdr), OK);
+    EXPECT_EQ(z.in_32bit_block, crc32);
+    EXPECT_EQ(hdr.type, ZDATA);
+    EXPECT_EQ(zm_get_hdr_position(&hdr), 0x11189013u);
+}
+
+TEST(sz, bin16_header)
+{
+    test_bin_header(false);
+}
+
+TEST(sz, bin32_header)
+{
+    test_bin_header(true);
+}
+
+static void test_data_block(bool crc32)
+{
+    zmodem_t z = {};
+    z.out_32bit_block = crc32;
+    z.in_32bit_block = crc32;
+
+    // All byte values.
+    uint8_t data[256];
+    for (int i = 0; i < 256; i++) {
+        data[i] = i;
+    }
+    set_buf("", 0);
+    EXPECT_EQ(zm_send_data_block(&z, data, sizeof(data), ZCRCG), OK);
+
+    uint8_t buf[300];
+    uint16_t len = sizeof(buf);
+    EXPECT_EQ(zm_read_data_block(&z, buf, &len), GOT_CRCG);
+    EXPECT_EQ(len, sizeof(data) + 1);
+    EXPECT_EQ(memcmp(buf, data, sizeof(data)), 0);
+
+    // Corrupted data.
+    set_buf("", 0);
+    EXPECT_EQ(zm_send_data_block(&z, data, 16, ZCRCE), OK);
+    recv_buf[5] ^= 1;
+    len = sizeof(buf);
+    EXPECT_EQ(zm_read_data_block(&z, buf, &len), BAD_CRC);
+}
+
+TEST(sz, data_block_crc16)
+{
+    test_data_block(false);
+}
+
+TEST(sz, data_block_crc32)
+{
+    test_data_block(true);
+}
+
+TEST(rz, read_data_block_runs)
+{
+    zmodem_t z = {};
+    z.out_32bit_block = true;
+    z.in_32bit_block = true;
+
+    // Mostly plain text, decoded in bulk.
+    uint8_t data[600];
+    for (unsigned i = 0; i < sizeof(data); i++) {
+        data[i] = "The quick brown fox jumps over the lazy dog. "[i % 45];
+    }
+    data[300] = ZDLE;
+    set_buf("", 0);
+    EXPECT_EQ(zm_send_data_block(&z, data, sizeof(data), ZCRCQ), OK);
+
+    // Flow control characters in the middle of runs are dropped.
+    std::string stream(recv_buf, buf_limit - recv_buf);
+    stream.insert(200, "\x11");
+    stream.insert(101, "\x13\x11");
+    stream.insert(50, "\x93\x91");
+    stream.insert(20, "\x91");
+    set_buf(stream.data(), stream.size());
+
+    uint8_t buf[700];
+    uint16_t len = sizeof(buf);
+    EXPECT_EQ(zm_read_data_block(&z, buf, &len), GOT_CRCQ);
+    EXPECT_EQ(len, sizeof(data) + 1);
+    EXPECT_EQ(memcmp(buf, data, sizeof(data)), 0);
+
+    // Block does not fit.
+    set_buf(stream.data(), stream.size());
+    len = 100;
+    EXPECT_EQ(zm_read_data_block(&z, buf, &len), OUT_OF_SPACE);
+    EXPECT_EQ(len, 100);
+    EXPECT_EQ(memcmp(buf, data, 100), 0);
 }
@@ -281,52 +281,34 @@ static void process_amd64_plt(const Elf64_Shdr *hdr)
 
         unsigned index = num_links;
 
-        if (is_amd64_entry(code)) {
-            // Entry with Indirect Branch Tracking.
-            //      f3 0f 1e fa              endbr64
+        if (is_amd64_entry(code) || is_amd64_entry2(code)) {
+            // Both formats are replaced with the same code.
+            // Index of the entry is left in %r11 for lazy binding.
+            //      41 bb 01 00 00 00        mov  $0x1, %r11d
             //      65 ff 24 25 08 00 00 00  jmp  *%gs:0x8
-            //      0f 1f 04 00              nopl (%rax,%rax,1)
+            //      66 90                    xchg %ax, %ax
 
-            // jmp *%gs:NUM
-            code[4] = 0x65;
-            code[5] = 0xff;
-            code[6] = 0x24;
-            code[7] = 0x25;
-            code[8] = (index * 8);
-            code[9] = (index * 8) >> 8;
-            code[10] = (index * 8) >> 16;
-            code[11] = (index * 8) >> 24;
-
-            // nopl (%rax,%rax,1)
-            code[12] = 0x0f;
-            code[13] = 0x1f;
-            code[14] = 0x04;
-            code[15] = 0x00;
-
-        } else if (is_amd64_entry2(code)) {
-            // Simple format.
-            //      65 ff 24 25 08 00 00 00  jmp  *%gs:0x8
-            //      0f 1f 84 00 01 00 00 00  nopl 1(%rax,%rax,1)
+            // mov $NUM, %r11d
+            code[0] = 0x41;
+            code[1] = 0xbb;
+            code[2] = index;
+            code[3] = index >> 8;
+            code[4] = index >> 16;
+            code[5] = index >> 24;
 
             // jmp *%gs:NUM
-            code[0] = 0x65;
-            code[1] = 0xff;
-            code[2] = 0x24;
-            code[3] = 0x25;
-            code[4] = (index * 8);
-            code[5] = (index * 8) >> 8;
-            code[6] = (index * 8) >> 16;
-            code[7] = (index * 8) >> 24;
-
-            // nopl 1(%rax,%rax,1)
-            code[8] = 0x0f;
-            code[9] = 0x1f;
-            code[10] = 0x84;
-            code[11] = 0x00;
-            code[12] = 0x01;
-            code[13] = 0x00;
-            code[14] = 0x00;
-            code[15] = 0x00;
+            code[6] = 0x65;
+            code[7] = 0xff;
+            code[8] = 0x24;
+            code[9] = 0x25;
+            code[10] = (index * 8);
+            code[11] = (index * 8) >> 8;
+            code[12] = (index * 8) >> 16;
+            code[13] = (index * 8) >> 24;
+
+            // xchg %ax, %ax
+            code[14] = 0x66;
+            code[15] = 0x90;
 
         } else {
             fprintf(stderr, "Bad PLT entry at offset %u: %02x %02x %02x %02x %02x %02x %02x %02x...\n",
@@ -566,6 +548,11 @@ int main(int argc, char **argv)
         // Mark this file as ready for FP/M.
         char *id = base;
         id[EI_OSABI] = (char)ELFOSABI_STANDALONE;
+
+        // On these machines PLT stubs leave index of the slot for lazy binding.
+        if (machine_type == EM_X86_64 || machine_type == EM_AARCH64) {
+            id[EI_ABIVERSION] = FPM_ABIVERSION_LAZY;
+        }
     }
     close_file();
 }
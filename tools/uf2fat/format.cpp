@@ -4,7 +4,9 @@
 #include <filesystem>
 #include <cstring>
 #include <fts.h>
+#include <fpm/api.h>
 #include <fpm/fs.h>
+#include <fpm/internal.h>
 #include "extern.h"
 #include "uf2.h"
 
@@ -59,8 +61,17 @@ static void add_file(const char *path, const std::string &dirname)
         exit(EXIT_FAILURE);
     }
 
-    // Write data.
+    // Allocate contiguous space: programs are executed in place.
     unsigned nbytes = content.size();
+    if (nbytes > 0) {
+        result = f_expand(fp, nbytes, 1);
+        if (result != FR_OK && fpm_has_extension(path, ".exe")) {
+            std::cerr << path << ": Cannot allocate contiguous space\n";
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Write data.
     unsigned written = 0;
     f_write(fp, content.data(), nbytes, &written);
     if (nbytes != written) {
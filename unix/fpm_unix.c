@@ -5,6 +5,8 @@
 #include <fpm/internal.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <poll.h>
+#include <errno.h>
 #include <stdlib.h>
 #include <sys/utsname.h>
 #include <sys/resource.h>
@@ -12,14 +14,27 @@
 #include <time.h>
 
 //
-// Read byte from the console.
+// Read byte from the console, waiting up to timeout_msec,
+// or forever when negative.
+// Return -1 on timeout.
 //
-char fpm_getchar()
+int fpm_getchar_timeout(int timeout_msec)
 {
+    if (fpm_core_num() != 0) {
+        // Background program has no console input: end of transmission.
+        return '\4';
+    }
+
+    // Input from file or pipe: end of transmission at end of file.
+    char data;
+    int count = fpm_redirect_read(&data, 1);
+    if (count >= 0) {
+        return (count > 0) ? (uint8_t) data : '\4';
+    }
+
     char ch;
-    if (read(0, &ch, 1) != 1) {
-        // Console closed.
-        exit(-1);
+    if (fpm_read(&ch, 1, timeout_msec) == 0) {
+        return -1;
     }
 
     // ^C - kill the process.
@@ -27,36 +42,99 @@ char fpm_getchar()
         fpm_puts("^C\r\n");
         longjmp(fpm_saved_point, 1);
     }
-    return ch;
+    return (uint8_t) ch;
 }
 
 //
-// Write byte to the console.
+// Read byte from the console.
 //
-void fpm_putchar(char ch)
+char fpm_getchar()
 {
-    putchar(ch);
-    fflush(stdout);
+    return fpm_getchar_timeout(-1);
 }
 
 //
-// Posix-compatible formatted output to console.
+// Read up to len bytes from the console.
+// Wait for the first byte up to timeout_msec, or forever when negative.
+// Return number of bytes received, 0 on timeout.
 //
-int fpm_printf(const char *format, ...)
+int fpm_read(char *buf, unsigned len, int timeout_msec)
 {
-    va_list args;
-    va_start(args, format);
-    int retval = vprintf(format, args);
-    va_end(args);
-    fflush(stdout);
-    return retval;
+    if (fpm_core_num() != 0) {
+        // Background program has no console input.
+        return 0;
+    }
+
+    // Input from file or pipe.
+    int count = fpm_redirect_read(buf, len);
+    if (count >= 0) {
+        return count;
+    }
+
+    // Show pending output before waiting.
+    fpm_flush();
+
+    // Poll is interrupted by the flush timer: wait for the rest of timeout.
+    uint64_t until = fpm_time_usec() + timeout_msec * 1000ULL;
+    struct pollfd fds = { .fd = 0, .events = POLLIN };
+    for (;;) {
+        int result = poll(&fds, 1, timeout_msec);
+        if (result > 0) {
+            break;
+        }
+        if (result == 0 || errno != EINTR) {
+            // Timeout.
+            return 0;
+        }
+        if (timeout_msec > 0) {
+            uint64_t now = fpm_time_usec();
+            timeout_msec = (now < until) ? (until - now + 999) / 1000 : 0;
+        }
+    }
+
+    ssize_t nbytes = read(0, buf, len);
+    if (nbytes <= 0) {
+        // Console closed.
+        exit(-1);
+    }
+    return nbytes;
 }
 
-int fpm_vprintf(const char *format, va_list args)
+//
+// Write a block of bytes to the console, bypassing the output buffer.
+//
+void fpm_write_arch(const char *buf, unsigned len)
 {
-    int retval = vprintf(format, args);
-    fflush(stdout);
-    return retval;
+    while (len > 0) {
+        ssize_t nbytes = write(1, buf, len);
+        if (nbytes <= 0) {
+            // Console closed.
+            return;
+        }
+        buf += nbytes;
+        len -= nbytes;
+    }
+}
+
+//
+// No hardware for checksums: compute in software.
+//
+bool fpm_crc32_arch(uint32_t *crc, const void *buf, unsigned len)
+{
+    return false;
+}
+
+bool fpm_crc16_arch(uint16_t *crc, const void *buf, unsigned len)
+{
+    return false;
+}
+
+//
+// Write byte to the console.
+//
+void fpm_putchar(char ch)
+{
+    fpm_write(&ch, 1);
 }
 
 //
@@ -157,7 +235,12 @@ uint64_t fpm_time_usec()
 //
 void fpm_delay_usec(uint64_t microseconds)
 {
-     usleep(microseconds);
+     fpm_flush();
+
+     // Sleep is interrupted by the flush timer: continue with the rest.
+     struct timespec t = { microseconds / 1000000, microseconds % 1000000 * 1000 };
+     while (nanosleep(&t, &t) < 0 && errno == EINTR) {
+     }
 }
 
 //
@@ -165,7 +248,7 @@ void fpm_delay_usec(uint64_t microseconds)
 //
 void fpm_delay_msec(unsigned milliseconds)
 {
-     usleep(milliseconds * 1000ULL);
+     fpm_delay_usec(milliseconds * 1000ULL);
 }
 
 //
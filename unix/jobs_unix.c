@@ -0,0 +1,99 @@
+//
+// Background jobs on Unix: executed by a worker thread.
+//
+#include <fpm/api.h>
+#include <fpm/internal.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+
+static pthread_t worker;
+static pthread_mutex_t worker_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t worker_wakeup = PTHREAD_COND_INITIALIZER;
+static bool worker_pending;
+static bool worker_started;
+
+//
+// Worker thread acts as core 1.
+//
+static __thread unsigned core_num;
+
+//
+// Main loop of the worker thread.
+//
+static void *worker_main(void *arg)
+{
+    core_num = 1;
+    for (;;) {
+        // Wait for new jobs.
+        pthread_mutex_lock(&worker_lock);
+        while (!worker_pending) {
+            pthread_cond_wait(&worker_wakeup, &worker_lock);
+        }
+        worker_pending = false;
+        pthread_mutex_unlock(&worker_lock);
+
+        fpm_jobs_process();
+    }
+    return NULL;
+}
+
+//
+// Start the worker thread.
+//
+void fpm_jobs_start()
+{
+    if (worker_started) {
+        return;
+    }
+
+    // Timer signal of console output goes to the main thread:
+    // block it in the worker.
+    sigset_t mask, saved_mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGALRM);
+    pthread_sigmask(SIG_BLOCK, &mask, &saved_mask);
+    int error = pthread_create(&worker, NULL, worker_main, NULL);
+    pthread_sigmask(SIG_SETMASK, &saved_mask, NULL);
+    if (error != 0) {
+        // Jobs will be executed in foreground.
+        return;
+    }
+    pthread_detach(worker);
+    worker_started = true;
+}
+
+//
+// Get number of the current core: 1 for worker thread, 0 otherwise.
+//
+unsigned fpm_core_num()
+{
+    return core_num;
+}
+
+//
+// Is the background worker running?
+//
+bool fpm_jobs_active_arch()
+{
+    return worker_started;
+}
+
+//
+// Notify the worker about new job in the queue.
+//
+void fpm_jobs_wakeup_arch()
+{
+    pthread_mutex_lock(&worker_lock);
+    worker_pending = true;
+    pthread_cond_signal(&worker_wakeup);
+    pthread_mutex_unlock(&worker_lock);
+}
+
+//
+// Wait a bit for a job to complete.
+//
+void fpm_jobs_idle_arch()
+{
+    usleep(100);
+}
@@ -28,6 +28,8 @@ err:    close(ctx->fd);
         return false;
     }
     ctx->file_size = sb.st_size;
+    ctx->file_start = sb.st_ino;
+    ctx->file_time = sb.st_mtime;
 
     // Map the file into memory
     ctx->base = mmap(NULL, ctx->file_size, PROT_READ | PROT_EXEC, MAP_SHARED, ctx->fd, 0);
@@ -38,6 +40,22 @@ err:    close(ctx->fd);
     return true;
 }
 
+//
+// Get identity of the file, without mapping it.
+// Return false when the file does not exist.
+//
+bool fpm_stat_arch(fpm_context_t *ctx, const char *filename)
+{
+    struct stat sb;
+    if (stat(filename, &sb) < 0) {
+        return false;
+    }
+    ctx->file_size = sb.st_size;
+    ctx->file_start = sb.st_ino;
+    ctx->file_time = sb.st_mtime;
+    return true;
+}
+
 //
 // Unmap ELF binary from memory.
 //
@@ -4,6 +4,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <termios.h>
+#include <signal.h>
+#include <errno.h>
+#include <sys/time.h>
 #include <fpm/api.h>
 #include <fpm/internal.h>
 #include <fpm/context.h>
@@ -17,6 +20,7 @@ static struct termios saved_term;
 static void restore()
 {
     //printf("Restore terminal\r\n");
+    fpm_flush();
     tcsetattr(0, TCSADRAIN, &saved_term);
 }
 
@@ -41,10 +45,32 @@ static void init()
     }
 }
 
+//
+// Periodic timer of the main thread: show output of a busy program.
+// Interrupted system calls are restarted, or retried by the caller.
+//
+static void flush_timer_handler(int sig)
+{
+    int saved_errno = errno;
+    fpm_flush_idle();
+    errno = saved_errno;
+}
+
+static void setup_flush_timer()
+{
+    struct sigaction action = {};
+    action.sa_handler = flush_timer_handler;
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGALRM, &action, NULL);
+
+    struct itimerval interval = { { 0, 10000 }, { 0, 10000 } };
+    setitimer(ITIMER_REAL, &interval, NULL);
+}
+
 int main()
 {
     // Setup heap area.
-    fpm_context_t context_base;
+    fpm_context_t context_base = {};
     fpm_heap_init(&context_base, (size_t)&core_memory[0], sizeof(core_memory));
 
     // Switch stdin to the raw mode (no line buffering and editing).
@@ -52,6 +78,11 @@ int main()
     disk_setup();
     f_mount("flash:");
     f_mount("sd:");
+    fpm_path_index();
+
+    // Start worker thread for background jobs.
+    fpm_jobs_start();
+    setup_flush_timer();
 
     printf("Start FP/M on Unix\r\n");
     printf("Use '?' for help or 'exit' to quit.\r\n\r\n");